@@ -19,13 +19,37 @@ document.addEventListener('DOMContentLoaded', function() {
     refreshRelayStatus(); // Carica stato relè
     updateTime();
     
-    // Aggiorna ogni secondo
-    setInterval(updateTime, 1000);
-    setInterval(loadSystemStatus, 5000);
+    // Canale push /api/events; il polling resta attivo solo se il canale non è connesso
+    startLiveEvents();
+    setInterval(() => { if (!liveConnected) updateTime(); }, 1000);
+    setInterval(() => { if (!liveConnected) loadSystemStatus(); }, 5000);
     setInterval(loadSystemInfo, 30000); // Aggiorna info sistema ogni 30 secondi
-    setInterval(refreshRelayStatus, 10000); // Aggiorna stato relè ogni 10 secondi
+    setInterval(() => { if (!liveConnected) refreshRelayStatus(); }, 10000); // Aggiorna stato relè ogni 10 secondi
 });
 
+// Eventi push (SSE): ora ogni secondo, variazioni di stato e fronti dei relè
+let liveConnected = false;
+
+function startLiveEvents() {
+    if (!window.EventSource) return;
+    const source = new EventSource('/api/events');
+    source.onopen = () => { liveConnected = true; };
+    source.onerror = () => { liveConnected = false; };
+    source.addEventListener('clock', e => {
+        document.getElementById('currentTime').textContent = JSON.parse(e.data).time;
+    });
+    source.addEventListener('status', e => {
+        Object.assign(systemStatus, JSON.parse(e.data));
+        updateStatusDisplay();
+    });
+    source.addEventListener('relay', e => {
+        const data = JSON.parse(e.data);
+        document.getElementById('relay1Status').textContent = data.relay1_raw === 0 ? 'ON (0V)' : 'OFF (3.3V)';
+        document.getElementById('relay2Status').textContent = data.relay2_raw === 0 ? 'ON (0V)' : 'OFF (3.3V)';
+        document.getElementById('bellsEnabledStatus').textContent = data.enabled ? 'Abilitate' : 'Disabilitate';
+    });
+}
+
 // Gestione tab
 function switchTab(tabName) {
     // Nascondi tutti i contenuti
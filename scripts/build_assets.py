@@ -0,0 +1,104 @@
+# Prepara l'immagine SPIFFS a partire da data/ (extra_script PlatformIO, fase "pre").
+#
+# - Le risorse web (html/js/css/svg/png/ico) vengono compresse con gzip.
+# - Quelle diverse dalla pagina principale ricevono anche un nome con l'hash del
+#   contenuto (favicon.1a2b3c4d.svg.gz) e i riferimenti in index.html vengono
+#   riscritti: il server può servirle con cache "immutable".
+# - Gli altri file (es. json letti dal firmware) vengono copiati invariati.
+# - /assets.txt è il manifest letto all'avvio: "<url> <file> <etag> <flag>",
+#   flag bit0 = immutable, bit1 = gzip.
+#
+# Uso diretto (senza PlatformIO): python3 scripts/build_assets.py [data] [uscita]
+
+import gzip
+import hashlib
+import os
+import shutil
+import sys
+
+WEB_EXTENSIONS = (".html", ".htm", ".js", ".css", ".svg", ".png", ".ico")
+ENTRY_PAGES = ("index.html",)            # URL stabile: revalidazione con ETag
+SPIFFS_NAME_MAX = 31                     # SPIFFS_OBJ_NAME_LEN - 1
+FLAG_IMMUTABLE = 1
+FLAG_GZIP = 2
+
+
+def content_hash(data):
+    return hashlib.sha256(data).hexdigest()[:8]
+
+
+def gzip_bytes(data):
+    # mtime fisso: stesso input, stessa immagine
+    return gzip.compress(data, compresslevel=9, mtime=0)
+
+
+def check_name(name):
+    if len(name) > SPIFFS_NAME_MAX:
+        raise SystemExit("build_assets: nome troppo lungo per SPIFFS: %s" % name)
+
+
+def build(src, dst):
+    if os.path.isdir(dst):
+        shutil.rmtree(dst)
+    os.makedirs(dst)
+
+    files = sorted(f for f in os.listdir(src) if os.path.isfile(os.path.join(src, f)))
+    web = [f for f in files if f.lower().endswith(WEB_EXTENSIONS)]
+    other = [f for f in files if f not in web]
+
+    manifest = []
+    renames = {}
+    # Prima le risorse con nome versionato, così la pagina principale può riferirle
+    for name in web:
+        if name in ENTRY_PAGES:
+            continue
+        with open(os.path.join(src, name), "rb") as f:
+            data = f.read()
+        h = content_hash(data)
+        base, ext = os.path.splitext(name)
+        hashed = "%s.%s%s" % (base, h, ext)
+        stored = "/" + hashed + ".gz"
+        check_name(stored)
+        with open(os.path.join(dst, hashed + ".gz"), "wb") as f:
+            f.write(gzip_bytes(data))
+        renames[name] = hashed
+        manifest.append(("/" + hashed, stored, h, FLAG_IMMUTABLE | FLAG_GZIP))
+        manifest.append(("/" + name, stored, h, FLAG_GZIP))
+
+    for name in web:
+        if name not in ENTRY_PAGES:
+            continue
+        with open(os.path.join(src, name), "rb") as f:
+            text = f.read().decode("utf-8")
+        for old, new in renames.items():
+            text = text.replace('"/%s"' % old, '"/%s"' % new).replace('"%s"' % old, '"%s"' % new)
+        data = text.encode("utf-8")
+        stored = "/" + name + ".gz"
+        check_name(stored)
+        with open(os.path.join(dst, name + ".gz"), "wb") as f:
+            f.write(gzip_bytes(data))
+        manifest.append(("/" + name, stored, content_hash(data), FLAG_GZIP))
+
+    for name in other:
+        check_name("/" + name)
+        shutil.copyfile(os.path.join(src, name), os.path.join(dst, name))
+
+    with open(os.path.join(dst, "assets.txt"), "w", newline="\n") as f:
+        for url, stored, h, flags in manifest:
+            check_name(url)
+            f.write("%s %s %s %d\n" % (url, stored, h, flags))
+
+    raw = sum(os.path.getsize(os.path.join(src, n)) for n in web)
+    packed = sum(os.path.getsize(os.path.join(dst, s[1:])) for s in set(m[1] for m in manifest))
+    print("build_assets: %d risorse web, %d -> %d byte" % (len(web), raw, packed))
+
+
+try:
+    Import("env")  # noqa: F821 (fornito da PlatformIO)
+except NameError:
+    src = sys.argv[1] if len(sys.argv) > 1 else "data"
+    dst = sys.argv[2] if len(sys.argv) > 2 else os.path.join(".pio", "data_build")
+    build(src, dst)
+else:
+    project = env.subst("$PROJECT_DIR")  # noqa: F821
+    build(os.path.join(project, "data"), os.path.join(project, ".pio", "data_build"))
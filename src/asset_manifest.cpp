@@ -0,0 +1,84 @@
+#include "include/asset_manifest.h"
+#include "include/logger.h"
+#include <SPIFFS.h>
+
+AssetManifest assetManifest;
+
+AssetManifest::AssetManifest() : count(0) {
+    memset(entries, 0, sizeof(entries));
+}
+
+bool AssetManifest::begin() {
+    count = 0;
+    fs::File f = SPIFFS.open(ASSET_MANIFEST_FS, "r");
+    if (!f) {
+        LOGW(LOG_WEB, "AssetManifest: /assets.txt assente, risorse servite senza cache");
+        return false;
+    }
+    char line[96];
+    while (f.available() && count < ASSET_MAX) {
+        size_t n = f.readBytesUntil('\n', line, sizeof(line) - 1);
+        line[n] = '\0';
+        char url[32], file[32], hash[9];
+        unsigned flags = 0;
+        if (sscanf(line, "%31s %31s %8s %u", url, file, hash, &flags) != 4) continue;
+        AssetEntry& e = entries[count++];
+        strlcpy(e.url, url, sizeof(e.url));
+        strlcpy(e.file, file, sizeof(e.file));
+        snprintf(e.etag, sizeof(e.etag), "\"%s\"", hash);
+        e.flags = (uint8_t)flags;
+    }
+    f.close();
+    LOGI(LOG_WEB, "AssetManifest: %u risorse", count);
+    return count > 0;
+}
+
+bool AssetManifest::isLoaded() {
+    return count > 0;
+}
+
+const AssetEntry* AssetManifest::find(const String& url) {
+    const char* u = (url == "/") ? "/index.html" : url.c_str();
+    for (uint8_t i = 0; i < count; i++) {
+        if (strcmp(entries[i].url, u) == 0) return &entries[i];
+    }
+    return nullptr;
+}
+
+const char* AssetManifest::contentType(const char* url) {
+    const char* ext = strrchr(url, '.');
+    if (!ext) return "application/octet-stream";
+    if (strcmp(ext, ".html") == 0 || strcmp(ext, ".htm") == 0) return "text/html";
+    if (strcmp(ext, ".js") == 0) return "application/javascript";
+    if (strcmp(ext, ".css") == 0) return "text/css";
+    if (strcmp(ext, ".svg") == 0) return "image/svg+xml";
+    if (strcmp(ext, ".png") == 0) return "image/png";
+    if (strcmp(ext, ".ico") == 0) return "image/x-icon";
+    if (strcmp(ext, ".json") == 0) return "application/json";
+    return "text/plain";
+}
+
+void AssetManifest::serve(AsyncWebServerRequest* request, const AssetEntry* asset) {
+    // Le risorse sono dietro Basic auth: cache solo del browser (private)
+    const char* cache = (asset->flags & ASSET_FLAG_IMMUTABLE)
+        ? "private, max-age=31536000, immutable"
+        : "private, no-cache";
+    if (request->hasHeader("If-None-Match") && request->header("If-None-Match") == asset->etag) {
+        AsyncWebServerResponse* r = request->beginResponse(304);
+        r->addHeader("ETag", asset->etag);
+        r->addHeader("Cache-Control", cache);
+        request->send(r);
+        return;
+    }
+    fs::File f = SPIFFS.open(asset->file, "r");
+    if (!f) {
+        request->send(404, "text/plain", "Not Found");
+        return;
+    }
+    // Con un file .gz e un URL senza .gz la libreria aggiunge Content-Encoding: gzip
+    AsyncWebServerResponse* r = request->beginResponse(f, String(asset->url), String(contentType(asset->url)));
+    r->addHeader("ETag", asset->etag);
+    r->addHeader("Cache-Control", cache);
+    r->addHeader("Vary", "Accept-Encoding");
+    request->send(r);
+}
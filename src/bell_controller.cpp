@@ -1,20 +1,33 @@
 #include "include/bell_controller.h"
-
-// Definizione dell'array delle melodie
-BellMelody melodies[10];
+#include "include/logger.h"
+#include "include/bell_stats.h"
+#include "include/config_store.h"
+#include "include/power_manager.h"
 
 BellController bellController;
 
 BellController::BellController() {
+    mux = portMUX_INITIALIZER_UNLOCKED;
     isPlaying = false;
     lastNoteTime = 0;
     currentNoteIndex = 0;
     currentMelodyIndex = 0;
     testMode = false;
+    playSource = HIST_SRC_SYSTEM;
+    playRef = HISTORY_NONE;
+    playLimit = BELL_PLAY_ALL;
+    pulseActive = false;
+    pulseBell = 0;
+    pulseStart = 0;
+    pulseDuration = 0;
+    for (uint8_t i = 0; i < BELL_COUNT; i++) {
+        relayOn[i] = false;
+        relayOnSince[i] = 0;
+    }
 }
 
 void BellController::begin() {
-    Serial.println("[DEBUG] BellController::begin()");
+    LOGD(LOG_BELL, "begin()");
     // Inizializza pin relè
     pinMode(RELAY1_PIN, OUTPUT);
     pinMode(RELAY2_PIN, OUTPUT);
@@ -25,17 +38,17 @@ void BellController::begin() {
     digitalWrite(RELAY2_PIN, HIGH);
     digitalWrite(STATUS_LED_PIN, LOW);
     
-    Serial.println("BellController: Inizializzato");
+    LOGI(LOG_BELL, "Inizializzato");
     
     // Carica melodie predefinite
     loadDefaultMelodies();
 }
 
 void BellController::ringBell(uint8_t bellNumber, uint16_t duration) {
-    Serial.printf("[BELL] ringBell(campana=%d, durata=%dms)\n", bellNumber, duration);
+    LOGD(LOG_BELL, "ringBell(campana=%d, durata=%dms)", bellNumber, duration);
     
     if (!systemStatus.bellsEnabled && !testMode) {
-        Serial.printf("[BELL] SKIP: Campane disabilitate (enabled=%s, testMode=%s)\n", 
+        LOGD(LOG_BELL, "SKIP: Campane disabilitate (enabled=%s, testMode=%s)", 
                      systemStatus.bellsEnabled ? "true" : "false", 
                      testMode ? "true" : "false");
         return;
@@ -43,101 +56,157 @@ void BellController::ringBell(uint8_t bellNumber, uint16_t duration) {
     
     // Validazione parametri
     if (bellNumber < 1 || bellNumber > 2) {
-        Serial.printf("[BELL] ERRORE: Numero campana non valido: %d (deve essere 1 o 2)\n", bellNumber);
+        LOGE(LOG_BELL, "Numero campana non valido: %d (deve essere 1 o 2)", bellNumber);
         return;
     }
     
     if (duration < BELL_MIN_PULSE || duration > BELL_MAX_PULSE) {
-        Serial.printf("[BELL] ERRORE: Durata non valida: %dms (range: %d-%d)\n", 
+        LOGE(LOG_BELL, "Durata non valida: %dms (range: %d-%d)", 
                      duration, BELL_MIN_PULSE, BELL_MAX_PULSE);
         return;
     }
     
-    uint8_t relayPin = (bellNumber == 1) ? RELAY1_PIN : RELAY2_PIN;
-    
-    // Attiva relè (LOW = attivo per logica invertita)
-    digitalWrite(relayPin, LOW);
+    portENTER_CRITICAL(&mux);
+    uint32_t now = millis();
+    startPulseLocked(bellNumber, duration, now);
+    portEXIT_CRITICAL(&mux);
+    recordStrike(bellNumber, duration, now);
+}
+
+bool BellController::pulseAllowed(uint8_t bellNumber, uint16_t duration, bool test) {
+    return (systemStatus.bellsEnabled || test) && bellNumber >= 1 && bellNumber <= 2 &&
+           duration >= BELL_MIN_PULSE && duration <= BELL_MAX_PULSE;
+}
+
+// Attiva il relè e registra l'impulso: la disattivazione avviene in update()
+// tramite timer non bloccante
+void BellController::startPulseLocked(uint8_t bellNumber, uint16_t duration, uint32_t now) {
+    // LOW = attivo per logica invertita
+    digitalWrite((bellNumber == 1) ? RELAY1_PIN : RELAY2_PIN, LOW);
     digitalWrite(STATUS_LED_PIN, HIGH);
-    
-    Serial.printf("[BELL] *** CAMPANA %d ATTIVATA *** (pin %d -> LOW, durata %dms)\n", 
-                 bellNumber, relayPin, duration);
+    if (!relayOn[bellNumber - 1]) {
+        relayOn[bellNumber - 1] = true;
+        relayOnSince[bellNumber - 1] = now;
+    }
+    pulseActive = true;
+    pulseBell = bellNumber;
+    pulseStart = now;
+    pulseDuration = duration;
+}
+
+void BellController::recordStrike(uint8_t bellNumber, uint16_t duration, uint32_t now) {
+    LOGD(LOG_BELL, "*** CAMPANA %d ATTIVATA *** (pin %d -> LOW, durata %dms)", 
+                 bellNumber, (bellNumber == 1) ? RELAY1_PIN : RELAY2_PIN, duration);
     
     // Aggiorna statistiche
-    systemStatus.lastBellTime = millis();
+    systemStatus.lastBellTime = now;
     systemStatus.totalBellRings++;
-    
-    // Nota: la disattivazione avviene in update() tramite timer non bloccante
+    bellStats.recordStrike(bellNumber);
+    // Lo spegnimento del relè lo fa update() dal loop: se il loop è in idleWait()
+    // (impulso da un handler web) va svegliato subito, con il boost delle campane
+    powerManager.wake();
 }
 
-void BellController::playMelody(uint8_t melodyIndex) {
-    Serial.printf("[BELL] BellController::playMelody(melodyIndex=%d) chiamata\n", melodyIndex);
+void BellController::playMelody(uint8_t melodyIndex, uint8_t source, uint8_t ref) {
+    // Chiamata sia dal loop sia dagli handler web: controlli e copia sulla stessa istantanea
+    ConfigSnapshot cfg;
+    const BellMelody* melodies = cfg->melodies;
+    LOGD(LOG_BELL, "playMelody(melodyIndex=%d) chiamata", melodyIndex);
     
     // Validazione indice
     if (melodyIndex >= 10) {
-        Serial.printf("[BELL] ERRORE: Indice melodia non valido: %d (max 9)\n", melodyIndex);
+        LOGE(LOG_BELL, "Indice melodia non valido: %d (max 9)", melodyIndex);
+        historyLog.append(HIST_SKIP_INVALID, source, melodyIndex, ref);
         return;
     }
     
     // Verifica che la melodia sia attiva
     if (!melodies[melodyIndex].isActive) {
-        Serial.printf("[BELL] ERRORE: Melodia %d non attiva\n", melodyIndex);
+        LOGE(LOG_BELL, "Melodia %d non attiva", melodyIndex);
+        historyLog.append(HIST_SKIP_INVALID, source, melodyIndex, ref);
         return;
     }
     
     // Verifica che ci siano note
     if (melodies[melodyIndex].noteCount == 0) {
-        Serial.printf("[BELL] ERRORE: Melodia %d non ha note (noteCount=0)\n", melodyIndex);
+        LOGE(LOG_BELL, "Melodia %d non ha note (noteCount=0)", melodyIndex);
+        historyLog.append(HIST_SKIP_INVALID, source, melodyIndex, ref);
         return;
     }
     
     // Verifica stato campane (eccetto modalità test)
     if (!systemStatus.bellsEnabled && !testMode) {
-        Serial.printf("[BELL] AVVISO: Campane disabilitate e non in modalità test. Melodia %d non riprodotta.\n", melodyIndex);
+        LOGW(LOG_BELL, "Campane disabilitate e non in modalità test. Melodia %d non riprodotta.", melodyIndex);
+        historyLog.append(HIST_SKIP_DISABLED, source, melodyIndex, ref);
+        return;
+    }
+    
+    // Protezione termica: una melodia già in corso non viene interrotta
+    if (!allowsSource(source)) {
+        LOGW(LOG_BELL, "Temperatura elevata: melodia %d rifiutata", melodyIndex);
+        historyLog.append(HIST_SKIP_THERMAL, source, melodyIndex, ref);
         return;
     }
     
     // Ferma eventuale melodia in corso
     if (isPlaying) {
-        Serial.printf("[BELL] Fermando melodia precedente (era: %d)\n", currentMelodyIndex);
+        LOGI(LOG_BELL, "Fermando melodia precedente (era: %d)", currentMelodyIndex);
         stopMelody();
     }
     
-    // Inizializza riproduzione
+    // Inizializza riproduzione (copia della melodia: la tabella può essere sostituita durante l'esecuzione)
+    portENTER_CRITICAL(&mux);
+    uint32_t now = millis();
+    playing = melodies[melodyIndex];
     currentMelodyIndex = melodyIndex;
     currentNoteIndex = 0;
+    playSource = source;
+    playRef = ref;
+    lastNoteTime = now;
     isPlaying = true;
-    lastNoteTime = millis();
+    portEXIT_CRITICAL(&mux);
     
-    Serial.printf("[BELL] ==> AVVIO MELODIA: '%s' (ID: %d, Note: %d) <==\n", 
+    LOGI(LOG_BELL, "==> AVVIO MELODIA: '%s' (ID: %d, Note: %d) <==", 
                  melodies[melodyIndex].name, melodyIndex, melodies[melodyIndex].noteCount);
     
     // Log delle note per debug
     if (DEBUG_MELODY_PLAYBACK) {
-        Serial.printf("[BELL] Sequenza note per '%s':\n", melodies[melodyIndex].name);
+        LOGV(LOG_BELL, "Sequenza note per '%s':", melodies[melodyIndex].name);
         for (int i = 0; i < melodies[melodyIndex].noteCount; i++) {
             const BellNote& note = melodies[melodyIndex].notes[i];
-            Serial.printf("  [%d] Campana %d: %dms suono + %dms pausa\n", 
+            LOGV(LOG_BELL, "  [%d] Campana %d: %dms suono + %dms pausa", 
                          i, note.bellNumber, note.duration, note.delay);
         }
     }
     
     systemStatus.activeMelody = melodyIndex;
+    bellStats.recordMelodyPlay(melodyIndex);
+    historyLog.append(HIST_MELODY_START, source, melodyIndex, ref, melodies[melodyIndex].noteCount);
+    // Le note le suona update() dal loop: niente attesa fino alla prossima scadenza
+    powerManager.wake();
 }
 
 void BellController::stopMelody() {
-    Serial.println("[DEBUG] BellController::stopMelody()");
-    if (isPlaying) {
+    LOGD(LOG_BELL, "stopMelody()");
+    uint32_t onMs[BELL_COUNT] = { 0 };
+    portENTER_CRITICAL(&mux);
+    uint32_t now = millis();
+    bool wasPlaying = isPlaying;
+    uint8_t source = playSource, melodyIndex = currentMelodyIndex, ref = playRef, noteIndex = currentNoteIndex;
+    if (wasPlaying) {
         isPlaying = false;
         currentNoteIndex = 0;
-        emergencyStop(); // Ferma eventuali campane attive
-        
-        // Se era in modalità test, disattivala automaticamente
-        if (testMode) {
-            testMode = false;
-            Serial.println("BellController: Modalità test disattivata automaticamente");
-        }
-        
-        Serial.println("BellController: Melodia fermata");
+        releaseRelaysLocked(now, onMs); // Ferma eventuali campane attive
+    }
+    portEXIT_CRITICAL(&mux);
+    if (!wasPlaying) return;
+    recordRelayTimes(onMs);
+    historyLog.append(HIST_MELODY_STOPPED, source, melodyIndex, ref, noteIndex);
+    LOGI(LOG_BELL, "Melodia fermata");
+    // Se era in modalità test, disattivala automaticamente
+    if (testMode) {
+        testMode = false;
+        LOGI(LOG_BELL, "Modalità test disattivata automaticamente");
     }
 }
 
@@ -145,8 +214,12 @@ bool BellController::isPlayingMelody() {
     return isPlaying;
 }
 
+bool BellController::isBusy() {
+    return isPlaying || pulseActive;
+}
+
 void BellController::testBell(uint8_t bellNumber) {
-    Serial.printf("[DEBUG] BellController::testBell(bellNumber=%d)\n", bellNumber);
+    LOGD(LOG_BELL, "testBell(bellNumber=%d)", bellNumber);
     bool wasTestMode = testMode;
     testMode = true;
     ringBell(bellNumber, 500); // Test di 500ms
@@ -154,80 +227,139 @@ void BellController::testBell(uint8_t bellNumber) {
 }
 
 void BellController::enableTestMode(bool enable) {
-    Serial.printf("[DEBUG] BellController::enableTestMode(enable=%d)\n", enable);
+    LOGD(LOG_BELL, "enableTestMode(enable=%d)", enable);
     testMode = enable;
-    Serial.printf("BellController: Modalità test %s\n", enable ? "attivata" : "disattivata");
+    LOGI(LOG_BELL, "Modalità test %s", enable ? "attivata" : "disattivata");
 }
 
-void BellController::update() {
-    static uint32_t bellStartTime = 0;
-    static uint8_t activeBell = 0;
-    static uint16_t bellDuration = 0;
-    static bool bellActive = false;
-    
-    // Gestione timing per singoli colpi di campana
-    if (bellActive && (millis() - bellStartTime >= bellDuration)) {
-        // Disattiva relè
+// Relè a riposo; il tempo di attivazione da registrare si somma in onMs
+void BellController::releaseRelaysLocked(uint32_t now, uint32_t onMs[BELL_COUNT]) {
     digitalWrite(RELAY1_PIN, HIGH);
     digitalWrite(RELAY2_PIN, HIGH);
     digitalWrite(STATUS_LED_PIN, LOW);
-        bellActive = false;
-        Serial.printf("BellController: Campana %d disattivata\n", activeBell);
+    for (uint8_t i = 0; i < BELL_COUNT; i++) {
+        if (relayOn[i]) {
+            onMs[i] += now - relayOnSince[i];
+            relayOn[i] = false;
+        }
+    }
+    pulseActive = false;
+}
+
+void BellController::recordRelayTimes(const uint32_t onMs[BELL_COUNT]) {
+    for (uint8_t i = 0; i < BELL_COUNT; i++) {
+        if (onMs[i]) bellStats.recordRelayOn(i + 1, onMs[i]);
+    }
+}
+
+void BellController::update() {
+    uint32_t onMs[BELL_COUNT] = { 0 };
+    bool struck = false, skipped = false, finished = false;
+    uint8_t endedBell = 0;              // Campana dell'impulso appena concluso (0 = nessuno)
+    BellNote note = { 0, 0, 0 };
+    uint8_t melodyIndex = 0, source = 0, ref = 0, noteCount = 0;
+    char name[sizeof(playing.name)];
+
+    // Decisioni e GPIO sotto mux; log, registro e statistiche dopo. L'ora si legge
+    // dentro il mux, così non precede mai un impulso avviato dall'altro core
+    portENTER_CRITICAL(&mux);
+    uint32_t now = millis();
+    // Gestione timing per singoli colpi di campana (anche quelli di test fuori melodia)
+    if (pulseActive && now - pulseStart >= pulseDuration) {
+        endedBell = pulseBell;
+        releaseRelaysLocked(now, onMs);
     }
-    
     // Gestione melodie
-    if (isPlaying && melodies[currentMelodyIndex].isActive) {
-        BellMelody& melody = melodies[currentMelodyIndex];
-        
-        if (currentNoteIndex < melody.noteCount) {
-            BellNote& note = melody.notes[currentNoteIndex];
-            
+    // (si usa la copia fatta all'avvio: un restore concorrente non altera la sequenza in corso)
+    if (isPlaying) {
+        if (currentNoteIndex < playing.noteCount) {
             // È tempo di suonare la prossima nota?
-            if (millis() - lastNoteTime >= (bellActive ? 0 : note.delay)) {
-                if (!bellActive) {
-                    // Inizia nuova nota
-                    bellStartTime = millis();
-                    activeBell = note.bellNumber;
-                    bellDuration = note.duration;
-                    bellActive = true;
-                    
-                    ringBell(note.bellNumber, note.duration);
-                    lastNoteTime = millis();
-                    currentNoteIndex++;
-                }
+            if (!pulseActive && now - lastNoteTime >= playing.notes[currentNoteIndex].delay) {
+                note = playing.notes[currentNoteIndex];
+                struck = pulseAllowed(note.bellNumber, note.duration, testMode);
+                if (struck) startPulseLocked(note.bellNumber, note.duration, now);
+                else skipped = true;
+                lastNoteTime = now;
+                currentNoteIndex++;
             }
         } else {
             // Melodia completata
-            Serial.printf("BellController: Melodia '%s' completata\n", melody.name);
-            stopMelody();
+            finished = true;
+            melodyIndex = currentMelodyIndex;
+            source = playSource;
+            ref = playRef;
+            noteCount = playing.noteCount;
+            memcpy(name, playing.name, sizeof(name));
+            isPlaying = false;
+            currentNoteIndex = 0;
+            releaseRelaysLocked(now, onMs);
+        }
+    }
+    portEXIT_CRITICAL(&mux);
+
+    recordRelayTimes(onMs);
+    if (endedBell) LOGD(LOG_BELL, "Campana %d disattivata", endedBell);
+    if (struck) recordStrike(note.bellNumber, note.duration, now);
+    if (skipped) LOGD(LOG_BELL, "Nota saltata (campana %d, %dms)", note.bellNumber, note.duration);
+    if (finished) {
+        name[sizeof(name) - 1] = '\0';
+        LOGI(LOG_BELL, "Melodia '%s' completata", name);
+        historyLog.append(HIST_MELODY_END, source, melodyIndex, ref, noteCount);
+        // Se era in modalità test, disattivala automaticamente
+        if (testMode) {
+            testMode = false;
+            LOGI(LOG_BELL, "Modalità test disattivata automaticamente");
         }
     }
 }
 
-void BellController::emergencyStop() {
-    Serial.println("[DEBUG] BellController::emergencyStop()");
-    digitalWrite(RELAY1_PIN, HIGH);
-    digitalWrite(RELAY2_PIN, HIGH);
-    digitalWrite(STATUS_LED_PIN, LOW);
+void BellController::emergencyStop(uint8_t source) {
+    LOGD(LOG_BELL, "emergencyStop()");
+    uint32_t onMs[BELL_COUNT] = { 0 };
+    portENTER_CRITICAL(&mux);
+    uint32_t now = millis();
+    bool wasPlaying = isPlaying, wasBusy = isPlaying || pulseActive;
+    uint8_t melodyIndex = currentMelodyIndex, noteIndex = currentNoteIndex;
+    releaseRelaysLocked(now, onMs);
     isPlaying = false;
-    Serial.println("BellController: STOP DI EMERGENZA!");
+    portEXIT_CRITICAL(&mux);
+    recordRelayTimes(onMs);
+    if (wasBusy) {
+        historyLog.append(HIST_EMERGENCY_STOP, source,
+                          wasPlaying ? melodyIndex : HISTORY_NONE, HISTORY_NONE,
+                          wasPlaying ? noteIndex : 0);
+    }
+    LOGW(LOG_BELL, "STOP DI EMERGENZA!");
+}
+
+bool BellController::allowsSource(uint8_t source) {
+    if (playLimit == BELL_PLAY_ALL) return true;
+    if (playLimit == BELL_PLAY_NONE) return false;
+    return source == HIST_SRC_WEEKLY || source == HIST_SRC_SPECIAL || source == HIST_SRC_BUTTON;
 }
 
 void BellController::setEnabled(bool enabled) {
-    Serial.printf("[DEBUG] BellController::setEnabled(enabled=%d)\n", enabled);
+    LOGD(LOG_BELL, "setEnabled(enabled=%d)", enabled);
     systemStatus.bellsEnabled = enabled;
     if (!enabled) {
-        emergencyStop();
+        emergencyStop(HIST_SRC_SYSTEM);
     }
-    Serial.printf("BellController: Campane %s\n", enabled ? "abilitate" : "disabilitate");
+    LOGI(LOG_BELL, "Campane %s", enabled ? "abilitate" : "disabilitate");
 }
 
 bool BellController::isEnabled() {
     return systemStatus.bellsEnabled;
 }
 
-bool BellController::addMelody(const char* name, BellNote* notes, uint8_t noteCount) {
-    Serial.printf("[DEBUG] BellController::addMelody(name=%s, noteCount=%d)\n", name, noteCount);
+// Le modifiche alle melodie passano da una transazione di ConfigStore: la tabella
+// pubblicata non viene mai scritta sul posto (lo scheduler potrebbe leggerla).
+// Non salvano su flash: servono per le melodie di default e per il test ad-hoc;
+// le API web modificano la bozza e passano da commitConfigDraft.
+bool BellController::addMelody(const char* name, const BellNote* notes, uint8_t noteCount) {
+    LOGD(LOG_BELL, "addMelody(name=%s, noteCount=%d)", name, noteCount);
+    ConfigTables* draft = configStore.beginTransaction();
+    if (!draft) return false;
+    BellMelody* melodies = draft->melodies;
     // Trova slot libero
     for (int i = 0; i < 10; i++) {
         if (!melodies[i].isActive) {
@@ -240,47 +372,65 @@ bool BellController::addMelody(const char* name, BellNote* notes, uint8_t noteCo
             }
             
             melodies[i].isActive = true;
-            Serial.printf("BellController: Melodia '%s' aggiunta (slot %d)\n", name, i);
+            configStore.publish();
+            LOGI(LOG_BELL, "Melodia '%s' aggiunta (slot %d)", name, i);
             return true;
         }
     }
     
-    Serial.println("BellController: Nessuno slot libero per nuova melodia");
+    configStore.abortTransaction();
+    LOGW(LOG_BELL, "Nessuno slot libero per nuova melodia");
     return false;
 }
 
 bool BellController::deleteMelody(uint8_t index) {
-    Serial.printf("[DEBUG] BellController::deleteMelody(index=%d)\n", index);
-    if (index < 10 && melodies[index].isActive) {
-        melodies[index].isActive = false;
-        melodies[index].noteCount = 0;
-        Serial.printf("BellController: Melodia slot %d eliminata\n", index);
-        return true;
-    }
-    return false;
+    LOGD(LOG_BELL, "deleteMelody(index=%d)", index);
+    if (index >= 10 || !configStore.current()->melodies[index].isActive) return false;
+    ConfigTables* draft = configStore.beginTransaction();
+    if (!draft) return false;
+    draft->melodies[index].isActive = false;
+    draft->melodies[index].noteCount = 0;
+    configStore.publish();
+    LOGI(LOG_BELL, "Melodia slot %d eliminata", index);
+    return true;
 }
 
-bool BellController::updateMelody(uint8_t index, const char* name, BellNote* notes, uint8_t noteCount) {
-    Serial.printf("[DEBUG] BellController::updateMelody(index=%d, name=%s, noteCount=%d)\n", index, name, noteCount);
+bool BellController::updateMelody(uint8_t index, const char* name, const BellNote* notes, uint8_t noteCount) {
+    LOGD(LOG_BELL, "updateMelody(index=%d, name=%s, noteCount=%d)", index, name, noteCount);
     if (index >= 10) return false;
-    melodies[index].isActive = true;
-    strncpy(melodies[index].name, name ? name : "Senza nome", 31);
-    melodies[index].name[31] = '\0';
-    melodies[index].noteCount = min(noteCount, (uint8_t)MAX_MELODY_STEPS);
-    for (int j = 0; j < melodies[index].noteCount; j++) {
-        melodies[index].notes[j] = notes[j];
+    ConfigTables* draft = configStore.beginTransaction();
+    if (!draft) return false;
+    BellMelody& m = draft->melodies[index];
+    m.isActive = true;
+    strncpy(m.name, name ? name : "Senza nome", 31);
+    m.name[31] = '\0';
+    m.noteCount = min(noteCount, (uint8_t)MAX_MELODY_STEPS);
+    for (int j = 0; j < m.noteCount; j++) {
+        m.notes[j] = notes[j];
     }
+    configStore.publish();
+    melodyChanged(index);
+    LOGI(LOG_BELL, "Melodia slot %d aggiornata (%s, %d note)", index, m.name, m.noteCount);
+    return true;
+}
+
+void BellController::melodyChanged(uint8_t index) {
     // Se stiamo suonando proprio questa melodia, ricomincia dall'inizio con la nuova sequenza
+    if (!isPlaying || currentMelodyIndex != index) return;
+    ConfigSnapshot cfg;
+    if (!cfg->melodies[index].isActive) return;
+    portENTER_CRITICAL(&mux);
+    uint32_t now = millis();
     if (isPlaying && currentMelodyIndex == index) {
+        playing = cfg->melodies[index];
         currentNoteIndex = 0;
-        lastNoteTime = millis();
+        lastNoteTime = now;
     }
-    Serial.printf("BellController: Melodia slot %d aggiornata (%s, %d note)\n", index, melodies[index].name, melodies[index].noteCount);
-    return true;
+    portEXIT_CRITICAL(&mux);
 }
 
 void BellController::loadDefaultMelodies() {
-    Serial.println("[DEBUG] BellController::loadDefaultMelodies()");
+    LOGD(LOG_BELL, "loadDefaultMelodies()");
     // Predefinita: FUNERALE
     // Pattern: 3 colpi Campana1, poi 3 colpi Campana2, ripetuto per 10 terzine (tot 30 colpi)
     // ogni colpo: durata 300ms, pausa 2700ms
@@ -295,7 +445,7 @@ void BellController::loadDefaultMelodies() {
         funerale[base + 5] = {2, 300, 2700};
     }
     // Slot 0 dedicato a FUNERALE (se libero)
-    if (!melodies[0].isActive) {
+    if (!configStore.current()->melodies[0].isActive) {
         updateMelody(0, "FUNERALE", funerale, 30);
     }
 
@@ -311,11 +461,11 @@ void BellController::loadDefaultMelodies() {
         chiamata[i] = {bell, 300, 400};
     }
     // Slot 1 dedicato a CHIAMATA MESSA (se libero)
-    if (!melodies[1].isActive) {
+    if (!configStore.current()->melodies[1].isActive) {
         updateMelody(1, "CHIAMATA MESSA", chiamata, totalNotes);
     }
 
-    Serial.println("BellController: Melodie predefinite caricate (FUNERALE, CHIAMATA MESSA)");
+    LOGI(LOG_BELL, "Melodie predefinite caricate (FUNERALE, CHIAMATA MESSA)");
 }
 
 String BellController::getStatusJson() {
@@ -332,6 +482,7 @@ String BellController::getStatusJson() {
 
 // Metodi getter per API
 int BellController::getMelodyCount() {
+    BellMelody* melodies = configStore.current()->melodies;
     int count = 0;
     for (int i = 0; i < 10; i++) {
         if (melodies[i].isActive) {
@@ -342,6 +493,7 @@ int BellController::getMelodyCount() {
 }
 
 const char* BellController::getMelodyName(uint8_t index) {
+    BellMelody* melodies = configStore.current()->melodies;
     if (index < 10 && melodies[index].isActive) {
         return melodies[index].name;
     }
@@ -349,6 +501,7 @@ const char* BellController::getMelodyName(uint8_t index) {
 }
 
 uint32_t BellController::getMelodyDuration(uint8_t index) {
+    BellMelody* melodies = configStore.current()->melodies;
     if (index >= 10 || !melodies[index].isActive) {
         return 0;
     }
@@ -361,6 +514,7 @@ uint32_t BellController::getMelodyDuration(uint8_t index) {
 }
 
 const BellNote* BellController::getMelodyNotes(uint8_t index) {
+    BellMelody* melodies = configStore.current()->melodies;
     if (index < 10 && melodies[index].isActive) {
         return melodies[index].notes;
     }
@@ -368,6 +522,7 @@ const BellNote* BellController::getMelodyNotes(uint8_t index) {
 }
 
 int BellController::getMelodyNoteCount(uint8_t index) {
+    BellMelody* melodies = configStore.current()->melodies;
     if (index < 10 && melodies[index].isActive) {
         return melodies[index].noteCount;
     }
@@ -0,0 +1,182 @@
+#include "include/bell_stats.h"
+#include "include/logger.h"
+#include <SPIFFS.h>
+
+BellStats bellStats;
+
+static const uint32_t STATS_MAGIC = 0x42535431; // "BST1"
+static const uint16_t STATS_VERSION = 1;
+static const char* STATS_SLOT_A = "/stats_a.bin";
+static const char* STATS_SLOT_B = "/stats_b.bin";
+
+BellStats::BellStats() {
+    memset(&data, 0, sizeof(data));
+    dirty = false;
+    unsavedStrikes = 0;
+    lastCheckpointMs = 0;
+    checkpointWrites = 0;
+    mux = portMUX_INITIALIZER_UNLOCKED;
+}
+
+uint32_t BellStats::computeChecksum(const BellStatsData& d) {
+    return fnv1a32(&d, offsetof(BellStatsData, checksum));
+}
+
+bool BellStats::readSlot(const char* path, BellStatsData& out) {
+    if (!SPIFFS.exists(path)) return false;
+    fs::File f = SPIFFS.open(path, "r");
+    if (!f) return false;
+    size_t n = f.read((uint8_t*)&out, sizeof(out));
+    f.close();
+    if (n != sizeof(out)) return false;
+    if (out.magic != STATS_MAGIC || out.version != STATS_VERSION || out.size != sizeof(out)) return false;
+    return out.checksum == computeChecksum(out);
+}
+
+void BellStats::begin() {
+    BellStatsData a, b;
+    bool okA = readSlot(STATS_SLOT_A, a);
+    bool okB = readSlot(STATS_SLOT_B, b);
+    if (okA && okB) {
+        data = (a.sequence >= b.sequence) ? a : b;
+    } else if (okA) {
+        data = a;
+    } else if (okB) {
+        data = b;
+    } else {
+        memset(&data, 0, sizeof(data));
+        LOGW(LOG_BELL, "BellStats: nessun checkpoint valido, contatori azzerati");
+    }
+    data.bootCount++;
+    dirty = true;
+    LOGI(LOG_BELL, "BellStats: caricate (avvio #%u, checkpoint #%u)",
+                  (unsigned)data.bootCount, (unsigned)data.sequence);
+    // Subito su flash: dopo un'interruzione breve l'avvio va comunque contato
+    checkpoint();
+}
+
+void BellStats::recordStrike(uint8_t bellNumber) {
+    if (bellNumber < 1 || bellNumber > BELL_COUNT) return;
+    portENTER_CRITICAL(&mux);
+    data.strikes[bellNumber - 1]++;
+    unsavedStrikes++;
+    dirty = true;
+    portEXIT_CRITICAL(&mux);
+}
+
+void BellStats::recordRelayOn(uint8_t bellNumber, uint32_t ms) {
+    if (bellNumber < 1 || bellNumber > BELL_COUNT) return;
+    portENTER_CRITICAL(&mux);
+    data.relayOnMs[bellNumber - 1] += ms;
+    dirty = true;
+    portEXIT_CRITICAL(&mux);
+}
+
+void BellStats::recordMelodyPlay(uint8_t melodyIndex) {
+    if (melodyIndex >= MAX_MELODIES) return;
+    portENTER_CRITICAL(&mux);
+    data.melodyPlays[melodyIndex]++;
+    dirty = true;
+    portEXIT_CRITICAL(&mux);
+}
+
+void BellStats::update(bool busy) {
+    if (!dirty || busy) return;
+    // Batching: si scrive solo dopo molti colpi o dopo un intervallo lungo
+    if (unsavedStrikes >= STATS_CHECKPOINT_STRIKES ||
+        millis() - lastCheckpointMs >= STATS_CHECKPOINT_INTERVAL) {
+        checkpoint();
+    }
+}
+
+bool BellStats::checkpoint() {
+    lastCheckpointMs = millis();
+    // Copia coerente sotto mux; la scrittura su flash avviene fuori
+    portENTER_CRITICAL(&mux);
+    if (!dirty) {
+        portEXIT_CRITICAL(&mux);
+        return true;
+    }
+    data.magic = STATS_MAGIC;
+    data.version = STATS_VERSION;
+    data.size = sizeof(data);
+    data.sequence++;
+    BellStatsData snap = data;
+    uint32_t snapStrikes = unsavedStrikes;
+    dirty = false;
+    unsavedStrikes = 0;
+    portEXIT_CRITICAL(&mux);
+
+    snap.checksum = computeChecksum(snap);
+    // Alterna i due slot: il precedente resta valido se questa scrittura si interrompe
+    const char* path = (snap.sequence & 1) ? STATS_SLOT_A : STATS_SLOT_B;
+    fs::File f = SPIFFS.open(path, "w");
+    bool ok = false;
+    if (f) {
+        ok = f.write((const uint8_t*)&snap, sizeof(snap)) == sizeof(snap);
+        f.close();
+    } else {
+        LOGE(LOG_BELL, "BellStats: impossibile aprire il file di checkpoint");
+    }
+    if (!ok) {
+        // Da ritentare al prossimo checkpoint
+        portENTER_CRITICAL(&mux);
+        dirty = true;
+        unsavedStrikes += snapStrikes;
+        portEXIT_CRITICAL(&mux);
+        return false;
+    }
+    checkpointWrites++;
+    return true;
+}
+
+void BellStats::reset() {
+    portENTER_CRITICAL(&mux);
+    uint32_t boots = data.bootCount;
+    uint32_t seq = data.sequence;
+    memset(&data, 0, sizeof(data));
+    data.bootCount = boots;
+    data.sequence = seq;
+    unsavedStrikes = 0;
+    dirty = true;
+    portEXIT_CRITICAL(&mux);
+    checkpoint();
+    LOGI(LOG_BELL, "BellStats: contatori azzerati");
+}
+
+uint64_t BellStats::getStrikes(uint8_t bellNumber) {
+    if (bellNumber < 1 || bellNumber > BELL_COUNT) return 0;
+    portENTER_CRITICAL(&mux);
+    uint64_t v = data.strikes[bellNumber - 1];
+    portEXIT_CRITICAL(&mux);
+    return v;
+}
+
+uint64_t BellStats::getRelayOnMs(uint8_t bellNumber) {
+    if (bellNumber < 1 || bellNumber > BELL_COUNT) return 0;
+    portENTER_CRITICAL(&mux);
+    uint64_t v = data.relayOnMs[bellNumber - 1];
+    portEXIT_CRITICAL(&mux);
+    return v;
+}
+
+uint32_t BellStats::getMelodyPlays(uint8_t melodyIndex) {
+    if (melodyIndex >= MAX_MELODIES) return 0;
+    return data.melodyPlays[melodyIndex];
+}
+
+uint32_t BellStats::getBootCount() {
+    return data.bootCount;
+}
+
+uint32_t BellStats::getCheckpointWrites() {
+    return checkpointWrites;
+}
+
+uint32_t BellStats::getLastCheckpointAgeMs() {
+    return millis() - lastCheckpointMs;
+}
+
+bool BellStats::isDirty() {
+    return dirty;
+}
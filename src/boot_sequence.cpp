@@ -0,0 +1,49 @@
+#include "include/boot_sequence.h"
+#include "include/logger.h"
+
+BootSequence bootSequence;
+
+BootSequence::BootSequence() : phase(BOOT_LOCAL), phaseStartMs(0), wifiFallback(false), sntpTimeout(false) {
+    memset(marks, 0, sizeof(marks));
+}
+
+void BootSequence::enter(uint8_t next) {
+    if (next == phase) return;
+    LOGD(LOG_SYS, "Avvio: %s -> %s dopo %lu ms", phaseName(phase), phaseName(next),
+         (unsigned long)inPhaseMs());
+    phase = next;
+    phaseStartMs = millis();
+}
+
+void BootSequence::mark(uint8_t milestone) {
+    if (milestone >= BOOT_MARK_COUNT || marks[milestone]) return;
+    marks[milestone] = millis();
+    if (marks[milestone] == 0) marks[milestone] = 1;
+    LOGI(LOG_SYS, "Avvio: %s a %lu ms", markName(milestone), (unsigned long)marks[milestone]);
+}
+
+uint32_t BootSequence::getMark(uint8_t milestone) {
+    return milestone < BOOT_MARK_COUNT ? marks[milestone] : 0;
+}
+
+const char* BootSequence::phaseName(uint8_t phase) {
+    switch (phase) {
+        case BOOT_LOCAL: return "local";
+        case BOOT_WEB: return "web";
+        case BOOT_WIFI: return "wifi";
+        case BOOT_SNTP: return "sntp";
+        case BOOT_READY: return "ready";
+        default: return "?";
+    }
+}
+
+const char* BootSequence::markName(uint8_t milestone) {
+    switch (milestone) {
+        case BOOT_MARK_BELLS: return "bellsReadyMs";
+        case BOOT_MARK_WEB: return "webMs";
+        case BOOT_MARK_WIFI: return "wifiMs";
+        case BOOT_MARK_SNTP: return "sntpMs";
+        case BOOT_MARK_READY: return "readyMs";
+        default: return "?";
+    }
+}
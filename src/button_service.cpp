@@ -0,0 +1,160 @@
+#include "include/button_service.h"
+#include "include/logger.h"
+#include "include/power_manager.h"
+#include <driver/gpio.h>
+
+ButtonService buttonService;
+
+ButtonService::ButtonService() : count(0), queue(nullptr), events(0), dropped(0) {
+    memset(buttons, 0, sizeof(buttons));
+}
+
+bool ButtonService::begin() {
+    if (!queue) queue = xQueueCreate(BUTTON_QUEUE_SIZE, sizeof(ButtonEventMsg));
+    if (!queue) LOGE(LOG_BTN, "impossibile creare la coda eventi");
+    return queue != nullptr;
+}
+
+int8_t ButtonService::add(const ButtonConfig& cfg) {
+    if (!queue || count >= BUTTON_MAX) return -1;
+    Button& b = buttons[count];
+    b.cfg = cfg;
+    b.owner = this;
+    b.index = count;
+    b.longFired = false;
+    b.clickPending = false;
+    b.edgeMs = 0;
+
+    pinMode(cfg.pin, cfg.activeLow ? INPUT_PULLUP : INPUT_PULLDOWN);
+    b.pressed = (digitalRead(cfg.pin) == (cfg.activeLow ? LOW : HIGH));
+
+    esp_timer_create_args_t args;
+    memset(&args, 0, sizeof(args));
+    args.arg = &b;
+    args.dispatch_method = ESP_TIMER_TASK;
+    args.callback = onSettled;
+    args.name = "btn_debounce";
+    if (esp_timer_create(&args, &b.debounce) != ESP_OK) return -1;
+    args.callback = onGesture;
+    args.name = "btn_gesture";
+    if (esp_timer_create(&args, &b.gesture) != ESP_OK) return -1;
+
+    attachInterruptArg(cfg.pin, onEdge, &b, CHANGE);
+    LOGI(LOG_BTN, "Pulsante %s: GPIO%u, attivo %s", cfg.name, cfg.pin, cfg.activeLow ? "LOW" : "HIGH");
+    return count++;
+}
+
+// Ogni rimbalzo riavvia il timer: scade solo quando il livello è fermo
+void IRAM_ATTR ButtonService::onEdge(void* arg) {
+    Button* b = (Button*)arg;
+    esp_timer_stop(b->debounce);
+    esp_timer_start_once(b->debounce, BUTTON_DEBOUNCE_MS * 1000ULL);
+}
+
+void ButtonService::onSettled(void* arg) {
+    Button* b = (Button*)arg;
+    const ButtonConfig& cfg = b->cfg;
+    bool pressed = (digitalRead(cfg.pin) == (cfg.activeLow ? LOW : HIGH));
+    if (pressed == b->pressed) return;          // Impulso più corto del debounce
+    b->pressed = pressed;
+    b->edgeMs = millis() - BUTTON_DEBOUNCE_MS;
+
+    // Senza gesti da distinguere la pressione è già l'evento
+    if (!cfg.onLongPress && !cfg.onDoublePress) {
+        if (pressed) b->owner->emit(*b, BUTTON_PRESS);
+        return;
+    }
+
+    esp_timer_stop(b->gesture);
+    if (pressed) {
+        b->longFired = false;
+        if (cfg.onLongPress) esp_timer_start_once(b->gesture, cfg.longMs * 1000ULL);
+        return;
+    }
+
+    // Rilascio
+    if (b->longFired) return;
+    if (!cfg.onDoublePress) {
+        b->owner->emit(*b, BUTTON_PRESS);
+    } else if (b->clickPending) {
+        b->clickPending = false;
+        b->owner->emit(*b, BUTTON_DOUBLE_PRESS);
+    } else {
+        b->clickPending = true;
+        esp_timer_start_once(b->gesture, BUTTON_DOUBLE_MS * 1000ULL);
+    }
+}
+
+// Pulsante ancora premuto: pressione lunga. Rilasciato: finestra del doppio click scaduta
+void ButtonService::onGesture(void* arg) {
+    Button* b = (Button*)arg;
+    if (b->clickPending) {
+        b->clickPending = false;
+        b->owner->emit(*b, BUTTON_PRESS);
+    }
+    if (b->pressed && b->cfg.onLongPress) {
+        b->longFired = true;
+        b->owner->emit(*b, BUTTON_LONG_PRESS);
+    }
+}
+
+void ButtonService::emit(Button& b, ButtonEventType type) {
+    ButtonEventMsg msg;
+    msg.button = b.index;
+    msg.type = type;
+    msg.ms = b.edgeMs;
+    if (xQueueSend(queue, &msg, 0) == pdTRUE) events++;
+    else dropped++;
+    powerManager.wake();
+}
+
+void ButtonService::service() {
+    if (!queue) return;
+    ButtonEventMsg msg;
+    while (xQueueReceive(queue, &msg, 0) == pdTRUE) {
+        if (msg.button >= count) continue;
+        const ButtonConfig& cfg = buttons[msg.button].cfg;
+        LOGI(LOG_BTN, "%s: %s (%lu ms dal fronte)", cfg.name, eventName(msg.type),
+                      (unsigned long)(millis() - msg.ms));
+        ButtonAction action = nullptr;
+        switch (msg.type) {
+            case BUTTON_PRESS: action = cfg.onPress; break;
+            case BUTTON_LONG_PRESS: action = cfg.onLongPress; break;
+            case BUTTON_DOUBLE_PRESS: action = cfg.onDoublePress; break;
+        }
+        if (action) action(msg.button);
+    }
+}
+
+void ButtonService::armWake() {
+    for (uint8_t i = 0; i < count; i++) {
+        gpio_num_t pin = (gpio_num_t)buttons[i].cfg.pin;
+        gpio_intr_disable(pin);
+        gpio_wakeup_enable(pin, digitalRead(pin) ? GPIO_INTR_LOW_LEVEL : GPIO_INTR_HIGH_LEVEL);
+    }
+}
+
+void ButtonService::disarmWake() {
+    for (uint8_t i = 0; i < count; i++) {
+        Button& b = buttons[i];
+        gpio_num_t pin = (gpio_num_t)b.cfg.pin;
+        gpio_wakeup_disable(pin);
+        gpio_set_intr_type(pin, GPIO_INTR_ANYEDGE);
+        gpio_intr_enable(pin);
+        // Fronte avvenuto senza interrupt: lo tratta il debounce come gli altri
+        bool pressed = (digitalRead(b.cfg.pin) == (b.cfg.activeLow ? LOW : HIGH));
+        if (pressed != b.pressed) onEdge(&b);
+    }
+}
+
+const char* ButtonService::eventName(uint8_t type) {
+    switch (type) {
+        case BUTTON_PRESS: return "press";
+        case BUTTON_LONG_PRESS: return "long-press";
+        case BUTTON_DOUBLE_PRESS: return "double-press";
+        default: return "?";
+    }
+}
+
+uint32_t ButtonService::getEvents() { return events; }
+uint32_t ButtonService::getDropped() { return dropped; }
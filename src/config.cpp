@@ -45,3 +45,14 @@ bool isValidDate(uint16_t year, uint8_t month, uint8_t day) {
   uint8_t daysInMonth[] = {31, 29, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31};
   return day <= daysInMonth[month - 1];
 }
+
+// Hash FNV-1a a 32 bit: usato per checksum dei file binari e per gli hash di contenuto
+uint32_t fnv1a32(const void* data, size_t len, uint32_t seed) {
+  const uint8_t* p = (const uint8_t*)data;
+  uint32_t h = seed;
+  for (size_t i = 0; i < len; i++) {
+    h ^= p[i];
+    h *= 16777619UL;
+  }
+  return h;
+}
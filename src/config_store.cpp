@@ -0,0 +1,476 @@
+#include "include/config_store.h"
+#include "include/logger.h"
+#include <ArduinoJson.h>
+#include <SPIFFS.h>
+
+ConfigStore configStore;
+
+static const char* WEEKLY_FS = "/weekly.json";
+static const char* MELODIES_FS = "/melodies.json";
+static const char* WEEKLY_NEW_FS = "/weekly.json.new";
+static const char* MELODIES_NEW_FS = "/melodies.json.new";
+static const char* COMMIT_MARKER_FS = "/config.commit";
+static const char* JOURNAL_FS = "/weekly.log";
+
+// ========== SERIALIZZAZIONE ==========
+
+// Scrittura JSON su file attraverso un buffer fisso sullo stack: nessun
+// documento, la memoria non dipende dalle tabelle (i salvataggi girano anche
+// negli handler di restore e batch, con heap frammentato)
+class JsonFileWriter : public Print {
+private:
+  fs::File& file;
+  uint8_t buf[256];
+  size_t len;
+  bool failed;
+
+public:
+  JsonFileWriter(fs::File& f) : file(f), len(0), failed(false) {}
+
+  size_t write(uint8_t c) override {
+    if (len >= sizeof(buf)) drain();
+    buf[len++] = c;
+    return 1;
+  }
+  using Print::write;
+
+  void drain() {
+    if (len && file.write(buf, len) != len) failed = true;
+    len = 0;
+  }
+  bool finish() { drain(); return !failed; }
+
+  // Stringa tra virgolette con escape (UTF-8 invariato)
+  void string(const char* s) {
+    static const char HEX_DIGITS[] = "0123456789abcdef";
+    write('"');
+    for (; *s; s++) {
+      uint8_t c = (uint8_t)*s;
+      if (c == '"' || c == '\\') { write('\\'); write(c); }
+      else if (c < 0x20) {
+        print("\\u00"); write(HEX_DIGITS[c >> 4]); write(HEX_DIGITS[c & 0x0F]);
+      } else {
+        write(c);
+      }
+    }
+    write('"');
+  }
+  void field(const char* key, long v, bool comma = true) {
+    if (comma) write(',');
+    write('"'); print(key); print("\":"); print(v);
+  }
+  void field(const char* key, bool v) {
+    write(','); write('"'); print(key); print("\":"); print(v ? "true" : "false");
+  }
+};
+
+static bool writeSchedulesFile(const ConfigTables& t, const char* path) {
+  fs::File f = SPIFFS.open(path, "w");
+  if (!f) return false;
+  JsonFileWriter w(f);
+  w.print("{\"weekly\":[");
+  for (int i=0;i<t.weeklyCount;i++){
+    const WeeklySchedule &e = t.weekly[i];
+    if (i) w.write(',');
+    w.write('{');
+    w.field("id", (long)e.id, false);
+    w.print(",\"name\":"); w.string(e.name);
+    w.field("dayOfWeek", (long)e.dayOfWeek); w.field("hour", (long)e.hour); w.field("minute", (long)e.minute);
+    w.field("melodyIndex", (long)e.melodyIndex); w.field("isActive", (bool)e.isActive);
+    w.write('}');
+  }
+  w.print("],\"special\":[");
+  for (int i=0;i<t.specialCount;i++){
+    const SpecialEvent &e = t.special[i];
+    if (i) w.write(',');
+    w.write('{');
+    w.field("id", (long)e.id, false);
+    w.print(",\"name\":"); w.string(e.name);
+    w.field("type", (long)e.type); w.field("year", (long)e.year); w.field("month", (long)e.month);
+    w.field("day", (long)e.day); w.field("hour", (long)e.hour); w.field("minute", (long)e.minute);
+    w.field("melodyIndex", (long)e.melodyIndex); w.field("isActive", (bool)e.isActive);
+    w.field("isRecurring", (bool)e.isRecurring);
+    w.write('}');
+  }
+  w.print("]}");
+  bool ok = w.finish();
+  f.close();
+  return ok;
+}
+
+static bool writeMelodiesFile(const ConfigTables& t, const char* path) {
+  fs::File f = SPIFFS.open(path, "w");
+  if (!f) return false;
+  JsonFileWriter w(f);
+  w.print("{\"melodies\":[");
+  bool first = true;
+  for (int i = 0; i < MAX_MELODIES; i++) {
+    const BellMelody &mel = t.melodies[i];
+    if (!mel.isActive) continue;
+    if (!first) w.write(',');
+    first = false;
+    w.write('{');
+    w.field("id", (long)i, false);
+    w.print(",\"name\":"); w.string(mel.name);
+    w.field("noteCount", (long)mel.noteCount);
+    w.print(",\"notes\":[");
+    for (int j = 0; j < mel.noteCount; j++) {
+      if (j) w.write(',');
+      w.write('{');
+      w.field("bellNumber", (long)mel.notes[j].bellNumber, false);
+      w.field("duration", (long)mel.notes[j].duration);
+      w.field("delay", (long)mel.notes[j].delay);
+      w.write('}');
+    }
+    w.print("]}");
+  }
+  w.print("]}");
+  bool ok = w.finish();
+  f.close();
+  return ok;
+}
+
+bool saveSchedulesToFS() {
+  return writeSchedulesFile(*configStore.current(), WEEKLY_FS);
+}
+
+bool saveAllMelodiesToFS() {
+  return writeMelodiesFile(*configStore.current(), MELODIES_FS);
+}
+
+bool loadSchedulesFromFS() {
+  ConfigTables* cfg = configStore.current();
+  cfg->weeklyCount = 0; cfg->specialCount = 0;
+  if (!SPIFFS.exists(WEEKLY_FS)) { configStore.replayJournal(*cfg); return true; }
+  fs::File f = SPIFFS.open(WEEKLY_FS, "r");
+  if (!f) return false;
+  DynamicJsonDocument doc(16384);
+  DeserializationError err = deserializeJson(doc, f);
+  f.close();
+  if (err) return false;
+  if (doc.containsKey("weekly")){
+    JsonArray w = doc["weekly"].as<JsonArray>();
+    for (JsonObject o : w){
+      if (cfg->weeklyCount>=MAX_WEEKLY_SCHEDULES) break;
+      WeeklySchedule &it = cfg->weekly[cfg->weeklyCount++];
+      strlcpy(it.name, (o["name"] | ""), sizeof(it.name));
+      it.id = o["id"] | cfg->weeklyCount;
+      it.dayOfWeek = (DayOfWeek)(int)(o["dayOfWeek"] | 0);
+      it.hour = o["hour"] | 0; it.minute = o["minute"] | 0;
+      it.melodyIndex = o["melodyIndex"] | 0; it.isActive = o["isActive"] | true;
+    }
+  }
+  if (doc.containsKey("special")){
+    JsonArray s = doc["special"].as<JsonArray>();
+    for (JsonObject o : s){
+      if (cfg->specialCount>=MAX_SPECIAL_EVENTS) break;
+      SpecialEvent &it = cfg->special[cfg->specialCount++];
+      strlcpy(it.name, (o["name"] | ""), sizeof(it.name));
+      it.id = o["id"] | cfg->specialCount;
+      it.type = (EventType)(int)(o["type"] | 5);
+      it.year = o["year"] | 0; it.month = o["month"] | 0; it.day = o["day"] | 0;
+      it.hour = o["hour"] | 0; it.minute = o["minute"] | 0;
+      it.melodyIndex = o["melodyIndex"] | 0; it.isActive = o["isActive"] | true; it.isRecurring = o["isRecurring"] | false;
+    }
+  }
+  configStore.replayJournal(*cfg);
+  return true;
+}
+
+bool loadMelodiesFromFS() {
+  if (!SPIFFS.exists(MELODIES_FS)) return true; // niente da caricare
+  fs::File f = SPIFFS.open(MELODIES_FS, "r");
+  if (!f) return false;
+  DynamicJsonDocument doc(32768);
+  DeserializationError err = deserializeJson(doc, f);
+  f.close();
+  if (err) return false;
+  if (!doc.containsKey("melodies")) return true;
+  BellMelody* melodies = configStore.current()->melodies;
+  // Azzerare tutte
+  for (int i = 0; i < MAX_MELODIES; i++) { melodies[i].isActive = false; melodies[i].noteCount = 0; melodies[i].name[0] = '\0'; }
+  for (JsonObject m : doc["melodies"].as<JsonArray>()) {
+    int id = m["id"] | -1;
+    if (id < 0 || id >= MAX_MELODIES) continue;
+    const char* name = m["name"] | "Senza nome";
+    strncpy(melodies[id].name, name, sizeof(melodies[id].name)-1);
+    melodies[id].name[sizeof(melodies[id].name)-1] = '\0';
+    JsonArray ns = m["notes"].as<JsonArray>();
+    uint8_t count = 0;
+    if (ns) {
+      for (JsonObject n : ns) {
+        uint8_t b = n["bellNumber"] | 1;
+        uint16_t d = n["duration"] | 300;
+        uint16_t dl = n["delay"] | 800;
+        if (b < 1 || b > 2) continue;
+        melodies[id].notes[count++] = { b, d, dl };
+        if (count >= MAX_MELODY_STEPS) break;
+      }
+    }
+    melodies[id].noteCount = count;
+    melodies[id].isActive = (count > 0);
+  }
+  return true;
+}
+
+// ========== ISTANTANEE ==========
+
+ConfigStore::ConfigStore() {
+  memset(banks, 0, sizeof(banks));
+  active = &banks[0];
+  draft = nullptr;
+  readers[0] = readers[1] = 0;
+  writerLock = xSemaphoreCreateMutex();
+  graceWaits = 0;
+  graceTimeouts = 0;
+  journalCount = 0;
+}
+
+ConfigTables* ConfigStore::current() {
+  return __atomic_load_n(&active, __ATOMIC_ACQUIRE);
+}
+
+// Il lettore si registra sul banco e poi ricontrolla che sia ancora quello attivo.
+// Con lo scrittore che pubblica e poi legge i contatori (tutto seq_cst), almeno uno
+// dei due vede l'altro: o il lettore riprova sul banco nuovo, o lo scrittore aspetta.
+ConfigTables* ConfigStore::acquire() {
+  for (;;) {
+    ConfigTables* t = __atomic_load_n(&active, __ATOMIC_SEQ_CST);
+    uint8_t b = (t == &banks[0]) ? 0 : 1;
+    __atomic_add_fetch(&readers[b], 1, __ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&active, __ATOMIC_SEQ_CST) == t) return t;
+    __atomic_sub_fetch(&readers[b], 1, __ATOMIC_SEQ_CST);
+  }
+}
+
+void ConfigStore::release(ConfigTables* t) {
+  __atomic_sub_fetch(&readers[(t == &banks[0]) ? 0 : 1], 1, __ATOMIC_SEQ_CST);
+}
+
+bool ConfigStore::waitForReaders(uint8_t bank) {
+  if (__atomic_load_n(&readers[bank], __ATOMIC_SEQ_CST) == 0) return true;
+  graceWaits++;
+  uint32_t start = millis();
+  while (__atomic_load_n(&readers[bank], __ATOMIC_SEQ_CST) != 0) {
+    if (millis() - start > CONFIG_GRACE_TIMEOUT_MS) {
+      graceTimeouts++;
+      LOGW(LOG_CFG, "ConfigStore: lettore bloccato sul banco da riscrivere, transazione rifiutata");
+      return false;
+    }
+    vTaskDelay(1);
+  }
+  return true;
+}
+
+ConfigTables* ConfigStore::beginTransaction(TickType_t lockWait) {
+  if (xSemaphoreTake(writerLock, lockWait) != pdTRUE) return nullptr;
+  ConfigTables* cur = current();
+  ConfigTables* next = (cur == &banks[0]) ? &banks[1] : &banks[0];
+  // Il banco libero è la versione pubblicata prima di questa: lo si riusa
+  // solo quando nessuno lo sta più leggendo: sovrascriverlo sotto un lettore
+  // gli cambierebbe le tabelle a metà giro
+  if (!waitForReaders(next == &banks[0] ? 0 : 1)) {
+    xSemaphoreGive(writerLock);
+    return nullptr;
+  }
+  memcpy(next, cur, sizeof(ConfigTables));
+  draft = next;
+  return draft;
+}
+
+void ConfigStore::abortTransaction() {
+  if (!draft) return;
+  draft = nullptr;
+  xSemaphoreGive(writerLock);
+}
+
+bool ConfigStore::validate(const ConfigTables& t, char* error, size_t len) {
+  for (int i = 0; i < MAX_MELODIES; i++) {
+    const BellMelody& m = t.melodies[i];
+    if (!m.isActive) continue;
+    if (m.noteCount == 0 || m.noteCount > MAX_MELODY_STEPS) {
+      snprintf(error, len, "Melodia %d: numero note non valido", i);
+      return false;
+    }
+    for (int j = 0; j < m.noteCount; j++) {
+      if (m.notes[j].bellNumber < 1 || m.notes[j].bellNumber > BELL_COUNT) {
+        snprintf(error, len, "Melodia %d: campana non valida alla nota %d", i, j);
+        return false;
+      }
+    }
+  }
+  if (t.weeklyCount > MAX_WEEKLY_SCHEDULES || t.specialCount > MAX_SPECIAL_EVENTS) {
+    snprintf(error, len, "Troppe programmazioni");
+    return false;
+  }
+  for (int i = 0; i < t.weeklyCount; i++) {
+    const WeeklySchedule& e = t.weekly[i];
+    if (e.dayOfWeek > SABATO || !isValidTime(e.hour, e.minute) || e.melodyIndex >= MAX_MELODIES) {
+      snprintf(error, len, "Programmazione settimanale %d (%s) non valida", i, e.name);
+      return false;
+    }
+  }
+  for (int i = 0; i < t.specialCount; i++) {
+    const SpecialEvent& e = t.special[i];
+    if (e.month < 1 || e.month > 12 || e.day < 1 || e.day > 31 ||
+        !isValidTime(e.hour, e.minute) || e.melodyIndex >= MAX_MELODIES) {
+      snprintf(error, len, "Evento speciale %d (%s) non valido", i, e.name);
+      return false;
+    }
+  }
+  return true;
+}
+
+void ConfigStore::publish() {
+  if (!draft) return;
+  draft->generation = current()->generation + 1;
+  __atomic_store_n(&active, draft, __ATOMIC_SEQ_CST);
+  draft = nullptr;
+  xSemaphoreGive(writerLock);
+}
+
+uint32_t ConfigStore::getGraceWaits() {
+  return graceWaits;
+}
+
+uint32_t ConfigStore::getGraceTimeouts() {
+  return graceTimeouts;
+}
+
+// ========== COMMIT SU FLASH ==========
+
+// Sostituisce i file definitivi con le versioni .new presenti
+void ConfigStore::finishCommit() {
+  // Le nuove tabelle includono già il journal: va eliminato prima di renderle
+  // definitive, altrimenti voci vecchie potrebbero essere riapplicate sopra
+  if (SPIFFS.exists(WEEKLY_NEW_FS)) {
+    SPIFFS.remove(JOURNAL_FS);
+    journalCount = 0;
+  }
+  const char* finals[] = { MELODIES_FS, WEEKLY_FS };
+  const char* staged[] = { MELODIES_NEW_FS, WEEKLY_NEW_FS };
+  for (int i = 0; i < 2; i++) {
+    if (!SPIFFS.exists(staged[i])) continue;
+    if (SPIFFS.exists(finals[i])) SPIFFS.remove(finals[i]);
+    SPIFFS.rename(staged[i], finals[i]);
+  }
+  SPIFFS.remove(COMMIT_MARKER_FS);
+}
+
+bool ConfigStore::persist(const ConfigTables& t, bool melodies, bool schedules) {
+  bool ok = true;
+  if (melodies) ok = writeMelodiesFile(t, MELODIES_NEW_FS);
+  if (ok && schedules) ok = writeSchedulesFile(t, WEEKLY_NEW_FS);
+  if (ok) {
+    fs::File f = SPIFFS.open(COMMIT_MARKER_FS, "w");
+    ok = f && f.print(t.generation) > 0;
+    if (f) f.close();
+  }
+  if (!ok) {
+    // Nessun marker: i file definitivi sono intatti
+    SPIFFS.remove(MELODIES_NEW_FS);
+    SPIFFS.remove(WEEKLY_NEW_FS);
+    SPIFFS.remove(COMMIT_MARKER_FS);
+    LOGE(LOG_CFG, "ConfigStore: salvataggio fallito, file precedenti conservati");
+    return false;
+  }
+  finishCommit();
+  return true;
+}
+
+void ConfigStore::recover() {
+  if (SPIFFS.exists(COMMIT_MARKER_FS)) {
+    LOGE(LOG_CFG, "ConfigStore: completamento commit interrotto");
+    finishCommit();
+  } else if (SPIFFS.exists(MELODIES_NEW_FS) || SPIFFS.exists(WEEKLY_NEW_FS)) {
+    LOGW(LOG_CFG, "ConfigStore: scarto salvataggio incompleto");
+    SPIFFS.remove(MELODIES_NEW_FS);
+    SPIFFS.remove(WEEKLY_NEW_FS);
+  }
+}
+
+// ========== JOURNAL RECORD ==========
+
+static uint32_t journalChecksum(const ConfigJournalEntry& e) {
+  return fnv1a32(&e, offsetof(ConfigJournalEntry, checksum));
+}
+
+bool ConfigStore::appendJournal(const ConfigJournalEntry& e) {
+  fs::File f = SPIFFS.open(JOURNAL_FS, "a");
+  if (!f) return false;
+  bool ok = f.write((const uint8_t*)&e, sizeof(e)) == sizeof(e);
+  f.close();
+  if (ok) journalCount++;
+  return ok;
+}
+
+bool ConfigStore::persistRecord(const ConfigTables& t, uint8_t table, uint8_t id, bool deleted) {
+  if (journalCount >= CONFIG_JOURNAL_MAX) {
+    // Compattazione: tabelle complete con il protocollo di commit (azzera il journal)
+    return persist(t, false, true);
+  }
+  ConfigJournalEntry e;
+  memset(&e, 0, sizeof(e));
+  e.size = sizeof(e);
+  e.table = table;
+  e.op = deleted ? JOURNAL_DELETE : JOURNAL_UPSERT;
+  e.id = id;
+  if (!deleted) {
+    bool found = false;
+    if (table == CFG_TABLE_WEEKLY) {
+      for (int i = 0; i < t.weeklyCount && !found; i++) {
+        if (t.weekly[i].id == id) { e.weekly = t.weekly[i]; found = true; }
+      }
+    } else if (table == CFG_TABLE_SPECIAL) {
+      for (int i = 0; i < t.specialCount && !found; i++) {
+        if (t.special[i].id == id) { e.special = t.special[i]; found = true; }
+      }
+    }
+    if (!found) return false;
+  }
+  e.checksum = journalChecksum(e);
+  if (!appendJournal(e)) {
+    LOGE(LOG_CFG, "ConfigStore: scrittura journal fallita");
+    return false;
+  }
+  return true;
+}
+
+void ConfigStore::replayJournal(ConfigTables& t) {
+  journalCount = 0;
+  if (!SPIFFS.exists(JOURNAL_FS)) return;
+  fs::File f = SPIFFS.open(JOURNAL_FS, "r");
+  if (!f) return;
+  ConfigJournalEntry e;
+  uint16_t applied = 0, skipped = 0;
+  while (f.read((uint8_t*)&e, sizeof(e)) == sizeof(e)) {
+    journalCount = (journalCount < 0xFF) ? journalCount + 1 : journalCount;
+    if (e.size != sizeof(e) || e.checksum != journalChecksum(e)) { skipped++; continue; }
+    if (e.table == CFG_TABLE_WEEKLY) {
+      int i = 0;
+      while (i < t.weeklyCount && t.weekly[i].id != e.id) i++;
+      if (e.op == JOURNAL_DELETE) {
+        if (i == t.weeklyCount) continue;
+        memmove(&t.weekly[i], &t.weekly[i + 1], sizeof(WeeklySchedule) * (t.weeklyCount - i - 1));
+        t.weeklyCount--;
+      } else {
+        if (i == t.weeklyCount) { if (t.weeklyCount >= MAX_WEEKLY_SCHEDULES) continue; t.weeklyCount++; }
+        t.weekly[i] = e.weekly;
+      }
+    } else if (e.table == CFG_TABLE_SPECIAL) {
+      int i = 0;
+      while (i < t.specialCount && t.special[i].id != e.id) i++;
+      if (e.op == JOURNAL_DELETE) {
+        if (i == t.specialCount) continue;
+        memmove(&t.special[i], &t.special[i + 1], sizeof(SpecialEvent) * (t.specialCount - i - 1));
+        t.specialCount--;
+      } else {
+        if (i == t.specialCount) { if (t.specialCount >= MAX_SPECIAL_EVENTS) continue; t.specialCount++; }
+        t.special[i] = e.special;
+      }
+    }
+    applied++;
+  }
+  f.close();
+  LOGI(LOG_CFG, "ConfigStore: journal %u voci applicate, %u scartate", applied, skipped);
+}
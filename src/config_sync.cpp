@@ -0,0 +1,190 @@
+#include "include/config_sync.h"
+#include "include/logger.h"
+#include <SPIFFS.h>
+
+ConfigSync configSync;
+
+static const uint32_t SYNC_MAGIC = 0x43535931; // "CSY1"
+static const uint16_t SYNC_VERSION = 1;
+static const char* SYNC_FS = "/sync.bin";
+static const char* SYNC_NEW_FS = "/sync.bin.new";
+
+ConfigSync::ConfigSync() {
+    memset(&data, 0, sizeof(data));
+}
+
+uint32_t ConfigSync::computeChecksum(const ConfigSyncData& d) {
+    return fnv1a32(&d, offsetof(ConfigSyncData, checksum));
+}
+
+void ConfigSync::resetState() {
+    memset(&data, 0, sizeof(data));
+    data.magic = SYNC_MAGIC;
+    data.version = SYNC_VERSION;
+    data.size = sizeof(data);
+    data.instance = esp_random();
+}
+
+void ConfigSync::begin() {
+    bool ok = false;
+    if (SPIFFS.exists(SYNC_FS)) {
+        fs::File f = SPIFFS.open(SYNC_FS, "r");
+        if (f) {
+            ok = f.read((uint8_t*)&data, sizeof(data)) == sizeof(data);
+            f.close();
+        }
+        ok = ok && data.magic == SYNC_MAGIC && data.version == SYNC_VERSION &&
+             data.size == sizeof(data) && data.checksum == computeChecksum(data);
+    }
+    if (!ok) {
+        // Nuova istanza: i client con un cursore vecchio riceveranno un backup completo
+        resetState();
+        LOGW(LOG_CFG, "ConfigSync: stato non trovato, nuova istanza");
+        return;
+    }
+    LOGI(LOG_CFG, "ConfigSync: generazione %u, %u record", (unsigned)data.generation, data.recordCount);
+}
+
+bool ConfigSync::save() {
+    data.checksum = computeChecksum(data);
+    fs::File f = SPIFFS.open(SYNC_NEW_FS, "w");
+    if (!f) return false;
+    bool ok = f.write((const uint8_t*)&data, sizeof(data)) == sizeof(data);
+    f.close();
+    if (!ok) { SPIFFS.remove(SYNC_NEW_FS); return false; }
+    if (SPIFFS.exists(SYNC_FS)) SPIFFS.remove(SYNC_FS);
+    return SPIFFS.rename(SYNC_NEW_FS, SYNC_FS);
+}
+
+ConfigRecordVersion* ConfigSync::find(uint8_t table, uint8_t key) {
+    for (uint16_t i = 0; i < data.recordCount; i++) {
+        if (data.records[i].table == table && data.records[i].key == key) return &data.records[i];
+    }
+    return nullptr;
+}
+
+void ConfigSync::addTombstone(uint8_t table, uint8_t key, uint32_t gen) {
+    if (data.tombCount == CONFIG_SYNC_TOMBSTONES) {
+        // Ring pieno: la tombstone più vecchia si perde, i delta precedenti non sono più completi
+        const ConfigTombstone& old = data.tombs[data.tombHead];
+        if (old.gen > data.floor) data.floor = old.gen;
+        data.tombHead = (data.tombHead + 1) % CONFIG_SYNC_TOMBSTONES;
+        data.tombCount--;
+    }
+    ConfigTombstone& t = data.tombs[(data.tombHead + data.tombCount) % CONFIG_SYNC_TOMBSTONES];
+    t.table = table;
+    t.key = key;
+    t.reserved = 0;
+    t.gen = gen;
+    data.tombCount++;
+}
+
+uint32_t ConfigSync::refresh(const ConfigTables& t) {
+    uint32_t fresh[CONFIG_SYNC_RECORDS];
+    bool seen[CONFIG_SYNC_RECORDS];
+    memset(seen, 0, sizeof(seen));
+    uint32_t newGen = data.generation + 1;
+
+    // Record nuovi: gen = 0 finché non vengono confrontati
+    auto visit = [&](uint8_t table, uint8_t key, uint32_t hash) {
+        ConfigRecordVersion* r = find(table, key);
+        if (!r) {
+            if (data.recordCount >= CONFIG_SYNC_RECORDS) return;
+            r = &data.records[data.recordCount++];
+            r->table = table;
+            r->key = key;
+            r->reserved = 0;
+            r->hash = 0;
+            r->gen = 0;
+        }
+        uint16_t idx = r - data.records;
+        // Id duplicati: gli hash vengono concatenati in un unico record
+        fresh[idx] = seen[idx] ? fnv1a32(&hash, sizeof(hash), fresh[idx]) : hash;
+        seen[idx] = true;
+    };
+    for (uint8_t i = 0; i < MAX_MELODIES; i++) {
+        if (t.melodies[i].isActive) visit(CFG_TABLE_MELODIES, i, hashMelody(t.melodies[i]));
+    }
+    for (uint8_t i = 0; i < t.weeklyCount; i++) visit(CFG_TABLE_WEEKLY, t.weekly[i].id, hashWeekly(t.weekly[i]));
+    for (uint8_t i = 0; i < t.specialCount; i++) visit(CFG_TABLE_SPECIAL, t.special[i].id, hashSpecial(t.special[i]));
+
+    bool changed = false;
+    // Dal fondo, così la rimozione (scambio con l'ultimo) non salta elementi
+    for (int i = data.recordCount - 1; i >= 0; i--) {
+        ConfigRecordVersion& r = data.records[i];
+        if (!seen[i]) {
+            addTombstone(r.table, r.key, newGen);
+            data.records[i] = data.records[data.recordCount - 1];
+            seen[i] = seen[data.recordCount - 1];
+            fresh[i] = fresh[data.recordCount - 1];
+            data.recordCount--;
+            changed = true;
+        } else if (r.gen == 0 || r.hash != fresh[i]) {
+            r.hash = fresh[i];
+            r.gen = newGen;
+            changed = true;
+        }
+    }
+    if (changed) {
+        data.generation = newGen;
+        if (!save()) LOGE(LOG_CFG, "ConfigSync: salvataggio stato fallito");
+    }
+    return data.generation;
+}
+
+uint32_t ConfigSync::getGeneration() {
+    return data.generation;
+}
+
+uint32_t ConfigSync::getInstance() {
+    return data.instance;
+}
+
+bool ConfigSync::canDelta(uint32_t since) {
+    return since >= data.floor && since <= data.generation;
+}
+
+uint32_t ConfigSync::recordGeneration(uint8_t table, uint8_t key) {
+    ConfigRecordVersion* r = find(table, key);
+    return r ? r->gen : 0;
+}
+
+uint32_t ConfigSync::recordHash(uint8_t table, uint8_t key) {
+    ConfigRecordVersion* r = find(table, key);
+    return r ? r->hash : 0;
+}
+
+uint8_t ConfigSync::tombstoneCount() {
+    return data.tombCount;
+}
+
+const ConfigTombstone& ConfigSync::tombstone(uint8_t i) {
+    return data.tombs[(data.tombHead + i) % CONFIG_SYNC_TOMBSTONES];
+}
+
+// Hash campo per campo: padding e byte dopo il terminatore dei nomi non contano
+uint32_t ConfigSync::hashMelody(const BellMelody& m) {
+    uint32_t h = fnv1a32(m.name, strlen(m.name));
+    h = fnv1a32(&m.noteCount, sizeof(m.noteCount), h);
+    for (uint8_t i = 0; i < m.noteCount; i++) {
+        const BellNote& n = m.notes[i];
+        h = fnv1a32(&n.bellNumber, sizeof(n.bellNumber), h);
+        h = fnv1a32(&n.duration, sizeof(n.duration), h);
+        h = fnv1a32(&n.delay, sizeof(n.delay), h);
+    }
+    return h;
+}
+
+uint32_t ConfigSync::hashWeekly(const WeeklySchedule& e) {
+    uint8_t fields[] = { e.id, (uint8_t)e.dayOfWeek, e.hour, e.minute, e.melodyIndex, (uint8_t)e.isActive };
+    uint32_t h = fnv1a32(e.name, strlen(e.name));
+    return fnv1a32(fields, sizeof(fields), h);
+}
+
+uint32_t ConfigSync::hashSpecial(const SpecialEvent& e) {
+    uint8_t fields[] = { e.id, (uint8_t)e.type, (uint8_t)(e.year & 0xFF), (uint8_t)(e.year >> 8),
+                         e.month, e.day, e.hour, e.minute, e.melodyIndex,
+                         (uint8_t)e.isActive, (uint8_t)e.isRecurring };
+    uint32_t h = fnv1a32(e.name, strlen(e.name));
+    return fnv1a32(fields, sizeof(fields), h);
+}
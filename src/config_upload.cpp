@@ -0,0 +1,517 @@
+#include "include/config_upload.h"
+#include "include/config_sync.h"
+
+// ========== HELPER CAMPI ==========
+
+void resetMelodyStaging(MelodyStaging& m) {
+    strlcpy(m.name, "Senza nome", sizeof(m.name));
+    m.noteCount = 0;
+    m.notesSeen = 0;
+    m.hasNotes = false;
+    m.hasName = false;
+}
+
+// Stessi default usati finora con ArduinoJson (bellNumber 1, 300ms, 800ms)
+static void resetNote(BellNote& n) {
+    n.bellNumber = 1;
+    n.duration = 300;
+    n.delay = 800;
+}
+
+void applyNoteField(BellNote& n, const char* key, JsonValueType type, const char* text) {
+    if (strcmp(key, "bellNumber") == 0) {
+        long b = JsonStreamHandler::toLong(type, text, 1);
+        n.bellNumber = (b < 1 || b > BELL_COUNT) ? 0 : (uint8_t)b;   // 0 = nota scartata
+    } else if (strcmp(key, "duration") == 0) {
+        n.duration = (uint16_t)JsonStreamHandler::toLong(type, text, 300);
+    } else if (strcmp(key, "delay") == 0) {
+        n.delay = (uint16_t)JsonStreamHandler::toLong(type, text, 800);
+    }
+}
+
+void commitNote(MelodyStaging& m, const BellNote& n) {
+    m.notesSeen++;
+    if (n.bellNumber == 0 || m.noteCount >= MAX_MELODY_STEPS) return;
+    m.notes[m.noteCount++] = n;
+}
+
+// I nomi (melodie, programmazioni, eventi) stanno in char[32]: uno più lungo
+// fa fallire l'upload invece di essere troncato in silenzio
+#define UPLOAD_NAME_ERROR "nome troppo lungo (max 31 byte)"
+
+static bool nameTooLong(const char* key, JsonValueType type, const char* text) {
+    return type == JSON_STRING && strcmp(key, "name") == 0 && strlen(text) >= sizeof(((BellMelody*)0)->name);
+}
+
+static void applyName(char* dest, size_t size, JsonValueType type, const char* text) {
+    if (type == JSON_STRING) strlcpy(dest, text, size);
+}
+
+void applyWeeklyField(WeeklySchedule& e, const char* key, JsonValueType type, const char* text) {
+    if (strcmp(key, "id") == 0) e.id = (uint8_t)JsonStreamHandler::toLong(type, text, e.id);
+    else if (strcmp(key, "name") == 0) applyName(e.name, sizeof(e.name), type, text);
+    else if (strcmp(key, "dayOfWeek") == 0) e.dayOfWeek = (DayOfWeek)JsonStreamHandler::toLong(type, text, 0);
+    else if (strcmp(key, "hour") == 0) e.hour = (uint8_t)JsonStreamHandler::toLong(type, text, 0);
+    else if (strcmp(key, "minute") == 0) e.minute = (uint8_t)JsonStreamHandler::toLong(type, text, 0);
+    else if (strcmp(key, "melodyIndex") == 0) e.melodyIndex = (uint8_t)JsonStreamHandler::toLong(type, text, 0);
+    else if (strcmp(key, "isActive") == 0) e.isActive = JsonStreamHandler::toBool(type, text, true);
+}
+
+void applySpecialField(SpecialEvent& e, const char* key, JsonValueType type, const char* text) {
+    if (strcmp(key, "id") == 0) e.id = (uint8_t)JsonStreamHandler::toLong(type, text, e.id);
+    else if (strcmp(key, "name") == 0) applyName(e.name, sizeof(e.name), type, text);
+    else if (strcmp(key, "type") == 0) e.type = (EventType)JsonStreamHandler::toLong(type, text, EVENTO_PERSONALIZZATO);
+    else if (strcmp(key, "year") == 0) e.year = (uint16_t)JsonStreamHandler::toLong(type, text, 0);
+    else if (strcmp(key, "month") == 0) e.month = (uint8_t)JsonStreamHandler::toLong(type, text, 0);
+    else if (strcmp(key, "day") == 0) e.day = (uint8_t)JsonStreamHandler::toLong(type, text, 0);
+    else if (strcmp(key, "hour") == 0) e.hour = (uint8_t)JsonStreamHandler::toLong(type, text, 0);
+    else if (strcmp(key, "minute") == 0) e.minute = (uint8_t)JsonStreamHandler::toLong(type, text, 0);
+    else if (strcmp(key, "melodyIndex") == 0) e.melodyIndex = (uint8_t)JsonStreamHandler::toLong(type, text, 0);
+    else if (strcmp(key, "isActive") == 0) e.isActive = JsonStreamHandler::toBool(type, text, true);
+    else if (strcmp(key, "isRecurring") == 0) e.isRecurring = JsonStreamHandler::toBool(type, text, false);
+}
+
+// ========== MELODIA SINGOLA ==========
+// Profondità: campi radice 1, array "notes" 1, oggetti nota 2, campi nota 3
+
+MelodyUpload::MelodyUpload() : parser(this) {
+    resetMelodyStaging(melody);
+    resetNote(note);
+    index = -1;
+    melodyId = -1;
+    inNotes = false;
+}
+
+bool MelodyUpload::feed(const uint8_t* data, size_t len) {
+    return parser.feed(data, len);
+}
+
+bool MelodyUpload::finish() {
+    return parser.finish();
+}
+
+const char* MelodyUpload::errorMessage() {
+    return parser.errorMessage();
+}
+
+void MelodyUpload::onStartArray(uint8_t depth, const char* key) {
+    if (depth == 1 && strcmp(key, "notes") == 0) {
+        inNotes = true;
+        melody.hasNotes = true;
+        melody.noteCount = 0;
+        melody.notesSeen = 0;
+    } else if (depth == 1) {
+        inNotes = false;
+    }
+}
+
+void MelodyUpload::onStartObject(uint8_t depth, const char* key) {
+    if (inNotes && depth == 2) resetNote(note);
+}
+
+void MelodyUpload::onEndObject(uint8_t depth, const char* key) {
+    if (inNotes && depth == 2) commitNote(melody, note);
+}
+
+void MelodyUpload::onValue(uint8_t depth, const char* key, JsonValueType type, const char* text) {
+    if (nameTooLong(key, type, text)) { parser.abort(UPLOAD_NAME_ERROR); return; }
+    if (depth == 1) {
+        if (strcmp(key, "name") == 0 && type == JSON_STRING) {
+            strlcpy(melody.name, text, sizeof(melody.name));
+            melody.hasName = true;
+        } else if (strcmp(key, "index") == 0) {
+            index = toLong(type, text, -1);
+        } else if (strcmp(key, "melodyId") == 0) {
+            melodyId = toLong(type, text, -1);
+        }
+    } else if (inNotes && depth == 3) {
+        applyNoteField(note, key, type, text);
+    }
+}
+
+// ========== PROGRAMMAZIONI ==========
+// Profondità: array 1, record 2, campi record 3
+
+ScheduleUpload::ScheduleUpload(const char* weeklyKey, const char* specialKey) : parser(this) {
+    this->weeklyKey = weeklyKey;
+    this->specialKey = specialKey;
+    weeklyCount = 0;
+    hasWeekly = false;
+    specialCount = 0;
+    hasSpecial = false;
+    section = SEC_NONE;
+    inRecord = false;
+}
+
+bool ScheduleUpload::feed(const uint8_t* data, size_t len) {
+    return parser.feed(data, len);
+}
+
+bool ScheduleUpload::finish() {
+    return parser.finish();
+}
+
+const char* ScheduleUpload::errorMessage() {
+    return parser.errorMessage();
+}
+
+void ScheduleUpload::onStartArray(uint8_t depth, const char* key) {
+    if (depth != 1) return;
+    if (strcmp(key, weeklyKey) == 0) {
+        section = SEC_WEEKLY;
+        hasWeekly = true;
+        weeklyCount = 0;
+    } else if (strcmp(key, specialKey) == 0) {
+        section = SEC_SPECIAL;
+        hasSpecial = true;
+        specialCount = 0;
+    } else {
+        section = SEC_NONE;
+    }
+}
+
+void ScheduleUpload::onEndArray(uint8_t depth, const char* key) {
+    if (depth == 1) section = SEC_NONE;
+}
+
+void ScheduleUpload::onStartObject(uint8_t depth, const char* key) {
+    if (depth != 2) return;
+    inRecord = false;
+    if (section == SEC_WEEKLY && weeklyCount < MAX_WEEKLY_SCHEDULES) {
+        WeeklySchedule& e = weekly[weeklyCount];
+        memset(&e, 0, sizeof(e));
+        e.id = weeklyCount + 1;
+        e.isActive = true;
+        inRecord = true;
+    } else if (section == SEC_SPECIAL && specialCount < MAX_SPECIAL_EVENTS) {
+        SpecialEvent& e = special[specialCount];
+        memset(&e, 0, sizeof(e));
+        e.id = specialCount + 1;
+        e.type = EVENTO_PERSONALIZZATO;
+        e.isActive = true;
+        inRecord = true;
+    }
+}
+
+void ScheduleUpload::onEndObject(uint8_t depth, const char* key) {
+    if (depth != 2 || !inRecord) return;
+    if (section == SEC_WEEKLY) weeklyCount++;
+    else if (section == SEC_SPECIAL) specialCount++;
+    inRecord = false;
+}
+
+void ScheduleUpload::onValue(uint8_t depth, const char* key, JsonValueType type, const char* text) {
+    if (nameTooLong(key, type, text)) { parser.abort(UPLOAD_NAME_ERROR); return; }
+    if (depth != 3 || !inRecord) return;
+    if (section == SEC_WEEKLY) applyWeeklyField(weekly[weeklyCount], key, type, text);
+    else if (section == SEC_SPECIAL) applySpecialField(special[specialCount], key, type, text);
+}
+
+// ========== RECORD SINGOLO ==========
+// Profondità: campi radice 1
+
+struct RecordFieldName {
+    const char* key;
+    uint16_t field;
+};
+
+static const RecordFieldName RECORD_FIELDS[] = {
+    { "id", REC_ID }, { "name", REC_NAME }, { "dayOfWeek", REC_DAY_OF_WEEK },
+    { "hour", REC_HOUR }, { "minute", REC_MINUTE }, { "melodyIndex", REC_MELODY },
+    { "isActive", REC_ACTIVE }, { "type", REC_TYPE }, { "year", REC_YEAR },
+    { "month", REC_MONTH }, { "day", REC_DAY }, { "isRecurring", REC_RECURRING }
+};
+
+void RecordStaging::reset() {
+    memset(&weekly, 0, sizeof(weekly));
+    weekly.isActive = true;
+    memset(&special, 0, sizeof(special));
+    special.type = EVENTO_PERSONALIZZATO;
+    special.isActive = true;
+    fields = 0;
+}
+
+bool RecordStaging::apply(const char* key, JsonValueType type, const char* text) {
+    for (size_t i = 0; i < sizeof(RECORD_FIELDS) / sizeof(RECORD_FIELDS[0]); i++) {
+        if (strcmp(key, RECORD_FIELDS[i].key) != 0) continue;
+        // Il nome conta solo se è una stringa (come in applyName)
+        if (RECORD_FIELDS[i].field == REC_NAME && type != JSON_STRING) return true;
+        fields |= RECORD_FIELDS[i].field;
+        applyWeeklyField(weekly, key, type, text);
+        applySpecialField(special, key, type, text);
+        return true;
+    }
+    return false;
+}
+
+void RecordStaging::mergeInto(WeeklySchedule& e) const {
+    if (has(REC_NAME)) strlcpy(e.name, weekly.name, sizeof(e.name));
+    if (has(REC_DAY_OF_WEEK)) e.dayOfWeek = weekly.dayOfWeek;
+    if (has(REC_HOUR)) e.hour = weekly.hour;
+    if (has(REC_MINUTE)) e.minute = weekly.minute;
+    if (has(REC_MELODY)) e.melodyIndex = weekly.melodyIndex;
+    if (has(REC_ACTIVE)) e.isActive = weekly.isActive;
+}
+
+void RecordStaging::mergeInto(SpecialEvent& e) const {
+    if (has(REC_NAME)) strlcpy(e.name, special.name, sizeof(e.name));
+    if (has(REC_TYPE)) e.type = special.type;
+    if (has(REC_YEAR)) e.year = special.year;
+    if (has(REC_MONTH)) e.month = special.month;
+    if (has(REC_DAY)) e.day = special.day;
+    if (has(REC_HOUR)) e.hour = special.hour;
+    if (has(REC_MINUTE)) e.minute = special.minute;
+    if (has(REC_MELODY)) e.melodyIndex = special.melodyIndex;
+    if (has(REC_ACTIVE)) e.isActive = special.isActive;
+    if (has(REC_RECURRING)) e.isRecurring = special.isRecurring;
+}
+
+RecordUpload::RecordUpload() : parser(this) {
+    record.reset();
+}
+
+bool RecordUpload::feed(const uint8_t* data, size_t len) {
+    return parser.feed(data, len);
+}
+
+bool RecordUpload::finish() {
+    return parser.finish();
+}
+
+const char* RecordUpload::errorMessage() {
+    return parser.errorMessage();
+}
+
+void RecordUpload::onValue(uint8_t depth, const char* key, JsonValueType type, const char* text) {
+    if (nameTooLong(key, type, text)) { parser.abort(UPLOAD_NAME_ERROR); return; }
+    if (depth == 1) record.apply(key, type, text);
+}
+
+// ========== BATCH ==========
+// Profondità: array "ops" 1, operazione 2, campi 3, array "notes" 3, nota 4, campi nota 5.
+// Il campo "op" può comparire dopo gli altri: nome e note finiscono sempre nel
+// prossimo slot melodia libero, che viene tenuto solo se l'operazione è una melodia.
+
+static const char* const BATCH_OP_NAMES[] = {
+    "",
+    "add-weekly-schedule", "update-weekly-schedule", "toggle-weekly-schedule", "delete-weekly-schedule",
+    "add-special-event", "update-special-event", "toggle-special-event", "delete-special-event",
+    "save-melody", "update-melody", "delete-melody",
+    "set-time"
+};
+
+const char* BatchUpload::opName(uint8_t kind) {
+    return kind < sizeof(BATCH_OP_NAMES) / sizeof(BATCH_OP_NAMES[0]) ? BATCH_OP_NAMES[kind] : "";
+}
+
+BatchUpload::BatchUpload() : parser(this) {
+    opCount = 0;
+    hasOps = false;
+    overflow = false;
+    melodyCount = 0;
+    dateTime[0] = '\0';
+    resetNote(note);
+    inOps = false;
+    inOp = false;
+    inNotes = false;
+    melodyUsed = false;
+}
+
+bool BatchUpload::feed(const uint8_t* data, size_t len) {
+    return parser.feed(data, len);
+}
+
+bool BatchUpload::finish() {
+    return parser.finish();
+}
+
+const char* BatchUpload::errorMessage() {
+    return parser.errorMessage();
+}
+
+void BatchUpload::onStartArray(uint8_t depth, const char* key) {
+    if (depth == 1 && strcmp(key, "ops") == 0) {
+        inOps = true;
+        hasOps = true;
+    } else if (inOp && depth == 3 && strcmp(key, "notes") == 0) {
+        if (melodyCount >= BATCH_MAX_MELODIES) return;
+        MelodyStaging& m = melodies[melodyCount];
+        if (!melodyUsed) { resetMelodyStaging(m); melodyUsed = true; }
+        m.hasNotes = true;
+        m.noteCount = 0;
+        m.notesSeen = 0;
+        inNotes = true;
+    }
+}
+
+void BatchUpload::onEndArray(uint8_t depth, const char* key) {
+    if (depth == 1) inOps = false;
+    else if (depth == 3) inNotes = false;
+}
+
+void BatchUpload::onStartObject(uint8_t depth, const char* key) {
+    if (inOps && depth == 2) {
+        if (opCount >= BATCH_MAX_OPS) { overflow = true; return; }
+        BatchOp& op = ops[opCount];
+        op.kind = BATCH_UNKNOWN;
+        op.record.reset();
+        op.index = -1;
+        op.melody = -1;
+        inOp = true;
+        melodyUsed = false;
+    } else if (inNotes && depth == 4) {
+        resetNote(note);
+    }
+}
+
+void BatchUpload::onEndObject(uint8_t depth, const char* key) {
+    if (inNotes && depth == 4) {
+        commitNote(melodies[melodyCount], note);
+    } else if (inOp && depth == 2) {
+        BatchOp& op = ops[opCount];
+        if (op.kind == BATCH_SAVE_MELODY || op.kind == BATCH_UPDATE_MELODY) {
+            if (melodyCount >= BATCH_MAX_MELODIES) {
+                overflow = true;
+            } else {
+                if (!melodyUsed) resetMelodyStaging(melodies[melodyCount]);
+                op.melody = (int8_t)melodyCount++;
+            }
+        }
+        opCount++;
+        inOp = false;
+        inNotes = false;
+    }
+}
+
+void BatchUpload::onValue(uint8_t depth, const char* key, JsonValueType type, const char* text) {
+    if (nameTooLong(key, type, text)) { parser.abort(UPLOAD_NAME_ERROR); return; }
+    if (!inOp) return;
+    if (inNotes && depth == 5) { applyNoteField(note, key, type, text); return; }
+    if (depth != 3) return;
+    BatchOp& op = ops[opCount];
+    if (strcmp(key, "op") == 0) {
+        op.kind = BATCH_UNKNOWN;
+        if (type != JSON_STRING) return;
+        for (uint8_t k = BATCH_ADD_WEEKLY; k < sizeof(BATCH_OP_NAMES) / sizeof(BATCH_OP_NAMES[0]); k++) {
+            if (strcmp(text, BATCH_OP_NAMES[k]) == 0) { op.kind = k; break; }
+        }
+    } else if (strcmp(key, "index") == 0) {
+        long idx = toLong(type, text, -1);
+        op.index = (idx >= 0 && idx < MAX_MELODIES) ? (int16_t)idx : -1;
+    } else if (strcmp(key, "dateTime") == 0) {
+        if (type == JSON_STRING) strlcpy(dateTime, text, sizeof(dateTime));
+    } else {
+        op.record.apply(key, type, text);
+        if (strcmp(key, "name") == 0 && type == JSON_STRING && melodyCount < BATCH_MAX_MELODIES) {
+            MelodyStaging& m = melodies[melodyCount];
+            if (!melodyUsed) { resetMelodyStaging(m); melodyUsed = true; }
+            strlcpy(m.name, text, sizeof(m.name));
+            m.hasName = true;
+        }
+    }
+}
+
+// ========== RESTORE ==========
+// Melodie: array 1, melodia 2, campi melodia 3, array "notes" 3, nota 4, campi nota 5
+// Eliminazioni (delta): oggetto "deleted" 1, array per tabella 2, id 3
+
+RestoreUpload::RestoreUpload() : ScheduleUpload("weekly", "special") {
+    melodyCount = 0;
+    hasMelodies = false;
+    inMelody = false;
+    inNotes = false;
+    resetNote(note);
+    delta = false;
+    deletedMelodyCount = 0;
+    deletedWeeklyCount = 0;
+    deletedSpecialCount = 0;
+    inDeleted = false;
+    deletedTable = 0xFF;
+}
+
+void RestoreUpload::onStartArray(uint8_t depth, const char* key) {
+    if (inDeleted) {
+        if (depth != 2) return;
+        if (strcmp(key, "melodies") == 0) deletedTable = CFG_TABLE_MELODIES;
+        else if (strcmp(key, "weekly") == 0) deletedTable = CFG_TABLE_WEEKLY;
+        else if (strcmp(key, "special") == 0) deletedTable = CFG_TABLE_SPECIAL;
+        else deletedTable = 0xFF;
+        return;
+    }
+    if (depth == 1 && strcmp(key, "melodies") == 0) {
+        section = SEC_MELODIES;
+        hasMelodies = true;
+        melodyCount = 0;
+        return;
+    }
+    if (section == SEC_MELODIES) {
+        if (inMelody && depth == 3 && strcmp(key, "notes") == 0) {
+            inNotes = true;
+            melodies[melodyCount].hasNotes = true;
+        }
+        return;
+    }
+    ScheduleUpload::onStartArray(depth, key);
+}
+
+void RestoreUpload::onEndArray(uint8_t depth, const char* key) {
+    if (inDeleted) { if (depth == 2) deletedTable = 0xFF; return; }
+    if (section == SEC_MELODIES && depth == 3) inNotes = false;
+    ScheduleUpload::onEndArray(depth, key);
+}
+
+void RestoreUpload::onStartObject(uint8_t depth, const char* key) {
+    if (depth == 1 && strcmp(key, "deleted") == 0) { inDeleted = true; return; }
+    if (section != SEC_MELODIES) { ScheduleUpload::onStartObject(depth, key); return; }
+    if (depth == 2 && melodyCount < MAX_MELODIES) {
+        resetMelodyStaging(melodies[melodyCount]);
+        melodyIds[melodyCount] = -1;
+        inMelody = true;
+    } else if (inNotes && depth == 4) {
+        resetNote(note);
+    }
+}
+
+void RestoreUpload::onEndObject(uint8_t depth, const char* key) {
+    if (inDeleted) { if (depth == 1) inDeleted = false; return; }
+    if (section != SEC_MELODIES) { ScheduleUpload::onEndObject(depth, key); return; }
+    if (inNotes && depth == 4) {
+        commitNote(melodies[melodyCount], note);
+    } else if (inMelody && depth == 2) {
+        // Come in passato, le melodie senza note valide vengono ignorate
+        if (melodies[melodyCount].noteCount > 0) melodyCount++;
+        inMelody = false;
+        inNotes = false;
+    }
+}
+
+void RestoreUpload::onValue(uint8_t depth, const char* key, JsonValueType type, const char* text) {
+    if (nameTooLong(key, type, text)) { parser.abort(UPLOAD_NAME_ERROR); return; }
+    if (depth == 1 && strcmp(key, "delta") == 0) { delta = toBool(type, text, false); return; }
+    if (inDeleted) {
+        long id = toLong(type, text, -1);
+        if (depth != 3 || id < 0 || id > 255) return;
+        if (deletedTable == CFG_TABLE_MELODIES && id < MAX_MELODIES && deletedMelodyCount < MAX_MELODIES) {
+            deletedMelodies[deletedMelodyCount++] = (uint8_t)id;
+        } else if (deletedTable == CFG_TABLE_WEEKLY && deletedWeeklyCount < MAX_WEEKLY_SCHEDULES) {
+            deletedWeekly[deletedWeeklyCount++] = (uint8_t)id;
+        } else if (deletedTable == CFG_TABLE_SPECIAL && deletedSpecialCount < MAX_SPECIAL_EVENTS) {
+            deletedSpecial[deletedSpecialCount++] = (uint8_t)id;
+        }
+        return;
+    }
+    if (section != SEC_MELODIES) { ScheduleUpload::onValue(depth, key, type, text); return; }
+    if (!inMelody) return;
+    MelodyStaging& m = melodies[melodyCount];
+    if (depth == 3) {
+        if (strcmp(key, "name") == 0 && type == JSON_STRING) {
+            strlcpy(m.name, text, sizeof(m.name));
+            m.hasName = true;
+        } else if (strcmp(key, "id") == 0) {
+            long id = toLong(type, text, -1);
+            melodyIds[melodyCount] = (id >= 0 && id < MAX_MELODIES) ? (int8_t)id : -1;
+        }
+    } else if (inNotes && depth == 5) {
+        applyNoteField(note, key, type, text);
+    }
+}
@@ -0,0 +1,99 @@
+#include "include/heap_monitor.h"
+#include "include/logger.h"
+
+HeapMonitor heapMonitor;
+
+HeapMonitor::HeapMonitor()
+    : freeHeap(0), largestBlock(0), minFreeHeap(0), minLargestBlock(UINT32_MAX),
+      fragmentation(0), peakFragmentation(0), heapAlarm(false), stackAlarm(false),
+      alarms(0), lastSampleMs(0), lastStackMs(0), taskCount(0) {
+    memset(tasks, 0, sizeof(tasks));
+}
+
+void HeapMonitor::watchTask(const char* name) {
+    if (taskCount >= HEAP_MAX_TASKS) return;
+    TaskStackInfo& t = tasks[taskCount++];
+    t.name = name;
+    t.handle = nullptr;
+    t.minFree = UINT32_MAX;
+}
+
+void HeapMonitor::update() {
+    uint32_t now = millis();
+    if (lastSampleMs != 0 && now - lastSampleMs < HEAP_SAMPLE_MS) return;
+    lastSampleMs = now;
+
+    freeHeap = ESP.getFreeHeap();
+    largestBlock = ESP.getMaxAllocHeap();
+    minFreeHeap = ESP.getMinFreeHeap();
+    if (largestBlock < minLargestBlock) minLargestBlock = largestBlock;
+    fragmentation = freeHeap ? 100 - (uint8_t)((uint64_t)largestBlock * 100 / freeHeap) : 0;
+    if (fragmentation > peakFragmentation) peakFragmentation = fragmentation;
+
+    if (!heapAlarm && (freeHeap < HEAP_ALARM_FREE || largestBlock < HEAP_ALARM_BLOCK)) {
+        heapAlarm = true;
+        alarms++;
+        LOGW(LOG_SYS, "Memoria bassa: libero %u, blocco max %u, frammentazione %u%%",
+             (unsigned)freeHeap, (unsigned)largestBlock, fragmentation);
+    } else if (heapAlarm && freeHeap >= HEAP_ALARM_FREE + HEAP_ALARM_HYSTERESIS &&
+               largestBlock >= HEAP_ALARM_BLOCK + HEAP_ALARM_HYSTERESIS) {
+        heapAlarm = false;
+        LOGI(LOG_SYS, "Memoria rientrata: libero %u, blocco max %u", (unsigned)freeHeap, (unsigned)largestBlock);
+    }
+
+    if (lastStackMs == 0 || now - lastStackMs >= HEAP_STACK_SAMPLE_MS) {
+        lastStackMs = now;
+        sampleStacks();
+    }
+}
+
+// Il margine di uno stack può solo scendere: l'allarme resta fino al riavvio
+void HeapMonitor::sampleStacks() {
+    for (uint8_t i = 0; i < taskCount; i++) {
+        TaskStackInfo& t = tasks[i];
+        if (!t.handle) t.handle = xTaskGetHandle(t.name);
+        if (!t.handle) continue;
+        uint32_t free = uxTaskGetStackHighWaterMark(t.handle);      // Byte su ESP32
+        if (free >= t.minFree) continue;
+        t.minFree = free;
+        if (free < HEAP_ALARM_STACK) {
+            if (!stackAlarm) alarms++;
+            stackAlarm = true;
+            LOGW(LOG_SYS, "Stack del task %s quasi esaurito: %u byte liberi", t.name, (unsigned)free);
+        }
+    }
+}
+
+void HeapMonitor::print(Print& out) {
+    out.printf("{\"free\":%u,\"largestBlock\":%u,\"minFree\":%u,\"minLargestBlock\":%u,",
+               (unsigned)freeHeap, (unsigned)largestBlock, (unsigned)minFreeHeap,
+               (unsigned)(minLargestBlock == UINT32_MAX ? 0 : minLargestBlock));
+    out.printf("\"fragmentation\":%u,\"peakFragmentation\":%u,", fragmentation, peakFragmentation);
+    out.printf("\"alarm\":{\"heap\":%s,\"stack\":%s,\"count\":%u,\"freeBelow\":%u,\"blockBelow\":%u,\"stackBelow\":%u},",
+               heapAlarm ? "true" : "false", stackAlarm ? "true" : "false", (unsigned)alarms,
+               HEAP_ALARM_FREE, HEAP_ALARM_BLOCK, HEAP_ALARM_STACK);
+    out.print("\"stacks\":[");
+    bool first = true;
+    for (uint8_t i = 0; i < taskCount; i++) {
+        const TaskStackInfo& t = tasks[i];
+        if (t.minFree == UINT32_MAX) continue;
+        out.printf("%s{\"task\":\"%s\",\"minFree\":%u}", first ? "" : ",", t.name, (unsigned)t.minFree);
+        first = false;
+    }
+    out.print("]}");
+}
+
+void HeapMonitor::printSummary(Print& out) {
+    out.println("=== MEMORIA ===");
+    out.printf("Heap libero: %u (minimo %u)\n", (unsigned)freeHeap, (unsigned)minFreeHeap);
+    out.printf("Blocco più grande: %u (minimo %u)\n", (unsigned)largestBlock,
+               (unsigned)(minLargestBlock == UINT32_MAX ? 0 : minLargestBlock));
+    out.printf("Frammentazione: %u%% (picco %u%%)\n", fragmentation, peakFragmentation);
+    out.printf("Allarme: %s (%u dall'avvio)\n",
+               heapAlarm ? "HEAP" : (stackAlarm ? "STACK" : "no"), (unsigned)alarms);
+    for (uint8_t i = 0; i < taskCount; i++) {
+        const TaskStackInfo& t = tasks[i];
+        if (t.minFree == UINT32_MAX) out.printf("  stack %-10s -\n", t.name);
+        else out.printf("  stack %-10s %u byte mai usati\n", t.name, (unsigned)t.minFree);
+    }
+}
@@ -0,0 +1,335 @@
+#include "include/history_log.h"
+#include "include/logger.h"
+#include <time.h>
+
+HistoryLog historyLog;
+
+static const uint8_t HISTORY_PARTITION_SUBTYPE = 0x40;
+
+HistoryLog::HistoryLog() {
+    partition = nullptr;
+    sectorCount = 0;
+    writeSector = 0;
+    writeSlot = 0;
+    nextSeq = 1;
+    sectorReady = false;
+    queueHead = 0;
+    queueCount = 0;
+    dropped = 0;
+    queueMux = portMUX_INITIALIZER_UNLOCKED;
+}
+
+uint16_t HistoryLog::computeCheck(const HistoryRecord& r) {
+    uint32_t h = fnv1a32(&r, offsetof(HistoryRecord, check));
+    return (uint16_t)(h ^ (h >> 16));
+}
+
+bool HistoryLog::readRecord(uint32_t sector, uint32_t slot, HistoryRecord& out) {
+    size_t offset = sector * HISTORY_SECTOR_SIZE + slot * sizeof(HistoryRecord);
+    return esp_partition_read(partition, offset, &out, sizeof(out)) == ESP_OK;
+}
+
+bool HistoryLog::readSectorFirstSeq(uint32_t sector, uint32_t& seq) {
+    HistoryRecord r;
+    if (!readRecord(sector, 0, r)) return false;
+    if (r.seq == 0xFFFFFFFF || r.check != computeCheck(r)) return false;
+    seq = r.seq;
+    return true;
+}
+
+bool HistoryLog::begin() {
+    partition = esp_partition_find_first(ESP_PARTITION_TYPE_DATA,
+                                         (esp_partition_subtype_t)HISTORY_PARTITION_SUBTYPE, "history");
+    if (!partition) {
+        LOGW(LOG_SYS, "HistoryLog: partizione 'history' non trovata (controlla partitions.csv)");
+        return false;
+    }
+    sectorCount = partition->size / HISTORY_SECTOR_SIZE;
+
+    // Il settore di scrittura è quello con il primo seq più alto
+    bool found = false;
+    uint32_t bestSeq = 0;
+    for (uint32_t s = 0; s < sectorCount; s++) {
+        uint32_t seq;
+        if (readSectorFirstSeq(s, seq) && (!found || seq > bestSeq)) {
+            found = true;
+            bestSeq = seq;
+            writeSector = s;
+        }
+    }
+    if (!found) {
+        writeSector = 0;
+        writeSlot = 0;
+        nextSeq = 1;
+        sectorReady = false;
+        LOGI(LOG_SYS, "HistoryLog: registro vuoto (%u record disponibili)", (unsigned)getCapacity());
+        return true;
+    }
+
+    // Primo slot libero nel settore corrente; i record troncati vengono saltati
+    uint32_t lastSeq = bestSeq;
+    writeSlot = RECORDS_PER_SECTOR;
+    for (uint32_t slot = 0; slot < RECORDS_PER_SECTOR; slot++) {
+        HistoryRecord r;
+        if (!readRecord(writeSector, slot, r)) break;
+        if (r.seq == 0xFFFFFFFF) { writeSlot = slot; break; }
+        if (r.check == computeCheck(r)) lastSeq = r.seq;
+    }
+    nextSeq = lastSeq + 1;
+    sectorReady = true;
+    LOGI(LOG_SYS, "HistoryLog: ripreso da seq %u (settore %u, slot %u)",
+                  (unsigned)nextSeq, (unsigned)writeSector, (unsigned)writeSlot);
+    return true;
+}
+
+bool HistoryLog::isAvailable() {
+    return partition != nullptr;
+}
+
+bool HistoryLog::append(uint8_t type, uint8_t source, uint8_t melody, uint8_t ref, uint16_t arg) {
+    HistoryRecord r;
+    time_t now = time(nullptr);
+    if (now > 1000000000) {
+        r.epoch = (uint32_t)now;
+    } else {
+        // Ora non ancora valida: salva i secondi dall'avvio
+        r.epoch = millis() / 1000;
+        type |= HISTORY_UPTIME_FLAG;
+    }
+    r.seq = 0;
+    r.type = type;
+    r.source = source;
+    r.melody = melody;
+    r.ref = ref;
+    r.arg = arg;
+    r.check = 0;
+
+    bool ok = true;
+    portENTER_CRITICAL(&queueMux);
+    if (queueCount >= HISTORY_QUEUE_SIZE) {
+        dropped++;
+        ok = false;
+    } else {
+        queue[(queueHead + queueCount) % HISTORY_QUEUE_SIZE] = r;
+        queueCount++;
+    }
+    portEXIT_CRITICAL(&queueMux);
+    return ok;
+}
+
+void HistoryLog::service(bool busy) {
+    if (!partition) return;
+    while (true) {
+        HistoryRecord r;
+        bool pending = false;
+        portENTER_CRITICAL(&queueMux);
+        if (queueCount > 0) {
+            r = queue[queueHead];
+            pending = true;
+        }
+        portEXIT_CRITICAL(&queueMux);
+        if (!pending) return;
+
+        // Settore pieno: passa al successivo (il più vecchio) che andrà cancellato
+        if (writeSlot >= RECORDS_PER_SECTOR) {
+            if (busy) return;
+            writeSector = (writeSector + 1) % sectorCount;
+            writeSlot = 0;
+            sectorReady = false;
+        }
+        if (!sectorReady) {
+            if (busy) return;
+            if (esp_partition_erase_range(partition, writeSector * HISTORY_SECTOR_SIZE, HISTORY_SECTOR_SIZE) != ESP_OK) {
+                LOGE(LOG_SYS, "HistoryLog: cancellazione settore fallita");
+                return;
+            }
+            sectorReady = true;
+        }
+
+        r.seq = nextSeq;
+        r.check = computeCheck(r);
+        size_t offset = writeSector * HISTORY_SECTOR_SIZE + writeSlot * sizeof(HistoryRecord);
+        // Lo slot è consumato comunque (può contenere dati parziali, scartati dal
+        // check in lettura); il seq avanza solo se il record è davvero salvato
+        bool written = esp_partition_write(partition, offset, &r, sizeof(r)) == ESP_OK;
+        writeSlot++;
+        if (written) {
+            nextSeq++;
+        } else {
+            LOGE(LOG_SYS, "HistoryLog: scrittura fallita (settore %u, slot %u), evento perso",
+                          (unsigned)writeSector, (unsigned)(writeSlot - 1));
+        }
+
+        portENTER_CRITICAL(&queueMux);
+        queueHead = (queueHead + 1) % HISTORY_QUEUE_SIZE;
+        queueCount--;
+        if (!written) dropped++;
+        portEXIT_CRITICAL(&queueMux);
+    }
+}
+
+bool HistoryLog::seek(uint32_t since, uint32_t& sector, uint32_t& slot) {
+    if (!partition) return false;
+    // Settore con il primo seq più alto che non supera since+1; se since è più
+    // vecchio di tutto il registro si parte dal settore più vecchio.
+    bool foundBefore = false, foundAny = false;
+    uint32_t bestSeq = 0, oldestSeq = 0;
+    uint32_t bestSector = 0, oldestSector = 0;
+    for (uint32_t s = 0; s < sectorCount; s++) {
+        uint32_t first;
+        if (!readSectorFirstSeq(s, first)) continue;
+        if (!foundAny || first < oldestSeq) { oldestSeq = first; oldestSector = s; }
+        foundAny = true;
+        if (first <= since + 1 && (!foundBefore || first > bestSeq)) {
+            foundBefore = true;
+            bestSeq = first;
+            bestSector = s;
+        }
+    }
+    if (!foundAny) return false;
+    if (!foundBefore) {
+        sector = oldestSector;
+        slot = 0;
+        return true;
+    }
+    sector = bestSector;
+    // Stima per difetto: i record troncati spostano i successivi in avanti
+    uint32_t offset = since + 1 - bestSeq;
+    slot = offset < RECORDS_PER_SECTOR ? offset : RECORDS_PER_SECTOR - 1;
+    return true;
+}
+
+bool HistoryLog::readNext(uint32_t& sector, uint32_t& slot, uint32_t expectedSeq, HistoryRecord& out) {
+    if (!partition) return false;
+    for (uint32_t guard = 0; guard < RECORDS_PER_SECTOR * sectorCount; guard++) {
+        if (slot >= RECORDS_PER_SECTOR) {
+            slot = 0;
+            sector = (sector + 1) % sectorCount;
+        }
+        HistoryRecord r;
+        if (!readRecord(sector, slot, r)) return false;
+        if (r.seq == 0xFFFFFFFF) return false;          // fine dei dati scritti
+        slot++;
+        if (r.check != computeCheck(r)) continue;       // record troncato
+        if (r.seq < expectedSeq) {
+            // Dati più vecchi: o siamo tornati all'inizio del ring o è un record già letto
+            if (slot == 1) return false;
+            continue;
+        }
+        out = r;
+        return true;
+    }
+    return false;
+}
+
+uint32_t HistoryLog::getNextSeq() {
+    return nextSeq;
+}
+
+uint32_t HistoryLog::getOldestSeq() {
+    if (!partition) return 0;
+    uint32_t sector, slot;
+    if (!seek(0, sector, slot)) return 0;
+    HistoryRecord r;
+    uint32_t first;
+    if (readSectorFirstSeq(sector, first)) return first;
+    return readNext(sector, slot, 0, r) ? r.seq : 0;
+}
+
+uint32_t HistoryLog::getDropped() {
+    return dropped;
+}
+
+uint32_t HistoryLog::getCapacity() {
+    return sectorCount * RECORDS_PER_SECTOR;
+}
+
+const char* HistoryLog::typeName(uint8_t type) {
+    switch (type & ~HISTORY_UPTIME_FLAG) {
+        case HIST_BOOT: return "boot";
+        case HIST_MELODY_START: return "start";
+        case HIST_MELODY_END: return "end";
+        case HIST_MELODY_STOPPED: return "stopped";
+        case HIST_SKIP_DISABLED: return "skip_disabled";
+        case HIST_SKIP_INVALID: return "skip_invalid";
+        case HIST_MISSED: return "missed";
+        case HIST_EMERGENCY_STOP: return "emergency_stop";
+        case HIST_SKIP_THERMAL: return "skip_thermal";
+        case HIST_THERMAL: return "thermal";
+        default: return "unknown";
+    }
+}
+
+const char* HistoryLog::sourceName(uint8_t source) {
+    switch (source) {
+        case HIST_SRC_SYSTEM: return "system";
+        case HIST_SRC_WEEKLY: return "weekly";
+        case HIST_SRC_SPECIAL: return "special";
+        case HIST_SRC_BUTTON: return "button";
+        case HIST_SRC_API: return "api";
+        case HIST_SRC_SERIAL: return "serial";
+        default: return "unknown";
+    }
+}
+
+HistoryJsonStream::HistoryJsonStream(uint32_t since, uint16_t limit) {
+    this->since = since;
+    lastSeq = since;
+    remaining = limit;
+    sector = 0;
+    slot = 0;
+    phase = 0;
+    first = true;
+    pendingLen = 0;
+    pendingOff = 0;
+}
+
+bool HistoryJsonStream::refill() {
+    pendingLen = 0;
+    pendingOff = 0;
+    int n = 0;
+    if (phase == 0) {
+        n = snprintf(pending, sizeof(pending), "{\"head\":%u,\"dropped\":%u,\"events\":[",
+                     (unsigned)historyLog.getNextSeq(), (unsigned)historyLog.getDropped());
+        phase = historyLog.seek(since, sector, slot) ? 1 : 2;
+    } else if (phase == 1) {
+        HistoryRecord r;
+        if (remaining == 0 || !historyLog.readNext(sector, slot, lastSeq + 1, r)) {
+            phase = 2;
+            return refill();
+        }
+        remaining--;
+        lastSeq = r.seq;
+        n = snprintf(pending, sizeof(pending),
+                     "%s{\"seq\":%u,\"%s\":%u,\"type\":\"%s\",\"source\":\"%s\"",
+                     first ? "" : ",", (unsigned)r.seq,
+                     (r.type & HISTORY_UPTIME_FLAG) ? "uptime" : "epoch", (unsigned)r.epoch,
+                     HistoryLog::typeName(r.type), HistoryLog::sourceName(r.source));
+        first = false;
+        if (r.melody != HISTORY_NONE) n += snprintf(pending + n, sizeof(pending) - n, ",\"melody\":%u", r.melody);
+        if (r.ref != HISTORY_NONE) n += snprintf(pending + n, sizeof(pending) - n, ",\"ref\":%u", r.ref);
+        if (r.arg) n += snprintf(pending + n, sizeof(pending) - n, ",\"arg\":%u", r.arg);
+        n += snprintf(pending + n, sizeof(pending) - n, "}");
+    } else if (phase == 2) {
+        // "next" va passato come since per la pagina successiva
+        n = snprintf(pending, sizeof(pending), "],\"next\":%u}", (unsigned)lastSeq);
+        phase = 3;
+    } else {
+        return false;
+    }
+    pendingLen = (n < (int)sizeof(pending)) ? n : sizeof(pending) - 1;
+    return true;
+}
+
+size_t HistoryJsonStream::fill(uint8_t* buf, size_t maxLen) {
+    size_t out = 0;
+    while (out < maxLen) {
+        if (pendingOff >= pendingLen && !refill()) break;
+        size_t chunk = pendingLen - pendingOff;
+        if (chunk > maxLen - out) chunk = maxLen - out;
+        memcpy(buf + out, pending + pendingOff, chunk);
+        pendingOff += chunk;
+        out += chunk;
+    }
+    return out;
+}
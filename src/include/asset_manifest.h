@@ -0,0 +1,46 @@
+#ifndef ASSET_MANIFEST_H
+#define ASSET_MANIFEST_H
+
+#include "config.h"
+#include <ESPAsyncWebServer.h>
+
+// Manifest delle risorse web generato da scripts/build_assets.py (/assets.txt).
+// Caricato in RAM all'avvio: per servire una risorsa basta una ricerca in
+// tabella, senza exists() su SPIFFS. Le risorse con l'hash nel nome sono
+// immutabili (cache di un anno), la pagina principale si rivalida con l'ETag.
+
+#define ASSET_MAX 16
+#define ASSET_MANIFEST_FS "/assets.txt"
+
+#define ASSET_FLAG_IMMUTABLE 0x01       // URL con hash del contenuto
+#define ASSET_FLAG_GZIP 0x02            // File salvato compresso
+
+struct AssetEntry {
+    char url[32];
+    char file[32];                      // Percorso su SPIFFS
+    char etag[12];                      // "<hash>" con virgolette
+    uint8_t flags;
+};
+
+class AssetManifest {
+private:
+    AssetEntry entries[ASSET_MAX];
+    uint8_t count;
+
+public:
+    AssetManifest();
+    // Legge /assets.txt; false se manca (immagine caricata senza lo script di build)
+    bool begin();
+    bool isLoaded();
+
+    // "/" equivale a "/index.html"; nullptr se l'URL non è nel manifest
+    const AssetEntry* find(const String& url);
+    // Risponde con la risorsa (304 se l'ETag coincide)
+    void serve(AsyncWebServerRequest* request, const AssetEntry* asset);
+
+    static const char* contentType(const char* url);
+};
+
+extern AssetManifest assetManifest;
+
+#endif
@@ -2,14 +2,48 @@
 #define BELL_CONTROLLER_H
 
 #include "config.h"
+#include "history_log.h"
+#include <freertos/FreeRTOS.h>
 
+// Melodie ammesse dalla protezione termica
+enum BellPlayLimit {
+    BELL_PLAY_ALL = 0,
+    BELL_PLAY_CRITICAL,         // Solo programmazioni, eventi speciali e pulsanti
+    BELL_PLAY_NONE              // Arresto termico
+};
+
+// Stato di riproduzione e impulso relè: avanzato dal loop (update(), core 1),
+// avviato e fermato anche dagli handler web (task AsyncTCP, core 0). Letto e
+// scritto solo sotto mux; dentro la sezione critica solo copie e GPIO, mentre
+// log, registro eventi e statistiche si fanno dopo averla lasciata.
 class BellController {
 private:
+    portMUX_TYPE mux;
     bool isPlaying;
     uint32_t lastNoteTime;
     uint8_t currentNoteIndex;
     uint8_t currentMelodyIndex;
+    BellMelody playing;         // Copia della melodia in riproduzione
     bool testMode;
+    uint8_t playSource;         // Origine della melodia in corso (HistorySource)
+    uint8_t playRef;            // id programmazione/evento, se applicabile
+    uint8_t playLimit;          // BellPlayLimit
+
+    // Impulso relè in corso (rilasciato da update() in modo non bloccante)
+    bool pulseActive;
+    uint8_t pulseBell;
+    uint32_t pulseStart;
+    uint16_t pulseDuration;
+    bool relayOn[BELL_COUNT];
+    uint32_t relayOnSince[BELL_COUNT];  // Per il tempo cumulativo relè attivo
+
+    // Con mux tenuto
+    static bool pulseAllowed(uint8_t bellNumber, uint16_t duration, bool test);
+    void startPulseLocked(uint8_t bellNumber, uint16_t duration, uint32_t now);
+    void releaseRelaysLocked(uint32_t now, uint32_t onMs[BELL_COUNT]);
+    // Fuori dal mux
+    void recordStrike(uint8_t bellNumber, uint16_t duration, uint32_t now);
+    static void recordRelayTimes(const uint32_t onMs[BELL_COUNT]);
 
 public:
     BellController();
@@ -19,18 +53,22 @@ public:
     
     // Controllo campane
     void ringBell(uint8_t bellNumber, uint16_t duration);
-    void playMelody(uint8_t melodyIndex);
+    void playMelody(uint8_t melodyIndex, uint8_t source = HIST_SRC_API, uint8_t ref = HISTORY_NONE);
     void stopMelody();
     bool isPlayingMelody();
+    // Melodia o impulso relè in corso (servono i tempi al millisecondo)
+    bool isBusy();
     
     // Test
     void testBell(uint8_t bellNumber);
     void enableTestMode(bool enable);
     
     // Gestione melodie
-    bool addMelody(const char* name, BellNote* notes, uint8_t noteCount);
+    bool addMelody(const char* name, const BellNote* notes, uint8_t noteCount);
     bool deleteMelody(uint8_t index);
-    bool updateMelody(uint8_t index, const char* name, BellNote* notes, uint8_t noteCount);
+    bool updateMelody(uint8_t index, const char* name, const BellNote* notes, uint8_t noteCount);
+    // Melodia modificata in una transazione già pubblicata: riparte se è in riproduzione
+    void melodyChanged(uint8_t index);
     void loadDefaultMelodies();  // Carica melodie predefinite
     
     // Getters per API
@@ -44,7 +82,10 @@ public:
     void update();
     
     // Sicurezza
-    void emergencyStop();
+    void emergencyStop(uint8_t source = HIST_SRC_API);
+    // Protezione termica: le melodie non ammesse vengono rifiutate (e registrate)
+    void setPlayLimit(uint8_t limit) { playLimit = limit; }
+    bool allowsSource(uint8_t source);
     void setEnabled(bool enabled);
     bool isEnabled();
     
@@ -0,0 +1,63 @@
+#ifndef BELL_STATS_H
+#define BELL_STATS_H
+
+#include "config.h"
+#include <freertos/FreeRTOS.h>
+
+// Contatori persistenti per la manutenzione (batacchi e relè).
+// I contatori vivono in RAM e vengono salvati su SPIFFS a lotti,
+// alternando due file (A/B) così che un salvataggio interrotto non perda i dati.
+// Aggiornati dal loop e dal task AsyncTCP (test relè, reset): accesso sotto mux.
+struct BellStatsData {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t size;
+    uint32_t sequence;                    // Numero progressivo del checkpoint
+    uint32_t bootCount;                   // Avvii del dispositivo
+    uint64_t strikes[BELL_COUNT];         // Colpi per campana
+    uint64_t relayOnMs[BELL_COUNT];       // Tempo cumulativo relè attivo (ms)
+    uint32_t melodyPlays[MAX_MELODIES];   // Esecuzioni per slot melodia
+    uint32_t checksum;                    // FNV-1a dei campi precedenti
+};
+
+class BellStats {
+private:
+    BellStatsData data;
+    bool dirty;
+    uint32_t unsavedStrikes;
+    uint32_t lastCheckpointMs;
+    uint32_t checkpointWrites;            // Scritture su flash dall'avvio
+    portMUX_TYPE mux;
+
+    uint32_t computeChecksum(const BellStatsData& d);
+    bool readSlot(const char* path, BellStatsData& out);
+
+public:
+    BellStats();
+
+    // Carica l'ultimo checkpoint valido, incrementa il contatore avvii e lo salva subito
+    void begin();
+
+    // Eventi dal BellController
+    void recordStrike(uint8_t bellNumber);
+    void recordRelayOn(uint8_t bellNumber, uint32_t ms);
+    void recordMelodyPlay(uint8_t melodyIndex);
+
+    // Checkpoint a lotti: da chiamare nel loop. Non scrive mentre 'busy' (melodia in corso).
+    void update(bool busy);
+    bool checkpoint();
+    void reset();
+
+    // Getters
+    uint64_t getStrikes(uint8_t bellNumber);
+    uint64_t getRelayOnMs(uint8_t bellNumber);
+    uint32_t getMelodyPlays(uint8_t melodyIndex);
+    uint32_t getBootCount();
+    uint32_t getCheckpointWrites();
+    uint32_t getLastCheckpointAgeMs();
+    bool isDirty();
+};
+
+extern BellStats bellStats;
+
+#endif
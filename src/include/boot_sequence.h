@@ -0,0 +1,68 @@
+#ifndef BOOT_SEQUENCE_H
+#define BOOT_SEQUENCE_H
+
+#include "config.h"
+
+// Avvio a fasi: setup() arma solo i sottosistemi locali (ora da RTC, melodie,
+// programmazioni, relè, pulsanti) e ritorna; rete e web server salgono dopo,
+// un passo per giro di loop(), senza mai bloccare le campane.
+//   LOCAL -> WEB -> WIFI -> SNTP -> READY
+// WIFI passa a SNTP alla connessione, oppure dopo BOOT_WIFI_TIMEOUT_MS
+// direttamente a READY (i tentativi proseguono in WifiManager); SNTP passa a
+// READY alla prima sincronia o dopo BOOT_SNTP_TIMEOUT_MS (la sincronia può
+// comunque arrivare più tardi: la applica serviceSntp() dal loop).
+// Per ogni traguardo si conserva il tempo dall'accensione (millis()), esposto in
+// /api/stats ("boot").
+
+#define BOOT_WIFI_TIMEOUT_MS 20000
+#define BOOT_SNTP_TIMEOUT_MS 15000
+
+enum BootPhase {
+    BOOT_LOCAL = 0,
+    BOOT_WEB,
+    BOOT_WIFI,
+    BOOT_SNTP,
+    BOOT_READY
+};
+
+enum BootMilestone {
+    BOOT_MARK_BELLS = 0,                // Campane, programmazioni e pulsanti operativi
+    BOOT_MARK_WEB,                      // Web server in ascolto
+    BOOT_MARK_WIFI,                     // Prima connessione come stazione (anche dopo READY)
+    BOOT_MARK_SNTP,                     // Prima sincronia SNTP
+    BOOT_MARK_READY,                    // Sequenza conclusa
+    BOOT_MARK_COUNT
+};
+
+class BootSequence {
+private:
+    uint8_t phase;
+    uint32_t phaseStartMs;
+    uint32_t marks[BOOT_MARK_COUNT];    // ms dall'accensione, 0 = non raggiunto
+    bool wifiFallback;                  // Conclusa senza rete (AP di recupero)
+    bool sntpTimeout;
+
+public:
+    BootSequence();
+
+    void enter(uint8_t next);
+    uint8_t getPhase() { return phase; }
+    uint32_t inPhaseMs() { return millis() - phaseStartMs; }
+    bool isReady() { return phase == BOOT_READY; }
+
+    // Registra il traguardo (solo la prima volta) e lo scrive a log
+    void mark(uint8_t milestone);
+    uint32_t getMark(uint8_t milestone);
+
+    void setWifiFallback() { wifiFallback = true; }
+    void setSntpTimeout() { sntpTimeout = true; }
+    bool isWifiFallback() { return wifiFallback; }
+    bool isSntpTimeout() { return sntpTimeout; }
+
+    static const char* phaseName(uint8_t phase);
+    static const char* markName(uint8_t milestone);
+};
+
+extern BootSequence bootSequence;
+
+#endif
@@ -0,0 +1,102 @@
+#ifndef BUTTON_SERVICE_H
+#define BUTTON_SERVICE_H
+
+#include "config.h"
+#include <esp_timer.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/queue.h>
+
+// Pulsanti fisici gestiti a interrupt:
+//  - ISR sul fronte (CHANGE): riavvia solo il timer di debounce del pulsante;
+//  - timer di debounce (esp_timer, one-shot): a BUTTON_DEBOUNCE_MS dall'ultimo
+//    rimbalzo legge il livello stabile e aggiorna lo stato del pulsante;
+//  - timer di gesto (one-shot): pressione lunga mentre il pulsante è tenuto,
+//    finestra del doppio click dopo il rilascio.
+// Gli eventi (press, long-press, double-press) finiscono in una coda che il loop
+// svuota con service(), dove vengono eseguite le azioni configurate.
+// Un pulsante senza azioni long/double emette press subito al fronte di
+// pressione; con long-press emette press al rilascio, con double-press alla
+// scadenza della finestra (BUTTON_DOUBLE_MS).
+// Con il light sleep (PowerManager) i fronti non generano interrupt: durante
+// l'attesa del loop armWake() sostituisce l'interrupt con un risveglio a livello
+// (il livello opposto a quello attuale) e disarmWake() ripristina l'interrupt,
+// avviando il debounce se il livello è cambiato nel frattempo.
+
+#define BUTTON_MAX 4
+#define BUTTON_DEBOUNCE_MS 30           // Livello stabile per questo tempo = fronte valido
+#define BUTTON_DOUBLE_MS 400            // Finestra per il secondo click
+#define BUTTON_QUEUE_SIZE 8
+
+enum ButtonEventType {
+    BUTTON_PRESS = 0,
+    BUTTON_LONG_PRESS,
+    BUTTON_DOUBLE_PRESS,
+    BUTTON_EVENT_TYPES
+};
+
+// Azione eseguita dal loop; riceve l'indice restituito da add()
+typedef void (*ButtonAction)(uint8_t button);
+
+struct ButtonConfig {
+    const char* name;
+    uint8_t pin;
+    bool activeLow;                     // true: pull-up interno, premuto = LOW
+    uint16_t longMs;                    // Durata della pressione lunga (con onLongPress)
+    ButtonAction onPress;
+    ButtonAction onLongPress;           // nullptr = nessuna pressione lunga
+    ButtonAction onDoublePress;         // nullptr = nessun doppio click (press senza attesa)
+};
+
+struct ButtonEventMsg {
+    uint8_t button;
+    uint8_t type;                       // ButtonEventType
+    uint32_t ms;                        // millis() del fronte che ha generato l'evento
+};
+
+class ButtonService {
+private:
+    struct Button {
+        ButtonConfig cfg;
+        ButtonService* owner;
+        uint8_t index;
+        esp_timer_handle_t debounce;
+        esp_timer_handle_t gesture;
+        // Stato del gesto: scritto solo dai callback dei timer (task esp_timer)
+        bool pressed;
+        bool longFired;
+        bool clickPending;
+        uint32_t edgeMs;
+    };
+
+    Button buttons[BUTTON_MAX];
+    uint8_t count;
+    QueueHandle_t queue;
+    volatile uint32_t events;
+    volatile uint32_t dropped;
+
+    static void IRAM_ATTR onEdge(void* arg);
+    static void onSettled(void* arg);
+    static void onGesture(void* arg);
+    void emit(Button& b, ButtonEventType type);
+
+public:
+    ButtonService();
+
+    // Crea la coda degli eventi (prima di add)
+    bool begin();
+    // Configura il pin, i timer e l'interrupt; restituisce l'indice o -1
+    int8_t add(const ButtonConfig& cfg);
+    // Dal loop: esegue le azioni degli eventi in coda
+    void service();
+    // Dal loop, attorno all'attesa con light sleep
+    void armWake();
+    void disarmWake();
+
+    static const char* eventName(uint8_t type);
+    uint32_t getEvents();
+    uint32_t getDropped();
+};
+
+extern ButtonService buttonService;
+
+#endif
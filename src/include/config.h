@@ -32,6 +32,18 @@
 #define MASS_BUTTON_PIN 32
 #endif
 
+// Polarità dei pulsanti (true = pull-up interno, premuto = LOW)
+#ifndef FUNERAL_BUTTON_ACTIVE_LOW
+#define FUNERAL_BUTTON_ACTIVE_LOW true
+#endif
+#ifndef MASS_BUTTON_ACTIVE_LOW
+#define MASS_BUTTON_ACTIVE_LOW true
+#endif
+#ifndef CONFIG_BUTTON_ACTIVE_LOW
+#define CONFIG_BUTTON_ACTIVE_LOW true
+#endif
+#define CONFIG_BUTTON_LONG_MS 2000      // Pressione lunga del pulsante CONFIG: access point
+
 // ========== CONFIGURAZIONE RETE ==========
 // WiFi Credentials (da modificare)
 extern const char* WIFI_SSID;
@@ -62,6 +74,7 @@ extern const char* WIFI_PASSWORD;
 // Timing
 #define DISPLAY_UPDATE_INTERVAL 1000    // Aggiornamento display (ms)
 #define SCHEDULE_CHECK_INTERVAL 30000   // Controllo programmazione (ms)
+#define MISSED_EVENT_WINDOW 120         // Minuti saltati oltre i quali non si segnalano eventi persi
 #define BELL_MIN_PULSE 100              // Durata minima impulso campana (ms)
 #define BELL_MAX_PULSE 2000             // Durata massima impulso campana (ms)
 #define BELL_MIN_DELAY 50               // Ritardo minimo tra impulsi (ms)
@@ -71,9 +84,14 @@ extern const char* WIFI_PASSWORD;
 #define MAX_WEEKLY_SCHEDULES 64         // Max programmazioni settimanali (aumentato da 20)
 #define MAX_SPECIAL_EVENTS 10           // Max eventi speciali
 #define MAX_MELODY_STEPS 120            // Max passi per melodia (aumentato per scampanio fitto)
+#define MAX_MELODIES 10                 // Slot melodie disponibili
+#define BELL_COUNT 2                    // Numero campane (relè) gestite
+
+// Statistiche campane (checkpoint su flash a lotti per limitare l'usura)
+#define STATS_CHECKPOINT_INTERVAL 1800000UL  // Checkpoint al massimo ogni 30 minuti se ci sono modifiche
+#define STATS_CHECKPOINT_STRIKES 500         // ...oppure dopo questo numero di colpi non salvati
 
 // Monitoraggio temperatura ESP32
-#define TEMP_CHECK_INTERVAL 30000       // Controllo temperatura ogni 30 secondi
 #define TEMP_WARNING_THRESHOLD 70.0     // Soglia avviso temperatura (°C)
 #define TEMP_CRITICAL_THRESHOLD 80.0    // Soglia critica temperatura (°C)
 #define TEMP_SHUTDOWN_THRESHOLD 85.0    // Soglia spegnimento protezione (°C)
@@ -151,7 +169,7 @@ struct SystemStatus {
   uint8_t activeMelody;
   bool bellsEnabled;
   bool testMode;
-  uint16_t totalBellRings;
+  uint32_t totalBellRings;    // Colpi dall'avvio (i contatori persistenti sono in BellStats)
   
   // Monitoraggio temperatura
   float esp32Temperature;
@@ -160,9 +178,7 @@ struct SystemStatus {
 };
 
 // ========== VARIABILI GLOBALI (dichiarazioni) ==========
-extern BellMelody melodies[10];           // Max 10 melodie
-extern WeeklySchedule weeklySchedules[MAX_WEEKLY_SCHEDULES];
-extern SpecialEvent specialEvents[MAX_SPECIAL_EVENTS];
+// Melodie e programmazioni sono in ConfigStore (config_store.h)
 extern SystemStatus systemStatus;
 
 // ========== FUNZIONI UTILITY ==========
@@ -170,5 +186,6 @@ String dayOfWeekToString(DayOfWeek day);
 String eventTypeToString(EventType type);
 bool isValidTime(uint8_t hour, uint8_t minute);
 bool isValidDate(uint16_t year, uint8_t month, uint8_t day);
+uint32_t fnv1a32(const void* data, size_t len, uint32_t seed = 2166136261UL);
 
 #endif
@@ -0,0 +1,148 @@
+#ifndef CONFIG_STORE_H
+#define CONFIG_STORE_H
+
+#include "config.h"
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+
+// Tabelle di configurazione (melodie + programmazioni) come un'unica istantanea.
+// Ne esistono due copie: i lettori usano quella attiva, chi scrive prepara la
+// nuova nell'altra e la pubblica con un solo scambio di puntatore. Chi legge
+// vede quindi sempre o tutta la configurazione vecchia o tutta quella nuova.
+// L'istantanea pubblicata non viene mai modificata sul posto.
+struct ConfigTables {
+    BellMelody melodies[MAX_MELODIES];
+    WeeklySchedule weekly[MAX_WEEKLY_SCHEDULES];
+    uint8_t weeklyCount;
+    SpecialEvent special[MAX_SPECIAL_EVENTS];
+    uint8_t specialCount;
+    uint32_t generation;          // Incrementato a ogni pubblicazione
+};
+
+enum ConfigTableId {
+    CFG_TABLE_MELODIES = 0,       // key = slot
+    CFG_TABLE_WEEKLY = 1,         // key = id programmazione
+    CFG_TABLE_SPECIAL = 2         // key = id evento
+};
+
+// Journal delle modifiche a un singolo record di programmazione (/weekly.log).
+// Ogni voce contiene il record completo (o la sua eliminazione) e viene
+// riapplicata sopra /weekly.json all'avvio; oltre CONFIG_JOURNAL_MAX voci il
+// file completo viene riscritto e il journal azzerato. Le voci sono idempotenti
+// (conta l'ultima per id), quindi riapplicarle dopo una compattazione è innocuo.
+#define CONFIG_JOURNAL_MAX 32
+
+// Attesa massima perché i lettori lascino il banco da riscrivere (ms). Le letture
+// durano al più un giro dello scheduler: oltre questo tempo c'è un lettore
+// bloccato e la transazione viene rifiutata (vedi getGraceTimeouts).
+#define CONFIG_GRACE_TIMEOUT_MS 500
+
+enum ConfigJournalOp {
+    JOURNAL_UPSERT = 0,
+    JOURNAL_DELETE = 1
+};
+
+struct ConfigJournalEntry {
+    uint16_t size;                // sizeof(ConfigJournalEntry): voci di un altro firmware vengono ignorate
+    uint8_t table;                // CFG_TABLE_WEEKLY o CFG_TABLE_SPECIAL
+    uint8_t op;                   // ConfigJournalOp
+    uint8_t id;
+    uint8_t reserved[3];
+    union {
+        WeeklySchedule weekly;
+        SpecialEvent special;
+    };
+    uint32_t checksum;            // FNV-1a dei campi precedenti (voce troncata = scartata)
+};
+
+// Lettori e scrittori (stile RCU):
+//  - i lettori che scorrono le tabelle dal loop (core 1) fissano l'istantanea con
+//    ConfigSnapshot: un contatore per banco, nessun lock;
+//  - gli scrittori (handler web sul core 0, scheduler) si serializzano tra loro con
+//    un mutex; prima di riscrivere il banco non attivo aspettano che i suoi lettori
+//    abbiano finito (periodo di grazia), poi lo copiano, lo modificano e lo pubblicano.
+class ConfigStore {
+private:
+    ConfigTables banks[2];
+    ConfigTables* active;
+    ConfigTables* draft;          // Transazione aperta (nullptr se nessuna)
+    uint32_t readers[2];          // Lettori per banco (accesso atomico)
+    SemaphoreHandle_t writerLock;
+    uint32_t graceWaits;          // Transazioni che hanno dovuto attendere dei lettori
+    uint32_t graceTimeouts;       // Attese scadute (lettore bloccato)
+    uint8_t journalCount;         // Voci presenti in /weekly.log
+
+    void finishCommit();
+    bool appendJournal(const ConfigJournalEntry& e);
+    bool waitForReaders(uint8_t bank);
+
+public:
+    ConfigStore();
+
+    // Istantanea attiva, senza protezione: va bene per una lettura singola o nel
+    // task degli handler web (dove girano anche le transazioni). Per scorrere le
+    // tabelle da un altro task usare ConfigSnapshot.
+    ConfigTables* current();
+
+    // Fissa l'istantanea attiva finché non viene rilasciata (vedi ConfigSnapshot)
+    ConfigTables* acquire();
+    void release(ConfigTables* t);
+
+    // Apre una transazione: attende il turno tra gli scrittori e i lettori del banco
+    // libero, vi copia l'istantanea attiva e la restituisce. Va sempre chiusa con
+    // publish() o abortTransaction(), senza aprirne un'altra nel frattempo.
+    // Restituisce nullptr (nessuna transazione aperta) se un lettore tiene
+    // ancora il banco libero dopo CONFIG_GRACE_TIMEOUT_MS, o se il turno tra gli
+    // scrittori non arriva entro lockWait.
+    ConfigTables* beginTransaction(TickType_t lockWait = portMAX_DELAY);
+    // Scarta la transazione aperta (l'istantanea attiva resta invariata)
+    void abortTransaction();
+    // Controlla la coerenza delle tabelle; in caso di errore descrive il primo problema
+    bool validate(const ConfigTables& t, char* error, size_t len);
+    // Pubblica la bozza (scambio atomico del puntatore)
+    void publish();
+
+    // Salvataggio transazionale su SPIFFS: i file nuovi vengono scritti come .new,
+    // un marker rende definitivo il commit e poi i file vengono rinominati.
+    bool persist(const ConfigTables& t, bool melodies, bool schedules);
+    // Salva solo un record di programmazione (aggiunto/modificato o eliminato)
+    // accodandolo al journal; compatta riscrivendo le tabelle quando il journal è pieno.
+    bool persistRecord(const ConfigTables& t, uint8_t table, uint8_t id, bool deleted);
+    // Riapplica il journal alle tabelle appena caricate da /weekly.json
+    void replayJournal(ConfigTables& t);
+    // All'avvio: completa un commit interrotto o scarta i file .new orfani
+    void recover();
+
+    uint32_t getGraceWaits();
+    uint32_t getGraceTimeouts();
+};
+
+extern ConfigStore configStore;
+
+// Riferimento a un'istantanea per la durata di un blocco: finché esiste, il banco
+// non viene riutilizzato da una transazione. Non aprire transazioni mentre lo si tiene.
+class ConfigSnapshot {
+private:
+    ConfigTables* tables;
+    ConfigSnapshot(const ConfigSnapshot&);
+    ConfigSnapshot& operator=(const ConfigSnapshot&);
+
+public:
+    ConfigSnapshot() : tables(configStore.acquire()) {}
+    ~ConfigSnapshot() { release(); }
+    // Rilascio anticipato (es. prima di aprire una transazione)
+    void release() { if (tables) configStore.release(tables); tables = nullptr; }
+    // Sola lettura: l'istantanea è condivisa con gli altri task; le modifiche
+    // passano da beginTransaction()/publish()
+    const ConfigTables* operator->() const { return tables; }
+    const ConfigTables* get() const { return tables; }
+};
+
+// Persistenza dell'istantanea attiva (formato JSON invariato). Il caricamento
+// scrive direttamente nell'istantanea attiva: solo all'avvio, prima di scheduler e server.
+bool saveSchedulesToFS();
+bool loadSchedulesFromFS();
+bool saveAllMelodiesToFS();
+bool loadMelodiesFromFS();
+
+#endif
@@ -0,0 +1,82 @@
+#ifndef CONFIG_SYNC_H
+#define CONFIG_SYNC_H
+
+#include "config_store.h"
+
+// Versionamento dei record di configurazione per backup differenziali.
+// Ogni record (melodia per slot, programmazione/evento per id) ha un hash del
+// contenuto e la generazione in cui è cambiato l'ultima volta; le eliminazioni
+// restano in un ring di tombstone. I cambiamenti vengono rilevati confrontando
+// gli hash (refresh), quindi valgono per qualsiasi percorso di modifica.
+// Lo stato è salvato su /sync.bin: la generazione resta monotona tra i riavvii.
+
+#define CONFIG_SYNC_RECORDS (MAX_MELODIES + MAX_WEEKLY_SCHEDULES + MAX_SPECIAL_EVENTS)
+#define CONFIG_SYNC_TOMBSTONES 32
+
+struct ConfigRecordVersion {
+    uint8_t table;
+    uint8_t key;
+    uint16_t reserved;
+    uint32_t hash;                // FNV-1a dei campi del record
+    uint32_t gen;                 // Generazione dell'ultima modifica
+};
+
+struct ConfigTombstone {
+    uint8_t table;
+    uint8_t key;
+    uint16_t reserved;
+    uint32_t gen;                 // Generazione dell'eliminazione
+};
+
+struct ConfigSyncData {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t size;
+    uint32_t instance;            // Casuale, cambia se lo stato viene perso
+    uint32_t generation;
+    uint32_t floor;               // Delta completi solo per since >= floor
+    uint16_t recordCount;
+    uint8_t tombHead;             // Indice della tombstone più vecchia
+    uint8_t tombCount;
+    ConfigRecordVersion records[CONFIG_SYNC_RECORDS];
+    ConfigTombstone tombs[CONFIG_SYNC_TOMBSTONES];
+    uint32_t checksum;
+};
+
+class ConfigSync {
+private:
+    ConfigSyncData data;
+
+    ConfigRecordVersion* find(uint8_t table, uint8_t key);
+    void addTombstone(uint8_t table, uint8_t key, uint32_t gen);
+    uint32_t computeChecksum(const ConfigSyncData& d);
+    void resetState();
+    bool save();
+
+public:
+    ConfigSync();
+    void begin();
+
+    // Confronta gli hash con le tabelle; se qualcosa è cambiato apre una nuova
+    // generazione e salva lo stato. Restituisce la generazione corrente.
+    uint32_t refresh(const ConfigTables& t);
+
+    uint32_t getGeneration();
+    uint32_t getInstance();
+    // true se i record cambiati dopo since (tombstone incluse) sono tutti noti
+    bool canDelta(uint32_t since);
+    // Generazione e hash registrati per un record (0 se sconosciuto)
+    uint32_t recordGeneration(uint8_t table, uint8_t key);
+    uint32_t recordHash(uint8_t table, uint8_t key);
+    // Tombstone in ordine dalla più vecchia (i < tombstoneCount())
+    uint8_t tombstoneCount();
+    const ConfigTombstone& tombstone(uint8_t i);
+
+    static uint32_t hashMelody(const BellMelody& m);
+    static uint32_t hashWeekly(const WeeklySchedule& e);
+    static uint32_t hashSpecial(const SpecialEvent& e);
+};
+
+extern ConfigSync configSync;
+
+#endif
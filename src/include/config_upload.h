@@ -0,0 +1,224 @@
+#ifndef CONFIG_UPLOAD_H
+#define CONFIG_UPLOAD_H
+
+#include "config.h"
+#include "json_stream.h"
+
+// Ricezione in streaming dei body JSON di configurazione.
+// Ogni classe riceve i chunk HTTP, li passa al parser SAX e scrive i campi
+// direttamente in strutture di staging a dimensione fissa: la memoria dipende
+// dalle tabelle di destinazione, non dalla dimensione del payload.
+//
+// Nota: se la connessione cade a metà, ESPAsyncWebServer libera _tempObject
+// con free() senza chiamare il distruttore. Gli oggetti vanno quindi creati con
+// malloc() + placement new (receiveBodyChunk in main.cpp) e le classi non devono
+// possedere altra memoria dinamica: il distruttore non fa nulla.
+
+// Una melodia ricevuta, con note già validate
+struct MelodyStaging {
+    char name[32];
+    BellNote notes[MAX_MELODY_STEPS];
+    uint8_t noteCount;
+    uint16_t notesSeen;         // Note presenti nel JSON (anche non valide)
+    bool hasNotes;              // Campo "notes" presente come array
+    bool hasName;
+};
+
+// Body con una singola melodia: /api/save-melody, /api/update-melody, /api/test-melody
+class MelodyUpload : public JsonStreamHandler {
+public:
+    MelodyStaging melody;
+    long index;                 // Campo "index" (-1 se assente)
+    long melodyId;              // Campo "melodyId" (-1 se assente)
+
+    MelodyUpload();
+    bool feed(const uint8_t* data, size_t len);
+    bool finish();
+    const char* errorMessage();
+
+    void onStartObject(uint8_t depth, const char* key) override;
+    void onEndObject(uint8_t depth, const char* key) override;
+    void onStartArray(uint8_t depth, const char* key) override;
+    void onValue(uint8_t depth, const char* key, JsonValueType type, const char* text) override;
+
+private:
+    JsonStreamParser parser;
+    BellNote note;
+    bool inNotes;
+};
+
+// Body con tabelle di programmazione: /api/weekly-schedules e /api/special-events
+// (chiavi "schedules"/"events") oppure la parte schedules di /api/restore ("weekly"/"special")
+class ScheduleUpload : public JsonStreamHandler {
+public:
+    WeeklySchedule weekly[MAX_WEEKLY_SCHEDULES];
+    uint8_t weeklyCount;
+    bool hasWeekly;
+    SpecialEvent special[MAX_SPECIAL_EVENTS];
+    uint8_t specialCount;
+    bool hasSpecial;
+
+    ScheduleUpload(const char* weeklyKey, const char* specialKey);
+    bool feed(const uint8_t* data, size_t len);
+    bool finish();
+    const char* errorMessage();
+
+    void onStartObject(uint8_t depth, const char* key) override;
+    void onEndObject(uint8_t depth, const char* key) override;
+    void onStartArray(uint8_t depth, const char* key) override;
+    void onEndArray(uint8_t depth, const char* key) override;
+    void onValue(uint8_t depth, const char* key, JsonValueType type, const char* text) override;
+
+protected:
+    enum Section : uint8_t { SEC_NONE, SEC_WEEKLY, SEC_SPECIAL, SEC_MELODIES };
+    JsonStreamParser parser;
+    const char* weeklyKey;
+    const char* specialKey;
+    Section section;
+    bool inRecord;
+    bool idSeen;
+};
+
+// Body di /api/restore: melodie + programmazioni, completo oppure delta
+// ("delta": true, record da aggiornare per id/slot ed elenco "deleted")
+class RestoreUpload : public ScheduleUpload {
+public:
+    MelodyStaging melodies[MAX_MELODIES];
+    int8_t melodyIds[MAX_MELODIES];   // Campo "id" originale (-1 se assente)
+    uint8_t melodyCount;
+    bool hasMelodies;
+
+    bool delta;
+    uint8_t deletedMelodies[MAX_MELODIES];
+    uint8_t deletedMelodyCount;
+    uint8_t deletedWeekly[MAX_WEEKLY_SCHEDULES];
+    uint8_t deletedWeeklyCount;
+    uint8_t deletedSpecial[MAX_SPECIAL_EVENTS];
+    uint8_t deletedSpecialCount;
+
+    RestoreUpload();
+
+    void onStartObject(uint8_t depth, const char* key) override;
+    void onEndObject(uint8_t depth, const char* key) override;
+    void onStartArray(uint8_t depth, const char* key) override;
+    void onEndArray(uint8_t depth, const char* key) override;
+    void onValue(uint8_t depth, const char* key, JsonValueType type, const char* text) override;
+
+private:
+    BellNote note;
+    bool inMelody;
+    bool inNotes;
+    bool inDeleted;
+    uint8_t deletedTable;             // ConfigTableId dell'array "deleted" aperto (0xFF = nessuno)
+};
+
+// Campi di un singolo record (programmazione settimanale o evento speciale).
+// I valori vengono scritti in entrambe le strutture e "fields" ricorda quali
+// erano presenti, così un aggiornamento parziale modifica solo quelli.
+enum RecordField : uint16_t {
+    REC_ID = 1 << 0,
+    REC_NAME = 1 << 1,
+    REC_DAY_OF_WEEK = 1 << 2,
+    REC_HOUR = 1 << 3,
+    REC_MINUTE = 1 << 4,
+    REC_MELODY = 1 << 5,
+    REC_ACTIVE = 1 << 6,
+    REC_TYPE = 1 << 7,
+    REC_YEAR = 1 << 8,
+    REC_MONTH = 1 << 9,
+    REC_DAY = 1 << 10,
+    REC_RECURRING = 1 << 11
+};
+
+struct RecordStaging {
+    WeeklySchedule weekly;            // Default come ScheduleUpload (attivo)
+    SpecialEvent special;
+    uint16_t fields;                  // RecordField presenti nel body
+
+    void reset();
+    // Applica un campo; false se la chiave non è un campo di record
+    bool apply(const char* key, JsonValueType type, const char* text);
+    bool has(uint16_t field) const { return (fields & field) != 0; }
+    // Copia nel record esistente solo i campi presenti (id escluso)
+    void mergeInto(WeeklySchedule& e) const;
+    void mergeInto(SpecialEvent& e) const;
+};
+
+// Body con un solo record: /api/add-*, /api/update-*, /api/toggle-*, /api/delete-*
+class RecordUpload : public JsonStreamHandler {
+public:
+    RecordStaging record;
+
+    RecordUpload();
+    bool feed(const uint8_t* data, size_t len);
+    bool finish();
+    const char* errorMessage();
+
+    void onValue(uint8_t depth, const char* key, JsonValueType type, const char* text) override;
+
+private:
+    JsonStreamParser parser;
+};
+
+// Body di /api/batch: elenco ordinato di operazioni
+//   {"ops":[{"op":"add-weekly-schedule", ...campi}, {"op":"delete-melody","index":2}, ...]}
+// Le operazioni vengono solo raccolte: l'applicazione avviene a body completo,
+// su un'unica bozza di configurazione.
+#define BATCH_MAX_OPS 32
+#define BATCH_MAX_MELODIES 4          // Operazioni con note (save/update-melody) per batch
+
+enum BatchOpKind : uint8_t {
+    BATCH_UNKNOWN,
+    BATCH_ADD_WEEKLY, BATCH_UPDATE_WEEKLY, BATCH_TOGGLE_WEEKLY, BATCH_DELETE_WEEKLY,
+    BATCH_ADD_SPECIAL, BATCH_UPDATE_SPECIAL, BATCH_TOGGLE_SPECIAL, BATCH_DELETE_SPECIAL,
+    BATCH_SAVE_MELODY, BATCH_UPDATE_MELODY, BATCH_DELETE_MELODY,
+    BATCH_SET_TIME
+};
+
+struct BatchOp {
+    uint8_t kind;                     // BatchOpKind
+    RecordStaging record;             // Campi per le operazioni sui record
+    int16_t index;                    // Campo "index" per le melodie (-1 se assente)
+    int8_t melody;                    // Slot in BatchUpload::melodies (-1 = nessuno)
+};
+
+class BatchUpload : public JsonStreamHandler {
+public:
+    BatchOp ops[BATCH_MAX_OPS];
+    uint8_t opCount;
+    bool hasOps;                      // Campo "ops" presente come array
+    bool overflow;                    // Troppe operazioni (o troppe melodie)
+    MelodyStaging melodies[BATCH_MAX_MELODIES];
+    uint8_t melodyCount;
+    char dateTime[24];                // Ultimo "dateTime" di set-time
+
+    BatchUpload();
+    bool feed(const uint8_t* data, size_t len);
+    bool finish();
+    const char* errorMessage();
+
+    static const char* opName(uint8_t kind);
+
+    void onStartObject(uint8_t depth, const char* key) override;
+    void onEndObject(uint8_t depth, const char* key) override;
+    void onStartArray(uint8_t depth, const char* key) override;
+    void onEndArray(uint8_t depth, const char* key) override;
+    void onValue(uint8_t depth, const char* key, JsonValueType type, const char* text) override;
+
+private:
+    JsonStreamParser parser;
+    BellNote note;
+    bool inOps;
+    bool inOp;
+    bool inNotes;
+    bool melodyUsed;                  // L'operazione corrente ha scritto nello slot melodies[melodyCount]
+};
+
+// Helper condivisi per i campi dei record
+void resetMelodyStaging(MelodyStaging& m);
+void applyNoteField(BellNote& n, const char* key, JsonValueType type, const char* text);
+void commitNote(MelodyStaging& m, const BellNote& n);
+void applyWeeklyField(WeeklySchedule& e, const char* key, JsonValueType type, const char* text);
+void applySpecialField(SpecialEvent& e, const char* key, JsonValueType type, const char* text);
+
+#endif
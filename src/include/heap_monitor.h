@@ -0,0 +1,72 @@
+#ifndef HEAP_MONITOR_H
+#define HEAP_MONITOR_H
+
+#include "config.h"
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+
+// Telemetria della memoria, campionata dal loop:
+//  - heap libero, blocco libero più grande (il massimo allocabile in un pezzo,
+//    quello che serve ai DynamicJsonDocument), minimo storico del libero e
+//    frammentazione (1 - blocco più grande / libero);
+//  - margine minimo di stack (high-water mark) dei task noti, campionato più di
+//    rado perché uxTaskGetStackHighWaterMark scorre lo stack.
+// L'allarme scatta quando il libero o il blocco più grande scendono sotto la
+// soglia e rientra solo con un margine (isteresi); lo stesso per gli stack.
+// Viene segnalato a log, su /api/heap e sul display.
+
+#define HEAP_SAMPLE_MS 1000
+#define HEAP_STACK_SAMPLE_MS 10000
+#define HEAP_ALARM_FREE 24576           // Heap libero minimo
+#define HEAP_ALARM_BLOCK 16384          // Blocco contiguo minimo (documenti JSON grandi)
+#define HEAP_ALARM_HYSTERESIS 4096
+#define HEAP_ALARM_STACK 512            // Margine di stack minimo per task (byte)
+#define HEAP_MAX_TASKS 6
+
+struct TaskStackInfo {
+    const char* name;
+    TaskHandle_t handle;                // Risolto per nome al primo campione utile
+    uint32_t minFree;                   // Byte mai usati dello stack (UINT32_MAX = non ancora letto)
+};
+
+class HeapMonitor {
+private:
+    uint32_t freeHeap;
+    uint32_t largestBlock;
+    uint32_t minFreeHeap;
+    uint32_t minLargestBlock;           // Minimo storico del blocco più grande
+    uint8_t fragmentation;              // Percentuale attuale
+    uint8_t peakFragmentation;
+    bool heapAlarm;
+    bool stackAlarm;
+    uint32_t alarms;                    // Ingressi in allarme dall'avvio
+    uint32_t lastSampleMs;
+    uint32_t lastStackMs;
+
+    TaskStackInfo tasks[HEAP_MAX_TASKS];
+    uint8_t taskCount;
+
+    void sampleStacks();
+
+public:
+    HeapMonitor();
+
+    // Task di cui seguire lo stack (per nome, anche se creato più tardi)
+    void watchTask(const char* name);
+    // Dal loop: campiona se è trascorso l'intervallo
+    void update();
+
+    uint32_t getFreeHeap() { return freeHeap; }
+    uint32_t getLargestBlock() { return largestBlock; }
+    uint32_t getMinFreeHeap() { return minFreeHeap; }
+    uint8_t getFragmentation() { return fragmentation; }
+    bool isAlarm() { return heapAlarm || stackAlarm; }
+
+    // JSON di /api/heap e riepilogo per il comando seriale "heap"
+    void print(Print& out);
+    void printSummary(Print& out);
+};
+
+extern HeapMonitor heapMonitor;
+
+#endif
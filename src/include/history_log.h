@@ -0,0 +1,125 @@
+#ifndef HISTORY_LOG_H
+#define HISTORY_LOG_H
+
+#include "config.h"
+#include <esp_partition.h>
+
+// Registro eventi campane in un ring buffer su flash (partizione "history").
+// I record sono binari a dimensione fissa; i settori vengono riutilizzati
+// a rotazione (il più vecchio viene cancellato) così l'usura è distribuita.
+// append() non tocca la flash: accoda in RAM, la scrittura avviene in service().
+
+enum HistoryEventType {
+    HIST_BOOT = 0,
+    HIST_MELODY_START = 1,
+    HIST_MELODY_END = 2,          // Melodia completata
+    HIST_MELODY_STOPPED = 3,      // Melodia interrotta (stop o nuova melodia)
+    HIST_SKIP_DISABLED = 4,       // Campane disabilitate
+    HIST_SKIP_INVALID = 5,        // Melodia non valida/vuota
+    HIST_MISSED = 6,              // Evento programmato non eseguito in tempo
+    HIST_EMERGENCY_STOP = 7,
+    HIST_SKIP_THERMAL = 8,        // Melodia rifiutata dalla protezione termica
+    HIST_THERMAL = 9              // Cambio di livello termico: ref = livello, arg = decimi di grado
+};
+
+enum HistorySource {
+    HIST_SRC_SYSTEM = 0,
+    HIST_SRC_WEEKLY = 1,          // ref = id programmazione settimanale
+    HIST_SRC_SPECIAL = 2,         // ref = id evento speciale
+    HIST_SRC_BUTTON = 3,
+    HIST_SRC_API = 4,
+    HIST_SRC_SERIAL = 5
+};
+
+#define HISTORY_NONE 0xFF          // Campo melodia/ref non applicabile
+#define HISTORY_UPTIME_FLAG 0x80   // Bit in type: epoch contiene i secondi dall'avvio
+#define HISTORY_QUEUE_SIZE 32      // Eventi in attesa di scrittura su flash
+#define HISTORY_SECTOR_SIZE 4096
+
+// Record su flash (16 byte). seq == 0xFFFFFFFF indica slot vuoto (flash cancellata).
+struct HistoryRecord {
+    uint32_t seq;
+    uint32_t epoch;               // Ora UNIX (0 se non disponibile)
+    uint8_t type;                 // HistoryEventType
+    uint8_t source;               // HistorySource
+    uint8_t melody;
+    uint8_t ref;
+    uint16_t arg;                 // Dato aggiuntivo (es. note suonate)
+    uint16_t check;
+};
+
+class HistoryLog {
+private:
+    const esp_partition_t* partition;
+    uint32_t sectorCount;
+    uint32_t writeSector;
+    uint32_t writeSlot;           // Prossimo slot libero in writeSector
+    uint32_t nextSeq;
+    bool sectorReady;             // writeSector già cancellato e scrivibile
+
+    // Coda RAM (protetta da spinlock, usabile da entrambi i core)
+    HistoryRecord queue[HISTORY_QUEUE_SIZE];
+    uint8_t queueHead;
+    uint8_t queueCount;
+    uint32_t dropped;             // Eventi persi: coda piena o scrittura flash fallita
+    portMUX_TYPE queueMux;
+
+    uint16_t computeCheck(const HistoryRecord& r);
+    bool readRecord(uint32_t sector, uint32_t slot, HistoryRecord& out);
+    bool readSectorFirstSeq(uint32_t sector, uint32_t& seq);
+
+public:
+    static const uint32_t RECORDS_PER_SECTOR = HISTORY_SECTOR_SIZE / sizeof(HistoryRecord);
+
+    HistoryLog();
+    bool begin();
+    bool isAvailable();
+
+    // Accoda un evento (non bloccante). Restituisce false se la coda è piena.
+    bool append(uint8_t type, uint8_t source, uint8_t melody = HISTORY_NONE,
+                uint8_t ref = HISTORY_NONE, uint16_t arg = 0);
+
+    // Scrive su flash gli eventi in coda. Con busy=true evita la cancellazione
+    // di un settore (operazione lenta) per non disturbare una melodia in corso.
+    void service(bool busy);
+
+    // Lettura sequenziale: posiziona un cursore sul primo record con seq > since
+    bool seek(uint32_t since, uint32_t& sector, uint32_t& slot);
+    // Legge il record al cursore e avanza; false se non ci sono altri record validi
+    bool readNext(uint32_t& sector, uint32_t& slot, uint32_t expectedSeq, HistoryRecord& out);
+
+    uint32_t getNextSeq();
+    uint32_t getOldestSeq();
+    uint32_t getDropped();
+    uint32_t getCapacity();
+
+    static const char* typeName(uint8_t type);
+    static const char* sourceName(uint8_t source);
+};
+
+extern HistoryLog historyLog;
+
+// Serializzazione JSON a blocchi per /api/history: legge un record alla volta
+// dalla flash, senza mai caricare l'intero registro in RAM.
+class HistoryJsonStream {
+private:
+    uint32_t since;
+    uint32_t lastSeq;
+    uint16_t remaining;
+    uint32_t sector;
+    uint32_t slot;
+    uint8_t phase;                // 0=intestazione, 1=record, 2=chiusura, 3=fine
+    bool first;
+    char pending[160];
+    uint16_t pendingLen;
+    uint16_t pendingOff;
+
+    bool refill();
+
+public:
+    HistoryJsonStream(uint32_t since, uint16_t limit);
+    // Callback per beginChunkedResponse: restituisce 0 a fine stream
+    size_t fill(uint8_t* buf, size_t maxLen);
+};
+
+#endif
@@ -0,0 +1,105 @@
+#ifndef JSON_STREAM_H
+#define JSON_STREAM_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+// Parser JSON incrementale (stile SAX) per i body HTTP ricevuti a chunk.
+// Consuma i byte man mano che arrivano e notifica un handler per ogni valore,
+// senza mai tenere in memoria il documento: l'occupazione è fissa
+// (stack di chiavi + buffer del valore corrente, poche centinaia di byte).
+// È il primo controllo di ogni scrittura di configurazione: tutto ciò che non è
+// JSON valido (virgole finali, surrogati UTF-16 isolati) o che non entra nei
+// buffer viene rifiutato, mai troncato. Solo librerie C standard: i test
+// girano anche sull'host (pio test -e native).
+
+#define JSON_STREAM_MAX_DEPTH 8        // Annidamento massimo supportato
+#define JSON_STREAM_KEY_LEN 20         // Chiave massima 19 byte, oltre è un errore
+#define JSON_STREAM_VALUE_LEN 64       // Valore massimo 63 byte (UTF-8), oltre è un errore
+
+enum JsonValueType {
+    JSON_STRING,
+    JSON_NUMBER,
+    JSON_BOOL,
+    JSON_NULL
+};
+
+// depth = numero di contenitori aperti che racchiudono l'elemento
+// (l'oggetto radice ha depth 0, i suoi campi depth 1, ...).
+// key = chiave nell'oggetto padre, stringa vuota per gli elementi di un array.
+class JsonStreamHandler {
+public:
+    virtual ~JsonStreamHandler() {}
+    virtual void onStartObject(uint8_t depth, const char* key) {}
+    virtual void onEndObject(uint8_t depth, const char* key) {}
+    virtual void onStartArray(uint8_t depth, const char* key) {}
+    virtual void onEndArray(uint8_t depth, const char* key) {}
+    virtual void onValue(uint8_t depth, const char* key, JsonValueType type, const char* text) {}
+
+    // Conversioni di comodo per i valori ricevuti
+    static long toLong(JsonValueType type, const char* text, long fallback);
+    static bool toBool(JsonValueType type, const char* text, bool fallback);
+};
+
+class JsonStreamParser {
+private:
+    enum State : uint8_t {
+        ST_VALUE,           // Atteso un valore
+        ST_FIRST_VALUE,     // Dopo '[': valore o ']'
+        ST_FIRST_KEY,       // Dopo '{': chiave o '}'
+        ST_KEY,             // Dopo ',' in un oggetto: chiave
+        ST_COLON,
+        ST_AFTER_VALUE,     // Atteso ',' o chiusura
+        ST_STRING,
+        ST_STRING_ESCAPE,
+        ST_STRING_UNICODE,
+        ST_LOW_SURROGATE,   // Dopo un surrogato alto: atteso "\u" con quello basso
+        ST_NUMBER,
+        ST_LITERAL,
+        ST_DONE,
+        ST_ERROR
+    };
+
+    JsonStreamHandler* handler;
+    State state;
+    bool readingKey;
+    uint8_t depth;
+    uint8_t arrayMask;                                  // bit i: contenitore i è un array
+    char keys[JSON_STREAM_MAX_DEPTH + 1][JSON_STREAM_KEY_LEN];
+    char value[JSON_STREAM_VALUE_LEN];
+    uint8_t valueLen;
+    uint16_t unicode;
+    uint8_t unicodeDigits;
+    uint16_t highSurrogate;                             // 0 = nessuno in attesa
+    const char* error;
+    size_t consumed;
+
+    bool inArray();
+    void appendChar(char c);
+    void appendUtf8(uint32_t cp);
+    void endUnicodeEscape();
+    bool processChar(char c);        // false = carattere da riprocessare
+    void beginContainer(bool isArray);
+    bool endContainer(bool isArray);
+    void emitValue(JsonValueType type);
+    void afterValue();
+    void fail(const char* message);
+
+public:
+    explicit JsonStreamParser(JsonStreamHandler* handler);
+    void reset();
+
+    // Consuma un chunk; false se il JSON non è valido
+    bool feed(const uint8_t* data, size_t len);
+    // true se è stato letto un documento completo senza errori
+    bool finish();
+
+    bool hasError();
+    const char* errorMessage();
+    // Dal gestore: valore accettabile come JSON ma non per il destinatario
+    // (es. nome più lungo del campo). Il parsing si ferma con questo errore.
+    void abort(const char* message);
+    size_t bytesConsumed();
+};
+
+#endif
@@ -0,0 +1,61 @@
+#ifndef JSON_WRITER_H
+#define JSON_WRITER_H
+
+#include <Arduino.h>
+#include <ESPAsyncWebServer.h>
+#include <functional>
+
+// Scrittura JSON direttamente nel buffer di una risposta chunked.
+// La risposta è divisa in "elementi" (intestazione, un record, chiusura): a ogni
+// richiamata della libreria gli elementi vengono serializzati uno dopo l'altro
+// nel buffer di uscita; se un elemento non ci sta, alla richiamata successiva
+// viene rigenerato saltando i byte già inviati. Nessun documento e nessuna
+// String: la memoria per richiesta è il cursore, indipendente dalla tabella.
+
+// Posizione nella risposta, conservata tra una richiamata e l'altra
+struct JsonListCursor {
+    uint16_t item;                      // Elemento corrente
+    uint16_t offset;                    // Byte dell'elemento già inviati
+    uint16_t elements;                  // Elementi dell'array già completati (per le virgole)
+    bool done;
+};
+
+class JsonChunkWriter {
+private:
+    uint8_t* out;
+    size_t cap;
+    size_t len;
+    size_t skip;                        // Byte dell'elemento corrente da non riscrivere
+    size_t itemBytes;                   // Byte dell'elemento corrente prodotti finora
+    bool overflow;
+    bool isElement;
+    const JsonListCursor& cursor;
+
+    void put(char c);
+
+public:
+    JsonChunkWriter(uint8_t* buffer, size_t maxLen, const JsonListCursor& c);
+
+    // Nuovo elemento, di cui i primi "alreadySent" byte sono già stati inviati
+    void beginItem(size_t alreadySent);
+    bool full() const { return overflow; }
+    size_t itemLength() const { return itemBytes; }
+    size_t length() const { return len; }
+    bool wasElement() const { return isElement; }
+
+    // Elemento di array: virgola di separazione se non è il primo
+    void element();
+    void raw(const char* s);
+    void string(const char* s);         // Tra virgolette, con escape
+    void number(long v);
+    void number(unsigned long v);
+    void boolean(bool v);
+};
+
+// Genera l'elemento "item" (true) oppure restituisce false a risposta finita
+typedef std::function<bool(JsonChunkWriter& w, uint16_t item)> JsonListEmitter;
+
+// Risposta chunked application/json prodotta da un emettitore di elementi
+AsyncWebServerResponse* beginJsonList(AsyncWebServerRequest* request, JsonListEmitter emit);
+
+#endif
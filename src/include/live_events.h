@@ -0,0 +1,65 @@
+#ifndef LIVE_EVENTS_H
+#define LIVE_EVENTS_H
+
+#include "config.h"
+#include <ESPAsyncWebServer.h>
+
+// Canale push verso la UI (Server-Sent Events su /api/events).
+// Il loop confronta lo stato con l'ultimo inviato e manda solo i cambiamenti;
+// ogni messaggio viene serializzato una volta e condiviso da tutti i client.
+//   event "clock"   -> ora/data, una volta al secondo
+//   event "status"  -> campi di stato cambiati (alla connessione: stato completo)
+//   event "relay"   -> fronti dei relè (livello grezzo come /api/relay-status)
+//   event "history" -> nuovi eventi del registro (melodie, programmazioni, stop)
+
+#define LIVE_EVENTS_PATH "/api/events"
+#define LIVE_CLOCK_INTERVAL 1000        // Tick orologio (ms)
+#define LIVE_RECONNECT_MS 3000          // Ritardo di riconnessione suggerito al browser
+
+// Stato osservato e inviato ai client
+struct LiveState {
+    bool bellsEnabled;
+    bool testMode;
+    bool isPlaying;
+    uint8_t activeMelody;
+    bool wifiConnected;
+    bool ntpSynced;
+    bool rtcConnected;
+    uint8_t temperatureBand;            // 0=OK, 1=ELEVATA, 2=CRITICA
+    uint32_t totalBellRings;
+    uint8_t relay1;                     // digitalRead dei pin relè (LOW = attivo)
+    uint8_t relay2;
+};
+
+class LiveEvents {
+private:
+    AsyncEventSource source;
+    LiveState sent;                     // Ultimo stato inviato
+    bool hasSent;
+    volatile bool fullRequested;        // Nuovo client: il prossimo update invia lo stato completo
+    uint32_t lastClockMs;
+    uint32_t lastHistorySeq;            // Ultimo record del registro già inoltrato
+    uint32_t messageId;
+    char buffer[256];
+
+    size_t formatStatus(const LiveState& s, const LiveState* previous);
+    void sendStatus(const LiveState& s);
+    void forwardHistory();
+
+public:
+    LiveEvents();
+    void begin(AsyncWebServer& server);
+
+    // Dal loop: invia le variazioni di stato e i nuovi eventi del registro.
+    // Senza client connessi non fa nulla (lo stato completo parte alla connessione).
+    void update(const LiveState& state);
+    // true quando è il momento del tick orologio (e c'è almeno un client)
+    bool clockDue();
+    void sendClock(const char* timeStr, const char* dateStr);
+
+    size_t clientCount();
+};
+
+extern LiveEvents liveEvents;
+
+#endif
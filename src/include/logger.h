@@ -0,0 +1,135 @@
+#ifndef LOGGER_H
+#define LOGGER_H
+
+#include "config.h"
+#include <atomic>
+
+// Log a livelli con tag per modulo, asincrono.
+//  - LOG_LEVEL (flag di compilazione) fissa il livello massimo: le macro dei
+//    livelli superiori diventano istruzioni vuote e gli argomenti non vengono
+//    nemmeno valutati;
+//  - sopra quel limite ogni tag ha un livello impostabile a runtime (comando
+//    seriale "log");
+//  - i messaggi abilitati vengono formattati in un anello di slot fissi senza
+//    lock (un fetch_add per riservare lo slot, numero di sequenza per pubblicarlo)
+//    e un task a bassa priorità li scrive su Serial. Chi scrive un log non
+//    aspetta mai la UART;
+//  - /api/logs legge la coda dell'anello senza consumarla.
+// Se i produttori superano il task di un giro intero i messaggi più vecchi
+// vengono sovrascritti e contati come persi. Non usare dalle ISR.
+
+#define LOG_LEVEL_NONE 0
+#define LOG_LEVEL_ERROR 1
+#define LOG_LEVEL_WARN 2
+#define LOG_LEVEL_INFO 3
+#define LOG_LEVEL_DEBUG 4
+#define LOG_LEVEL_VERBOSE 5
+
+#ifndef LOG_LEVEL
+#define LOG_LEVEL LOG_LEVEL_INFO
+#endif
+
+#define LOG_RING_SIZE 64                // Messaggi conservati (potenza di 2)
+#define LOG_LINE_SIZE 96                // Testo per messaggio (troncato oltre)
+#define LOG_DRAIN_MS 20                 // Periodo del task di scrittura su Serial
+#define LOG_TASK_STACK 3072
+#define LOG_TASK_PRIORITY 1
+#define LOG_TASK_CORE 0
+
+enum LogTag {
+    LOG_SYS = 0,
+    LOG_BELL,
+    LOG_SCHED,
+    LOG_WEB,
+    LOG_NET,
+    LOG_CFG,
+    LOG_BTN,
+    LOG_DISP,
+    LOG_TAG_COUNT
+};
+
+struct LogEntry {
+    std::atomic<uint32_t> seq;          // Sequenza + 1 quando pubblicato, 0 durante la scrittura
+    uint32_t ms;
+    uint8_t level;
+    uint8_t tag;
+    char text[LOG_LINE_SIZE];
+};
+
+// Copia di un messaggio letto dall'anello
+struct LogLine {
+    uint32_t seq;
+    uint32_t ms;
+    uint8_t level;
+    uint8_t tag;
+    char text[LOG_LINE_SIZE];
+};
+
+class Logger {
+private:
+    LogEntry ring[LOG_RING_SIZE];
+    std::atomic<uint32_t> head;         // Prossima sequenza da riservare
+    uint32_t tail;                      // Prossima sequenza da scrivere su Serial (solo task)
+    volatile uint8_t levels[LOG_TAG_COUNT];
+    volatile uint32_t lost;
+
+    static void taskEntry(void* arg);
+    void drain();
+
+public:
+    Logger();
+
+    // Avvia il task di scrittura (i messaggi precedenti restano nell'anello)
+    void begin();
+
+    bool enabled(uint8_t tag, uint8_t level) const { return level <= levels[tag]; }
+    void write(uint8_t level, uint8_t tag, const char* fmt, ...) __attribute__((format(printf, 4, 5)));
+
+    void setLevel(uint8_t tag, uint8_t level);
+    uint8_t getLevel(uint8_t tag);
+
+    // Legge il messaggio "seq" se è ancora nell'anello e completo
+    bool read(uint32_t seq, LogLine& out);
+    uint32_t getHead();
+    uint32_t getLost();
+    // JSON di /api/logs: messaggi da "since" in poi (al massimo "limit")
+    void printTail(Print& out, uint32_t since, uint16_t limit);
+
+    static const char* tagName(uint8_t tag);
+    static const char* levelName(uint8_t level);
+    static int8_t parseTag(const char* name);
+    static int8_t parseLevel(const char* name);
+};
+
+extern Logger logger;
+
+#define LOG_AT(level, tag, ...) \
+    do { if (logger.enabled(tag, level)) logger.write(level, tag, __VA_ARGS__); } while (0)
+
+#if LOG_LEVEL >= LOG_LEVEL_ERROR
+#define LOGE(tag, ...) LOG_AT(LOG_LEVEL_ERROR, tag, __VA_ARGS__)
+#else
+#define LOGE(tag, ...) do {} while (0)
+#endif
+#if LOG_LEVEL >= LOG_LEVEL_WARN
+#define LOGW(tag, ...) LOG_AT(LOG_LEVEL_WARN, tag, __VA_ARGS__)
+#else
+#define LOGW(tag, ...) do {} while (0)
+#endif
+#if LOG_LEVEL >= LOG_LEVEL_INFO
+#define LOGI(tag, ...) LOG_AT(LOG_LEVEL_INFO, tag, __VA_ARGS__)
+#else
+#define LOGI(tag, ...) do {} while (0)
+#endif
+#if LOG_LEVEL >= LOG_LEVEL_DEBUG
+#define LOGD(tag, ...) LOG_AT(LOG_LEVEL_DEBUG, tag, __VA_ARGS__)
+#else
+#define LOGD(tag, ...) do {} while (0)
+#endif
+#if LOG_LEVEL >= LOG_LEVEL_VERBOSE
+#define LOGV(tag, ...) LOG_AT(LOG_LEVEL_VERBOSE, tag, __VA_ARGS__)
+#else
+#define LOGV(tag, ...) do {} while (0)
+#endif
+
+#endif
@@ -0,0 +1,32 @@
+#ifndef MSGPACK_WRITER_H
+#define MSGPACK_WRITER_H
+
+#include <Arduino.h>
+
+// Serializzazione MessagePack in streaming su un Print (es. AsyncResponseStream),
+// per i client automatici che chiedono Accept: application/msgpack.
+// Mappe e array richiedono il numero di elementi in testa: chi scrive li conta prima.
+// Gli interi usano sempre la codifica più corta.
+class MsgPackWriter {
+private:
+    Print& out;
+
+    void header(uint8_t fix, uint8_t fixMax, uint8_t code16, uint32_t n);
+    void be(uint32_t v, uint8_t bytes);
+
+public:
+    explicit MsgPackWriter(Print& p) : out(p) {}
+
+    void map(uint32_t count);
+    void array(uint32_t count);
+    void string(const char* s);
+    void number(uint32_t v);
+    void number(int32_t v);
+    void boolean(bool v);
+    void nil();
+
+    // Chiave di mappa seguita dal valore
+    void key(const char* k) { string(k); }
+};
+
+#endif
@@ -0,0 +1,86 @@
+#ifndef PERF_MONITOR_H
+#define PERF_MONITOR_H
+
+#include "config.h"
+#include <freertos/FreeRTOS.h>
+#include <esp_timer.h>
+
+// Profilazione a scope con esp_timer (µs): a differenza del contatore di cicli
+// resta corretto anche con la frequenza dinamica di PowerManager.
+//   PERF_SCOPE("loop.bell");   // misura fino alla fine del blocco
+// Ogni nome ha una sonda in una tabella fissa (registrata alla prima esecuzione
+// dello scope, poi solo un puntatore statico): conteggio, minimo, massimo, somma
+// e un istogramma logaritmico (2 intervalli per ottava, in µs) da cui si
+// ricavano p50 e p99. Nessuna allocazione.
+// Ogni sonda viene aggiornata da un solo task (loop, AsyncTCP, display); il
+// reset incrementa un'epoca e ogni sonda si azzera da sé alla misura successiva.
+// Con PERF_ENABLED=0 gli scope spariscono dalla compilazione.
+
+#ifndef PERF_ENABLED
+#define PERF_ENABLED 1
+#endif
+
+#define PERF_MAX_PROBES 48
+#define PERF_BUCKETS 44                 // Fino a ~2^21 µs, oltre nell'ultimo intervallo
+
+struct PerfProbe {
+    const char* name;
+    uint32_t epoch;
+    uint32_t count;
+    uint32_t minUs;
+    uint32_t maxUs;
+    uint64_t totalUs;
+    uint16_t buckets[PERF_BUCKETS];     // Dimezzati tutti quando uno satura
+
+    void record(uint32_t us);
+};
+
+class PerfMonitor {
+private:
+    PerfProbe probes[PERF_MAX_PROBES];
+    uint8_t count;
+    volatile uint32_t epoch;
+    uint32_t resetMs;
+    portMUX_TYPE mux;
+
+    friend struct PerfProbe;
+    static uint8_t bucketOf(uint32_t us);
+    static uint32_t bucketUpper(uint8_t index);
+    static uint32_t percentile(const PerfProbe& p, uint8_t pct);
+
+public:
+    PerfMonitor();
+    void begin();
+
+    // Sonda per nome (registrata se nuova); nullptr se la tabella è piena
+    PerfProbe* probe(const char* name);
+    void reset();
+
+    // JSON di /api/perf e tabella per il comando seriale "perf"
+    void print(Print& out);
+    void printTable(Print& out);
+};
+
+extern PerfMonitor perf;
+
+class PerfScope {
+private:
+    PerfProbe* probe;
+    uint32_t start;
+
+public:
+    explicit PerfScope(PerfProbe* p) : probe(p), start((uint32_t)esp_timer_get_time()) {}
+    ~PerfScope() { if (probe) probe->record((uint32_t)esp_timer_get_time() - start); }
+};
+
+#define PERF_CONCAT_(a, b) a##b
+#define PERF_CONCAT(a, b) PERF_CONCAT_(a, b)
+#if PERF_ENABLED
+#define PERF_SCOPE(name) \
+    static PerfProbe* PERF_CONCAT(perfProbe_, __LINE__) = perf.probe(name); \
+    PerfScope PERF_CONCAT(perfScope_, __LINE__)(PERF_CONCAT(perfProbe_, __LINE__))
+#else
+#define PERF_SCOPE(name) do {} while (0)
+#endif
+
+#endif
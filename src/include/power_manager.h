@@ -0,0 +1,112 @@
+#ifndef POWER_MANAGER_H
+#define POWER_MANAGER_H
+
+#include "config.h"
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <esp_pm.h>
+
+// Gestione energetica tra un evento e l'altro.
+//  - Con esp_pm disponibile: frequenza dinamica (POWER_MIN_MHZ..POWER_MAX_MHZ) e
+//    light sleep automatico quando tutti i task sono fermi. Lock di frequenza
+//    massima durante melodie/impulsi (più anche il divieto di light sleep, per
+//    i tempi dei relè) e per POWER_HTTP_BOOST_MS dopo ogni richiesta HTTP.
+//  - Senza esp_pm (core Arduino compilato senza CONFIG_PM_ENABLE) la CPU viene
+//    portata a POWER_MIN_MHZ con setCpuFrequencyMhz() dopo POWER_IDLE_DOWN_MS
+//    senza attività e riportata al massimo alla prima richiesta o melodia.
+//  - Il loop non gira più a vuoto: a inizio giro idleWait() lo sospende fino alla
+//    prossima scadenza (scheduler, display) o a un risveglio esplicito (wake():
+//    pulsanti, richieste HTTP, melodie e impulsi). Intanto il task idle può
+//    spegnere la CPU.
+// setMaxMhz() abbassa il tetto di frequenza (protezione termica): anche i boost
+// restano sotto il tetto.
+// Sorgenti di risveglio dal light sleep: timer (scadenza del loop), GPIO dei
+// pulsanti (armati da ButtonService durante l'attesa), linea SQW del DS3231 (se
+// collegata, RTC_SQW_PIN) e DTIM del WiFi (modem sleep, POWER_WIFI_MODEM_SLEEP).
+// La corrente media è una stima dal tempo passato nei vari stati con i valori
+// tipici del datasheet (POWER_MA_*): la scheda non ha un sensore di corrente.
+
+#ifndef POWER_LIGHT_SLEEP
+#define POWER_LIGHT_SLEEP 1
+#endif
+#ifndef POWER_WIFI_MODEM_SLEEP
+#define POWER_WIFI_MODEM_SLEEP 1
+#endif
+#ifndef RTC_SQW_PIN
+#define RTC_SQW_PIN -1                  // SQW del DS3231 (open drain), -1 = non collegato
+#endif
+
+#define POWER_MAX_MHZ 160               // Come board_build.f_cpu
+#define POWER_MIN_MHZ 80
+#define POWER_HTTP_BOOST_MS 2000
+#define POWER_IDLE_DOWN_MS 5000         // Solo senza esp_pm
+#define POWER_IDLE_MAX_MS 200           // Sospensione massima del loop
+
+// Valori tipici (mA) per la stima della corrente media
+#define POWER_MA_MAX 50                 // CPU a POWER_MAX_MHZ, WiFi in modem sleep
+#define POWER_MA_MIN 30                 // CPU a POWER_MIN_MHZ
+#define POWER_MA_SLEEP 5                // Light sleep (CPU ferma, WiFi a DTIM)
+
+enum PowerBoost {
+    POWER_BOOST_BELLS = 0,
+    POWER_BOOST_HTTP,
+    POWER_BOOST_COUNT
+};
+
+class PowerManager {
+private:
+    bool pmActive;                      // esp_pm configurato
+    bool lightSleep;
+    esp_pm_lock_handle_t maxLocks[POWER_BOOST_COUNT];
+    esp_pm_lock_handle_t noSleepLock;   // Tenuto durante melodie/impulsi
+    bool boosted[POWER_BOOST_COUNT];
+    portMUX_TYPE mux;
+    TaskHandle_t loopTask;
+    volatile uint32_t lastHttpMs;
+    uint32_t lastActiveMs;              // Ultima attività (per la discesa manuale)
+    uint32_t manualMhz;                 // Frequenza impostata senza esp_pm
+    uint32_t maxMhz;                    // Tetto attuale (POWER_MAX_MHZ salvo protezione termica)
+
+    int8_t sqwPin;
+
+    // Contabilità del tempo (µs) dall'avvio
+    int64_t windowStartUs;
+    int64_t lastUpdateUs;
+    int64_t idleUs;                     // Loop sospeso in idleWait()
+    int64_t maxFreqUs;                  // CPU a POWER_MAX_MHZ
+    uint32_t wakeups;
+    uint32_t boosts;
+
+    void setBoost(uint8_t source, bool on);
+
+public:
+    PowerManager();
+
+    // Dal task del loop (setup): configura esp_pm o il ripiego manuale
+    bool begin();
+    // Linea SQW a 1 Hz del DS3231: risveglio a ogni fronte
+    void setSqwPin(int8_t pin);
+
+    // Dal loop: boost per le campane, scadenza del boost HTTP, contabilità
+    void update(bool bellsBusy);
+    // Tetto di frequenza tra POWER_MIN_MHZ e POWER_MAX_MHZ, dal loop
+    void setMaxMhz(uint32_t mhz);
+    uint32_t getMaxMhz() { return maxMhz; }
+    // Richiesta HTTP ammessa (task AsyncTCP): boost e risveglio del loop
+    void noteHttp();
+    // Da qualsiasi task: interrompe idleWait()
+    void wake();
+    // Inizio giro del loop: attesa fino a maxMs (0 = solo yield)
+    void idleWait(uint32_t maxMs);
+
+    bool isPmActive() { return pmActive; }
+    bool isLightSleep() { return lightSleep; }
+    uint32_t getCpuMhz();
+
+    // JSON di /api/power (la temperatura la fornisce il chiamante)
+    void print(Print& out, float temperatureC);
+};
+
+extern PowerManager powerManager;
+
+#endif
@@ -0,0 +1,73 @@
+#ifndef RATE_LIMITER_H
+#define RATE_LIMITER_H
+
+#include "config.h"
+#include <ESPAsyncWebServer.h>
+
+// Controllo di ammissione delle richieste HTTP, registrato come primo handler
+// del server: decide a fine intestazioni, prima che il corpo venga ricevuto.
+//  - token bucket per IP remoto, con un costo per percorso (backup/restore
+//    costano più di /api/status);
+//  - limite globale di richieste in corso (la risposta non è ancora chiusa) e
+//    per singolo IP, così un client non occupa tutte le connessioni;
+//  - timeout di inattività in ricezione per le richieste ammesse (corpo bloccato).
+// Le richieste respinte ricevono 429/503 con Retry-After e il corpo viene scartato.
+// Stop di emergenza e stop melodia non vengono mai limitati.
+// Con setThrottle() (protezione termica) la ricarica dei bucket scende a
+// RATE_LIMIT_THROTTLED_REFILL e le richieste in corso a RATE_LIMIT_THROTTLED_INFLIGHT.
+
+#define RATE_LIMIT_CLIENTS 8            // IP tracciati (il meno recente viene sostituito)
+#define RATE_LIMIT_BURST 30             // Capacità del bucket (token)
+#define RATE_LIMIT_REFILL 3             // Token ricaricati al secondo
+#define RATE_LIMIT_MAX_INFLIGHT 6       // Richieste contemporanee in tutto il server
+#define RATE_LIMIT_PER_CLIENT 3         // Richieste contemporanee per IP
+#define RATE_LIMIT_IDLE_TIMEOUT 10      // Secondi senza dati in ricezione prima di chiudere
+#define RATE_LIMIT_THROTTLED_REFILL 1   // Token al secondo con throttle attivo
+#define RATE_LIMIT_THROTTLED_INFLIGHT 2
+
+struct RateBucket {
+    uint32_t ip;
+    uint32_t milliTokens;               // Token * 1000
+    uint32_t lastMs;                    // Ultima ricarica
+    uint32_t lastSeen;
+    uint8_t open;                       // Richieste in corso da questo IP
+};
+
+class RateLimiter : public AsyncWebHandler {
+private:
+    RateBucket buckets[RATE_LIMIT_CLIENTS];
+    uint8_t inFlight;
+    volatile bool throttled;
+    uint32_t rejectedRate;
+    uint32_t rejectedBusy;
+    uint32_t rejectedPerClient;
+
+    RateBucket& bucketFor(uint32_t ip, uint32_t now);
+    uint8_t maxInFlight() { return throttled ? RATE_LIMIT_THROTTLED_INFLIGHT : RATE_LIMIT_MAX_INFLIGHT; }
+    void release(uint32_t ip);
+
+public:
+    RateLimiter();
+
+    // Costo in token di una richiesta (0 = mai limitata)
+    static uint8_t routeCost(const String& url);
+
+    // AsyncWebHandler: true solo per le richieste da respingere
+    bool canHandle(AsyncWebServerRequest* request) override;
+    void handleRequest(AsyncWebServerRequest* request) override;
+    void handleBody(AsyncWebServerRequest* request, uint8_t* data, size_t len, size_t index, size_t total) override {}
+    bool isRequestHandlerTrivial() override { return true; }
+
+    // Dal loop: limiti ridotti finché attivo
+    void setThrottle(bool on) { throttled = on; }
+    bool isThrottled() { return throttled; }
+
+    uint8_t getInFlight();
+    uint32_t getRejectedRate();
+    uint32_t getRejectedBusy();
+    uint32_t getRejectedPerClient();
+};
+
+extern RateLimiter rateLimiter;
+
+#endif
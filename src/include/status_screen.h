@@ -0,0 +1,142 @@
+#ifndef STATUS_SCREEN_H
+#define STATUS_SCREEN_H
+
+#include "config.h"
+#include <TFT_eSPI.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+
+// Schermata di stato del TFT in modalità "retained": il modello conserva il
+// contenuto già disegnato (cifre dell'orologio, data, righe di stato) e a ogni
+// aggiornamento invia al display solo le zone cambiate.
+//  - orologio: una cifra alla volta in un piccolo sprite 18x24 (di solito cambia
+//    solo l'unità dei secondi, ~860 byte su SPI);
+//  - data e righe di stato: uno sprite grande una riga, inviato solo se il testo
+//    o il colore della riga sono cambiati;
+//  - intestazione e sfondo: solo al ridisegno completo (avvio o invalidate()).
+// Se la RAM per gli sprite non è disponibile si disegna direttamente sul TFT.
+//
+// Il disegno avviene solo nel task del display (priorità bassa, core 0): gli
+// altri contesti pubblicano lo stato con post() o chiedono un ridisegno con
+// requestRedraw(), e nessuno tranne il task usa il TFT dopo begin().
+// Con DMA disponibile gli sprite sono doppi: mentre uno viene trasferito su SPI
+// il task disegna la zona successiva nell'altro.
+
+#define SCREEN_LINES 6                  // WiFi, RTC, campane, temperatura, fuso, avviso (temperatura o memoria)
+#define SCREEN_CLOCK_CHARS 8            // "HH:MM:SS"
+#define SCREEN_CLOCK_SIZE 3             // Moltiplicatore del font 6x8
+#define SCREEN_CLOCK_Y 22
+#define SCREEN_DATE_Y 54
+#define SCREEN_LINES_Y 75
+#define SCREEN_LINE_PITCH 12
+
+#define DISPLAY_TASK_STACK 4096
+#define DISPLAY_TASK_PRIORITY 1         // Sotto AsyncTCP e lontano dal loop delle campane
+#define DISPLAY_TASK_CORE 0
+#define SCREEN_BL_CHANNEL 7             // Canale LEDC della retroilluminazione (TFT_BL)
+
+// Valori mostrati, raccolti dal chiamante (solo dati già in RAM)
+struct ScreenState {
+    bool timeValid;
+    char time[SCREEN_CLOCK_CHARS + 1];
+    char date[11];                      // "GG/MM/AAAA"
+    bool wifiConnected;                 // false = access point
+    uint32_t ip;
+    bool rtcConnected;
+    bool bellsEnabled;
+    bool temperatureWarning;
+    bool thermalProtection;
+    int16_t temperatureDeci;            // Decimi di grado
+    int8_t utcOffsetHours;
+    bool isDST;
+    bool memoryAlarm;                   // Allarme di HeapMonitor (heap o stack)
+    uint16_t freeHeapKb;                // Mostrato solo con l'allarme attivo
+};
+
+// Una riga di stato: etichetta e valore con colori distinti
+struct ScreenLine {
+    char label[32];
+    char value[24];
+    uint16_t labelColor;
+    uint16_t valueColor;
+};
+
+class StatusScreen {
+private:
+    TFT_eSPI& tft;
+    TFT_eSprite glyphA, glyphB;         // Una cifra dell'orologio (B solo con DMA)
+    TFT_eSprite stripA, stripB;         // Una riga di testo a tutta larghezza (B solo con DMA)
+    bool useSprites;
+    bool useDma;
+    uint8_t glyphFlip;
+    uint8_t stripFlip;
+    bool fullPending;
+
+    // Contenuto attualmente sul display (solo task del display)
+    bool shownTimeValid;
+    char shownTime[SCREEN_CLOCK_CHARS + 1];
+    char shownDate[11];
+    ScreenLine shown[SCREEN_LINES];
+
+    // Richieste verso il task, protette da mux
+    TaskHandle_t task;
+    portMUX_TYPE mux;
+    ScreenState pending;
+    bool pendingState;
+    bool pendingAp;
+    char apSsid[33];
+    char apPassword[65];
+    uint32_t apIp;
+    volatile bool redrawRequested;
+
+    volatile uint32_t lastBytes;        // Byte di pixel inviati nell'ultimo render
+    volatile uint32_t totalBytes;
+    volatile uint32_t fullRedraws;
+    volatile uint32_t partialRedraws;
+    uint32_t renderBytes;
+    uint8_t backlight;                  // Percentuale impostata
+
+    static void taskEntry(void* arg);
+    void taskLoop();
+    static void buildLines(const ScreenState& s, ScreenLine* out);
+    TFT_eSprite& nextGlyph();
+    TFT_eSprite& nextStrip();
+    void push(TFT_eSprite& sprite, int16_t x, int16_t y, int16_t w, int16_t h);
+    void waitDma();
+    void render(const ScreenState& s);
+    void drawAp();
+    void drawFull(const ScreenState& s, const ScreenLine* lines);
+    void drawClockChar(uint8_t i, char c);
+    void drawNoTime();
+    void drawDate(const char* date);
+    void drawLine(uint8_t i, const ScreenLine& line);
+
+public:
+    StatusScreen(TFT_eSPI& display);
+
+    // Dopo tft.init()/setRotation(): alloca gli sprite, attiva il DMA e avvia il task
+    void begin();
+    // Pubblica lo stato da mostrare (dal loop): il task lo confronta con quanto
+    // mostrato e aggiorna solo le zone cambiate
+    void post(const ScreenState& s);
+    // Da qualunque contesto (handler web compresi): il loop pubblicherà subito
+    // uno stato aggiornato invece di attendere il tick successivo
+    void requestRedraw();
+    bool takeRedrawRequest();
+    // Schermata dell'access point di configurazione; il post successivo
+    // ridisegna per intero la schermata di stato
+    void showApScreen(const char* ssid, const char* password, uint32_t ip);
+    // Retroilluminazione in PWM (0-100%); non tocca il TFT, usabile dal loop
+    void setBacklight(uint8_t percent);
+    uint8_t getBacklight() { return backlight; }
+
+    bool isDmaEnabled();
+    uint32_t getLastBytes();
+    uint32_t getTotalBytes();
+    uint32_t getFullRedraws();
+    uint32_t getPartialRedraws();
+};
+
+extern StatusScreen statusScreen;
+
+#endif
@@ -0,0 +1,85 @@
+#ifndef STATUS_SNAPSHOT_H
+#define STATUS_SNAPSHOT_H
+
+#include "config.h"
+
+// Istantanea di /api/status serializzata una volta per generazione.
+// Il loop raccoglie i campi (solo valori già in RAM, niente I2C) e li confronta
+// con quelli dell'istantanea: se qualcosa è cambiato il JSON viene rigenerato
+// nel buffer libero e pubblicato. L'handler HTTP copia il buffer pubblicato
+// nella risposta con un ETag e risponde 304 a If-None-Match, senza costruire
+// documenti.
+// Lo stesso documento viene serializzato anche in MessagePack per i client
+// automatici (Accept: application/msgpack), con un ETag distinto.
+
+#define STATUS_SNAPSHOT_CHECK 250           // Intervallo di confronto dei campi (ms)
+#define STATUS_SNAPSHOT_MIN_INTERVAL 1000   // Distanza minima tra due rigenerazioni (ms)
+#define STATUS_SNAPSHOT_MAX_AGE 60000       // Rigenera comunque (uptimeMs) dopo questo tempo (ms)
+#define STATUS_SNAPSHOT_SIZE 768
+#define STATUS_SNAPSHOT_PACK_SIZE 512
+
+// Campi di /api/status (uptimeMs e bootEpoch vengono aggiunti alla serializzazione)
+struct StatusFields {
+    bool wifiConnected;
+    bool ntpSynced;
+    bool rtcConnected;
+    bool bellsEnabled;
+    bool testMode;
+    bool schedulerActive;
+    bool apMode;
+    bool isDST;
+    bool temperatureWarning;
+    bool thermalProtection;
+    int32_t timezoneOffset;
+    int8_t utcOffsetHours;
+    uint32_t totalBellRings;
+    uint32_t lastBellTime;
+    int16_t temperatureDeci;            // Temperatura in decimi di grado (evita rigenerazioni per rumore)
+    uint32_t ip;                        // IP di stazione o dell'access point
+};
+
+struct StatusSlot {
+    char json[STATUS_SNAPSHOT_SIZE];
+    uint16_t length;
+    char etag[24];
+    uint8_t pack[STATUS_SNAPSHOT_PACK_SIZE];    // MessagePack
+    uint16_t packLength;
+    char packEtag[28];
+};
+
+class StatusSnapshot {
+private:
+    // Due buffer: si scrive sempre in quello non pubblicato, così una risposta
+    // appena avviata non vede mai un JSON a metà
+    StatusSlot slots[2];
+    StatusSlot* published;
+    StatusFields fields;
+    uint32_t generation;
+    uint32_t instance;                  // Casuale per avvio: gli ETag non si ripetono dopo un riavvio
+    uint32_t builtMs;
+    uint32_t lastCheckMs;
+    volatile bool dirty;
+    const char* firmwareVersion;
+    uint32_t (*readEpoch)();            // Ora UNIX corrente (0 se non disponibile), letta solo in build()
+
+    void build(const StatusFields& f);
+
+public:
+    StatusSnapshot();
+    void begin(const char* firmware, uint32_t (*epochSource)());
+
+    // true quando è il momento di confrontare i campi
+    bool checkDue();
+    // Rigenera l'istantanea se i campi sono cambiati (o è troppo vecchia)
+    void update(const StatusFields& f);
+    // Forza la rigenerazione al prossimo update (es. dopo un comando dalla UI)
+    void invalidate();
+
+    // Istantanea pubblicata (mai nullptr dopo begin)
+    const StatusSlot* current();
+    uint32_t getGeneration();
+};
+
+extern StatusSnapshot statusSnapshot;
+
+#endif
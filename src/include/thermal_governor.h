@@ -0,0 +1,116 @@
+#ifndef THERMAL_GOVERNOR_H
+#define THERMAL_GOVERNOR_H
+
+#include "config.h"
+
+// Protezione termica a gradini, al posto dell'arresto di emergenza secco.
+// Il sensore interno viene letto solo qui, ogni THERMAL_SAMPLE_MS, e filtrato
+// con una media mobile su THERMAL_AVG_SAMPLES campioni (il sensore dell'ESP32
+// è rumoroso di qualche grado). Ogni livello aggiunge una mitigazione a quelle
+// dei precedenti:
+//   DIM      retroilluminazione a THERMAL_DIM_PERCENT
+//   WIFI     potenza TX al minimo (WIFI_TX_MIN)
+//   CPU      frequenza massima a POWER_MIN_MHZ
+//   HTTP     ricarica dei bucket e richieste in corso ridotte (RateLimiter)
+//   MELODIES nuove melodie da web/seriale rifiutate; programmazioni, eventi
+//            speciali e pulsanti suonano ancora, quella in corso non si ferma
+//   STOP     arresto di emergenza e nessuna melodia: solo se la media resta
+//            sopra THERMAL_STOP_C per THERMAL_STOP_HOLD_MS
+// Si sale subito (anche di più livelli), si scende di un livello alla volta
+// quando la media è sotto la soglia di THERMAL_HYSTERESIS gradi e il livello è
+// attivo da almeno THERMAL_DOWN_HOLD_MS.
+// Ogni cambio di livello va a log e nel registro eventi (HIST_THERMAL); la
+// media di ogni minuto dell'ultima ora resta in RAM per /api/thermal.
+
+#define THERMAL_SAMPLE_MS 2000
+#define THERMAL_AVG_SAMPLES 8           // Media su 16 s
+#define THERMAL_HYSTERESIS 3.0
+#define THERMAL_DOWN_HOLD_MS 60000
+#define THERMAL_STOP_HOLD_MS 30000
+#define THERMAL_DIM_PERCENT 25
+
+// Soglie (°C) sulla media
+#define THERMAL_DIM_C TEMP_WARNING_THRESHOLD
+#define THERMAL_WIFI_C 73.0
+#define THERMAL_CPU_C 76.0
+#define THERMAL_HTTP_C TEMP_CRITICAL_THRESHOLD
+#define THERMAL_MELODIES_C 82.0
+#define THERMAL_STOP_C TEMP_SHUTDOWN_THRESHOLD
+
+#define THERMAL_TRACE_SIZE 60           // Medie al minuto conservate
+#define THERMAL_TRACE_MS 60000
+#define THERMAL_RECENT_SIZE 8           // Ultimi cambi di livello in RAM
+
+enum ThermalLevel {
+    THERMAL_NORMAL = 0,
+    THERMAL_DIM,
+    THERMAL_WIFI,
+    THERMAL_CPU,
+    THERMAL_HTTP,
+    THERMAL_MELODIES,
+    THERMAL_STOP,
+    THERMAL_LEVEL_COUNT
+};
+
+struct ThermalChange {
+    uint32_t uptimeS;
+    uint8_t from;
+    uint8_t to;
+    int16_t temperatureDeci;
+};
+
+class ThermalGovernor {
+private:
+    int16_t samples[THERMAL_AVG_SAMPLES];   // Decimi di grado
+    int32_t sampleSum;
+    uint8_t sampleIndex;
+    bool primed;                        // Finestra riempita con la prima lettura
+    int16_t lastRawDeci;
+    int16_t averageDeci;
+    int16_t peakDeci;
+    uint32_t readErrors;
+
+    uint8_t level;
+    uint32_t levelSinceMs;
+    uint32_t stopCandidateMs;           // Media sopra THERMAL_STOP_C da (0 = no)
+    uint32_t lastSampleMs;
+    uint32_t levelMs[THERMAL_LEVEL_COUNT];  // Tempo passato in ogni livello
+    uint32_t changes;
+    uint32_t stops;
+
+    ThermalChange recent[THERMAL_RECENT_SIZE];
+    uint8_t recentHead;
+    uint8_t recentCount;
+
+    int16_t trace[THERMAL_TRACE_SIZE];
+    uint8_t traceHead;
+    uint8_t traceCount;
+    int32_t traceSum;                   // Somma dei campioni del minuto in corso
+    uint16_t traceSamples;
+    uint32_t lastTraceMs;
+
+    uint8_t targetLevel(uint32_t now);
+    void setLevel(uint8_t next, uint32_t now);
+    void apply();
+    static float threshold(uint8_t level);
+
+public:
+    ThermalGovernor();
+
+    // Prima lettura e stato iniziale (dal setup)
+    void begin();
+    // Dal loop: campiona se è trascorso l'intervallo
+    void update();
+
+    float getTemperature() { return averageDeci / 10.0f; }
+    uint8_t getLevel() { return level; }
+
+    // JSON di /api/thermal e riepilogo per il comando seriale "temp"
+    void print(Print& out);
+    void printSummary(Print& out);
+    static const char* levelName(uint8_t level);
+};
+
+extern ThermalGovernor thermalGovernor;
+
+#endif
@@ -0,0 +1,65 @@
+#ifndef WEB_STATS_H
+#define WEB_STATS_H
+
+#include "config.h"
+#include <ESPAsyncWebServer.h>
+
+// Statistiche del livello web: connessioni aperte, riuso delle connessioni e
+// latenza per percorso (dalla fine delle intestazioni alla chiusura della
+// connessione, cioè risposta completamente inviata).
+// I contatori vengono aggiornati da RateLimiter, il primo handler che vede ogni
+// richiesta; le connessioni SSE (/api/events) non vengono misurate.
+// Heap per percorso: se il minimo storico dell'heap scende mentre una richiesta è
+// in corso, la discesa (rispetto al libero all'arrivo) viene attribuita al suo
+// percorso. È il picco che ha spinto l'heap più in basso, non quello di ogni
+// richiesta; con più richieste contemporanee lo prende quella che chiude per prima.
+
+#define WEB_STATS_OPEN_SLOTS 8            // Connessioni aperte tracciate
+
+struct RouteLatency {
+    const char* prefix;
+    uint32_t count;
+    uint32_t totalMs;
+    uint32_t maxMs;
+    uint32_t heapPeak;                  // Massima discesa dell'heap attribuita (byte)
+    uint16_t heapLows;                  // Volte in cui ha abbassato il minimo storico
+};
+
+class WebStats {
+private:
+    // Connessioni aperte: AsyncClient* e numero di richieste servite su ciascuna
+    const void* openClients[WEB_STATS_OPEN_SLOTS];
+    uint16_t openRequests[WEB_STATS_OPEN_SLOTS];
+    uint8_t openCount;
+    uint8_t openPeak;
+    uint32_t connections;               // Connessioni distinte viste
+    uint32_t requests;                  // Richieste ammesse
+    uint32_t reused;                    // Richieste arrivate su una connessione già aperta
+
+    static uint8_t routeIndex(const String& url);
+
+public:
+    // Stato di una richiesta misurata, da restituire a finish()
+    struct Token {
+        const void* client;
+        uint32_t startMs;
+        uint32_t startFree;
+        uint32_t startMinFree;
+        uint8_t route;
+        int8_t slot;
+    };
+
+    WebStats();
+
+    // Richiesta ammessa: registra la connessione e avvia la misura
+    Token track(AsyncWebServerRequest* request);
+    // Connessione chiusa (onDisconnect della richiesta)
+    void finish(const Token& t);
+
+    // JSON di /api/web-stats
+    void print(Print& out);
+};
+
+extern WebStats webStats;
+
+#endif
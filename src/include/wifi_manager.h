@@ -0,0 +1,116 @@
+#ifndef WIFI_MANAGER_H
+#define WIFI_MANAGER_H
+
+#include "config.h"
+#include <WiFi.h>
+
+// Gestione della connessione WiFi per tutta la vita del dispositivo.
+//  - Gli eventi di WiFi.onEvent (task degli eventi di rete) aggiornano solo flag
+//    e contatori; le azioni avvengono in update(), chiamata dal loop.
+//  - Connessione persa o tentativo scaduto: nuovo tentativo dopo un'attesa che
+//    raddoppia a ogni fallimento (da WIFI_BACKOFF_MIN_MS a WIFI_BACKOFF_MAX_MS)
+//    con ±25% di variazione casuale, per non ritentare tutti insieme dopo il
+//    riavvio dell'access point.
+//  - Se la rete manca da più di WIFI_AP_AFTER_MS si accende anche l'AP di
+//    configurazione (AP+STA): il dispositivo resta raggiungibile mentre continua
+//    a ritentare. L'AP si spegne quando la rete torna e nessuno vi è collegato.
+//  - Da connesso la potenza di trasmissione segue l'RSSI medio: scende con
+//    segnale forte, sale con segnale debole, entro WIFI_TX_MIN..WIFI_TX_MAX.
+//    setTxCap() abbassa il tetto (protezione termica), tentativi compresi.
+// forceAp() (pulsante CONFIG) passa al solo AP e sospende i tentativi.
+
+#define WIFI_CONNECT_TIMEOUT_MS 15000   // Durata massima di un tentativo
+#define WIFI_BACKOFF_MIN_MS 2000
+#define WIFI_BACKOFF_MAX_MS 300000
+#define WIFI_AP_AFTER_MS 20000          // Senza rete da tanto: AP di recupero
+#define WIFI_RSSI_SAMPLE_MS 5000
+#define WIFI_TX_SETTLE_MS 30000         // Attesa minima tra due cambi di potenza
+#define WIFI_RSSI_STRONG -55            // Sopra: si abbassa la potenza
+#define WIFI_RSSI_WEAK -72              // Sotto: si alza la potenza
+#define WIFI_TX_CONNECT WIFI_POWER_11dBm    // Potenza durante i tentativi
+#define WIFI_TX_MIN 0                   // Indici nella tabella dei livelli (wifi_manager.cpp)
+#define WIFI_TX_MAX 5
+#define WIFI_TX_START 2                 // 8.5 dBm appena connesso, come in passato
+
+enum WifiLinkState {
+    WIFI_LINK_OFF = 0,                  // Nessuna credenziale: solo AP
+    WIFI_LINK_CONNECTING,
+    WIFI_LINK_CONNECTED,
+    WIFI_LINK_BACKOFF,                  // In attesa del prossimo tentativo
+    WIFI_LINK_AP_ONLY                   // AP forzato, nessun tentativo
+};
+
+typedef void (*WifiLinkCallback)(bool connected);
+
+class WifiManager {
+private:
+    char ssid[33];
+    char password[65];
+    uint8_t state;
+    bool apActive;
+    bool modemSleep;
+    WifiLinkCallback callback;
+    const char* apSsid;
+    const char* apPassword;
+
+    // Scritti dal task degli eventi di rete
+    volatile bool gotIp;
+    volatile bool lost;
+    volatile uint8_t lastReason;
+    volatile uint16_t apStations;
+
+    uint32_t stateMs;                   // Ingresso nello stato attuale
+    uint32_t downSinceMs;               // Inizio dell'assenza di rete (0 = connesso)
+    uint32_t backoffMs;                 // Attesa prima del prossimo tentativo
+    uint32_t attempts;
+    uint32_t failures;                  // Tentativi consecutivi falliti
+    uint32_t connects;
+    uint32_t disconnects;
+    uint32_t downtimeMs;                // Totale senza rete dopo la prima connessione
+    bool everConnected;
+
+    int16_t rssiAvg;                    // Media mobile ×4 (dBm)
+    int8_t rssiLast;
+    uint8_t txLevel;
+    uint8_t txCap;                      // Livello massimo consentito
+    uint32_t txChanges;
+    uint32_t lastRssiMs;
+    uint32_t lastTxChangeMs;
+
+    void onEvent(arduino_event_id_t event, arduino_event_info_t info);
+    void connect();
+    void scheduleRetry();
+    void setAp(bool on);
+    void setTxLevel(uint8_t level);
+    wifi_power_t connectPower();
+    void adaptTxPower();
+
+public:
+    WifiManager();
+
+    // Carica le credenziali e avvia il primo tentativo; false (e AP acceso) se mancano
+    bool begin(const char* apName, const char* apPass);
+    // Chiamato al cambio di stato del collegamento, dal loop
+    void setCallback(WifiLinkCallback cb) { callback = cb; }
+    // Modem sleep da stazione (risveglio al DTIM), prima di begin()
+    void setModemSleep(bool on) { modemSleep = on; }
+    void update();
+    void forceAp();
+    // Tetto alla potenza TX (indice in WIFI_TX_MIN..WIFI_TX_MAX), applicato subito
+    void setTxCap(uint8_t level);
+    uint8_t getTxCap() { return txCap; }
+
+    bool isConnected() { return state == WIFI_LINK_CONNECTED; }
+    bool isApActive() { return apActive; }
+    uint8_t getState() { return state; }
+    int8_t getRssi() { return rssiLast; }
+    float getTxDbm();
+
+    // JSON di /api/wifi
+    void print(Print& out);
+    static const char* stateName(uint8_t state);
+};
+
+extern WifiManager wifiManager;
+
+#endif
@@ -0,0 +1,284 @@
+#include "include/json_stream.h"
+#include <stdlib.h>
+#include <string.h>
+
+long JsonStreamHandler::toLong(JsonValueType type, const char* text, long fallback) {
+    if (type != JSON_NUMBER) return fallback;
+    return strtol(text, nullptr, 10);
+}
+
+bool JsonStreamHandler::toBool(JsonValueType type, const char* text, bool fallback) {
+    if (type == JSON_BOOL) return text[0] == 't';
+    if (type == JSON_NUMBER) return strtol(text, nullptr, 10) != 0;
+    return fallback;
+}
+
+JsonStreamParser::JsonStreamParser(JsonStreamHandler* handler) {
+    this->handler = handler;
+    reset();
+}
+
+void JsonStreamParser::reset() {
+    state = ST_VALUE;
+    readingKey = false;
+    depth = 0;
+    arrayMask = 0;
+    keys[0][0] = '\0';
+    value[0] = '\0';
+    valueLen = 0;
+    unicode = 0;
+    unicodeDigits = 0;
+    highSurrogate = 0;
+    error = nullptr;
+    consumed = 0;
+}
+
+bool JsonStreamParser::inArray() {
+    return depth > 0 && (arrayMask & (1 << (depth - 1)));
+}
+
+void JsonStreamParser::fail(const char* message) {
+    state = ST_ERROR;
+    error = message;
+}
+
+// Chiavi e valori troppo lunghi sono un errore: un nome troncato verrebbe
+// salvato come se fosse quello inviato
+void JsonStreamParser::appendChar(char c) {
+    if (state == ST_ERROR) return;
+    if (readingKey) {
+        char* key = keys[depth];
+        size_t n = strlen(key);
+        if (n >= JSON_STREAM_KEY_LEN - 1) { fail("chiave troppo lunga"); return; }
+        key[n] = c;
+        key[n + 1] = '\0';
+    } else {
+        if (valueLen >= JSON_STREAM_VALUE_LEN - 1) { fail("valore troppo lungo"); return; }
+        value[valueLen++] = c;
+        value[valueLen] = '\0';
+    }
+}
+
+void JsonStreamParser::appendUtf8(uint32_t cp) {
+    if (cp < 0x80) {
+        appendChar((char)cp);
+    } else if (cp < 0x800) {
+        appendChar((char)(0xC0 | (cp >> 6)));
+        appendChar((char)(0x80 | (cp & 0x3F)));
+    } else if (cp < 0x10000) {
+        appendChar((char)(0xE0 | (cp >> 12)));
+        appendChar((char)(0x80 | ((cp >> 6) & 0x3F)));
+        appendChar((char)(0x80 | (cp & 0x3F)));
+    } else {
+        appendChar((char)(0xF0 | (cp >> 18)));
+        appendChar((char)(0x80 | ((cp >> 12) & 0x3F)));
+        appendChar((char)(0x80 | ((cp >> 6) & 0x3F)));
+        appendChar((char)(0x80 | (cp & 0x3F)));
+    }
+}
+
+// Fine di un \uXXXX: le coppie di surrogati diventano un solo carattere UTF-8
+// a 4 byte (non due da 3, che non sarebbero UTF-8 valido)
+void JsonStreamParser::endUnicodeEscape() {
+    uint16_t cp = unicode;
+    if (highSurrogate) {
+        if (cp < 0xDC00 || cp > 0xDFFF) { fail("surrogato UTF-16 isolato"); return; }
+        uint32_t full = 0x10000 + (((uint32_t)highSurrogate - 0xD800) << 10) + (cp - 0xDC00);
+        highSurrogate = 0;
+        state = ST_STRING;
+        appendUtf8(full);
+    } else if (cp >= 0xD800 && cp <= 0xDBFF) {
+        highSurrogate = cp;
+        state = ST_LOW_SURROGATE;
+    } else if (cp >= 0xDC00 && cp <= 0xDFFF) {
+        fail("surrogato UTF-16 isolato");
+    } else if (cp == 0) {
+        fail("carattere nullo nella stringa");
+    } else {
+        state = ST_STRING;
+        appendUtf8(cp);
+    }
+}
+
+// La chiave del contenitore è quella sotto cui è stato aperto (keys[depth])
+void JsonStreamParser::beginContainer(bool isArray) {
+    if (depth >= JSON_STREAM_MAX_DEPTH) { fail("annidamento eccessivo"); return; }
+    const char* key = inArray() ? "" : keys[depth];
+    if (isArray) handler->onStartArray(depth, key);
+    else handler->onStartObject(depth, key);
+    if (isArray) arrayMask |= (1 << depth);
+    else arrayMask &= ~(1 << depth);
+    depth++;
+    keys[depth][0] = '\0';
+    if (state == ST_ERROR) return;
+    state = isArray ? ST_FIRST_VALUE : ST_FIRST_KEY;
+}
+
+bool JsonStreamParser::endContainer(bool isArray) {
+    if (depth == 0 || inArray() != isArray) { fail("chiusura non attesa"); return false; }
+    depth--;
+    const char* key = inArray() ? "" : keys[depth];
+    if (isArray) handler->onEndArray(depth, key);
+    else handler->onEndObject(depth, key);
+    afterValue();
+    return true;
+}
+
+void JsonStreamParser::emitValue(JsonValueType type) {
+    const char* key = inArray() ? "" : keys[depth];
+    handler->onValue(depth, key, type, value);
+    valueLen = 0;
+    value[0] = '\0';
+    afterValue();
+}
+
+void JsonStreamParser::afterValue() {
+    if (state == ST_ERROR) return;      // Fermato dal gestore (abort)
+    state = (depth == 0) ? ST_DONE : ST_AFTER_VALUE;
+}
+
+bool JsonStreamParser::processChar(char c) {
+    bool space = (c == ' ' || c == '\t' || c == '\r' || c == '\n');
+    switch (state) {
+        case ST_VALUE:
+        case ST_FIRST_VALUE:
+            if (space) return true;
+            if (c == '{') beginContainer(false);
+            else if (c == '[') beginContainer(true);
+            else if (c == ']' && state == ST_FIRST_VALUE) endContainer(true);   // array vuoto (non dopo ',')
+            else if (c == '"') { readingKey = false; valueLen = 0; value[0] = '\0'; state = ST_STRING; }
+            else if (c == '-' || (c >= '0' && c <= '9')) { valueLen = 0; appendChar(c); state = ST_NUMBER; }
+            else if (c == 't' || c == 'f' || c == 'n') { valueLen = 0; appendChar(c); state = ST_LITERAL; }
+            else fail("valore non valido");
+            return true;
+
+        case ST_FIRST_KEY:
+        case ST_KEY:
+            if (space) return true;
+            if (c == '"') { readingKey = true; keys[depth][0] = '\0'; state = ST_STRING; }
+            else if (c == '}' && state == ST_FIRST_KEY) endContainer(false);
+            else fail("chiave attesa");
+            return true;
+
+        case ST_COLON:
+            if (space) return true;
+            if (c == ':') state = ST_VALUE;
+            else fail("':' atteso");
+            return true;
+
+        case ST_AFTER_VALUE:
+            if (space) return true;
+            if (c == ',') state = inArray() ? ST_VALUE : ST_KEY;
+            else if (c == '}') endContainer(false);
+            else if (c == ']') endContainer(true);
+            else fail("',' atteso");
+            return true;
+
+        case ST_STRING:
+            if (c == '"') {
+                if (readingKey) { readingKey = false; state = ST_COLON; }
+                else emitValue(JSON_STRING);
+            } else if (c == '\\') {
+                state = ST_STRING_ESCAPE;
+            } else if ((uint8_t)c < 0x20) {
+                fail("carattere di controllo nella stringa");
+            } else {
+                appendChar(c);
+            }
+            return true;
+
+        case ST_STRING_ESCAPE:
+            state = ST_STRING;
+            if (highSurrogate && c != 'u') { fail("surrogato UTF-16 isolato"); return true; }
+            switch (c) {
+                case '"': appendChar('"'); break;
+                case '\\': appendChar('\\'); break;
+                case '/': appendChar('/'); break;
+                case 'b': appendChar('\b'); break;
+                case 'f': appendChar('\f'); break;
+                case 'n': appendChar('\n'); break;
+                case 'r': appendChar('\r'); break;
+                case 't': appendChar('\t'); break;
+                case 'u': unicode = 0; unicodeDigits = 0; state = ST_STRING_UNICODE; break;
+                default: fail("escape non valido");
+            }
+            return true;
+
+        case ST_STRING_UNICODE: {
+            uint8_t v;
+            if (c >= '0' && c <= '9') v = c - '0';
+            else if (c >= 'a' && c <= 'f') v = c - 'a' + 10;
+            else if (c >= 'A' && c <= 'F') v = c - 'A' + 10;
+            else { fail("escape unicode non valido"); return true; }
+            unicode = (unicode << 4) | v;
+            if (++unicodeDigits == 4) endUnicodeEscape();
+            return true;
+        }
+
+        case ST_LOW_SURROGATE:
+            if (c == '\\') state = ST_STRING_ESCAPE;
+            else fail("surrogato UTF-16 isolato");
+            return true;
+
+        case ST_NUMBER:
+            if ((c >= '0' && c <= '9') || c == '.' || c == 'e' || c == 'E' || c == '+' || c == '-') {
+                appendChar(c);
+                return true;
+            }
+            emitValue(JSON_NUMBER);
+            return false;   // il terminatore appartiene allo stato successivo
+
+        case ST_LITERAL:
+            if (c >= 'a' && c <= 'z') {
+                appendChar(c);
+                return true;
+            }
+            if (strcmp(value, "true") == 0 || strcmp(value, "false") == 0) emitValue(JSON_BOOL);
+            else if (strcmp(value, "null") == 0) emitValue(JSON_NULL);
+            else { fail("letterale non valido"); return true; }
+            return false;
+
+        case ST_DONE:
+            if (!space) fail("dati dopo la fine del documento");
+            return true;
+
+        case ST_ERROR:
+        default:
+            return true;
+    }
+}
+
+bool JsonStreamParser::feed(const uint8_t* data, size_t len) {
+    for (size_t i = 0; i < len && state != ST_ERROR; ) {
+        if (processChar((char)data[i])) {
+            i++;
+            consumed++;
+        }
+    }
+    return state != ST_ERROR;
+}
+
+bool JsonStreamParser::finish() {
+    // Un numero in radice termina con la fine del body
+    if (state == ST_NUMBER && depth == 0) emitValue(JSON_NUMBER);
+    if (state == ST_LITERAL && depth == 0) processChar(' ');
+    if (state == ST_ERROR) return false;
+    if (state != ST_DONE) { fail("documento incompleto"); return false; }
+    return true;
+}
+
+bool JsonStreamParser::hasError() {
+    return state == ST_ERROR;
+}
+
+void JsonStreamParser::abort(const char* message) {
+    fail(message);
+}
+
+const char* JsonStreamParser::errorMessage() {
+    return error ? error : "";
+}
+
+size_t JsonStreamParser::bytesConsumed() {
+    return consumed;
+}
@@ -0,0 +1,81 @@
+#include "include/json_writer.h"
+#include <memory>
+
+JsonChunkWriter::JsonChunkWriter(uint8_t* buffer, size_t maxLen, const JsonListCursor& c)
+    : out(buffer), cap(maxLen), len(0), skip(0), itemBytes(0), overflow(false), isElement(false), cursor(c) {}
+
+void JsonChunkWriter::beginItem(size_t alreadySent) {
+    skip = alreadySent;
+    itemBytes = alreadySent;
+    isElement = false;
+}
+
+void JsonChunkWriter::put(char c) {
+    if (skip > 0) { skip--; return; }
+    if (len >= cap) { overflow = true; return; }
+    out[len++] = (uint8_t)c;
+    itemBytes++;
+}
+
+void JsonChunkWriter::element() {
+    isElement = true;
+    if (cursor.elements > 0) put(',');
+}
+
+void JsonChunkWriter::raw(const char* s) {
+    while (*s && !overflow) put(*s++);
+}
+
+void JsonChunkWriter::string(const char* s) {
+    static const char HEX_DIGITS[] = "0123456789abcdef";
+    put('"');
+    for (; *s && !overflow; s++) {
+        uint8_t c = (uint8_t)*s;
+        if (c == '"' || c == '\\') { put('\\'); put((char)c); }
+        else if (c == '\n') { put('\\'); put('n'); }
+        else if (c < 0x20) {
+            put('\\'); put('u'); put('0'); put('0');
+            put(HEX_DIGITS[c >> 4]); put(HEX_DIGITS[c & 0x0F]);
+        } else {
+            put((char)c);           // UTF-8 passa invariato
+        }
+    }
+    put('"');
+}
+
+void JsonChunkWriter::number(long v) {
+    char buf[12];
+    snprintf(buf, sizeof(buf), "%ld", v);
+    raw(buf);
+}
+
+void JsonChunkWriter::number(unsigned long v) {
+    char buf[12];
+    snprintf(buf, sizeof(buf), "%lu", v);
+    raw(buf);
+}
+
+void JsonChunkWriter::boolean(bool v) {
+    raw(v ? "true" : "false");
+}
+
+AsyncWebServerResponse* beginJsonList(AsyncWebServerRequest* request, JsonListEmitter emit) {
+    std::shared_ptr<JsonListCursor> cursor(new JsonListCursor());
+    return request->beginChunkedResponse("application/json",
+        [cursor, emit](uint8_t* buffer, size_t maxLen, size_t index) -> size_t {
+            JsonChunkWriter w(buffer, maxLen, *cursor);
+            while (!cursor->done) {
+                w.beginItem(cursor->offset);
+                if (!emit(w, cursor->item)) { cursor->done = true; break; }
+                if (w.full()) {
+                    // Elemento a metà: si riprende da qui alla prossima richiamata
+                    cursor->offset = (uint16_t)w.itemLength();
+                    break;
+                }
+                if (w.wasElement()) cursor->elements++;
+                cursor->item++;
+                cursor->offset = 0;
+            }
+            return w.length();
+        });
+}
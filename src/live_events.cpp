@@ -0,0 +1,141 @@
+#include "include/live_events.h"
+#include "include/history_log.h"
+
+LiveEvents liveEvents;
+
+#define LIVE_HISTORY_BATCH 8              // Record del registro inoltrati per ciclo di loop
+
+static const char* temperatureBandName(uint8_t band) {
+    switch (band) {
+        case 2: return "CRITICA";
+        case 1: return "ELEVATA";
+        default: return "OK";
+    }
+}
+
+LiveEvents::LiveEvents()
+    : source(LIVE_EVENTS_PATH), hasSent(false), fullRequested(false),
+      lastClockMs(0), lastHistorySeq(0), messageId(0) {
+    memset(&sent, 0, sizeof(sent));
+}
+
+void LiveEvents::begin(AsyncWebServer& server) {
+    source.onConnect([this](AsyncEventSourceClient* client) {
+        // Gira nel task di rete: qui si imposta solo il ritardo di riconnessione,
+        // lo stato completo viene inviato dal loop al prossimo update()
+        client->send("hello", NULL, messageId, LIVE_RECONNECT_MS);
+        fullRequested = true;
+    });
+    server.addHandler(&source);
+}
+
+size_t LiveEvents::clientCount() {
+    return source.count();
+}
+
+// Serializza i campi di stato; con previous != nullptr solo quelli cambiati.
+// Restituisce 0 se non c'è nulla da inviare.
+size_t LiveEvents::formatStatus(const LiveState& s, const LiveState* previous) {
+    size_t n = 0;
+    bool any = false;
+    auto field = [&](const char* key, const char* fmt, unsigned value, bool changed) {
+        if (!changed || n >= sizeof(buffer)) return;
+        n += snprintf(buffer + n, sizeof(buffer) - n, "%s\"%s\":", any ? "," : "{", key);
+        if (n < sizeof(buffer)) n += snprintf(buffer + n, sizeof(buffer) - n, fmt, value);
+        any = true;
+    };
+    auto boolField = [&](const char* key, bool value, bool changed) {
+        if (!changed || n >= sizeof(buffer)) return;
+        n += snprintf(buffer + n, sizeof(buffer) - n, "%s\"%s\":%s", any ? "," : "{", key, value ? "true" : "false");
+        any = true;
+    };
+#define LIVE_CHANGED(f) (!previous || previous->f != s.f)
+    boolField("bellsEnabled", s.bellsEnabled, LIVE_CHANGED(bellsEnabled));
+    boolField("testMode", s.testMode, LIVE_CHANGED(testMode));
+    boolField("isPlaying", s.isPlaying, LIVE_CHANGED(isPlaying));
+    field("activeMelody", "%u", s.activeMelody, LIVE_CHANGED(activeMelody));
+    boolField("wifiConnected", s.wifiConnected, LIVE_CHANGED(wifiConnected));
+    boolField("ntpSynced", s.ntpSynced, LIVE_CHANGED(ntpSynced));
+    boolField("rtcConnected", s.rtcConnected, LIVE_CHANGED(rtcConnected));
+    if (LIVE_CHANGED(temperatureBand) && n < sizeof(buffer)) {
+        n += snprintf(buffer + n, sizeof(buffer) - n, "%s\"temperatureStatus\":\"%s\"",
+                      any ? "," : "{", temperatureBandName(s.temperatureBand));
+        any = true;
+    }
+    field("totalBellRings", "%u", s.totalBellRings, LIVE_CHANGED(totalBellRings));
+#undef LIVE_CHANGED
+    if (!any) return 0;
+    if (n + 2 > sizeof(buffer)) return 0;          // Non dovrebbe accadere: tutti i campi sono corti
+    buffer[n++] = '}';
+    buffer[n] = '\0';
+    return n;
+}
+
+void LiveEvents::sendStatus(const LiveState& s) {
+    bool full = fullRequested || !hasSent;
+    fullRequested = false;
+    if (formatStatus(s, full ? nullptr : &sent) > 0) {
+        source.send(buffer, "status", ++messageId);
+    }
+    if (full || s.relay1 != sent.relay1 || s.relay2 != sent.relay2) {
+        snprintf(buffer, sizeof(buffer), "{\"relay1_raw\":%u,\"relay2_raw\":%u,\"enabled\":%s}",
+                 s.relay1, s.relay2, s.bellsEnabled ? "true" : "false");
+        source.send(buffer, "relay", ++messageId);
+    }
+    sent = s;
+    hasSent = true;
+}
+
+void LiveEvents::forwardHistory() {
+    if (!historyLog.isAvailable()) return;
+    uint32_t last = historyLog.getNextSeq() - 1;
+    if (last == lastHistorySeq) return;
+    uint32_t sector, slot;
+    if (!historyLog.seek(lastHistorySeq, sector, slot)) {
+        lastHistorySeq = last;
+        return;
+    }
+    HistoryRecord r;
+    for (uint8_t i = 0; i < LIVE_HISTORY_BATCH; i++) {
+        if (!historyLog.readNext(sector, slot, lastHistorySeq + 1, r)) {
+            // Record non leggibili (o sovrascritti): si riparte dall'ultimo scritto
+            lastHistorySeq = last;
+            return;
+        }
+        lastHistorySeq = r.seq;
+        int n = snprintf(buffer, sizeof(buffer),
+                         "{\"seq\":%u,\"%s\":%u,\"type\":\"%s\",\"source\":\"%s\"",
+                         (unsigned)r.seq, (r.type & HISTORY_UPTIME_FLAG) ? "uptime" : "epoch",
+                         (unsigned)r.epoch, HistoryLog::typeName(r.type), HistoryLog::sourceName(r.source));
+        if (r.melody != HISTORY_NONE) n += snprintf(buffer + n, sizeof(buffer) - n, ",\"melody\":%u", r.melody);
+        if (r.ref != HISTORY_NONE) n += snprintf(buffer + n, sizeof(buffer) - n, ",\"ref\":%u", r.ref);
+        if (r.arg) n += snprintf(buffer + n, sizeof(buffer) - n, ",\"arg\":%u", r.arg);
+        snprintf(buffer + n, sizeof(buffer) - n, "}");
+        source.send(buffer, "history", ++messageId);
+        if (r.seq >= last) return;
+    }
+}
+
+void LiveEvents::update(const LiveState& state) {
+    if (source.count() == 0) {
+        // Nessun ascoltatore: niente serializzazione, al prossimo client si riparte da zero
+        hasSent = false;
+        if (historyLog.isAvailable()) lastHistorySeq = historyLog.getNextSeq() - 1;
+        return;
+    }
+    sendStatus(state);
+    forwardHistory();
+}
+
+bool LiveEvents::clockDue() {
+    uint32_t now = millis();
+    if (now - lastClockMs < LIVE_CLOCK_INTERVAL) return false;
+    lastClockMs = now;
+    return source.count() > 0;
+}
+
+void LiveEvents::sendClock(const char* timeStr, const char* dateStr) {
+    snprintf(buffer, sizeof(buffer), "{\"time\":\"%s\",\"date\":\"%s\",\"uptimeMs\":%u}",
+             timeStr, dateStr, (unsigned)millis());
+    source.send(buffer, "clock", ++messageId);
+}
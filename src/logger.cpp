@@ -0,0 +1,159 @@
+#include "include/logger.h"
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <stdarg.h>
+
+Logger logger;
+
+static const char* const TAG_NAMES[LOG_TAG_COUNT] = {
+    "SYS", "BELL", "SCHED", "WEB", "NET", "CFG", "BTN", "DISP"
+};
+
+Logger::Logger() : head(0), tail(0), lost(0) {
+    for (uint16_t i = 0; i < LOG_RING_SIZE; i++) ring[i].seq.store(0);
+    for (uint8_t t = 0; t < LOG_TAG_COUNT; t++) levels[t] = LOG_LEVEL;
+}
+
+void Logger::begin() {
+    xTaskCreatePinnedToCore(taskEntry, "log", LOG_TASK_STACK, this,
+                            LOG_TASK_PRIORITY, nullptr, LOG_TASK_CORE);
+}
+
+void Logger::write(uint8_t level, uint8_t tag, const char* fmt, ...) {
+    uint32_t seq = head.fetch_add(1, std::memory_order_relaxed);
+    LogEntry& e = ring[seq % LOG_RING_SIZE];
+    e.seq.store(0, std::memory_order_release);          // Slot in scrittura
+    e.ms = millis();
+    e.level = level;
+    e.tag = tag;
+    va_list args;
+    va_start(args, fmt);
+    vsnprintf(e.text, sizeof(e.text), fmt, args);
+    va_end(args);
+    // Niente a capo finale: lo aggiunge chi scrive su Serial
+    size_t n = strlen(e.text);
+    while (n > 0 && (e.text[n - 1] == '\n' || e.text[n - 1] == '\r')) e.text[--n] = '\0';
+    e.seq.store(seq + 1, std::memory_order_release);
+}
+
+bool Logger::read(uint32_t seq, LogLine& out) {
+    const LogEntry& e = ring[seq % LOG_RING_SIZE];
+    if (e.seq.load(std::memory_order_acquire) != seq + 1) return false;
+    out.seq = seq;
+    out.ms = e.ms;
+    out.level = e.level;
+    out.tag = e.tag;
+    memcpy(out.text, e.text, sizeof(out.text));
+    out.text[sizeof(out.text) - 1] = '\0';
+    // Sovrascritto durante la copia: la copia non è affidabile
+    return e.seq.load(std::memory_order_acquire) == seq + 1;
+}
+
+void Logger::taskEntry(void* arg) {
+    Logger* self = (Logger*)arg;
+    for (;;) {
+        self->drain();
+        vTaskDelay(pdMS_TO_TICKS(LOG_DRAIN_MS));
+    }
+}
+
+void Logger::drain() {
+    LogLine line;
+    while (true) {
+        uint32_t h = head.load(std::memory_order_acquire);
+        if (tail == h) return;
+        // Doppiati dai produttori: si riparte dal messaggio più vecchio rimasto
+        if (h - tail > LOG_RING_SIZE) {
+            lost += h - LOG_RING_SIZE - tail;
+            tail = h - LOG_RING_SIZE;
+        }
+        uint32_t s = ring[tail % LOG_RING_SIZE].seq.load(std::memory_order_acquire);
+        if (s == 0 || s < tail + 1) return;     // Ancora in scrittura: al prossimo giro
+        if (!read(tail, line)) {                // Già sovrascritto da un giro successivo
+            lost++;
+            tail++;
+            continue;
+        }
+        Serial.printf("[%lu.%03lu] %c %s: %s\n", (unsigned long)(line.ms / 1000), (unsigned long)(line.ms % 1000),
+                      levelName(line.level)[0], tagName(line.tag), line.text);
+        tail++;
+    }
+}
+
+void Logger::setLevel(uint8_t tag, uint8_t level) {
+    if (tag < LOG_TAG_COUNT) levels[tag] = level > LOG_LEVEL ? LOG_LEVEL : level;
+}
+
+uint8_t Logger::getLevel(uint8_t tag) {
+    return tag < LOG_TAG_COUNT ? levels[tag] : LOG_LEVEL_NONE;
+}
+
+uint32_t Logger::getHead() { return head.load(std::memory_order_acquire); }
+uint32_t Logger::getLost() { return lost; }
+
+static void printJsonString(Print& out, const char* s) {
+    out.print('"');
+    for (; *s; s++) {
+        char c = *s;
+        if (c == '"' || c == '\\') { out.print('\\'); out.print(c); }
+        else if (c == '\n') out.print("\\n");
+        else if ((uint8_t)c < 0x20) out.printf("\\u%04x", (unsigned)c);
+        else out.print(c);
+    }
+    out.print('"');
+}
+
+void Logger::printTail(Print& out, uint32_t since, uint16_t limit) {
+    uint32_t h = getHead();
+    uint32_t oldest = h > LOG_RING_SIZE ? h - LOG_RING_SIZE : 0;
+    if (limit == 0 || limit > LOG_RING_SIZE) limit = LOG_RING_SIZE;
+    // Senza "since" gli ultimi "limit" messaggi; se "since" è già uscito dall'anello
+    // si riparte dal più vecchio rimasto (il salto si vede dal seq)
+    uint32_t from = since;
+    if (from > h) from = h - (h - oldest < limit ? h - oldest : limit);
+    else if (from < oldest) from = oldest;
+    if (h - from > limit) h = from + limit;
+
+    out.printf("{\"next\":%u,\"lost\":%u,\"lines\":[", (unsigned)h, (unsigned)lost);
+    LogLine line;
+    bool first = true;
+    for (uint32_t seq = from; seq < h; seq++) {
+        if (!read(seq, line)) continue;
+        out.printf("%s{\"seq\":%u,\"ms\":%u,\"level\":\"%s\",\"tag\":\"%s\",\"msg\":",
+                   first ? "" : ",", (unsigned)line.seq, (unsigned)line.ms,
+                   levelName(line.level), tagName(line.tag));
+        printJsonString(out, line.text);
+        out.print('}');
+        first = false;
+    }
+    out.print("]}");
+}
+
+const char* Logger::tagName(uint8_t tag) {
+    return tag < LOG_TAG_COUNT ? TAG_NAMES[tag] : "?";
+}
+
+const char* Logger::levelName(uint8_t level) {
+    switch (level) {
+        case LOG_LEVEL_NONE: return "NONE";
+        case LOG_LEVEL_ERROR: return "ERROR";
+        case LOG_LEVEL_WARN: return "WARN";
+        case LOG_LEVEL_INFO: return "INFO";
+        case LOG_LEVEL_DEBUG: return "DEBUG";
+        default: return "VERBOSE";
+    }
+}
+
+int8_t Logger::parseTag(const char* name) {
+    for (uint8_t t = 0; t < LOG_TAG_COUNT; t++) {
+        if (strcasecmp(name, TAG_NAMES[t]) == 0) return t;
+    }
+    return -1;
+}
+
+int8_t Logger::parseLevel(const char* name) {
+    for (uint8_t l = LOG_LEVEL_NONE; l <= LOG_LEVEL_VERBOSE; l++) {
+        if (strcasecmp(name, levelName(l)) == 0) return l;
+    }
+    return -1;
+}
@@ -2,16 +2,40 @@
 #include <TFT_eSPI.h>
 #include <WiFi.h>
 #include <time.h>
+#include <esp_sntp.h>
 #include <ESPAsyncWebServer.h>
 #include <AsyncTCP.h>
 #include <ArduinoJson.h>
 #include <SPIFFS.h>
 #include <RTClib.h>
 #include <Wire.h>
+#include <memory>
+#include <new>
 
 // Include dei nostri file
 #include "include/config.h"
 #include "include/bell_controller.h"
+#include "include/bell_stats.h"
+#include "include/history_log.h"
+#include "include/config_upload.h"
+#include "include/config_store.h"
+#include "include/config_sync.h"
+#include "include/live_events.h"
+#include "include/status_snapshot.h"
+#include "include/rate_limiter.h"
+#include "include/web_stats.h"
+#include "include/json_writer.h"
+#include "include/msgpack_writer.h"
+#include "include/asset_manifest.h"
+#include "include/status_screen.h"
+#include "include/button_service.h"
+#include "include/logger.h"
+#include "include/perf_monitor.h"
+#include "include/heap_monitor.h"
+#include "include/boot_sequence.h"
+#include "include/wifi_manager.h"
+#include "include/power_manager.h"
+#include "include/thermal_governor.h"
 
 // Pin I2C di default per ESP32 (T-Display): SDA=21, SCL=22, sovrascrivibili da config.h
 #ifndef I2C_SDA_PIN
@@ -37,7 +61,6 @@ bool manualTimeValid = false;
 // (NTP gestito dal sistema via time.h)
 
 // Modalità AP di backup
-bool apMode = false;
 const char* AP_SSID = "ChurchBells-Config";
 const char* AP_PASSWORD = "campanile123";
 
@@ -58,6 +81,7 @@ AsyncWebServer server(WEB_SERVER_PORT);
 
 // Display
 TFT_eSPI tft = TFT_eSPI();
+StatusScreen statusScreen(tft);
 
 // RTC (opzionale - se non connesso funziona comunque con NTP)
 RTC_DS3231 rtc;
@@ -71,7 +95,6 @@ bool schedulerActive = false;
 static const char* FIRMWARE_VERSION = "v2.2";
 
 // Pulsante funerale - polarità (GPIO27 con pullup -> premuto = LOW)
-static bool FUNERAL_PRESSED_LOW = true; // Pulsante con pullup: LOW = premuto
 
 // Timing variables
 unsigned long lastUpdate = 0;
@@ -79,43 +102,29 @@ unsigned long lastNTPCheck = 0;
 unsigned long lastScheduleCheck = 0;
 int lastCheckedMinute = -1;
 
-// Variabili monitoraggio temperatura ESP32
-float currentESP32Temperature = 0.0;
-unsigned long lastTemperatureCheck = 0;
-bool temperatureWarningActive = false;
-bool thermalProtectionActive = false;
-
-// Schedules in-memory (arrays + counters)
-static WeeklySchedule weeklyArr[MAX_WEEKLY_SCHEDULES];
-static int weeklyCount = 0;
-static SpecialEvent specialArr[MAX_SPECIAL_EVENTS];
-static int specialCount = 0;
-
-// FS paths
-static const char* WEEKLY_FS = "/weekly.json";
-static const char* SPECIAL_FS = "/events.json";
-static const char* MELODIES_FS = "/melodies.json";
- 
-
 // === DICHIARAZIONI DI FUNZIONE ===
 void updateDisplay();
-bool loadMelodiesFromFS();
-bool saveAllMelodiesToFS();
 void scanI2CDevices();
 void initSNTP(bool waitForSync);
-bool loadSchedulesFromFS();
-bool saveSchedulesToFS();
+void onSntpSynced(const struct tm &timeinfo);
+void serviceSntp();
 void checkAndRunSchedules();
+void servicePendingOneShots();
 bool getLocalTm(struct tm &out);
 // Forward declarations for functions used before their definitions
-void connectWiFi();
+void onWiFiLink(bool connected);
+void serviceBoot();
 void setupWebServer();
 void processSerialCommands();
 void startApConfig();
+void setupButtons();
+void formatClock(char* bufTime, size_t timeLen, char* bufDate, size_t dateLen);
+void readLiveState(LiveState& s);
+void readStatusFields(StatusFields& f);
+void readScreenState(ScreenState& s);
+uint32_t currentEpoch();
 
 // === FUNZIONI TEMPERATURA ESP32 ===
-float getESP32Temperature();
-void checkTemperatureThresholds();
 String getTemperatureStatus();
 
 // === FUNZIONI DI UTILITY ===
@@ -165,30 +174,42 @@ void updateTimezone() {
   
   // Il client NTP non è più usato, offset applicato via TZ
   
-  Serial.print("Fuso orario aggiornato: UTC+");
-  Serial.print(utcOffsetHours);
-  Serial.println(isDST ? " (Ora Legale)" : " (Ora Solare)");
+  LOGI(LOG_NET, "Fuso orario aggiornato: UTC+%d %s", utcOffsetHours, isDST ? "(Ora Legale)" : "(Ora Solare)");
+}
+
+// Sincronie SNTP notificate dal task di lwIP: lì si alza solo il flag, il resto
+// (RTC su I2C, log) lo fa serviceSntp() dal loop. Arriva anche dopo la fine
+// dell'avvio, per esempio quando il WiFi si collega oltre BOOT_WIFI_TIMEOUT_MS.
+static volatile bool sntpSyncPending = false;
+
+static void onSntpNotification(struct timeval *tv) {
+  sntpSyncPending = true;
 }
 
 void initSNTP(bool waitForSync) {
   // Inizializzazione SNTP
+  sntp_set_time_sync_notification_cb(onSntpNotification);
   configTzTime(TZ_ITALY, NTP1, NTP2, NTP3);
   if (!waitForSync) {
-    Serial.println("SNTP configurato (senza attesa sync)");
+    LOGI(LOG_NET, "SNTP configurato (senza attesa sync)");
     return;
   }
-  Serial.println("Sincronizzazione SNTP in corso...");
+  LOGI(LOG_NET, "Sincronizzazione SNTP in corso...");
   struct tm timeinfo;
   const uint32_t start = millis();
   while (!getLocalTime(&timeinfo, 1000)) { // attesa max 15s con log progressivo
-    Serial.print('.');
     if (millis() - start > 15000) {
-      Serial.println("\n✗ SNTP: timeout di sincronizzazione");
+      LOGE(LOG_NET, "✗ SNTP: timeout di sincronizzazione");
       systemStatus.ntpSynced = false;
       return;
     }
   }
-  Serial.println("\n✓ SNTP sincronizzato");
+  LOGI(LOG_NET, "✓ SNTP sincronizzato in %lu ms", (unsigned long)(millis() - start));
+  onSntpSynced(timeinfo);
+}
+
+// Prima ora valida da SNTP: fuso orario e RTC allineati
+void onSntpSynced(const struct tm &timeinfo) {
   systemStatus.ntpSynced = true;
   updateTimezone();
   if (systemStatus.rtcConnected) {
@@ -202,10 +223,22 @@ void initSNTP(bool waitForSync) {
       timeinfo.tm_sec
     );
     rtc.adjust(now);
-    Serial.println("RTC aggiornato da SNTP");
+    LOGI(LOG_NET, "RTC aggiornato da SNTP");
   }
 }
 
+// Dal loop: applica le sincronie notificate, in qualunque fase dell'avvio
+void serviceSntp() {
+  if (!sntpSyncPending) return;
+  sntpSyncPending = false;
+  time_t now = time(nullptr);
+  struct tm timeinfo;
+  localtime_r(&now, &timeinfo);
+  if (!systemStatus.ntpSynced) LOGI(LOG_NET, "✓ SNTP sincronizzato");
+  onSntpSynced(timeinfo);
+  bootSequence.mark(BOOT_MARK_SNTP);
+}
+
 bool getLocalTm(struct tm &out) {
   // Prova prima NTP/sistema
   time_t now = time(nullptr);
@@ -248,160 +281,13 @@ bool getLocalTm(struct tm &out) {
   return true; // Restituisco sempre true per evitare errori continui
 }
 
-bool saveSchedulesToFS() {
-  DynamicJsonDocument doc(16384);
-  JsonArray w = doc.createNestedArray("weekly");
-  for (int i=0;i<weeklyCount;i++){
-    JsonObject o = w.createNestedObject();
-    o["id"]=weeklyArr[i].id; o["name"]=weeklyArr[i].name; o["dayOfWeek"]=weeklyArr[i].dayOfWeek; o["hour"]=weeklyArr[i].hour; o["minute"]=weeklyArr[i].minute; o["melodyIndex"]=weeklyArr[i].melodyIndex; o["isActive"]=weeklyArr[i].isActive;
-  }
-  JsonArray s = doc.createNestedArray("special");
-  for (int i=0;i<specialCount;i++){
-    JsonObject o = s.createNestedObject();
-    o["id"]=specialArr[i].id; o["name"]=specialArr[i].name; o["type"]=specialArr[i].type; o["year"]=specialArr[i].year; o["month"]=specialArr[i].month; o["day"]=specialArr[i].day; o["hour"]=specialArr[i].hour; o["minute"]=specialArr[i].minute; o["melodyIndex"]=specialArr[i].melodyIndex; o["isActive"]=specialArr[i].isActive; o["isRecurring"]=specialArr[i].isRecurring;
-  }
-  fs::File f = SPIFFS.open(WEEKLY_FS, "w");
-  if (!f) return false;
-  bool ok = serializeJson(doc, f) > 0;
-  f.close();
-  return ok;
-}
-
-bool loadSchedulesFromFS() {
-  weeklyCount = 0; specialCount = 0;
-  if (!SPIFFS.exists(WEEKLY_FS)) return true; // nothing to load
-  fs::File f = SPIFFS.open(WEEKLY_FS, "r");
-  if (!f) return false;
-  DynamicJsonDocument doc(16384);
-  DeserializationError err = deserializeJson(doc, f);
-  f.close();
-  if (err) return false;
-  if (doc.containsKey("weekly")){
-    JsonArray w = doc["weekly"].as<JsonArray>();
-    for (JsonObject o : w){
-      if (weeklyCount>=MAX_WEEKLY_SCHEDULES) break;
-      WeeklySchedule &it = weeklyArr[weeklyCount++];
-      strlcpy(it.name, (o["name"] | ""), sizeof(it.name));
-      it.id = o["id"] | weeklyCount;
-      it.dayOfWeek = (DayOfWeek)(int)(o["dayOfWeek"] | 0);
-      it.hour = o["hour"] | 0; it.minute = o["minute"] | 0;
-      it.melodyIndex = o["melodyIndex"] | 0; it.isActive = o["isActive"] | true;
-    }
-  }
-  if (doc.containsKey("special")){
-    JsonArray s = doc["special"].as<JsonArray>();
-    for (JsonObject o : s){
-      if (specialCount>=MAX_SPECIAL_EVENTS) break;
-      SpecialEvent &it = specialArr[specialCount++];
-      strlcpy(it.name, (o["name"] | ""), sizeof(it.name));
-      it.id = o["id"] | specialCount;
-      it.type = (EventType)(int)(o["type"] | 5);
-      it.year = o["year"] | 0; it.month = o["month"] | 0; it.day = o["day"] | 0;
-      it.hour = o["hour"] | 0; it.minute = o["minute"] | 0;
-      it.melodyIndex = o["melodyIndex"] | 0; it.isActive = o["isActive"] | true; it.isRecurring = o["isRecurring"] | false;
-    }
-  }
-  return true;
-}
-
-// === IMPLEMENTAZIONE FUNZIONI TEMPERATURA ESP32 ===
-float getESP32Temperature() {
-  // Semplice stima tramite sensore interno (non molto accurato su ESP32)
-  // Su alcune revisioni il sensore non è accessibile; restituiamo l'ultima lettura se fallisce
-  float tempC = temperatureRead(); // ritorna in °C
-  if (isnan(tempC)) {
-    return systemStatus.esp32Temperature;
-  }
-  // Aggiorna soglie
-  if (tempC >= TEMP_SHUTDOWN_THRESHOLD) {
-    systemStatus.thermalProtection = true;
-    systemStatus.temperatureWarning = true;
-    bellController.emergencyStop();
-  } else if (tempC >= TEMP_CRITICAL_THRESHOLD) {
-    systemStatus.thermalProtection = true;
-    systemStatus.temperatureWarning = true;
-  } else if (tempC >= TEMP_WARNING_THRESHOLD) {
-    systemStatus.thermalProtection = false;
-    systemStatus.temperatureWarning = true;
-  } else {
-    systemStatus.thermalProtection = false;
-    systemStatus.temperatureWarning = false;
-  }
-  return tempC;
-}
-
-void checkTemperatureThresholds() {
-  float t = getESP32Temperature();
-  systemStatus.esp32Temperature = t;
-  // Azioni di protezione già gestite in getESP32Temperature()
-}
-
+// === STATO TEMPERATURA (livelli di ThermalGovernor) ===
 String getTemperatureStatus() {
   if (systemStatus.thermalProtection) return String("CRITICA");
   if (systemStatus.temperatureWarning) return String("ELEVATA");
   return String("OK");
 }
 
-// === MELODIE: SALVATAGGIO/CARICAMENTO SU FS ===
-bool saveAllMelodiesToFS() {
-  DynamicJsonDocument doc(32768);
-  JsonArray arr = doc.createNestedArray("melodies");
-  for (int i = 0; i < 10; i++) {
-    if (!melodies[i].isActive) continue;
-    JsonObject m = arr.createNestedObject();
-    m["id"] = i;
-    m["name"] = melodies[i].name;
-    m["noteCount"] = melodies[i].noteCount;
-    JsonArray ns = m.createNestedArray("notes");
-    for (int j = 0; j < melodies[i].noteCount; j++) {
-      JsonObject n = ns.createNestedObject();
-      n["bellNumber"] = melodies[i].notes[j].bellNumber;
-      n["duration"] = melodies[i].notes[j].duration;
-      n["delay"] = melodies[i].notes[j].delay;
-    }
-  }
-  fs::File f = SPIFFS.open(MELODIES_FS, "w");
-  if (!f) return false;
-  bool ok = serializeJson(doc, f) > 0;
-  f.close();
-  return ok;
-}
-
-bool loadMelodiesFromFS() {
-  if (!SPIFFS.exists(MELODIES_FS)) return true; // niente da caricare
-  fs::File f = SPIFFS.open(MELODIES_FS, "r");
-  if (!f) return false;
-  DynamicJsonDocument doc(32768);
-  DeserializationError err = deserializeJson(doc, f);
-  f.close();
-  if (err) return false;
-  if (!doc.containsKey("melodies")) return true;
-  // Azzerare tutte
-  for (int i = 0; i < 10; i++) { melodies[i].isActive = false; melodies[i].noteCount = 0; melodies[i].name[0] = '\0'; }
-  for (JsonObject m : doc["melodies"].as<JsonArray>()) {
-    int id = m["id"] | -1;
-    if (id < 0 || id >= 10) continue;
-    const char* name = m["name"] | "Senza nome";
-    strncpy(melodies[id].name, name, sizeof(melodies[id].name)-1);
-    melodies[id].name[sizeof(melodies[id].name)-1] = '\0';
-    JsonArray ns = m["notes"].as<JsonArray>();
-    uint8_t count = 0;
-    if (ns) {
-      for (JsonObject n : ns) {
-        uint8_t b = n["bellNumber"] | 1;
-        uint16_t d = n["duration"] | 300;
-        uint16_t dl = n["delay"] | 800;
-        if (b < 1 || b > 2) continue;
-        melodies[id].notes[count++] = { b, d, dl };
-        if (count >= MAX_MELODY_STEPS) break;
-      }
-    }
-    melodies[id].noteCount = count;
-    melodies[id].isActive = (count > 0);
-  }
-  return true;
-}
-
 // === SCAN I2C ===
 void scanI2CDevices() {
   byte count = 0;
@@ -423,16 +309,27 @@ void scanI2CDevices() {
 void setup() {
   Serial.begin(115200);
   delay(200);
-  Serial.println("\n=== Avvio Campane Chiesa ===");
+  // Log asincrono: da qui in poi i messaggi non attendono la UART
+  logger.begin();
+  perf.begin();
+  // Task di cui seguire il margine di stack (async_tcp viene creato dal web server)
+  heapMonitor.watchTask("loopTask");
+  heapMonitor.watchTask("async_tcp");
+  heapMonitor.watchTask("display");
+  heapMonitor.watchTask("log");
+  heapMonitor.watchTask("esp_timer");
+  LOGI(LOG_SYS, "=== Avvio Campane Chiesa ===");
 
   // Inizializza SPIFFS
   if (!SPIFFS.begin(true)) {
-    Serial.println("SPIFFS mount failed");
+    LOGE(LOG_SYS, "SPIFFS mount failed");
   }
+  assetManifest.begin();
 
   // Display
   tft.init();
   tft.setRotation(1); // orizzontale (T-Display)
+  statusScreen.begin();
 
   // I2C
   Wire.begin(I2C_SDA_PIN, I2C_SCL_PIN);
@@ -448,19 +345,20 @@ void setup() {
     systemStatus.rtcConnected = false;
   }
 
+  // Statistiche persistenti e registro eventi (prima del controller, che li aggiorna)
+  bellStats.begin();
+  historyLog.begin();
+  historyLog.append(HIST_BOOT, HIST_SRC_SYSTEM);
+
   // Bell controller
   bellController.begin();
 
-  // Pulsante fisico per avvio "FUNERALE" (GPIO27 - pulsante esterno)
-  pinMode(FUNERAL_BUTTON_PIN, INPUT_PULLUP); // Usa pullup interno
-
-  // Pulsante fisico per avvio "CHIAMATA MESSA" (GPIO32 - pulsante esterno)
-  pinMode(MASS_BUTTON_PIN, INPUT_PULLUP); // Usa pullup interno
-
-  // Pulsante di configurazione (GPIO0 - boot button)
-  pinMode(CONFIG_BUTTON_PIN, INPUT_PULLUP);
+  // Pulsanti fisici: FUNERALE (GPIO27), CHIAMATA MESSA (GPIO32) e CONFIG (GPIO0)
+  setupButtons();
 
-  // Carica melodie e schedules da FS
+  // Carica melodie e schedules da FS (dopo aver chiuso un eventuale restore interrotto)
+  configStore.recover();
+  configSync.begin();
   loadMelodiesFromFS();
   loadSchedulesFromFS();
 
@@ -472,200 +370,187 @@ void setup() {
     bellController.loadDefaultMelodies();
   }
 
-  // WiFi e SNTP
-  connectWiFi();
+  // Energia: esp_pm (frequenza dinamica e light sleep) o ripiego manuale.
+  // La linea SQW del DS3231, se collegata, risveglia a ogni mezzo secondo.
+  powerManager.begin();
+  if (RTC_SQW_PIN >= 0 && systemStatus.rtcConnected) {
+    rtc.writeSqwPinMode(DS3231_SquareWave1Hz);
+    powerManager.setSqwPin(RTC_SQW_PIN);
+  }
+
+  // Protezione termica: prima lettura del sensore (le mitigazioni valgono anche
+  // per i moduli avviati dopo)
+  thermalGovernor.begin();
 
-  // Web server
-  setupWebServer();
-  server.begin();
-  Serial.println("Web server avviato");
+  // WiFi: solo avvio della connessione, tentativi e AP di recupero li segue il loop.
+  // Senza credenziali parte subito l'Access Point.
+  wifiManager.setCallback(onWiFiLink);
+  wifiManager.setModemSleep(POWER_WIFI_MODEM_SLEEP);
+  wifiManager.begin(AP_SSID, AP_PASSWORD);
 
   // Prima schermata
   updateDisplay();
+
+  // Campane operative: web server, WiFi e SNTP proseguono in serviceBoot()
+  bootSequence.mark(BOOT_MARK_BELLS);
+  bootSequence.enter(BOOT_WEB);
+}
+
+// Tempo fino alla prossima scadenza periodica del loop (display, programmazioni);
+// al massimo POWER_IDLE_MAX_MS per i controlli senza scadenza propria
+static uint32_t msUntilNextDeadline() {
+  uint32_t now = millis();
+  uint32_t sinceDisplay = now - lastUpdate;
+  uint32_t sinceSchedule = now - lastScheduleCheck;
+  if (sinceDisplay >= DISPLAY_UPDATE_INTERVAL || sinceSchedule >= SCHEDULE_CHECK_INTERVAL) return 0;
+  uint32_t wait = POWER_IDLE_MAX_MS;
+  if (DISPLAY_UPDATE_INTERVAL - sinceDisplay < wait) wait = DISPLAY_UPDATE_INTERVAL - sinceDisplay;
+  if (SCHEDULE_CHECK_INTERVAL - sinceSchedule < wait) wait = SCHEDULE_CHECK_INTERVAL - sinceSchedule;
+  return wait;
 }
 
 void loop() {
+  // Loop sospeso fino alla prossima scadenza o a un risveglio (pulsanti, HTTP);
+  // mai durante melodie, impulsi relè o avvio, dove serve il giro continuo
+  bool spin = bellController.isBusy() || !bootSequence.isReady();
+  powerManager.idleWait(spin ? 0 : msUntilNextDeadline());
+
+  PERF_SCOPE("loop");
+
   // Aggiorna controller campane (non bloccante)
-  bellController.update();
+  {
+    PERF_SCOPE("loop.bell");
+    bellController.update();
+  }
+
+  // Collegamento WiFi: riconnessioni con attesa crescente, AP di recupero, potenza TX
+  wifiManager.update();
+
+  // Sincronie SNTP (RTC e fuso orario), anche dopo la fine dell'avvio
+  serviceSntp();
+
+  // Avvio in background di web server, WiFi e SNTP (un passo per giro)
+  if (!bootSequence.isReady()) serviceBoot();
+
+  // Telemetria memoria (heap ogni secondo, stack più di rado)
+  heapMonitor.update();
+
+  // Checkpoint statistiche a lotti e scrittura registro eventi (senza operazioni lente durante una melodia)
+  {
+    PERF_SCOPE("loop.stats");
+    bellStats.update(bellController.isPlayingMelody());
+    historyLog.service(bellController.isPlayingMelody());
+  }
+
+  // Temperatura: campione a intervallo fisso, media mobile e mitigazioni a gradini
+  {
+    PERF_SCOPE("loop.temperature");
+    thermalGovernor.update();
+  }
+
+  // Istantanea di /api/status: rigenerata solo se lo stato è cambiato
+  if (statusSnapshot.checkDue()) {
+    PERF_SCOPE("loop.status");
+    StatusFields fields;
+    readStatusFields(fields);
+    statusSnapshot.update(fields);
+  }
 
-  // Aggiorna temperatura periodicamente
-  if (millis() - lastTemperatureCheck >= TEMP_CHECK_INTERVAL) {
-    lastTemperatureCheck = millis();
-    checkTemperatureThresholds();
+  // Eventi push verso la UI (serializzati solo se ci sono client connessi)
+  {
+    PERF_SCOPE("loop.events");
+    LiveState live;
+    readLiveState(live);
+    liveEvents.update(live);
+    if (liveEvents.clockDue()) {
+      char bufTime[20];
+      char bufDate[20];
+      formatClock(bufTime, sizeof(bufTime), bufDate, sizeof(bufDate));
+      liveEvents.sendClock(bufTime, bufDate);
+    }
   }
 
-  // Aggiornamento display
-  if (millis() - lastUpdate >= DISPLAY_UPDATE_INTERVAL) {
+  // Aggiornamento display: lo stato viene pubblicato al task del display, che
+  // disegna le sole zone cambiate (anche subito, se richiesto da un handler)
+  bool redraw = statusScreen.takeRedrawRequest();
+  if (redraw || millis() - lastUpdate >= DISPLAY_UPDATE_INTERVAL) {
+    PERF_SCOPE("loop.display");
     lastUpdate = millis();
     updateDisplay();
   }
 
   // Controllo programmazioni
   if (millis() - lastScheduleCheck >= SCHEDULE_CHECK_INTERVAL) {
+    PERF_SCOPE("loop.scheduler");
     lastScheduleCheck = millis();
     checkAndRunSchedules();
   }
 
-  // Comandi seriale
-  processSerialCommands();
+  // Disattivazione degli eventi non ricorrenti già suonati (scrittura su flash)
+  if (!bellController.isBusy()) servicePendingOneShots();
 
-  // Gestione pulsante fisico FUNERALE (debounce + cooldown)
+  // Comandi seriale
   {
-    static uint32_t lastPressMs = 0;
-    static bool lastState = true; // pull-up: true=rilasciato
-    static uint32_t lastDebugMs = 0;
-    
-    bool raw = digitalRead(FUNERAL_BUTTON_PIN);
-    bool state = raw; // true=alto, false=basso
-    
-    // Debug semplice ogni 3 secondi
-    if (millis() - lastDebugMs > 3000) {
-      lastDebugMs = millis();
-      Serial.printf("[FUNERAL] GPIO27 = %d\n", raw);
-    }
-    if (lastState != state) {
-      lastState = state;
-      Serial.printf("[BUTTON] GPIO27 cambiato: %d -> %d\n", !state, state);
-      bool isPressed = FUNERAL_PRESSED_LOW ? (!state) : state;
-      Serial.printf("[BUTTON] isPressedLogic: %s (FUNERAL_PRESSED_LOW=%s)\n", 
-                   isPressed ? "PREMUTO" : "rilasciato", FUNERAL_PRESSED_LOW ? "true" : "false");
-      if (isPressed) { // pressione
-        uint32_t now = millis();
-        if (now - lastPressMs > 800) { // debounce
-          lastPressMs = now;
-          // Avvia FUNERALE solo se non sta già suonando qualcosa
-          if (!bellController.isPlayingMelody()) {
-            Serial.println("FUNERALE: pulsante premuto");
-            // Assicura che la melodia 0 esista
-            if (bellController.getMelodyNoteCount(0) == 0) {
-              bellController.loadDefaultMelodies();
-            }
-            // Esegui in modalità test per bypassare campane disabilitate (se lo fossero)
-            bellController.enableTestMode(true);
-            bellController.playMelody(0); // 0 = FUNERALE
-          }
-        }
-      }
-    }
-    // Fallback: se non ci sono stati cambiamenti per >10s, prova a invertire logica
-    static uint32_t lastChangeTime = millis();
-    static int lastRawValue = raw;
-    if (lastRawValue != raw) {
-      lastChangeTime = millis();
-      lastRawValue = raw;
-    }
-    
-    if (millis() - lastChangeTime > 10000) {
-      Serial.printf("[BUTTON] Nessun cambiamento per 10s, inverto polarità: %s -> %s\n",
-                   FUNERAL_PRESSED_LOW ? "LOW" : "HIGH", !FUNERAL_PRESSED_LOW ? "LOW" : "HIGH");
-      FUNERAL_PRESSED_LOW = !FUNERAL_PRESSED_LOW;
-      lastChangeTime = millis();
-    }
+    PERF_SCOPE("loop.serial");
+    processSerialCommands();
   }
 
-  // === PULSANTE CHIAMATA MESSA (GPIO32) ===
+  // Eventi dei pulsanti fisici (rilevati a interrupt, azioni eseguite qui)
   {
-    static uint32_t lastMassPressMs = 0;
-    static bool lastMassState = true; // pull-up: true=rilasciato
-    static uint32_t lastMassDebugMs = 0;
-    
-    bool massRaw = digitalRead(MASS_BUTTON_PIN);
-    bool massState = massRaw; // true=alto, false=basso
-    
-    // Debug semplice ogni 3 secondi
-    if (millis() - lastMassDebugMs > 3000) {
-      lastMassDebugMs = millis();
-      Serial.printf("[MASS] GPIO32 = %d\n", massRaw);
-    }
-    
-    if (lastMassState != massState) {
-      lastMassState = massState;
-      Serial.printf("[BUTTON] GPIO32 cambiato: %d -> %d\n", !massState, massState);
-      bool isPressed = !massState; // GPIO32 con INPUT_PULLUP: LOW = premuto
-      Serial.printf("[BUTTON] isPressedLogic: %s (GPIO32)\n", 
-                   isPressed ? "PREMUTO" : "rilasciato");
-      if (isPressed) { // pressione
-        uint32_t now = millis();
-        if (now - lastMassPressMs > 800) { // debounce
-          lastMassPressMs = now;
-          // Avvia CHIAMATA MESSA solo se non sta già suonando qualcosa
-          if (!bellController.isPlayingMelody()) {
-            Serial.println("CHIAMATA MESSA: pulsante premuto (GPIO32)");
-            // Assicura che la melodia 1 esista
-            if (bellController.getMelodyNoteCount(1) == 0) {
-              bellController.loadDefaultMelodies();
-            }
-            // Esegui in modalità test per bypassare campane disabilitate
-            bellController.enableTestMode(true);
-            bellController.playMelody(1); // 1 = CHIAMATA MESSA
-          }
-        }
-      }
-    }
+    PERF_SCOPE("loop.buttons");
+    buttonService.service();
   }
 
-  // Gestione pulsante CONFIG (GPIO35):
-  // - breve pressione (<2s): toggle campane abilitate
-  // - lunga pressione (>=2s): attiva AP di configurazione
-  {
-  static bool lastCfgState = false; // GPIO0 boot button
-    static uint32_t pressStart = 0;
-    static bool longHandled = false;
-  // GPIO0 (boot button) è tipicamente ACTIVE-LOW con pullup (premuto = LOW)
-  bool pressed = (digitalRead(CONFIG_BUTTON_PIN) == LOW);
-    uint32_t now = millis();
-
-    // Edge di pressione
-    if (pressed && !lastCfgState) {
-      pressStart = now; // inizio pressione
-      longHandled = false; // reset gestione long-press
-    }
-    // Long press: una sola volta per pressione
-    if (pressed && !longHandled && (now - pressStart >= 2000)) {
-      startApConfig();
-      longHandled = true; // non ripetere finché non rilascia
-    }
-    // Rilascio: se non c'è stata long-press, gestisci come breve
-    if (!pressed && lastCfgState) {
-      uint32_t held = now - pressStart;
-      if (!longHandled && held < 2000) {
-        bellController.setEnabled(!bellController.isEnabled());
-      }
-    }
-    lastCfgState = pressed;
+  // Frequenza massima durante melodie/impulsi e subito dopo una richiesta HTTP
+  powerManager.update(bellController.isBusy());
+}
+
+// === PULSANTI FISICI ===
+
+// Avvio rapido di una melodia dal pulsante, solo se non sta già suonando qualcosa
+static void startButtonMelody(uint8_t melodyIndex) {
+  if (bellController.isPlayingMelody()) return;
+  // Assicura che la melodia esista
+  if (bellController.getMelodyNoteCount(melodyIndex) == 0) {
+    bellController.loadDefaultMelodies();
   }
+  // Esegui in modalità test per bypassare campane disabilitate (se lo fossero)
+  bellController.enableTestMode(true);
+  bellController.playMelody(melodyIndex, HIST_SRC_BUTTON);
+}
 
-  // Coopera con stack async
-  delay(0);
-  yield();
+static void onFuneralButton(uint8_t) { startButtonMelody(0); }   // 0 = FUNERALE
+static void onMassButton(uint8_t) { startButtonMelody(1); }      // 1 = CHIAMATA MESSA
+static void onConfigShort(uint8_t) { bellController.setEnabled(!bellController.isEnabled()); }
+static void onConfigLong(uint8_t) { startApConfig(); }
+
+void setupButtons() {
+  buttonService.begin();
+  ButtonConfig funeral = { "FUNERALE", FUNERAL_BUTTON_PIN, FUNERAL_BUTTON_ACTIVE_LOW, 0,
+                           onFuneralButton, nullptr, nullptr };
+  ButtonConfig mass = { "MESSA", MASS_BUTTON_PIN, MASS_BUTTON_ACTIVE_LOW, 0,
+                        onMassButton, nullptr, nullptr };
+  // CONFIG: breve pressione = abilita/disabilita campane, lunga = AP di configurazione
+  ButtonConfig config = { "CONFIG", CONFIG_BUTTON_PIN, CONFIG_BUTTON_ACTIVE_LOW, CONFIG_BUTTON_LONG_MS,
+                          onConfigShort, onConfigLong, nullptr };
+  buttonService.add(funeral);
+  buttonService.add(mass);
+  buttonService.add(config);
 }
 
 // Avvia Access Point di configurazione in runtime
 void startApConfig() {
-  if (apMode) return;
-  Serial.println("[NET] Attivo Access Point di configurazione...");
-  WiFi.disconnect(true);
-  delay(100);
-  WiFi.mode(WIFI_AP);
-  apMode = true;
-  WiFi.softAP(AP_SSID, AP_PASSWORD);
+  if (wifiManager.getState() == WIFI_LINK_AP_ONLY) return;
+  LOGI(LOG_NET, "Attivo Access Point di configurazione...");
+  wifiManager.forceAp();
   IPAddress ip = WiFi.softAPIP();
-  Serial.print("AP IP: "); Serial.println(ip);
-  // Feedback a display
-  tft.fillScreen(TFT_BLACK);
-  tft.setTextColor(TFT_YELLOW);
-  tft.setTextSize(2);
-  tft.setCursor(4, 4);
-  tft.println("CONFIG AP ON");
-  tft.setTextSize(1);
-  tft.setCursor(4, 28);
-  tft.print("SSID: "); tft.println(AP_SSID);
-  tft.print("PWD : "); tft.println(AP_PASSWORD);
-  tft.print("IP  : "); tft.println(ip.toString());
+  // Feedback a display (disegnato dal task del display)
+  statusScreen.showApScreen(AP_SSID, AP_PASSWORD, (uint32_t)ip);
 }
 
 // Funzioni di debug per la programmazione
 void debugScheduleCheck() {
+    ConfigSnapshot cfg;
     struct tm ti;
     if (!getLocalTm(ti)) {
         // Impossibile ottenere ora locale
@@ -683,10 +568,10 @@ void debugScheduleCheck() {
     Serial.printf("  - RTC connesso: %s\n", systemStatus.rtcConnected ? "SÌ" : "NO");
     Serial.printf("  - NTP sincronizzato: %s\n", systemStatus.ntpSynced ? "SÌ" : "NO");
     
-    Serial.printf("\n--- Programmazioni Settimanali Attive (%d totali) ---\n", weeklyCount);
+    Serial.printf("\n--- Programmazioni Settimanali Attive (%d totali) ---\n", cfg->weeklyCount);
     bool foundActiveWeekly = false;
-    for (int i = 0; i < weeklyCount; i++) {
-        const WeeklySchedule &e = weeklyArr[i];
+    for (int i = 0; i < cfg->weeklyCount; i++) {
+        const WeeklySchedule &e = cfg->weekly[i];
         if (e.isActive) {
             foundActiveWeekly = true;
             Serial.printf("[%d] %s: Giorno %d, %02d:%02d, Melodia %d\n",
@@ -711,10 +596,10 @@ void debugScheduleCheck() {
         Serial.println("  Nessuna programmazione settimanale attiva");
     }
     
-    Serial.printf("\n--- Eventi Speciali Attivi (%d totali) ---\n", specialCount);
+    Serial.printf("\n--- Eventi Speciali Attivi (%d totali) ---\n", cfg->specialCount);
     bool foundActiveSpecial = false;
-    for (int i = 0; i < specialCount; i++) {
-        const SpecialEvent &e = specialArr[i];
+    for (int i = 0; i < cfg->specialCount; i++) {
+        const SpecialEvent &e = cfg->special[i];
         if (e.isActive) {
             foundActiveSpecial = true;
             Serial.printf("[%d] %s: %02d/%02d/%04d %02d:%02d, Ricorrente: %s\n",
@@ -784,22 +669,25 @@ void testScheduleNow() {
         }
     }
     
-    // Sostituisci temporaneamente una programmazione
+    // Sostituisci temporaneamente una programmazione: nuova versione della tabella
+    // (solo in RAM, non salvata), nessuna istantanea tenuta durante l'attesa
     WeeklySchedule backup;
     bool hasBackup = false;
-    int backupIndex = -1;
-    
-    if (weeklyCount < MAX_WEEKLY_SCHEDULES) {
+    ConfigTables* draft = configStore.beginTransaction();
+    if (!draft) {
+        Serial.println("ERRORE: configurazione occupata, riprovare");
+        return;
+    }
+    if (draft->weeklyCount < MAX_WEEKLY_SCHEDULES) {
         // Aggiungi nuovo slot
-        backupIndex = weeklyCount;
-        weeklyArr[weeklyCount++] = testSchedule;
+        draft->weekly[draft->weeklyCount++] = testSchedule;
     } else {
         // Sostituisci l'ultimo
-        backupIndex = weeklyCount - 1;
-        backup = weeklyArr[backupIndex];
+        backup = draft->weekly[draft->weeklyCount - 1];
         hasBackup = true;
-        weeklyArr[backupIndex] = testSchedule;
+        draft->weekly[draft->weeklyCount - 1] = testSchedule;
     }
+    configStore.publish();
     
     Serial.printf("Test programmato per: %02d:%02d del giorno %d\n", 
                   testSchedule.hour, testSchedule.minute, testSchedule.dayOfWeek);
@@ -829,11 +717,28 @@ void testScheduleNow() {
     // Ripristina stato originale
     systemStatus.bellsEnabled = originalEnabled;
     
-    if (hasBackup) {
-        weeklyArr[backupIndex] = backup;
-    } else {
-        weeklyCount--;
+    // Toglie la programmazione di test (cercata per id: nel frattempo la tabella
+    // può essere cambiata da altre richieste)
+    draft = nullptr;
+    for (int attempt = 0; attempt < 10 && !draft; attempt++) {
+        draft = configStore.beginTransaction();
+        if (!draft) delay(100);
+    }
+    if (!draft) {
+        Serial.println("ERRORE: programmazione di test non rimossa (configurazione occupata)");
+        return;
     }
+    for (int i = 0; i < draft->weeklyCount; i++) {
+        if (draft->weekly[i].id != testSchedule.id || strcmp(draft->weekly[i].name, testSchedule.name) != 0) continue;
+        if (hasBackup) {
+            draft->weekly[i] = backup;
+        } else {
+            memmove(&draft->weekly[i], &draft->weekly[i+1], sizeof(WeeklySchedule) * (draft->weeklyCount - i - 1));
+            draft->weeklyCount--;
+        }
+        break;
+    }
+    configStore.publish();
     
     Serial.println("=== FINE TEST AUTOMATICO ===\n");
 }
@@ -859,6 +764,7 @@ void processSerialCommands() {
         Serial.println("enable_test_mode        - Abilita modalità test");
         Serial.println("disable_test_mode       - Disabilita modalità test");
         Serial.println("status                  - Mostra stato sistema");
+        Serial.println("stats                   - Statistiche campane persistenti");
         Serial.println("temp                    - Mostra temperatura ESP32");
         Serial.println("list_melodies           - Lista melodie disponibili");
         Serial.println("list_schedules          - Lista programmazioni");
@@ -867,6 +773,11 @@ void processSerialCommands() {
         Serial.println("enable_bells            - Abilita campane");
         Serial.println("disable_bells           - Disabilita campane");
         Serial.println("i2c / scan              - Scansione dispositivi I2C");
+        Serial.println("log                     - Livelli di log per modulo");
+        Serial.println("log <tag|all> <livello> - Imposta livello (none/error/warn/info/debug/verbose)");
+        Serial.println("heap                    - Heap, frammentazione e stack dei task");
+        Serial.println("perf                    - Tempi di loop, task e handler (min/media/p50/p99/max)");
+        Serial.println("perf reset              - Azzera il profilo");
         Serial.println("=========================\n");
         
     } else if (command == "debug") {
@@ -879,7 +790,7 @@ void processSerialCommands() {
         int melodyId = command.substring(12).toInt();
         if (melodyId >= 0 && melodyId < 10) {
             Serial.printf("Riproduzione melodia %d...\n", melodyId);
-            bellController.playMelody(melodyId);
+            bellController.playMelody(melodyId, HIST_SRC_SERIAL);
         } else {
             Serial.printf("ID melodia non valido: %d (range: 0-9)\n", melodyId);
         }
@@ -916,6 +827,7 @@ void processSerialCommands() {
         Serial.println("Modalità test: DISABILITATA");
         
     } else if (command == "status") {
+        ConfigSnapshot cfg;
         Serial.println("\n=== STATO SISTEMA ===");
         Serial.printf("WiFi: %s\n", systemStatus.wifiConnected ? "Connesso" : "Disconnesso");
         Serial.printf("RTC: %s\n", systemStatus.rtcConnected ? "Connesso" : "Disconnesso");
@@ -923,19 +835,33 @@ void processSerialCommands() {
         Serial.printf("Campane: %s\n", systemStatus.bellsEnabled ? "Abilitate" : "Disabilitate");
         Serial.printf("Test Mode: %s\n", testMode ? "Attivo" : "Disattivo");
         Serial.printf("Melodia in riproduzione: %s\n", bellController.isPlayingMelody() ? "Sì" : "No");
-        Serial.printf("Suonate totali: %d\n", systemStatus.totalBellRings);
-        Serial.printf("Programmazioni settimanali: %d\n", weeklyCount);
-        Serial.printf("Eventi speciali: %d\n", specialCount);
+        Serial.printf("Colpi dall'avvio: %u\n", (unsigned)systemStatus.totalBellRings);
+        Serial.printf("Programmazioni settimanali: %d\n", cfg->weeklyCount);
+        Serial.printf("Eventi speciali: %d\n", cfg->specialCount);
         Serial.printf("Temperatura ESP32: %.1f°C [%s]\n", systemStatus.esp32Temperature, 
                      systemStatus.thermalProtection ? "CRITICA" : 
                      systemStatus.temperatureWarning ? "ELEVATA" : "OK");
         Serial.println("====================\n");
         
+    } else if (command == "stats") {
+        Serial.println("\n=== STATISTICHE CAMPANE ===");
+        for (uint8_t b = 1; b <= BELL_COUNT; b++) {
+            Serial.printf("Campana %d: %llu colpi, relè attivo %.1f min\n", b,
+                         (unsigned long long)bellStats.getStrikes(b),
+                         bellStats.getRelayOnMs(b) / 60000.0);
+        }
+        for (uint8_t i = 0; i < MAX_MELODIES; i++) {
+            uint32_t plays = bellStats.getMelodyPlays(i);
+            if (plays > 0) {
+                Serial.printf("Melodia [%d] %s: %u esecuzioni\n", i, bellController.getMelodyName(i), (unsigned)plays);
+            }
+        }
+        Serial.printf("Avvii: %u, checkpoint in questa sessione: %u\n",
+                     (unsigned)bellStats.getBootCount(), (unsigned)bellStats.getCheckpointWrites());
+        Serial.println("===========================\n");
+        
     } else if (command == "temp") {
-        float temp = getESP32Temperature();
-        Serial.printf("🌡️ Temperatura ESP32: %.1f°C\n", temp);
-        Serial.printf("Soglie: Avviso=%.1f°C, Critica=%.1f°C, Spegnimento=%.1f°C\n", 
-                     TEMP_WARNING_THRESHOLD, TEMP_CRITICAL_THRESHOLD, TEMP_SHUTDOWN_THRESHOLD);
+        thermalGovernor.printSummary(Serial);
         Serial.printf("Stato: %s\n", getTemperatureStatus().c_str());
         
     } else if (command == "list_melodies") {
@@ -954,22 +880,23 @@ void processSerialCommands() {
         Serial.println("==========================\n");
         
     } else if (command == "list_schedules") {
+        ConfigSnapshot cfg;
         Serial.println("\n=== PROGRAMMAZIONI ===");
-        Serial.printf("Settimanali (%d):\n", weeklyCount);
-        for (int i = 0; i < weeklyCount; i++) {
-            if (weeklyArr[i].isActive) {
+        Serial.printf("Settimanali (%d):\n", cfg->weeklyCount);
+        for (int i = 0; i < cfg->weeklyCount; i++) {
+            if (cfg->weekly[i].isActive) {
                 Serial.printf("  [%d] %s: Giorno %d, %02d:%02d, Melodia %d\n",
-                             i, weeklyArr[i].name, weeklyArr[i].dayOfWeek,
-                             weeklyArr[i].hour, weeklyArr[i].minute, weeklyArr[i].melodyIndex);
+                             i, cfg->weekly[i].name, cfg->weekly[i].dayOfWeek,
+                             cfg->weekly[i].hour, cfg->weekly[i].minute, cfg->weekly[i].melodyIndex);
             }
         }
-        Serial.printf("Speciali (%d):\n", specialCount);
-        for (int i = 0; i < specialCount; i++) {
-            if (specialArr[i].isActive) {
+        Serial.printf("Speciali (%d):\n", cfg->specialCount);
+        for (int i = 0; i < cfg->specialCount; i++) {
+            if (cfg->special[i].isActive) {
                 Serial.printf("  [%d] %s: %02d/%02d/%04d %02d:%02d, Ricorrente: %s\n",
-                             i, specialArr[i].name, specialArr[i].day, specialArr[i].month,
-                             specialArr[i].year, specialArr[i].hour, specialArr[i].minute,
-                             specialArr[i].isRecurring ? "Sì" : "No");
+                             i, cfg->special[i].name, cfg->special[i].day, cfg->special[i].month,
+                             cfg->special[i].year, cfg->special[i].hour, cfg->special[i].minute,
+                             cfg->special[i].isRecurring ? "Sì" : "No");
             }
         }
         Serial.println("===================\n");
@@ -1006,6 +933,37 @@ void processSerialCommands() {
     } else if (command == "i2c" || command == "scan") {
         Serial.println("=== SCANSIONE DISPOSITIVI I2C ===");
         scanI2CDevices();
+
+    } else if (command == "log" || command.startsWith("log ")) {
+        // Livello a runtime per tag, entro il massimo fissato in compilazione (LOG_LEVEL)
+        int sp = command.indexOf(' ', 4);
+        if (command.length() > 4 && sp > 0) {
+            String tagName = command.substring(4, sp);
+            int8_t level = Logger::parseLevel(command.substring(sp + 1).c_str());
+            int8_t tag = Logger::parseTag(tagName.c_str());
+            if (level < 0 || (tag < 0 && tagName != "all")) {
+                Serial.println("Uso: log <tag|all> <none|error|warn|info|debug|verbose>");
+            } else {
+                for (uint8_t t = 0; t < LOG_TAG_COUNT; t++) {
+                    if (tag < 0 || t == tag) logger.setLevel(t, level);
+                }
+            }
+        }
+        Serial.printf("Livello massimo compilato: %s, messaggi persi: %u\n",
+                      Logger::levelName(LOG_LEVEL), (unsigned)logger.getLost());
+        for (uint8_t t = 0; t < LOG_TAG_COUNT; t++) {
+            Serial.printf("  %-6s %s\n", Logger::tagName(t), Logger::levelName(logger.getLevel(t)));
+        }
+        
+    } else if (command == "heap") {
+        heapMonitor.printSummary(Serial);
+        
+    } else if (command == "perf") {
+        perf.printTable(Serial);
+        
+    } else if (command == "perf reset") {
+        perf.reset();
+        Serial.println("Profilo azzerato");
         
     } else {
         Serial.printf("Comando sconosciuto: '%s'. Digita 'help' per l'elenco comandi.\n", command.c_str());
@@ -1014,10 +972,111 @@ void processSerialCommands() {
     Serial.println(">>> Pronto per nuovo comando <<<\n");
 }
 
+// Registra nel registro eventi le programmazioni comprese nei minuti saltati
+// (esclusi il minuto già controllato e quello corrente)
+static void logMissedSchedules(int fromMinuteOfWeek, int gap, const struct tm &now) {
+  ConfigSnapshot cfg;
+  for (int i=0;i<cfg->weeklyCount;i++){
+    const WeeklySchedule &e = cfg->weekly[i];
+    if (!e.isActive) continue;
+    int mow = (int)e.dayOfWeek * 1440 + e.hour * 60 + e.minute;
+    int delta = (mow - fromMinuteOfWeek + 10080) % 10080;
+    if (delta > 0 && delta < gap) {
+      LOGW(LOG_SCHED, "Evento perso: '%s' (%02d:%02d)", e.name, e.hour, e.minute);
+      historyLog.append(HIST_MISSED, HIST_SRC_WEEKLY, e.melodyIndex, e.id);
+    }
+  }
+  // Eventi speciali di oggi o di ieri (buco a cavallo della mezzanotte):
+  // minuti trascorsi contati dalla mezzanotte di ieri
+  struct tm yesterday = now;
+  yesterday.tm_mday -= 1;
+  yesterday.tm_hour = 12;             // Lontano dai cambi d'ora
+  yesterday.tm_isdst = -1;
+  mktime(&yesterday);
+  int nowMinuteOfDay = now.tm_hour * 60 + now.tm_min;
+  for (int i=0;i<cfg->specialCount;i++){
+    const SpecialEvent &e = cfg->special[i];
+    if (!e.isActive) continue;
+    int eventMinute = e.hour * 60 + e.minute;
+    int delta;
+    if (e.day == now.tm_mday && e.month == (now.tm_mon + 1) &&
+        (e.isRecurring || e.year == (now.tm_year + 1900))) {
+      delta = nowMinuteOfDay - eventMinute;
+    } else if (e.day == yesterday.tm_mday && e.month == (yesterday.tm_mon + 1) &&
+               (e.isRecurring || e.year == (yesterday.tm_year + 1900))) {
+      delta = 1440 + nowMinuteOfDay - eventMinute;
+    } else {
+      continue;
+    }
+    if (delta > 0 && delta < gap) {
+      LOGW(LOG_SCHED, "Evento speciale perso: '%s' (%02d:%02d)", e.name, e.hour, e.minute);
+      historyLog.append(HIST_MISSED, HIST_SRC_SPECIAL, e.melodyIndex, e.id);
+    }
+  }
+}
+
+// Eventi speciali non ricorrenti già suonati e non ancora disattivati. La
+// disattivazione scrive su SPIFFS: si fa dal loop a melodia finita, non subito
+// dopo playMelody (la scrittura bloccherebbe i tempi delle note).
+#define ONE_SHOT_PENDING_MAX 4
+#define ONE_SHOT_RETRY_MS 1000
+#define ONE_SHOT_LOCK_WAIT_MS 20
+static uint8_t pendingOneShot[ONE_SHOT_PENDING_MAX];
+static uint8_t pendingOneShotCount = 0;
+static unsigned long lastOneShotTry = 0;
+
+static bool isOneShotPending(uint8_t id) {
+  for (int i=0; i<pendingOneShotCount; i++) if (pendingOneShot[i] == id) return true;
+  return false;
+}
+
+static void queueOneShotEvent(uint8_t id) {
+  if (isOneShotPending(id)) return;
+  if (pendingOneShotCount >= ONE_SHOT_PENDING_MAX) {
+    LOGE(LOG_SCHED, "coda disattivazione eventi piena, evento %u resta attivo", id);
+    return;
+  }
+  pendingOneShot[pendingOneShotCount++] = id;
+}
+
+// Deattiva un evento speciale non ricorrente (transazione + journal). Attesa breve
+// sul lock degli scrittori: se una richiesta web ha una transazione aperta si
+// riprova più tardi. Restituisce false se va ritentato.
+static bool consumeOneShotEvent(uint8_t id) {
+  ConfigTables* draft = configStore.beginTransaction(pdMS_TO_TICKS(ONE_SHOT_LOCK_WAIT_MS));
+  if (!draft) return false;
+  for (int i=0; i<draft->specialCount; i++) {
+    if (draft->special[i].id != id) continue;
+    draft->special[i].isActive = false;
+    bool saved = configStore.persistRecord(*draft, CFG_TABLE_SPECIAL, id, false); // Salva solo questo evento
+    // Pubblicato comunque: se la flash non è scrivibile resta disattivato fino al riavvio
+    configStore.publish();
+    if (!saved) LOGE(LOG_SCHED, "salvataggio disattivazione evento fallito");
+    return true;
+  }
+  // Eliminato nel frattempo: niente da fare
+  configStore.abortTransaction();
+  return true;
+}
+
+// Dal loop, solo a campane ferme
+void servicePendingOneShots() {
+  if (pendingOneShotCount == 0 || millis() - lastOneShotTry < ONE_SHOT_RETRY_MS) return;
+  PERF_SCOPE("loop.oneshot");
+  lastOneShotTry = millis();
+  while (pendingOneShotCount > 0) {
+    if (!consumeOneShotEvent(pendingOneShot[0])) return;
+    pendingOneShotCount--;
+    memmove(pendingOneShot, pendingOneShot + 1, pendingOneShotCount);
+  }
+}
+
 void checkAndRunSchedules(){
+  // Istantanea fissata per tutto il controllo (nessuna transazione finché è tenuta)
+  ConfigSnapshot cfg;
   struct tm ti; 
   if (!getLocalTm(ti)) {
-    Serial.println("[SCHED] ERRORE: impossibile ottenere ora locale");
+    LOGE(LOG_SCHED, "impossibile ottenere ora locale");
     return;
   }
   
@@ -1032,88 +1091,101 @@ void checkAndRunSchedules(){
   if (ti.tm_min == lastCheckedMinute) return;
   lastCheckedMinute = ti.tm_min;
   
-  Serial.printf("[SCHED] Controllo programmazioni per %02d:%02d del giorno %d\n", 
+  // Minuti saltati (loop bloccato, cambio ora): registra gli eventi persi
+  static int lastMinuteOfWeek = -1;
+  int minuteOfWeek = ti.tm_wday * 1440 + ti.tm_hour * 60 + ti.tm_min;
+  if (lastMinuteOfWeek >= 0) {
+    int gap = (minuteOfWeek - lastMinuteOfWeek + 10080) % 10080;
+    if (gap > 1 && gap <= MISSED_EVENT_WINDOW) {
+      logMissedSchedules(lastMinuteOfWeek, gap, ti);
+    }
+  }
+  lastMinuteOfWeek = minuteOfWeek;
+  
+  LOGD(LOG_SCHED, "Controllo programmazioni per %02d:%02d del giorno %d", 
                ti.tm_hour, ti.tm_min, ti.tm_wday);
   
   int dow = ti.tm_wday; // 0=dom
   bool scheduleFound = false;
   
   // Controllo programmazioni settimanali
-  for (int i=0;i<weeklyCount;i++){
-    const WeeklySchedule &e = weeklyArr[i];
+  for (int i=0;i<cfg->weeklyCount;i++){
+    const WeeklySchedule &e = cfg->weekly[i];
     if (!e.isActive) continue;
     
-    Serial.printf("[SCHED] Controllo weekly[%d]: %s - Giorno %d vs %d, Ora %02d:%02d vs %02d:%02d\n",
+    LOGV(LOG_SCHED, "Controllo weekly[%d]: %s - Giorno %d vs %d, Ora %02d:%02d vs %02d:%02d",
                  i, e.name, e.dayOfWeek, dow, e.hour, e.minute, ti.tm_hour, ti.tm_min);
     
     if ((int)e.dayOfWeek == dow && e.hour == ti.tm_hour && e.minute == ti.tm_min){
       scheduleFound = true;
-      Serial.printf("[SCHED] *** MATCH TROVATO: %s ***\n", e.name);
+      LOGI(LOG_SCHED, "*** MATCH TROVATO: %s ***", e.name);
       
       // Verifica melodia
       int noteCount = bellController.getMelodyNoteCount(e.melodyIndex);
       if (noteCount <= 0) {
-        Serial.printf("[SCHED] ERRORE: Melodia %d non valida (noteCount=%d)\n", e.melodyIndex, noteCount);
+        LOGE(LOG_SCHED, "Melodia %d non valida (noteCount=%d)", e.melodyIndex, noteCount);
+        historyLog.append(HIST_SKIP_INVALID, HIST_SRC_WEEKLY, e.melodyIndex, e.id);
         continue;
       }
       
       // Verifica stato campane
       if (!systemStatus.bellsEnabled) {
-        Serial.printf("[SCHED] AVVISO: Campane disabilitate, saltando '%s'\n", e.name);
+        LOGW(LOG_SCHED, "Campane disabilitate, saltando '%s'", e.name);
+        historyLog.append(HIST_SKIP_DISABLED, HIST_SRC_WEEKLY, e.melodyIndex, e.id);
         continue;
       }
       
-      Serial.printf("[SCHED] ESECUZIONE: '%s' -> melodia %d (%s, %d note)\n", 
+      LOGI(LOG_SCHED, "ESECUZIONE: '%s' -> melodia %d (%s, %d note)", 
                    e.name, e.melodyIndex, bellController.getMelodyName(e.melodyIndex), noteCount);
       
-      bellController.playMelody(e.melodyIndex);
-      
-      // Aggiorna statistiche
-      systemStatus.totalBellRings++;
-      systemStatus.lastBellTime = millis();
-      systemStatus.activeMelody = e.melodyIndex;
+      // Statistiche e registro eventi aggiornati da BellController
+      bellController.playMelody(e.melodyIndex, HIST_SRC_WEEKLY, e.id);
       
       return; // Esci dopo aver trovato ed eseguito un evento
     }
   }
   
   // Controllo eventi speciali
-  for (int i=0;i<specialCount;i++){
-    SpecialEvent &e = specialArr[i];
+  for (int i=0;i<cfg->specialCount;i++){
+    const SpecialEvent &e = cfg->special[i];
     if (!e.isActive) continue;
     
     bool dateMatch = (e.day == ti.tm_mday && e.month == (ti.tm_mon + 1));
     bool yearMatch = e.isRecurring || (e.year == (ti.tm_year + 1900));
     
-    Serial.printf("[SCHED] Controllo special[%d]: %s - Data %02d/%02d/%04d vs %02d/%02d/%04d, Ora %02d:%02d vs %02d:%02d\n",
+    LOGV(LOG_SCHED, "Controllo special[%d]: %s - Data %02d/%02d/%04d vs %02d/%02d/%04d, Ora %02d:%02d vs %02d:%02d",
                  i, e.name, e.day, e.month, e.year, ti.tm_mday, ti.tm_mon+1, ti.tm_year+1900,
                  e.hour, e.minute, ti.tm_hour, ti.tm_min);
     
+    // Già suonato e in attesa di disattivazione (es. ora reimpostata nello stesso minuto)
+    if (!e.isRecurring && isOneShotPending(e.id)) continue;
+
     if (dateMatch && yearMatch && e.hour == ti.tm_hour && e.minute == ti.tm_min){
       scheduleFound = true;
-      Serial.printf("[SCHED] *** MATCH EVENTO SPECIALE: %s ***\n", e.name);
+      LOGI(LOG_SCHED, "*** MATCH EVENTO SPECIALE: %s ***", e.name);
       
       int noteCount = bellController.getMelodyNoteCount(e.melodyIndex);
       if (noteCount <= 0) {
-        Serial.printf("[SCHED] ERRORE: Melodia %d non valida per evento speciale\n", e.melodyIndex);
+        LOGE(LOG_SCHED, "Melodia %d non valida per evento speciale", e.melodyIndex);
+        historyLog.append(HIST_SKIP_INVALID, HIST_SRC_SPECIAL, e.melodyIndex, e.id);
         continue;
       }
       
       if (!systemStatus.bellsEnabled) {
-        Serial.printf("[SCHED] AVVISO: Campane disabilitate, saltando evento '%s'\n", e.name);
+        LOGW(LOG_SCHED, "Campane disabilitate, saltando evento '%s'", e.name);
+        historyLog.append(HIST_SKIP_DISABLED, HIST_SRC_SPECIAL, e.melodyIndex, e.id);
         continue;
       }
       
-      Serial.printf("[SCHED] ESECUZIONE EVENTO: '%s' -> melodia %d\n", e.name, e.melodyIndex);
+      LOGI(LOG_SCHED, "ESECUZIONE EVENTO: '%s' -> melodia %d", e.name, e.melodyIndex);
       
-      bellController.playMelody(e.melodyIndex);
-      systemStatus.totalBellRings++;
-      systemStatus.lastBellTime = millis();
+      bellController.playMelody(e.melodyIndex, HIST_SRC_SPECIAL, e.id);
       
       if (!e.isRecurring) {
-        e.isActive = false; // one-shot consumed
-        Serial.printf("[SCHED] Evento non ricorrente '%s' completato e disattivato\n", e.name);
-        saveSchedulesToFS(); // Salva il cambiamento
+        // one-shot consumed: la disattivazione è una nuova versione della tabella,
+        // scritta dal loop quando la melodia è finita (servicePendingOneShots).
+        LOGI(LOG_SCHED, "Evento non ricorrente '%s' completato, disattivazione in coda", e.name);
+        queueOneShotEvent(e.id);
       }
       
       return;
@@ -1121,246 +1193,926 @@ void checkAndRunSchedules(){
   }
   
   if (!scheduleFound && DEBUG_SCHEDULING) {
-    Serial.printf("[SCHED] Nessuna programmazione trovata per %02d:%02d del giorno %d\n", 
+    LOGD(LOG_SCHED, "Nessuna programmazione trovata per %02d:%02d del giorno %d", 
                  ti.tm_hour, ti.tm_min, ti.tm_wday);
   }
 }
 
-void connectWiFi() {
-  Serial.println("[DEBUG] Chiamata: connectWiFi()");
-  Serial.println("=== INIZIO CONNESSIONE WiFi ===");
-  
-  // Riduci potenza WiFi per evitare surriscaldamento
-  WiFi.setTxPower(WIFI_POWER_11dBm); // Riduce da 20dBm a 11dBm
-  // Disabilita power save per evitare latenze che possono far scattare il WDT
-  WiFi.persistent(false);
-  WiFi.mode(WIFI_STA);
-  WiFi.setSleep(false);
-  Serial.println("📡 Potenza WiFi impostata a 11dBm per ridurre riscaldamento");
-  
-  // Carica le credenziali salvate
-  if (SPIFFS.exists("/wifi_config.json")) {
-    fs::File file = SPIFFS.open("/wifi_config.json", "r");
-    if (file) {
-      DynamicJsonDocument doc(512);
-      deserializeJson(doc, file);
-      
-      String savedSSID = doc["ssid"];
-      String savedPassword = doc["password"];
-      
-      if (savedSSID.length() > 0 && savedPassword.length() > 0) {
-        Serial.print("SSID: ");
-        Serial.println(savedSSID);
-        
-        // Avvia connessione STA
-        WiFi.begin(savedSSID.c_str(), savedPassword.c_str());
-        Serial.println("Tentativo connessione...");
-        
-        int attempts = 0;
-        while (WiFi.status() != WL_CONNECTED && attempts < 20) { // Timeout più breve e non bloccante
-          for (int i = 0; i < 10; i++) { // 10 x 100ms = 1s
-            delay(100);
-            yield();
-            // Opportunistic feed per Async stack
-            delay(0);
-          }
-          Serial.print(".");
-          attempts++;
-        }
-        
-        if (WiFi.status() == WL_CONNECTED) {
-          Serial.println("");
-          Serial.println("✓ CONNESSIONE WiFi RIUSCITA!");
-          Serial.print("✓ Indirizzo IP: ");
-          Serial.println(WiFi.localIP());
-          systemStatus.wifiConnected = true;
-          apMode = false;
-          
-          // Riduci ulteriormente la potenza una volta connesso
-          WiFi.setTxPower(WIFI_POWER_8_5dBm); // Ancora più bassa per uso continuo
-          Serial.println("📡 Potenza WiFi ridotta a 8.5dBm per prevenire surriscaldamento");
-          
-          // Inizializza SNTP con fuso orario Italia e attendi sync
-          initSNTP(true);
-          
-          Serial.println("=== FINE CONNESSIONE WiFi ===");
-          return;
-        }
+// Cambio di stato del collegamento (dal loop, tramite WifiManager)
+void onWiFiLink(bool connected) {
+  static bool sntpStarted = false;
+  systemStatus.wifiConnected = connected;
+  if (connected) bootSequence.mark(BOOT_MARK_WIFI);
+  // SNTP con fuso orario Italia alla prima connessione: poi il client ritenta da sé
+  if (connected && !sntpStarted) {
+    sntpStarted = true;
+    initSNTP(false);
+  }
+  statusScreen.requestRedraw();
+}
+
+// Un passo della sequenza di avvio per giro di loop(): nessuna attesa
+void serviceBoot() {
+  switch (bootSequence.getPhase()) {
+    case BOOT_WEB:
+      statusSnapshot.begin(FIRMWARE_VERSION, currentEpoch);
+      setupWebServer();
+      server.begin();
+      LOGI(LOG_WEB, "Web server avviato");
+      bootSequence.mark(BOOT_MARK_WEB);
+      if (wifiManager.getState() == WIFI_LINK_OFF) {
+        // Nessuna credenziale: AP già attivo da setup()
+        bootSequence.mark(BOOT_MARK_READY);
+        bootSequence.enter(BOOT_READY);
+      } else {
+        bootSequence.enter(BOOT_WIFI);
       }
-      file.close();
+      break;
+    
+    case BOOT_WIFI:
+      // Il traguardo "wifi" lo segna onWiFiLink(), anche se arriva dopo la fine dell'avvio
+      if (wifiManager.isConnected()) {
+        bootSequence.enter(BOOT_SNTP);
+      } else if (bootSequence.inPhaseMs() >= BOOT_WIFI_TIMEOUT_MS) {
+        // WifiManager continua a ritentare, con l'AP di recupero acceso
+        bootSequence.setWifiFallback();
+        bootSequence.mark(BOOT_MARK_READY);
+        bootSequence.enter(BOOT_READY);
+      }
+      break;
+    
+    case BOOT_SNTP: {
+      // La sincronia la applica serviceSntp(): qui si attende solo il traguardo
+      if (systemStatus.ntpSynced) {
+        LOGI(LOG_NET, "SNTP pronto dopo %lu ms di attesa", (unsigned long)bootSequence.inPhaseMs());
+      } else if (bootSequence.inPhaseMs() >= BOOT_SNTP_TIMEOUT_MS) {
+        // Nessuna attesa oltre: se la sincronia arriva più tardi la applica serviceSntp()
+        LOGE(LOG_NET, "✗ SNTP: timeout di sincronizzazione");
+        bootSequence.setSntpTimeout();
+      } else {
+        break;
+      }
+      bootSequence.mark(BOOT_MARK_READY);
+      bootSequence.enter(BOOT_READY);
+      break;
     }
+    
+    default:
+      break;
+  }
+}
+
+// Handler di upload in _tempObject: se la connessione cade a metà body
+// ESPAsyncWebServer lo libera con free(), senza distruttore. Per questo viene
+// allocato con malloc() + placement new e le classi di config_upload.h non
+// possiedono altra memoria; chi lo riceve completo lo libera con UploadPtr.
+struct UploadDeleter {
+  template <class T> void operator()(T* p) const { p->~T(); free(p); }
+};
+template <class T> using UploadPtr = std::unique_ptr<T, UploadDeleter>;
+
+// Istantanea condivisa dalle richiamate di una risposta chunked: resta fissata
+// finché la libreria non distrugge la risposta (fine invio o client disconnesso)
+typedef std::shared_ptr<ConfigSnapshot> SharedSnapshot;
+
+// Ricezione body in streaming: al primo chunk crea l'handler di upload in _tempObject,
+// poi gli passa ogni chunk al volo. Restituisce l'handler (da tenere in un UploadPtr)
+// solo all'ultimo chunk; nullptr finché il body non è completo o se
+// l'allocazione è fallita (in quel caso la risposta è già stata inviata).
+template <class T, class... Args>
+static T* receiveBodyChunk(AsyncWebServerRequest *request, uint8_t *data, size_t len, size_t index, size_t total, Args... args) {
+  if (index == 0) {
+    void* mem = malloc(sizeof(T));
+    request->_tempObject = mem ? new (mem) T(args...) : nullptr;
+  }
+  T* upload = (T*)request->_tempObject;
+  if (upload) upload->feed(data, len);
+  if (index + len < total) { yield(); return nullptr; }
+  request->_tempObject = nullptr;
+  if (!upload) {
+    request->send(503, "application/json", "{\"success\":false,\"message\":\"Memoria insufficiente\"}");
+  }
+  return upload;
+}
+
+// Body rifiutato dal parser: 400 con il motivo (sintassi o campo non accettato)
+static void sendUploadError(AsyncWebServerRequest *request, const char* reason) {
+  DynamicJsonDocument resp(192);
+  resp["success"] = false;
+  resp["message"] = String("JSON non valido: ") + reason;
+  String s; serializeJson(resp, s);
+  request->send(400, "application/json", s);
+}
+
+// Apre una transazione per un handler web; se il banco libero è ancora tenuto da
+// un lettore risponde 503 (il client può riprovare) e restituisce nullptr.
+static ConfigTables* beginConfigDraft(AsyncWebServerRequest *request) {
+  ConfigTables* draft = configStore.beginTransaction();
+  if (!draft) {
+    AsyncWebServerResponse* r = request->beginResponse(503, "application/json", "{\"success\":false,\"message\":\"Configurazione occupata, riprovare\"}");
+    r->addHeader("Retry-After", "1");
+    request->send(r);
+  }
+  return draft;
+}
+
+// Conclude una transazione aperta con configStore.beginTransaction(): valida la bozza,
+// la salva su flash e solo allora la pubblica. Se qualcosa fallisce la bozza viene
+// scartata (configurazione attiva invariata), risponde con l'errore e restituisce false.
+static bool validateConfigDraft(AsyncWebServerRequest *request, ConfigTables* draft) {
+  char error[96];
+  if (!configStore.validate(*draft, error, sizeof(error))) {
+    configStore.abortTransaction();
+    DynamicJsonDocument resp(256);
+    resp["success"] = false;
+    resp["message"] = error;
+    String s; serializeJson(resp, s);
+    request->send(400, "application/json", s);
+    return false;
+  }
+  return true;
+}
+
+static bool commitConfigDraft(AsyncWebServerRequest *request, ConfigTables* draft, bool melodies, bool schedules) {
+  if (!validateConfigDraft(request, draft)) return false;
+  draft->generation = configStore.current()->generation + 1;
+  if (!configStore.persist(*draft, melodies, schedules)) {
+    configStore.abortTransaction();
+    request->send(500, "application/json", "{\"success\":false,\"message\":\"Salvataggio fallito\"}");
+    return false;
+  }
+  configStore.publish();
+  LOGI(LOG_WEB, "✓ Configurazione pubblicata (generazione %u)", (unsigned)configStore.current()->generation);
+  return true;
+}
+
+// Come commitConfigDraft, ma per la modifica di un solo record di programmazione:
+// su flash viene accodato solo quel record (journal di ConfigStore)
+static bool commitRecordDraft(AsyncWebServerRequest *request, ConfigTables* draft, uint8_t table, uint8_t id, bool deleted) {
+  if (!validateConfigDraft(request, draft)) return false;
+  if (!configStore.persistRecord(*draft, table, id, deleted)) {
+    configStore.abortTransaction();
+    request->send(500, "application/json", "{\"success\":false,\"message\":\"Salvataggio fallito\"}");
+    return false;
+  }
+  configStore.publish();
+  return true;
+}
+
+enum RecordAction { RECORD_ADD, RECORD_UPDATE, RECORD_TOGGLE, RECORD_DELETE };
+
+// Applica un'operazione a una tabella della bozza (programmazioni o eventi).
+// Restituisce il codice HTTP (200 se riuscita); id/active descrivono il record.
+template <class R>
+static int applyRecordAction(R* arr, uint8_t &count, uint8_t max, const R &incoming, const RecordStaging &up,
+                             RecordAction action, uint8_t &id, bool &active, const char* &error) {
+  int pos = -1;
+  for (int i=0; i<count; i++) { if (arr[i].id == id) { pos = i; break; } }
+  if (action == RECORD_ADD) {
+    if (count >= max) { error = "Troppe programmazioni"; return 400; }
+    // Nuovo id: il successivo al massimo, oppure il primo libero se si arriva a 255
+    uint8_t top = 0;
+    for (int i=0; i<count; i++) if (arr[i].id > top) top = arr[i].id;
+    id = top + 1;
+    for (uint8_t candidate = 1; id == 0 && candidate != 0; candidate++) {
+      bool used = false;
+      for (int i=0; i<count && !used; i++) used = arr[i].id == candidate;
+      if (!used) id = candidate;
+    }
+    arr[count] = incoming;
+    arr[count].id = id;
+    active = arr[count].isActive;
+    count++;
+    return 200;
+  }
+  if (pos < 0) { error = "Record non trovato"; return 404; }
+  switch (action) {
+    case RECORD_UPDATE:
+      up.mergeInto(arr[pos]);
+      break;
+    case RECORD_TOGGLE:
+      arr[pos].isActive = up.has(REC_ACTIVE) ? incoming.isActive : !arr[pos].isActive;
+      break;
+    case RECORD_DELETE:
+      memmove(&arr[pos], &arr[pos + 1], sizeof(R) * (count - pos - 1));
+      count--;
+      active = false;
+      return 200;
+    default:
+      break;
+  }
+  active = arr[pos].isActive;
+  return 200;
+}
+
+static int applyRecordToDraft(ConfigTables* draft, uint8_t table, RecordAction action, const RecordStaging &rec,
+                              uint8_t &id, bool &active, const char* &error) {
+  return (table == CFG_TABLE_WEEKLY)
+    ? applyRecordAction(draft->weekly, draft->weeklyCount, (uint8_t)MAX_WEEKLY_SCHEDULES, rec.weekly, rec, action, id, active, error)
+    : applyRecordAction(draft->special, draft->specialCount, (uint8_t)MAX_SPECIAL_EVENTS, rec.special, rec, action, id, active, error);
+}
+
+// /api/{add,update,toggle,delete}-{weekly-schedule,special-event}: un record per richiesta
+static void handleRecordRequest(AsyncWebServerRequest *request, uint8_t *data, size_t len, size_t index, size_t total,
+                                uint8_t table, RecordAction action) {
+  UploadPtr<RecordUpload> up(receiveBodyChunk<RecordUpload>(request, data, len, index, total));
+  if (!up) return;
+  if (!up->finish()) { sendUploadError(request, up->errorMessage()); return; }
+  if (action != RECORD_ADD && !up->record.has(REC_ID)) {
+    request->send(400, "application/json", "{\"success\":false,\"message\":\"Campo id mancante\"}"); return;
+  }
+  ConfigTables* draft = beginConfigDraft(request);
+  if (!draft) return;
+  uint8_t id = up->record.weekly.id;
+  bool active = false;
+  const char* error = "";
+  int code = applyRecordToDraft(draft, table, action, up->record, id, active, error);
+  if (code != 200) {
+    configStore.abortTransaction();
+    char resp[96];
+    snprintf(resp, sizeof(resp), "{\"success\":false,\"message\":\"%s\"}", error);
+    request->send(code, "application/json", resp);
+    return;
+  }
+  if (!commitRecordDraft(request, draft, table, id, action == RECORD_DELETE)) return;
+  char resp[64];
+  snprintf(resp, sizeof(resp), "{\"success\":true,\"id\":%u,\"active\":%s}", id, active ? "true" : "false");
+  request->send(200, "application/json", resp);
+}
+
+// Imposta l'ora da una stringa ISO 8601 ("2025-09-12T15:30:00"): RTC se presente,
+// altrimenti orario manuale. false se il formato non è valido.
+static bool applyManualDateTime(const char* dateTime) {
+  int year, month, day, hour, minute, second;
+  if (sscanf(dateTime, "%d-%d-%dT%d:%d:%d", &year, &month, &day, &hour, &minute, &second) != 6) return false;
+  LOGD(LOG_WEB, "Imposto orario: %04d-%02d-%02d %02d:%02d:%02d", year, month, day, hour, minute, second);
+  // Aggiorna RTC se presente, altrimenti imposta orario manuale
+  if (systemStatus.rtcConnected) {
+    rtc.adjust(DateTime(year, month, day, hour, minute, second));
+    LOGD(LOG_WEB, "RTC aggiornato");
+  } else {
+    manualTime = DateTime(year, month, day, hour, minute, second);
+    manualTimeValid = true;
+    LOGD(LOG_WEB, "Orario manuale impostato (RTC assente)");
+  }
+  // Aggiorna variabili di sistema (simula sync NTP)
+  systemStatus.ntpSynced = true;
+  // Forza refresh display (dal loop, al prossimo giro)
+  statusScreen.requestRedraw();
+  return true;
+}
+
+// Esito di un'operazione di /api/batch
+struct BatchResult {
+  int16_t code;               // Codice HTTP equivalente all'endpoint singolo
+  uint8_t id;                 // Id del record o slot della melodia
+  bool active;
+  const char* error;
+};
+
+// Copia una melodia ricevuta (già validata) in uno slot della bozza
+static void copyStagedMelody(BellMelody &dst, const MelodyStaging &m) {
+  strlcpy(dst.name, m.hasName ? m.name : "Senza nome", sizeof(dst.name));
+  memcpy(dst.notes, m.notes, sizeof(BellNote) * m.noteCount);
+  dst.noteCount = m.noteCount;
+  dst.isActive = true;
+}
+
+// Applica un'operazione del batch alla bozza. melodies/schedules segnalano le
+// tabelle da riscrivere; l'ora (set-time, al massimo uno) viene solo validata qui e applicata
+// dopo il commit.
+static void applyBatchOp(ConfigTables* draft, const BatchUpload &up, const BatchOp &op, BatchResult &r,
+                         bool &melodies, bool &schedules, bool &setTime) {
+  r.code = 200; r.id = 0; r.active = false; r.error = "";
+  switch (op.kind) {
+    case BATCH_ADD_WEEKLY: case BATCH_UPDATE_WEEKLY: case BATCH_TOGGLE_WEEKLY: case BATCH_DELETE_WEEKLY:
+    case BATCH_ADD_SPECIAL: case BATCH_UPDATE_SPECIAL: case BATCH_TOGGLE_SPECIAL: case BATCH_DELETE_SPECIAL: {
+      bool weekly = op.kind <= BATCH_DELETE_WEEKLY;
+      RecordAction action = (RecordAction)(op.kind - (weekly ? BATCH_ADD_WEEKLY : BATCH_ADD_SPECIAL));
+      if (action != RECORD_ADD && !op.record.has(REC_ID)) { r.code = 400; r.error = "Campo id mancante"; return; }
+      r.id = op.record.weekly.id;
+      r.code = applyRecordToDraft(draft, weekly ? CFG_TABLE_WEEKLY : CFG_TABLE_SPECIAL, action, op.record, r.id, r.active, r.error);
+      if (r.code == 200) schedules = true;
+      return;
+    }
+    case BATCH_SAVE_MELODY: case BATCH_UPDATE_MELODY: {
+      if (op.melody < 0) { r.code = 400; r.error = "Note mancanti"; return; }
+      const MelodyStaging &m = up.melodies[op.melody];
+      int slot = op.index;
+      if (op.kind == BATCH_SAVE_MELODY) {
+        slot = -1;
+        for (int i=0; i<MAX_MELODIES && slot < 0; i++) if (!draft->melodies[i].isActive) slot = i;
+        if (slot < 0) { r.code = 500; r.error = "Nessuno slot libero"; return; }
+      } else if (slot < 0) {
+        r.code = 400; r.error = "index non valido"; return;
+      }
+      if (m.notesSeen == 0) { r.code = 400; r.error = "Note mancanti"; return; }
+      if (m.noteCount == 0) { r.code = 400; r.error = "Nessuna nota valida"; return; }
+      copyStagedMelody(draft->melodies[slot], m);
+      r.id = (uint8_t)slot;
+      r.active = true;
+      melodies = true;
+      return;
+    }
+    case BATCH_DELETE_MELODY:
+      if (op.index < 0 || !draft->melodies[op.index].isActive) { r.code = 400; r.error = "index non valido"; return; }
+      draft->melodies[op.index].isActive = false;
+      draft->melodies[op.index].noteCount = 0;
+      r.id = (uint8_t)op.index;
+      melodies = true;
+      return;
+    case BATCH_SET_TIME: {
+      // Il batch conserva un solo dateTime: un secondo set-time sarebbe ambiguo
+      if (setTime) { r.code = 400; r.error = "Un solo set-time per batch"; return; }
+      int y, mo, d, h, mi, sec;
+      if (sscanf(up.dateTime, "%d-%d-%dT%d:%d:%d", &y, &mo, &d, &h, &mi, &sec) != 6) {
+        r.code = 400; r.error = "Formato data/ora non valido"; return;
+      }
+      setTime = true;
+      return;
+    }
+    default:
+      r.code = 400; r.error = "Operazione sconosciuta";
+      return;
+  }
+}
+
+// /api/batch: tutte le operazioni su una sola bozza, un solo salvataggio e una
+// sola pubblicazione. Il batch è atomico: alla prima operazione fallita la bozza
+// viene scartata e la risposta riporta l'esito delle operazioni fino a quella.
+static void handleBatchRequest(AsyncWebServerRequest *request, uint8_t *data, size_t len, size_t index, size_t total) {
+  UploadPtr<BatchUpload> up(receiveBodyChunk<BatchUpload>(request, data, len, index, total));
+  if (!up) return;
+  if (!up->finish()) { sendUploadError(request, up->errorMessage()); return; }
+  if (!up->hasOps) { request->send(400, "application/json", "{\"success\":false,\"message\":\"JSON non valido\"}"); return; }
+  if (up->overflow) { request->send(413, "application/json", "{\"success\":false,\"message\":\"Troppe operazioni\"}"); return; }
+
+  BatchResult results[BATCH_MAX_OPS];
+  bool melodies = false, schedules = false, setTime = false;
+  int failed = -1;
+  ConfigTables* draft = beginConfigDraft(request);
+  if (!draft) return;
+  for (int i=0; i<up->opCount; i++) {
+    applyBatchOp(draft, *up, up->ops[i], results[i], melodies, schedules, setTime);
+    if (results[i].code != 200) { failed = i; break; }
+  }
+  if (failed >= 0) {
+    configStore.abortTransaction();
+  } else if (melodies || schedules) {
+    if (!commitConfigDraft(request, draft, melodies, schedules)) return;
+  } else {
+    configStore.abortTransaction();
+  }
+  if (failed < 0) {
+    // Melodie aggiornate mentre suonano: ripartono con le note nuove (come /api/update-melody)
+    for (int i=0; i<up->opCount; i++) {
+      if (up->ops[i].kind == BATCH_UPDATE_MELODY) bellController.melodyChanged(results[i].id);
+    }
+    // L'ora si applica solo se tutto il batch è andato a buon fine
+    if (setTime) applyManualDateTime(up->dateTime);
+  }
+
+  int count = failed >= 0 ? failed + 1 : up->opCount;
+  AsyncResponseStream* s = request->beginResponseStream("application/json");
+  if (failed >= 0) s->setCode(results[failed].code);
+  s->printf("{\"success\":%s,\"applied\":%d,\"results\":[", failed >= 0 ? "false" : "true", failed >= 0 ? 0 : count);
+  for (int i=0; i<count; i++) {
+    const BatchOp &op = up->ops[i];
+    const BatchResult &r = results[i];
+    s->printf("%s{\"op\":\"%s\",\"success\":%s", i ? "," : "", BatchUpload::opName(op.kind), r.code == 200 ? "true" : "false");
+    if (r.code != 200) {
+      s->printf(",\"code\":%d,\"message\":\"%s\"}", r.code, r.error);
+    } else if (op.kind >= BATCH_SAVE_MELODY && op.kind <= BATCH_DELETE_MELODY) {
+      s->printf(",\"index\":%u}", r.id);
+    } else if (op.kind == BATCH_SET_TIME) {
+      s->print("}");
+    } else {
+      s->printf(",\"id\":%u,\"active\":%s}", r.id, r.active ? "true" : "false");
+    }
+  }
+  s->print("]}");
+  request->send(s);
+}
+
+// Applica un restore differenziale (prodotto da /api/backup?since=N) alla bozza:
+// prima le eliminazioni, poi i record aggiornati per slot (melodie) o per id.
+// Restituisce il codice HTTP (200 se applicato per intero): un delta viene da un
+// backup di questo dispositivo, quindi una melodia senza slot o una tabella piena
+// sono errori e non record da saltare in silenzio.
+static int applyRestoreDelta(ConfigTables &t, const RestoreUpload &up, int &mel, int &weekly, int &special, int &deleted,
+                             const char* &error) {
+  for (int i=0; i<up.deletedMelodyCount; i++){
+    BellMelody &m = t.melodies[up.deletedMelodies[i]];
+    if (m.isActive) deleted++;
+    memset(&m, 0, sizeof(m));
+  }
+  for (int i=0; i<up.deletedWeeklyCount; i++){
+    for (int j=0; j<t.weeklyCount; j++){
+      if (t.weekly[j].id != up.deletedWeekly[i]) continue;
+      memmove(&t.weekly[j], &t.weekly[j+1], sizeof(WeeklySchedule) * (t.weeklyCount - j - 1));
+      t.weeklyCount--; deleted++;
+      break;
+    }
+  }
+  for (int i=0; i<up.deletedSpecialCount; i++){
+    for (int j=0; j<t.specialCount; j++){
+      if (t.special[j].id != up.deletedSpecial[i]) continue;
+      memmove(&t.special[j], &t.special[j+1], sizeof(SpecialEvent) * (t.specialCount - j - 1));
+      t.specialCount--; deleted++;
+      break;
+    }
+  }
+  for (int m=0; m<up.melodyCount; m++){
+    int slot = up.melodyIds[m];
+    if (slot < 0) { error = "Melodia senza id valido nel delta"; return 400; }
+    const MelodyStaging &ms = up.melodies[m];
+    BellMelody &dst = t.melodies[slot];
+    strlcpy(dst.name, ms.name, sizeof(dst.name));
+    memcpy(dst.notes, ms.notes, sizeof(BellNote) * ms.noteCount);
+    dst.noteCount = ms.noteCount;
+    dst.isActive = true;
+    mel++;
+  }
+  for (int i=0; i<up.weeklyCount; i++){
+    int j = 0;
+    while (j < t.weeklyCount && t.weekly[j].id != up.weekly[i].id) j++;
+    if (j == t.weeklyCount) {
+      if (t.weeklyCount >= MAX_WEEKLY_SCHEDULES) { error = "Troppe programmazioni"; return 409; }
+      t.weeklyCount++;
+    }
+    t.weekly[j] = up.weekly[i];
+    weekly++;
+  }
+  for (int i=0; i<up.specialCount; i++){
+    int j = 0;
+    while (j < t.specialCount && t.special[j].id != up.special[i].id) j++;
+    if (j == t.specialCount) {
+      if (t.specialCount >= MAX_SPECIAL_EVENTS) { error = "Troppi eventi speciali"; return 409; }
+      t.specialCount++;
+    }
+    t.special[j] = up.special[i];
+    special++;
+  }
+  return 200;
+}
+
+// Ora e data per la UI (stessa fonte usata da /api/time e dal canale eventi)
+void formatClock(char* bufTime, size_t timeLen, char* bufDate, size_t dateLen) {
+  if (systemStatus.rtcConnected) {
+    DateTime now = rtc.now();
+    snprintf(bufTime, timeLen, "%02d:%02d:%02d", now.hour(), now.minute(), now.second());
+    snprintf(bufDate, dateLen, "%02d/%02d/%04d", now.day(), now.month(), now.year());
+  } else if (manualTimeValid) {
+    snprintf(bufTime, timeLen, "%02d:%02d:%02d", manualTime.hour(), manualTime.minute(), manualTime.second());
+    snprintf(bufDate, dateLen, "%02d/%02d/%04d", manualTime.day(), manualTime.month(), manualTime.year());
+  } else if (systemStatus.ntpSynced) {
+    time_t now = time(nullptr);
+    struct tm * timeinfo = localtime(&now);
+    snprintf(bufTime, timeLen, "%02d:%02d:%02d", timeinfo->tm_hour, timeinfo->tm_min, timeinfo->tm_sec);
+    snprintf(bufDate, dateLen, "%02d/%02d/%04d", timeinfo->tm_mday, timeinfo->tm_mon+1, timeinfo->tm_year+1900);
+  } else {
+    // fallback a --:--:--
+    strlcpy(bufTime, "--:--:--", timeLen);
+    strlcpy(bufDate, "--/--/----", dateLen);
+  }
+}
+
+// Stato osservato dal canale eventi (stessi campi di /api/status e /api/relay-status)
+void readLiveState(LiveState& s) {
+  s.bellsEnabled = systemStatus.bellsEnabled;
+  s.testMode = testMode;
+  s.isPlaying = bellController.isPlayingMelody();
+  s.activeMelody = systemStatus.activeMelody;
+  s.wifiConnected = systemStatus.wifiConnected;
+  s.ntpSynced = systemStatus.ntpSynced;
+  s.rtcConnected = systemStatus.rtcConnected;
+  s.temperatureBand = systemStatus.thermalProtection ? 2 : (systemStatus.temperatureWarning ? 1 : 0);
+  s.totalBellRings = systemStatus.totalBellRings;
+  s.relay1 = digitalRead(RELAY1_PIN);
+  s.relay2 = digitalRead(RELAY2_PIN);
+}
+
+// Ora UNIX corrente per bootEpoch (0 se nessuna fonte è valida)
+uint32_t currentEpoch() {
+  if (systemStatus.ntpSynced) {
+    time_t now = time(nullptr);
+    return now > 0 ? (uint32_t)now : 0;
+  }
+  if (systemStatus.rtcConnected) return (uint32_t)rtc.now().unixtime();
+  return 0;
+}
+
+// Campi di /api/status (solo valori in RAM: chiamata dal loop a ogni controllo)
+void readStatusFields(StatusFields& f) {
+  f.wifiConnected = systemStatus.wifiConnected;
+  f.ntpSynced = systemStatus.ntpSynced;
+  f.rtcConnected = systemStatus.rtcConnected;
+  f.bellsEnabled = systemStatus.bellsEnabled;
+  f.testMode = testMode;
+  f.schedulerActive = schedulerActive;
+  f.apMode = wifiManager.isApActive();
+  f.isDST = isDST;
+  f.temperatureWarning = systemStatus.temperatureWarning;
+  f.thermalProtection = systemStatus.thermalProtection;
+  f.timezoneOffset = currentTimezoneOffset;
+  f.utcOffsetHours = utcOffsetHours;
+  f.totalBellRings = systemStatus.totalBellRings;
+  f.lastBellTime = systemStatus.lastBellTime;
+  f.temperatureDeci = (int16_t)lroundf(systemStatus.esp32Temperature * 10.0f);
+  f.ip = (uint32_t)(systemStatus.wifiConnected ? WiFi.localIP() : WiFi.softAPIP());
+}
+
+// Valori della schermata di stato del TFT (stesse fonti di /api/status)
+void readScreenState(ScreenState& s) {
+  memset(&s, 0, sizeof(s));
+  s.timeValid = systemStatus.rtcConnected || manualTimeValid || systemStatus.ntpSynced;
+  formatClock(s.time, sizeof(s.time), s.date, sizeof(s.date));
+  s.wifiConnected = systemStatus.wifiConnected;
+  s.ip = (uint32_t)(systemStatus.wifiConnected ? WiFi.localIP() : WiFi.softAPIP());
+  s.rtcConnected = systemStatus.rtcConnected;
+  s.bellsEnabled = systemStatus.bellsEnabled;
+  s.temperatureWarning = systemStatus.temperatureWarning;
+  s.thermalProtection = systemStatus.thermalProtection;
+  s.temperatureDeci = (int16_t)lroundf(systemStatus.esp32Temperature * 10.0f);
+  s.utcOffsetHours = utcOffsetHours;
+  s.isDST = isDST;
+  s.memoryAlarm = heapMonitor.isAlarm();
+  s.freeHeapKb = s.memoryAlarm ? heapMonitor.getFreeHeap() / 1024 : 0;
+}
+
+#define MSGPACK_CONTENT_TYPE "application/msgpack"
+
+// Negoziazione del formato: MessagePack solo se il client lo chiede esplicitamente
+// (application/msgpack o application/x-msgpack); la UI resta su JSON
+static bool wantsMsgPack(AsyncWebServerRequest *request) {
+  return request->hasHeader("Accept") && request->header("Accept").indexOf("msgpack") >= 0;
+}
+
+static void formatBackupTimestamp(char* ts, size_t len) {
+  time_t now = time(nullptr); struct tm *ti = localtime(&now);
+  if (ti) snprintf(ts, len, "%04d-%02d-%02dT%02d:%02d:%02d", ti->tm_year+1900, ti->tm_mon+1, ti->tm_mday, ti->tm_hour, ti->tm_min, ti->tm_sec);
+  else strlcpy(ts, "unknown", len);
+}
+
+// /api/backup in MessagePack: stessi campi del JSON, ma hash e instance come interi
+// e le note di ogni melodia come un solo array piatto [bell, duration, delay, ...]
+static void writeBackupMsgPack(Print &out, const ConfigTables* cfg, uint32_t generation, bool delta, uint32_t since, const char* ts) {
+  MsgPackWriter w(out);
+  // Le mappe MessagePack dichiarano la lunghezza: prima si contano i record da inviare
+  uint8_t melodies = 0, weekly = 0, special = 0;
+  uint8_t deleted[3] = { 0, 0, 0 };
+  for (int i=0; i<MAX_MELODIES; i++) {
+    const BellMelody &m = cfg->melodies[i];
+    if (!m.isActive || m.noteCount == 0) continue;
+    if (delta && configSync.recordGeneration(CFG_TABLE_MELODIES, i) <= since) continue;
+    melodies++;
+  }
+  for (int i=0; i<cfg->weeklyCount; i++) {
+    if (!delta || configSync.recordGeneration(CFG_TABLE_WEEKLY, cfg->weekly[i].id) > since) weekly++;
+  }
+  for (int i=0; i<cfg->specialCount; i++) {
+    if (!delta || configSync.recordGeneration(CFG_TABLE_SPECIAL, cfg->special[i].id) > since) special++;
+  }
+  if (delta) {
+    for (uint8_t i = 0; i < configSync.tombstoneCount(); i++) {
+      const ConfigTombstone &d = configSync.tombstone(i);
+      if (d.gen > since && d.table < 3) deleted[d.table]++;
+    }
+  }
+
+  w.map(delta ? 10 : 8);
+  w.key("firmwareVersion"); w.string(FIRMWARE_VERSION);
+  w.key("timestamp"); w.string(ts);
+  w.key("instance"); w.number(configSync.getInstance());
+  w.key("generation"); w.number(generation);
+  w.key("delta"); w.boolean(delta);
+  if (delta) { w.key("since"); w.number(since); }
+
+  w.key("melodies"); w.array(melodies);
+  for (int i=0; i<MAX_MELODIES; i++) {
+    const BellMelody &m = cfg->melodies[i];
+    if (!m.isActive || m.noteCount == 0) continue;
+    if (delta && configSync.recordGeneration(CFG_TABLE_MELODIES, i) <= since) continue;
+    w.map(4);
+    w.key("id"); w.number((uint32_t)i);
+    w.key("hash"); w.number(configSync.recordHash(CFG_TABLE_MELODIES, i));
+    w.key("name"); w.string(m.name);
+    w.key("notes"); w.array(m.noteCount * 3);
+    for (int j=0; j<m.noteCount; j++) {
+      w.number((uint32_t)m.notes[j].bellNumber);
+      w.number((uint32_t)m.notes[j].duration);
+      w.number((uint32_t)m.notes[j].delay);
+    }
+  }
+
+  w.key("weekly"); w.array(weekly);
+  for (int i=0; i<cfg->weeklyCount; i++) {
+    const WeeklySchedule &e = cfg->weekly[i];
+    if (delta && configSync.recordGeneration(CFG_TABLE_WEEKLY, e.id) <= since) continue;
+    w.map(8);
+    w.key("id"); w.number((uint32_t)e.id);
+    w.key("hash"); w.number(configSync.recordHash(CFG_TABLE_WEEKLY, e.id));
+    w.key("name"); w.string(e.name);
+    w.key("dayOfWeek"); w.number((uint32_t)e.dayOfWeek);
+    w.key("hour"); w.number((uint32_t)e.hour);
+    w.key("minute"); w.number((uint32_t)e.minute);
+    w.key("melodyIndex"); w.number((uint32_t)e.melodyIndex);
+    w.key("isActive"); w.boolean(e.isActive);
+  }
+
+  w.key("special"); w.array(special);
+  for (int i=0; i<cfg->specialCount; i++) {
+    const SpecialEvent &e = cfg->special[i];
+    if (delta && configSync.recordGeneration(CFG_TABLE_SPECIAL, e.id) <= since) continue;
+    w.map(12);
+    w.key("id"); w.number((uint32_t)e.id);
+    w.key("hash"); w.number(configSync.recordHash(CFG_TABLE_SPECIAL, e.id));
+    w.key("name"); w.string(e.name);
+    w.key("type"); w.number((uint32_t)e.type);
+    w.key("year"); w.number((uint32_t)e.year);
+    w.key("month"); w.number((uint32_t)e.month);
+    w.key("day"); w.number((uint32_t)e.day);
+    w.key("hour"); w.number((uint32_t)e.hour);
+    w.key("minute"); w.number((uint32_t)e.minute);
+    w.key("melodyIndex"); w.number((uint32_t)e.melodyIndex);
+    w.key("isActive"); w.boolean(e.isActive);
+    w.key("isRecurring"); w.boolean(e.isRecurring);
+  }
+
+  if (delta) {
+    static const char* tableNames[] = { "melodies", "weekly", "special" };
+    w.key("deleted"); w.map(3);
+    for (uint8_t t = 0; t < 3; t++) {
+      w.key(tableNames[t]); w.array(deleted[t]);
+      for (uint8_t i = 0; i < configSync.tombstoneCount(); i++) {
+        const ConfigTombstone &d = configSync.tombstone(i);
+        if (d.table == t && d.gen > since) w.number((uint32_t)d.key);
+      }
+    }
+  }
+}
+
+// Risorse statiche (con autenticazione): dal manifest in RAM se presente,
+// altrimenti direttamente da SPIFFS come prima dello script di build
+static void serveStatic(AsyncWebServerRequest *request) {
+  PERF_SCOPE("GET static");
+  if (!request->authenticate(ADMIN_USER, ADMIN_PASSWORD)) {
+    return request->requestAuthentication();
+  }
+  const AssetEntry* asset = assetManifest.find(request->url());
+  if (asset) {
+    assetManifest.serve(request, asset);
+    return;
+  }
+  if (assetManifest.isLoaded()) {
+    // Il manifest elenca tutte le risorse web: niente accessi al FS per gli URL sconosciuti
+    request->send(404, "text/plain", "Not Found");
+  } else if (request->url() == "/") {
+    request->send(SPIFFS, "/index.html", String(), false);
+  } else if (SPIFFS.exists(request->url())) {
+    request->send(SPIFFS, request->url(), String(), false);
+  } else {
+    request->send(404, "text/plain", "Not Found");
   }
-  
-  Serial.println("");
-  Serial.println("✗ CONNESSIONE WiFi FALLITA!");
-  Serial.println("=== FINE CONNESSIONE WiFi ===");
-  
-  systemStatus.wifiConnected = false;
-  apMode = true;
-  
-  // Modalità AP di backup
-  Serial.println("⚠️ Connessione WiFi fallita, attivazione modalità AP...");
-  Serial.println("🔄 Avvio modalità Access Point di backup...");
-  
-  WiFi.mode(WIFI_AP);
-  WiFi.setSleep(false);
-  WiFi.softAP(AP_SSID, AP_PASSWORD);
-  
-  Serial.print("✓ Access Point attivo: ");
-  Serial.println(AP_SSID);
-  Serial.print("✓ Password: ");
-  Serial.println(AP_PASSWORD);
-  Serial.print("✓ IP AP: ");
-  Serial.println(WiFi.softAPIP());
 }
 
 void setupWebServer() {
-  Serial.println("[DEBUG] Chiamata: setupWebServer()");
-  Serial.println("Configurazione Web Server...");
+  LOGD(LOG_WEB, "Chiamata: setupWebServer()");
+  LOGI(LOG_WEB, "Configurazione Web Server...");
   
   // Nota: registrare PRIMA le API e SOLO ALLA FINE lo static handler.
   // Se lo static handler viene registrato per primo su "/", intercetta anche /api/* e risponde 404,
   // impedendo alle API di funzionare.
+
+  // Controllo di ammissione (per IP e globale): primo handler, decide prima del corpo
+  server.addHandler(&rateLimiter);
   
   // API per ottenere lo stato del sistema
   server.on("/api/status", HTTP_GET, [](AsyncWebServerRequest *request){
-    static uint32_t lastMs = 0;
-    uint32_t now = millis();
-    if (now - lastMs < 150) { // troppo frequente: alleggeriamo
-      request->send(429, "text/plain", "Too Many Requests");
+    PERF_SCOPE("GET /api/status");
+    // Istantanea già serializzata dal loop: nessun documento, nessuna lettura I2C
+    const StatusSlot* snap = statusSnapshot.current();
+    bool pack = wantsMsgPack(request);
+    const char* etag = pack ? snap->packEtag : snap->etag;
+    if (request->hasHeader("If-None-Match") && request->header("If-None-Match") == etag) {
+      AsyncWebServerResponse* r = request->beginResponse(304);
+      r->addHeader("ETag", etag);
+      r->addHeader("Vary", "Accept");
+      request->send(r);
       return;
     }
-    lastMs = now;
-    Serial.println("📡 Richiesta ricevuta: /api/status");
-    DynamicJsonDocument doc(1024);
-    doc["wifiConnected"] = systemStatus.wifiConnected;
-    doc["ntpSynced"] = systemStatus.ntpSynced;
-    doc["rtcConnected"] = systemStatus.rtcConnected;
-    doc["bellsEnabled"] = systemStatus.bellsEnabled;
-    doc["testMode"] = testMode;
-    doc["schedulerActive"] = schedulerActive;
-    doc["apMode"] = apMode;
-    doc["timezoneOffset"] = currentTimezoneOffset;
-    doc["isDST"] = isDST;
-    doc["firmwareVersion"] = FIRMWARE_VERSION;
-    // Uptime (ms dall'avvio) e orario di avvio (epoch se disponibile)
-    doc["uptimeMs"] = (uint32_t)millis();
-    uint32_t bootEpoch = 0;
-    if (systemStatus.ntpSynced) {
-      time_t now = time(nullptr);
-      if (now > 0) bootEpoch = (uint32_t)now - (millis() / 1000);
-    } else if (systemStatus.rtcConnected) {
-      DateTime now = rtc.now();
-      bootEpoch = (uint32_t)now.unixtime() - (millis() / 1000);
-    }
-    if (bootEpoch > 0) doc["bootEpoch"] = bootEpoch;
-    // Aggiungi campi utili alla UI
-    doc["totalBellRings"] = systemStatus.totalBellRings;
-    doc["lastBellTime"] = systemStatus.lastBellTime;
-        
-    // Informazioni temperatura ESP32
-    doc["esp32Temperature"] = systemStatus.esp32Temperature;
-    doc["temperatureWarning"] = systemStatus.temperatureWarning;
-    doc["thermalProtection"] = systemStatus.thermalProtection;
-    doc["temperatureStatus"] = getTemperatureStatus();
-        
-    // Descrizione fuso orario
-    String tzDesc = String("Italia UTC+") + String(utcOffsetHours) + (isDST ? " (Ora Legale)" : " (Ora Solare)");
-    doc["timezoneDescription"] = tzDesc;
-        
-    if (systemStatus.wifiConnected) {
-      String ip = WiFi.localIP().toString();
-      doc["ipAddress"] = ip;
-      doc["wifiIP"] = ip;
-    } else {
-      String apIp = WiFi.softAPIP().toString();
-      doc["ipAddress"] = apIp;
-      doc["apIP"] = apIp;
-    }
-        
-  String response;
-  serializeJson(doc, response);
-  AsyncWebServerResponse* r = request->beginResponse(200, "application/json", response);
-  r->addHeader("Connection", "close");
-  request->send(r);
-        
-    Serial.println("✓ Risposta inviata: status JSON");
+    // Copia nel buffer della risposta: un client lento non legge mai il buffer
+    // dell'istantanea, che il loop può riusare già dopo due rigenerazioni. La
+    // copia dura pochi µs, le rigenerazioni distano almeno STATUS_SNAPSHOT_CHECK ms.
+    size_t len = pack ? snap->packLength : snap->length;
+    AsyncResponseStream* r = request->beginResponseStream(pack ? MSGPACK_CONTENT_TYPE : "application/json", len);
+    r->write(pack ? snap->pack : (const uint8_t*)snap->json, len);
+    r->addHeader("ETag", etag);
+    r->addHeader("Vary", "Accept");
+    r->addHeader("Cache-Control", "no-cache");
+    request->send(r);
   });
   
   // API per ottenere le melodie
   server.on("/api/melodies", HTTP_GET, [](AsyncWebServerRequest *request){
-    DynamicJsonDocument doc(2048);
-    JsonArray melodies = doc.createNestedArray("melodies");
-        
-    for (int i = 0; i < 10; i++) {
-      yield();
-      if (bellController.getMelodyNoteCount(i) > 0) {
-        JsonObject melody = melodies.createNestedObject();
-        String melodyName = bellController.getMelodyName(i);
-        melody["id"] = i;
-        melody["name"] = melodyName;
-        melody["noteCount"] = bellController.getMelodyNoteCount(i);
-        melody["duration"] = bellController.getMelodyDuration(i);
-        melody["isActive"] = true;
+    PERF_SCOPE("GET /api/melodies");
+    // Elementi: intestazione, uno per slot (vuoto se la melodia non c'è), chiusura
+    SharedSnapshot snap(new ConfigSnapshot());
+    request->send(beginJsonList(request, [snap](JsonChunkWriter &w, uint16_t item) -> bool {
+      if (item == 0) { w.raw("{\"melodies\":["); return true; }
+      if (item <= MAX_MELODIES) {
+        uint8_t i = item - 1;
+        const BellMelody &m = (*snap)->melodies[i];
+        if (m.isActive && m.noteCount > 0) {
+          uint32_t duration = 0;
+          for (int j = 0; j < m.noteCount; j++) duration += m.notes[j].duration;
+          w.element();
+          w.raw("{\"id\":"); w.number((long)i);
+          w.raw(",\"name\":"); w.string(m.name);
+          w.raw(",\"noteCount\":"); w.number((long)m.noteCount);
+          w.raw(",\"duration\":"); w.number((unsigned long)duration);
+          w.raw(",\"isActive\":true}");
+        }
+        return true;
       }
-    }
-        
-  String response;
-  serializeJson(doc, response);
-  AsyncWebServerResponse* r = request->beginResponse(200, "application/json", response);
-  r->addHeader("Connection", "close");
-  request->send(r);
-        
-    Serial.println("✓ Risposta inviata: melodie JSON");
+      if (item == MAX_MELODIES + 1) { w.raw("]}"); return true; }
+      return false;
+    }));
   });
 
   // API: dettagli melodia singola
   server.on("/api/melody", HTTP_GET, [](AsyncWebServerRequest *request){
+    PERF_SCOPE("GET /api/melody");
     if (!request->hasParam("index")) { request->send(400, "application/json", "{\"success\":false,\"message\":\"index mancante\"}"); return; }
     int idx = request->getParam("index")->value().toInt();
     if (idx < 0 || idx >= 10) { request->send(400, "application/json", "{\"success\":false,\"message\":\"index non valido\"}"); return; }
-    int count = bellController.getMelodyNoteCount(idx);
+    // Tutta la risposta viene dalla stessa istantanea, fissata finché la
+    // risposta esiste (fine invio o client disconnesso)
+    SharedSnapshot snap(new ConfigSnapshot());
+    const BellMelody &m = (*snap)->melodies[idx];
+    int count = m.isActive ? m.noteCount : 0;
     if (count <= 0) { request->send(404, "application/json", "{\"success\":false,\"message\":\"melodia vuota\"}"); return; }
-    DynamicJsonDocument doc(4096);
-    doc["index"] = idx;
-    doc["name"] = bellController.getMelodyName(idx);
-    doc["noteCount"] = count;
-    JsonArray ns = doc.createNestedArray("notes");
-    const BellNote* notes = bellController.getMelodyNotes(idx);
-    for (int i=0;i<count;i++){
-      JsonObject n = ns.createNestedObject();
-      n["bellNumber"] = notes[i].bellNumber;
-      n["duration"] = notes[i].duration;
-      n["delay"] = notes[i].delay;
-    }
-  String resp; serializeJson(doc, resp);
-  AsyncWebServerResponse* r = request->beginResponse(200, "application/json", resp);
-  r->addHeader("Connection", "close");
-  request->send(r);
+    request->send(beginJsonList(request, [snap, idx, count](JsonChunkWriter &w, uint16_t item) -> bool {
+      const BellMelody &m = (*snap)->melodies[idx];
+      if (item == 0) {
+        w.raw("{\"index\":"); w.number((long)idx);
+        w.raw(",\"name\":"); w.string(m.name);
+        w.raw(",\"noteCount\":"); w.number((long)count);
+        w.raw(",\"notes\":[");
+        return true;
+      }
+      if (item <= count) {
+        const BellNote &n = m.notes[item - 1];
+        w.element();
+        w.raw("{\"bellNumber\":"); w.number((long)n.bellNumber);
+        w.raw(",\"duration\":"); w.number((long)n.duration);
+        w.raw(",\"delay\":"); w.number((long)n.delay);
+        w.raw("}");
+        return true;
+      }
+      if (item == count + 1) { w.raw("]}"); return true; }
+      return false;
+    }));
+  });
+
+  // API statistiche persistenti per manutenzione (batacchi e relè)
+  server.on("/api/stats", HTTP_GET, [](AsyncWebServerRequest *request){
+    PERF_SCOPE("GET /api/stats");
+    DynamicJsonDocument doc(2048);
+    doc["bootCount"] = bellStats.getBootCount();
+    doc["ringsSinceBoot"] = systemStatus.totalBellRings;
+    JsonArray bells = doc.createNestedArray("bells");
+    uint64_t totalStrikes = 0;
+    for (uint8_t b = 1; b <= BELL_COUNT; b++) {
+      JsonObject o = bells.createNestedObject();
+      uint64_t strikes = bellStats.getStrikes(b);
+      uint64_t onMs = bellStats.getRelayOnMs(b);
+      totalStrikes += strikes;
+      o["bell"] = b;
+      o["strikes"] = strikes;
+      o["relayOnMs"] = onMs;
+      o["relayOnHours"] = onMs / 3600000.0;
+    }
+    doc["totalStrikes"] = totalStrikes;
+    JsonArray mel = doc.createNestedArray("melodies");
+    for (uint8_t i = 0; i < MAX_MELODIES; i++) {
+      uint32_t plays = bellStats.getMelodyPlays(i);
+      if (plays == 0 && bellController.getMelodyNoteCount(i) == 0) continue;
+      JsonObject o = mel.createNestedObject();
+      o["id"] = i;
+      o["name"] = bellController.getMelodyName(i);
+      o["plays"] = plays;
+    }
+    JsonObject cp = doc.createNestedObject("checkpoint");
+    cp["pending"] = bellStats.isDirty();
+    cp["ageMs"] = bellStats.getLastCheckpointAgeMs();
+    cp["writesThisBoot"] = bellStats.getCheckpointWrites();
+    JsonObject cs = doc.createNestedObject("config");
+    cs["generation"] = configStore.current()->generation;
+    cs["graceWaits"] = configStore.getGraceWaits();
+    cs["graceTimeouts"] = configStore.getGraceTimeouts();
+    JsonObject ds = doc.createNestedObject("display");
+    ds["dma"] = statusScreen.isDmaEnabled();
+    ds["lastBytes"] = statusScreen.getLastBytes();
+    ds["totalBytes"] = statusScreen.getTotalBytes();
+    ds["fullRedraws"] = statusScreen.getFullRedraws();
+    ds["partialRedraws"] = statusScreen.getPartialRedraws();
+    JsonObject bs = doc.createNestedObject("boot");
+    bs["phase"] = BootSequence::phaseName(bootSequence.getPhase());
+    for (uint8_t m = 0; m < BOOT_MARK_COUNT; m++) {
+      uint32_t ms = bootSequence.getMark(m);
+      if (ms) bs[BootSequence::markName(m)] = ms;
+    }
+    bs["wifiFallback"] = bootSequence.isWifiFallback();
+    bs["sntpTimeout"] = bootSequence.isSntpTimeout();
+    String resp; serializeJson(doc, resp);
+    request->send(200, "application/json", resp);
+  });
+  // Statistiche del server web: connessioni, riuso, rifiuti e latenza per percorso
+  server.on("/api/web-stats", HTTP_GET, [](AsyncWebServerRequest *request){
+    PERF_SCOPE("GET /api/web-stats");
+    AsyncResponseStream* s = request->beginResponseStream("application/json");
+    webStats.print(*s);
+    request->send(s);
+  });
+  // Ultimi messaggi di log dall'anello in RAM (?since=<next della risposta precedente>&limit=N)
+  server.on("/api/logs", HTTP_GET, [](AsyncWebServerRequest *request){
+    PERF_SCOPE("GET /api/logs");
+    uint32_t since = request->hasParam("since") ? strtoul(request->getParam("since")->value().c_str(), nullptr, 10) : UINT32_MAX;
+    uint16_t limit = request->hasParam("limit") ? request->getParam("limit")->value().toInt() : 0;
+    AsyncResponseStream* s = request->beginResponseStream("application/json");
+    logger.printTail(*s, since, limit);
+    request->send(s);
+  });
+  // Qualità del collegamento WiFi: stato, RSSI, potenza TX, tentativi e disconnessioni
+  server.on("/api/wifi", HTTP_GET, [](AsyncWebServerRequest *request){
+    AsyncResponseStream* s = request->beginResponseStream("application/json");
+    wifiManager.print(*s);
+    request->send(s);
+  });
+  // Energia: frequenza, light sleep, tempo sospeso/al massimo, corrente stimata, temperatura
+  server.on("/api/power", HTTP_GET, [](AsyncWebServerRequest *request){
+    AsyncResponseStream* s = request->beginResponseStream("application/json");
+    powerManager.print(*s, systemStatus.esp32Temperature);
+    request->send(s);
+  });
+  // Protezione termica: media, livello, mitigazioni attive, cambi recenti, medie al minuto
+  server.on("/api/thermal", HTTP_GET, [](AsyncWebServerRequest *request){
+    AsyncResponseStream* s = request->beginResponseStream("application/json");
+    thermalGovernor.print(*s);
+    request->send(s);
+  });
+  // Telemetria memoria: heap, blocco più grande, frammentazione, stack dei task
+  server.on("/api/heap", HTTP_GET, [](AsyncWebServerRequest *request){
+    AsyncResponseStream* s = request->beginResponseStream("application/json");
+    heapMonitor.print(*s);
+    request->send(s);
+  });
+  // Profilo dei tempi (sonde PERF_SCOPE): /api/perf, azzerabile con POST /api/perf/reset
+  server.on("/api/perf", HTTP_GET, [](AsyncWebServerRequest *request){
+    AsyncResponseStream* s = request->beginResponseStream("application/json");
+    perf.print(*s);
+    request->send(s);
+  });
+  server.on("/api/perf/reset", HTTP_POST, [](AsyncWebServerRequest *request){
+    perf.reset();
+    request->send(200, "application/json", "{\"success\":true}");
+  });
+  server.on("/api/stats/reset", HTTP_POST, [](AsyncWebServerRequest *request){
+    PERF_SCOPE("POST /api/stats/reset");
+    LOGD(LOG_WEB, "Richiesta ricevuta: /api/stats/reset");
+    bellStats.reset();
+    request->send(200, "application/json", "{\"success\":true}");
+  });
+
+  // API registro eventi (paginato): /api/history?since=<seq>&limit=<n>
+  server.on("/api/history", HTTP_GET, [](AsyncWebServerRequest *request){
+    PERF_SCOPE("GET /api/history");
+    if (!historyLog.isAvailable()) {
+      request->send(503, "application/json", "{\"success\":false,\"message\":\"Registro eventi non disponibile\"}");
+      return;
+    }
+    uint32_t since = 0;
+    long limit = 50;
+    if (request->hasParam("since")) since = strtoul(request->getParam("since")->value().c_str(), nullptr, 10);
+    if (request->hasParam("limit")) limit = request->getParam("limit")->value().toInt();
+    if (limit < 1) limit = 1;
+    if (limit > 500) limit = 500;
+    std::shared_ptr<HistoryJsonStream> stream = std::make_shared<HistoryJsonStream>(since, (uint16_t)limit);
+    AsyncWebServerResponse* r = request->beginChunkedResponse("application/json",
+      [stream](uint8_t *buffer, size_t maxLen, size_t index) -> size_t {
+        return stream->fill(buffer, maxLen);
+      });
+    request->send(r);
   });
 
   // API orario corrente per UI
   server.on("/api/time", HTTP_GET, [](AsyncWebServerRequest *request){
+    PERF_SCOPE("GET /api/time");
     DynamicJsonDocument doc(256);
     char bufTime[20];
     char bufDate[20];
-    if (systemStatus.rtcConnected) {
-      DateTime now = rtc.now();
-      snprintf(bufTime, sizeof(bufTime), "%02d:%02d:%02d", now.hour(), now.minute(), now.second());
-      snprintf(bufDate, sizeof(bufDate), "%02d/%02d/%04d", now.day(), now.month(), now.year());
-    } else if (manualTimeValid) {
-      snprintf(bufTime, sizeof(bufTime), "%02d:%02d:%02d", manualTime.hour(), manualTime.minute(), manualTime.second());
-      snprintf(bufDate, sizeof(bufDate), "%02d/%02d/%04d", manualTime.day(), manualTime.month(), manualTime.year());
-    } else if (systemStatus.ntpSynced) {
-      time_t now = time(nullptr);
-      struct tm * timeinfo = localtime(&now);
-      snprintf(bufTime, sizeof(bufTime), "%02d:%02d:%02d", timeinfo->tm_hour, timeinfo->tm_min, timeinfo->tm_sec);
-      snprintf(bufDate, sizeof(bufDate), "%02d/%02d/%04d", timeinfo->tm_mday, timeinfo->tm_mon+1, timeinfo->tm_year+1900);
-    } else {
-      // fallback a --:--:--
-      strlcpy(bufTime, "--:--:--", sizeof(bufTime));
-      strlcpy(bufDate, "--/--/----", sizeof(bufDate));
-    }
+    formatClock(bufTime, sizeof(bufTime), bufDate, sizeof(bufDate));
     doc["time"] = String(bufTime);
     doc["date"] = String(bufDate);
     String resp; serializeJson(doc, resp);
@@ -1369,100 +2121,132 @@ void setupWebServer() {
   
   // API per ottenere programmazioni settimanali
   server.on("/api/weekly-schedules", HTTP_GET, [](AsyncWebServerRequest *request){
-    Serial.println("📡 Richiesta ricevuta: /api/weekly-schedules (GET)");
-    DynamicJsonDocument doc(16384);
-    JsonArray arr = doc.createNestedArray("schedules");
-    for (int i=0;i<weeklyCount;i++){
-      if ((i & 3) == 0) { yield(); }
-      const WeeklySchedule &e = weeklyArr[i];
-      JsonObject o = arr.createNestedObject();
-      o["id"]=e.id; o["name"]=e.name; o["dayOfWeek"]=e.dayOfWeek; o["hour"]=e.hour; o["minute"]=e.minute; o["melodyIndex"]=e.melodyIndex; o["isActive"]=e.isActive;
-    }
-  String response; serializeJson(doc, response);
-  AsyncWebServerResponse* r = request->beginResponse(200, "application/json", response);
-  r->addHeader("Connection", "close");
-  request->send(r);
+    PERF_SCOPE("GET /api/weekly-schedules");
+    LOGD(LOG_WEB, "Richiesta ricevuta: /api/weekly-schedules (GET)");
+    // Istantanea fissata per tutta la risposta: conteggio e record della stessa
+    // versione, e un elemento rigenerato a metà è identico a quello già inviato
+    SharedSnapshot snap(new ConfigSnapshot());
+    request->send(beginJsonList(request, [snap](JsonChunkWriter &w, uint16_t item) -> bool {
+      const ConfigTables* cfg = snap->get();
+      uint8_t count = cfg->weeklyCount;
+      if (item == 0) { w.raw("{\"schedules\":["); return true; }
+      if (item <= count) {
+        const WeeklySchedule &e = cfg->weekly[item - 1];
+        w.element();
+        w.raw("{\"id\":"); w.number((long)e.id);
+        w.raw(",\"name\":"); w.string(e.name);
+        w.raw(",\"dayOfWeek\":"); w.number((long)e.dayOfWeek);
+        w.raw(",\"hour\":"); w.number((long)e.hour);
+        w.raw(",\"minute\":"); w.number((long)e.minute);
+        w.raw(",\"melodyIndex\":"); w.number((long)e.melodyIndex);
+        w.raw(",\"isActive\":"); w.boolean(e.isActive);
+        w.raw("}");
+        return true;
+      }
+      if (item == count + 1) { w.raw("]}"); return true; }
+      return false;
+    }));
   });
   server.on("/api/weekly-schedules", HTTP_POST, [](AsyncWebServerRequest *request){}, NULL, [](AsyncWebServerRequest *request, uint8_t *data, size_t len, size_t index, size_t total){
-    Serial.println("📡 Richiesta ricevuta: /api/weekly-schedules (POST)");
-    // Accumula i chunk del body
-    if (index == 0) {
-      request->_tempObject = new String();
-      ((String*)request->_tempObject)->reserve(total);
-    }
-    String* body = (String*)request->_tempObject;
-    body->concat((const char*)data, len);
-    if (index + len < total) { yield(); return; }
-    // Fine: parse JSON
-  DynamicJsonDocument doc(24576);
-    DeserializationError err = deserializeJson(doc, *body);
-    delete body; request->_tempObject = nullptr;
-    if (err) { request->send(400, "application/json", "{\"success\":false,\"message\":\"JSON non valido\"}"); return; }
-    if (!doc.containsKey("schedules") || !doc["schedules"].is<JsonArray>()){
+    PERF_SCOPE("POST /api/weekly-schedules");
+    if (index == 0) LOGD(LOG_WEB, "Richiesta ricevuta: /api/weekly-schedules (POST)");
+    // Parse incrementale dei chunk direttamente nelle tabelle di staging
+    UploadPtr<ScheduleUpload> up(receiveBodyChunk<ScheduleUpload>(request, data, len, index, total, "schedules", "events"));
+    if (!up) return;
+    if (!up->finish()) { sendUploadError(request, up->errorMessage()); return; }
+    if (!up->hasWeekly){
       request->send(400, "application/json", "{\"success\":false,\"message\":\"Campo schedules mancante\"}"); return;
     }
-    weeklyCount = 0;
-    for (JsonObject o : doc["schedules"].as<JsonArray>()){
-      if (weeklyCount>=MAX_WEEKLY_SCHEDULES) break;
-      WeeklySchedule &e = weeklyArr[weeklyCount++];
-      strlcpy(e.name, (o["name"] | ""), sizeof(e.name));
-      e.id = o["id"] | weeklyCount; e.dayOfWeek = (DayOfWeek)(int)(o["dayOfWeek"] | 0);
-      e.hour = o["hour"] | 0; e.minute = o["minute"] | 0; e.melodyIndex = o["melodyIndex"] | 0; e.isActive = o["isActive"] | true;
-      if ((weeklyCount & 3) == 0) { yield(); }
-    }
-    saveSchedulesToFS();
+    ConfigTables* draft = beginConfigDraft(request);
+    if (!draft) return;
+    draft->weeklyCount = up->weeklyCount;
+    memcpy(draft->weekly, up->weekly, sizeof(WeeklySchedule) * draft->weeklyCount);
+    if (!commitConfigDraft(request, draft, false, true)) return;
     request->send(200, "application/json", "{\"success\":true}");
   });
   
+  // API per singolo record (programmazione o evento) identificato da id
+  struct RecordRoute { const char* path; uint8_t table; RecordAction action; };
+  static const RecordRoute recordRoutes[] = {
+    { "/api/add-weekly-schedule", CFG_TABLE_WEEKLY, RECORD_ADD },
+    { "/api/update-weekly-schedule", CFG_TABLE_WEEKLY, RECORD_UPDATE },
+    { "/api/toggle-weekly-schedule", CFG_TABLE_WEEKLY, RECORD_TOGGLE },
+    { "/api/delete-weekly-schedule", CFG_TABLE_WEEKLY, RECORD_DELETE },
+    { "/api/add-special-event", CFG_TABLE_SPECIAL, RECORD_ADD },
+    { "/api/update-special-event", CFG_TABLE_SPECIAL, RECORD_UPDATE },
+    { "/api/toggle-special-event", CFG_TABLE_SPECIAL, RECORD_TOGGLE },
+    { "/api/delete-special-event", CFG_TABLE_SPECIAL, RECORD_DELETE },
+  };
+  for (const RecordRoute &route : recordRoutes) {
+    uint8_t table = route.table;
+    RecordAction action = route.action;
+    server.on(route.path, HTTP_POST, [](AsyncWebServerRequest *request){}, NULL,
+      [table, action](AsyncWebServerRequest *request, uint8_t *data, size_t len, size_t index, size_t total){
+        PERF_SCOPE("POST record");
+        if (index == 0) LOGD(LOG_WEB, "Richiesta ricevuta: %s", request->url().c_str());
+        handleRecordRequest(request, data, len, index, total, table, action);
+      });
+  }
+
+  // API per più operazioni in una richiesta (record, melodie, ora)
+  server.on("/api/batch", HTTP_POST, [](AsyncWebServerRequest *request){}, NULL,
+    [](AsyncWebServerRequest *request, uint8_t *data, size_t len, size_t index, size_t total){
+      PERF_SCOPE("POST /api/batch");
+      if (index == 0) LOGD(LOG_WEB, "Richiesta ricevuta: /api/batch");
+      handleBatchRequest(request, data, len, index, total);
+    });
+
   // API per ottenere eventi speciali
   server.on("/api/special-events", HTTP_GET, [](AsyncWebServerRequest *request){
-    Serial.println("📡 Richiesta ricevuta: /api/special-events (GET)");
-    DynamicJsonDocument doc(8192);
-    JsonArray arr = doc.createNestedArray("events");
-    for (int i=0;i<specialCount;i++){
-      if ((i & 3) == 0) { yield(); }
-      const SpecialEvent &e = specialArr[i];
-      JsonObject o = arr.createNestedObject();
-      o["id"]=e.id; o["name"]=e.name; o["type"]=e.type; o["year"]=e.year; o["month"]=e.month; o["day"]=e.day; o["hour"]=e.hour; o["minute"]=e.minute; o["melodyIndex"]=e.melodyIndex; o["isActive"]=e.isActive; o["isRecurring"]=e.isRecurring;
-    }
-  String response; serializeJson(doc, response);
-  AsyncWebServerResponse* r = request->beginResponse(200, "application/json", response);
-  r->addHeader("Connection", "close");
-  request->send(r);
+    PERF_SCOPE("GET /api/special-events");
+    LOGD(LOG_WEB, "Richiesta ricevuta: /api/special-events (GET)");
+    SharedSnapshot snap(new ConfigSnapshot());
+    request->send(beginJsonList(request, [snap](JsonChunkWriter &w, uint16_t item) -> bool {
+      const ConfigTables* cfg = snap->get();
+      uint8_t count = cfg->specialCount;
+      if (item == 0) { w.raw("{\"events\":["); return true; }
+      if (item <= count) {
+        const SpecialEvent &e = cfg->special[item - 1];
+        w.element();
+        w.raw("{\"id\":"); w.number((long)e.id);
+        w.raw(",\"name\":"); w.string(e.name);
+        w.raw(",\"type\":"); w.number((long)e.type);
+        w.raw(",\"year\":"); w.number((long)e.year);
+        w.raw(",\"month\":"); w.number((long)e.month);
+        w.raw(",\"day\":"); w.number((long)e.day);
+        w.raw(",\"hour\":"); w.number((long)e.hour);
+        w.raw(",\"minute\":"); w.number((long)e.minute);
+        w.raw(",\"melodyIndex\":"); w.number((long)e.melodyIndex);
+        w.raw(",\"isActive\":"); w.boolean(e.isActive);
+        w.raw(",\"isRecurring\":"); w.boolean(e.isRecurring);
+        w.raw("}");
+        return true;
+      }
+      if (item == count + 1) { w.raw("]}"); return true; }
+      return false;
+    }));
   });
   server.on("/api/special-events", HTTP_POST, [](AsyncWebServerRequest *request){}, NULL, [](AsyncWebServerRequest *request, uint8_t *data, size_t len, size_t index, size_t total){
-    Serial.println("📡 Richiesta ricevuta: /api/special-events (POST)");
-    if (index == 0) {
-      request->_tempObject = new String();
-      ((String*)request->_tempObject)->reserve(total);
-    }
-    String* body = (String*)request->_tempObject;
-    body->concat((const char*)data, len);
-    if (index + len < total) { yield(); return; }
-    DynamicJsonDocument doc(12288);
-    DeserializationError err = deserializeJson(doc, *body);
-    delete body; request->_tempObject = nullptr;
-    if (err) { request->send(400, "application/json", "{\"success\":false,\"message\":\"JSON non valido\"}"); return; }
-    if (!doc.containsKey("events") || !doc["events"].is<JsonArray>()){
+    PERF_SCOPE("POST /api/special-events");
+    if (index == 0) LOGD(LOG_WEB, "Richiesta ricevuta: /api/special-events (POST)");
+    UploadPtr<ScheduleUpload> up(receiveBodyChunk<ScheduleUpload>(request, data, len, index, total, "schedules", "events"));
+    if (!up) return;
+    if (!up->finish()) { sendUploadError(request, up->errorMessage()); return; }
+    if (!up->hasSpecial){
       request->send(400, "application/json", "{\"success\":false,\"message\":\"Campo events mancante\"}"); return;
     }
-    specialCount = 0;
-    for (JsonObject o : doc["events"].as<JsonArray>()){
-      if (specialCount>=MAX_SPECIAL_EVENTS) break;
-      SpecialEvent &e = specialArr[specialCount++];
-      strlcpy(e.name, (o["name"] | ""), sizeof(e.name));
-      e.id = o["id"] | specialCount; e.type = (EventType)(int)(o["type"] | 5);
-      e.year = o["year"] | 0; e.month = o["month"] | 0; e.day = o["day"] | 0;
-      e.hour = o["hour"] | 0; e.minute = o["minute"] | 0; e.melodyIndex = o["melodyIndex"] | 0; e.isActive = o["isActive"] | true; e.isRecurring = o["isRecurring"] | false;
-      if ((specialCount & 3) == 0) { yield(); }
-    }
-    saveSchedulesToFS();
+    ConfigTables* draft = beginConfigDraft(request);
+    if (!draft) return;
+    draft->specialCount = up->specialCount;
+    memcpy(draft->special, up->special, sizeof(SpecialEvent) * draft->specialCount);
+    if (!commitConfigDraft(request, draft, false, true)) return;
     request->send(200, "application/json", "{\"success\":true}");
   });
 
   // API: forza resync SNTP
   server.on("/api/ntp-resync", HTTP_POST, [](AsyncWebServerRequest *request){
-    Serial.println("📡 Richiesta ricevuta: /api/ntp-resync");
+    PERF_SCOPE("POST /api/ntp-resync");
+    LOGD(LOG_WEB, "Richiesta ricevuta: /api/ntp-resync");
     if (!systemStatus.wifiConnected) {
       request->send(503, "application/json", "{\"success\":false,\"message\":\"WiFi non connesso\"}");
       return;
@@ -1473,30 +2257,78 @@ void setupWebServer() {
   });
 
   // API: backup completo (melodie + schedules). WiFi escluso per sicurezza.
+  // Con ?since=N (generazione dell'ultimo backup, opzionale &instance=) restituisce solo
+  // i record cambiati dopo N e le eliminazioni; se il delta non è ricostruibile torna
+  // un backup completo ("delta":false).
   server.on("/api/backup", HTTP_GET, [](AsyncWebServerRequest *request){
+    PERF_SCOPE("GET /api/backup");
+    // Tutto il backup viene letto dalla stessa istantanea, fissata fino alla fine
+    ConfigSnapshot snap;
+    const ConfigTables* cfg = snap.get();
+    uint32_t generation = configSync.refresh(*cfg);
+    bool delta = false;
+    uint32_t since = 0;
+    if (request->hasParam("since")) {
+      since = strtoul(request->getParam("since")->value().c_str(), nullptr, 10);
+      delta = configSync.canDelta(since);
+      if (request->hasParam("instance") &&
+          strtoul(request->getParam("instance")->value().c_str(), nullptr, 16) != configSync.getInstance()) {
+        delta = false;
+      }
+    }
+    bool pack = wantsMsgPack(request);
+    char etag[40];
+    snprintf(etag, sizeof(etag), "\"%08x-%u-%u%s\"", (unsigned)configSync.getInstance(), (unsigned)generation,
+             (unsigned)(delta ? since : 0), pack ? "-m" : "");
+    if (request->hasHeader("If-None-Match") && request->header("If-None-Match") == etag) {
+      AsyncWebServerResponse* r = request->beginResponse(304);
+      r->addHeader("ETag", etag);
+      r->addHeader("Vary", "Accept");
+      request->send(r);
+      return;
+    }
+    char ts[32];
+    formatBackupTimestamp(ts, sizeof(ts));
+    if (pack) {
+      AsyncResponseStream* s = request->beginResponseStream(MSGPACK_CONTENT_TYPE);
+      s->addHeader("ETag", etag);
+      s->addHeader("Vary", "Accept");
+      writeBackupMsgPack(*s, cfg, generation, delta, since, ts);
+      request->send(s);
+      return;
+    }
     AsyncResponseStream* s = request->beginResponseStream("application/json");
+    s->addHeader("ETag", etag);
+    s->addHeader("Vary", "Accept");
+    char hash[12];
     // Header
     s->print('{');
     s->print("\"firmwareVersion\":\""); s->print(FIRMWARE_VERSION); s->print("\",");
-    // timestamp
-    time_t now = time(nullptr); struct tm *ti = localtime(&now);
-    char ts[32]; if (ti) snprintf(ts, sizeof(ts), "%04d-%02d-%02dT%02d:%02d:%02d", ti->tm_year+1900, ti->tm_mon+1, ti->tm_mday, ti->tm_hour, ti->tm_min, ti->tm_sec); else strlcpy(ts, "unknown", sizeof(ts));
     s->print("\"timestamp\":\""); s->print(ts); s->print("\",");
+    snprintf(hash, sizeof(hash), "%08x", (unsigned)configSync.getInstance());
+    s->print("\"instance\":\""); s->print(hash); s->print("\",");
+    s->print("\"generation\":"); s->print(generation); s->print(',');
+    s->print("\"delta\":"); s->print(delta ? "true" : "false"); s->print(',');
+    if (delta) { s->print("\"since\":"); s->print(since); s->print(','); }
 
     // Melodies
     s->print("\"melodies\":[");
     bool firstMel = true;
     for (int i=0;i<10;i++){
       if ((i & 1) == 0) { yield(); }
-      int cnt = bellController.getMelodyNoteCount(i);
+      const BellMelody &mel = cfg->melodies[i];
+      int cnt = mel.isActive ? mel.noteCount : 0;
       if (cnt <= 0) continue;
+      if (delta && configSync.recordGeneration(CFG_TABLE_MELODIES, i) <= since) continue;
       if (!firstMel) s->print(','); firstMel = false;
       s->print('{');
       s->print("\"id\":"); s->print(i); s->print(',');
-      s->print("\"name\":\""); s->print(bellController.getMelodyName(i)); s->print("\",");
+      snprintf(hash, sizeof(hash), "%08x", (unsigned)configSync.recordHash(CFG_TABLE_MELODIES, i));
+      s->print("\"hash\":\""); s->print(hash); s->print("\",");
+      s->print("\"name\":\""); s->print(mel.name); s->print("\",");
       s->print("\"notes\":[");
       bool firstNote = true;
-      const BellNote* notes = bellController.getMelodyNotes(i);
+      const BellNote* notes = mel.notes;
       for (int j=0;j<cnt;j++){
         if ((j & 3) == 0) { yield(); }
         if (!firstNote) s->print(','); firstNote = false;
@@ -1512,12 +2344,16 @@ void setupWebServer() {
 
     // Weekly
     s->print(','); s->print("\"weekly\":[");
-    for (int i=0;i<weeklyCount;i++){
+    bool firstWeekly = true;
+    for (int i=0;i<cfg->weeklyCount;i++){
       if ((i & 3) == 0) { yield(); }
-      if (i>0) s->print(',');
-      const WeeklySchedule &e = weeklyArr[i];
+      const WeeklySchedule &e = cfg->weekly[i];
+      if (delta && configSync.recordGeneration(CFG_TABLE_WEEKLY, e.id) <= since) continue;
+      if (!firstWeekly) s->print(','); firstWeekly = false;
       s->print('{');
       s->print("\"id\":"); s->print(e.id); s->print(',');
+      snprintf(hash, sizeof(hash), "%08x", (unsigned)configSync.recordHash(CFG_TABLE_WEEKLY, e.id));
+      s->print("\"hash\":\""); s->print(hash); s->print("\",");
       s->print("\"name\":\""); s->print(e.name); s->print("\",");
       s->print("\"dayOfWeek\":"); s->print(e.dayOfWeek); s->print(',');
       s->print("\"hour\":"); s->print(e.hour); s->print(',');
@@ -1530,12 +2366,16 @@ void setupWebServer() {
 
     // Special
     s->print(','); s->print("\"special\":[");
-    for (int i=0;i<specialCount;i++){
+    bool firstSpecial = true;
+    for (int i=0;i<cfg->specialCount;i++){
       if ((i & 3) == 0) { yield(); }
-      if (i>0) s->print(',');
-      const SpecialEvent &e = specialArr[i];
+      const SpecialEvent &e = cfg->special[i];
+      if (delta && configSync.recordGeneration(CFG_TABLE_SPECIAL, e.id) <= since) continue;
+      if (!firstSpecial) s->print(','); firstSpecial = false;
       s->print('{');
       s->print("\"id\":"); s->print(e.id); s->print(',');
+      snprintf(hash, sizeof(hash), "%08x", (unsigned)configSync.recordHash(CFG_TABLE_SPECIAL, e.id));
+      s->print("\"hash\":\""); s->print(hash); s->print("\",");
       s->print("\"name\":\""); s->print(e.name); s->print("\",");
       s->print("\"type\":"); s->print(e.type); s->print(',');
       s->print("\"year\":"); s->print(e.year); s->print(',');
@@ -1550,6 +2390,25 @@ void setupWebServer() {
     }
     s->print(']');
 
+    // Eliminazioni dopo since (solo delta)
+    if (delta) {
+      static const char* tableNames[] = { "melodies", "weekly", "special" };
+      s->print(",\"deleted\":{");
+      for (uint8_t t = 0; t < 3; t++) {
+        if (t > 0) s->print(',');
+        s->print('"'); s->print(tableNames[t]); s->print("\":[");
+        bool firstDel = true;
+        for (uint8_t i = 0; i < configSync.tombstoneCount(); i++) {
+          const ConfigTombstone &d = configSync.tombstone(i);
+          if (d.table != t || d.gen <= since) continue;
+          if (!firstDel) s->print(','); firstDel = false;
+          s->print(d.key);
+        }
+        s->print(']');
+      }
+      s->print('}');
+    }
+
     // Chiudi array principale
     s->print('}');
     request->send(s);
@@ -1558,67 +2417,70 @@ void setupWebServer() {
   // API: restore completo (melodie + schedules). WiFi escluso.
   server.on("/api/restore", HTTP_POST, [](AsyncWebServerRequest *request){}, NULL,
   [](AsyncWebServerRequest *request, uint8_t *data, size_t len, size_t index, size_t total){
-    Serial.println("📡 Richiesta ricevuta: /api/restore");
-    if (index == 0) {
-      request->_tempObject = new String();
-      ((String*)request->_tempObject)->reserve(total);
-    }
-    String* body = (String*)request->_tempObject;
-    body->concat((const char*)data, len);
-    if (index + len < total) { yield(); return; }
-    DynamicJsonDocument doc(32768);
-    DeserializationError err = deserializeJson(doc, *body);
-    delete body; request->_tempObject = nullptr;
-    if (err) { request->send(400, "application/json", "{\"success\":false,\"message\":\"JSON non valido\"}"); return; }
-    // Import melodie (opzionale)
-    int importedMel = 0;
-    if (doc.containsKey("melodies") && doc["melodies"].is<JsonArray>()){
-      // Svuota
-      for (int i=0;i<10;i++) { bellController.deleteMelody(i); if ((i & 1)==0) yield(); }
-      for (JsonObject m : doc["melodies"].as<JsonArray>()){
-        yield();
-        String name = m["name"] | "Senza nome";
-        JsonArray ns = m["notes"].as<JsonArray>();
-        if (!ns) continue;
-        BellNote temp[MAX_MELODY_STEPS]; uint8_t count=0;
-        for (JsonObject n : ns){
-          if ((count & 3)==0) yield();
-          int b = n["bellNumber"] | 1; int d = n["duration"] | 300; int dl = n["delay"] | 800;
-          if (b<1 || b>2) continue; temp[count++] = { (uint8_t)b, (uint16_t)d, (uint16_t)dl }; if (count>=MAX_MELODY_STEPS) break;
+    PERF_SCOPE("POST /api/restore");
+    if (index == 0) LOGD(LOG_WEB, "Richiesta ricevuta: /api/restore");
+    UploadPtr<RestoreUpload> up(receiveBodyChunk<RestoreUpload>(request, data, len, index, total));
+    if (!up) return;
+    if (!up->finish()) { sendUploadError(request, up->errorMessage()); return; }
+    // Le tabelle nuove vengono costruite in una copia: l'istantanea attiva resta
+    // intatta finché la bozza non è completa e validata
+    ConfigTables* draft = beginConfigDraft(request);
+    if (!draft) return;
+    int importedMel = 0, importedWeekly = 0, importedSpecial = 0, deleted = 0;
+    // Delta: aggiorna solo i record presenti. Completo: le tabelle incluse vengono sostituite.
+    // Import melodie (opzionale): lo slot originale ("id") viene mantenuto se libero,
+    // così le programmazioni continuano a puntare alla melodia giusta
+    if (up->delta) {
+      const char* error = "";
+      int code = applyRestoreDelta(*draft, *up, importedMel, importedWeekly, importedSpecial, deleted, error);
+      if (code != 200) {
+        configStore.abortTransaction();
+        DynamicJsonDocument resp(128);
+        resp["success"] = false;
+        resp["message"] = error;
+        String s; serializeJson(resp, s);
+        request->send(code, "application/json", s);
+        return;
+      }
+    } else if (up->hasMelodies){
+      memset(draft->melodies, 0, sizeof(draft->melodies));
+      bool placed[MAX_MELODIES] = { false };
+      // Prima le melodie con slot indicato, poi le altre nei primi slot liberi
+      for (int pass=0; pass<2; pass++){
+        for (int m=0; m<up->melodyCount; m++){
+          if (placed[m]) continue;
+          int slot = up->melodyIds[m];
+          if (pass == 0 && (slot < 0 || draft->melodies[slot].isActive)) continue;
+          if (pass == 1) {
+            slot = -1;
+            for (int i=0;i<MAX_MELODIES;i++) { if (!draft->melodies[i].isActive) { slot = i; break; } }
+            if (slot < 0) break;
+          }
+          const MelodyStaging &ms = up->melodies[m];
+          BellMelody &mel = draft->melodies[slot];
+          strlcpy(mel.name, ms.name, sizeof(mel.name));
+          memcpy(mel.notes, ms.notes, sizeof(BellNote) * ms.noteCount);
+          mel.noteCount = ms.noteCount;
+          mel.isActive = true;
+          placed[m] = true;
+          importedMel++;
         }
-        if (count>0) { if (bellController.addMelody(name.c_str(), temp, count)) importedMel++; }
       }
-      saveAllMelodiesToFS();
     }
     // Import schedules (opzionale)
-    int importedWeekly = 0;
-    if (doc.containsKey("weekly") && doc["weekly"].is<JsonArray>()){
-      weeklyCount = 0;
-      for (JsonObject o : doc["weekly"].as<JsonArray>()){
-        if ((weeklyCount & 3)==0) yield();
-        if (weeklyCount>=MAX_WEEKLY_SCHEDULES) break;
-        WeeklySchedule &e = weeklyArr[weeklyCount++];
-        strlcpy(e.name, (o["name"] | ""), sizeof(e.name));
-        e.id = o["id"] | weeklyCount; e.dayOfWeek = (DayOfWeek)(int)(o["dayOfWeek"] | 0);
-        e.hour = o["hour"] | 0; e.minute = o["minute"] | 0; e.melodyIndex = o["melodyIndex"] | 0; e.isActive = o["isActive"] | true;
-        importedWeekly++;
-      }
-    }
-    int importedSpecial = 0;
-    if (doc.containsKey("special") && doc["special"].is<JsonArray>()){
-      specialCount = 0;
-      for (JsonObject o : doc["special"].as<JsonArray>()){
-        if ((specialCount & 3)==0) yield();
-        if (specialCount>=MAX_SPECIAL_EVENTS) break;
-        SpecialEvent &e = specialArr[specialCount++];
-        strlcpy(e.name, (o["name"] | ""), sizeof(e.name));
-        e.id = o["id"] | specialCount; e.type = (EventType)(int)(o["type"] | 5);
-        e.year = o["year"] | 0; e.month = o["month"] | 0; e.day = o["day"] | 0;
-        e.hour = o["hour"] | 0; e.minute = o["minute"] | 0; e.melodyIndex = o["melodyIndex"] | 0; e.isActive = o["isActive"] | true; e.isRecurring = o["isRecurring"] | false;
-        importedSpecial++;
-      }
-    }
-    saveSchedulesToFS();
+    if (!up->delta && up->hasWeekly){
+      draft->weeklyCount = up->weeklyCount;
+      memcpy(draft->weekly, up->weekly, sizeof(WeeklySchedule) * draft->weeklyCount);
+      importedWeekly = draft->weeklyCount;
+    }
+    if (!up->delta && up->hasSpecial){
+      draft->specialCount = up->specialCount;
+      memcpy(draft->special, up->special, sizeof(SpecialEvent) * draft->specialCount);
+      importedSpecial = draft->specialCount;
+    }
+    bool melodiesChanged = up->hasMelodies || up->deletedMelodyCount > 0;
+    bool schedulesChanged = up->hasWeekly || up->hasSpecial || up->deletedWeeklyCount > 0 || up->deletedSpecialCount > 0;
+    if (!commitConfigDraft(request, draft, melodiesChanged, schedulesChanged)) return;
     // Assicura preset se mancanti (slot 0/1)
     if (bellController.getMelodyNoteCount(0) == 0 || bellController.getMelodyNoteCount(1) == 0) {
       bellController.loadDefaultMelodies();
@@ -1631,9 +2493,10 @@ void setupWebServer() {
       imp["melodies"] = importedMel;
       imp["weekly"] = importedWeekly;
       imp["special"] = importedSpecial;
+      resp["delta"] = up->delta;
+      if (up->delta) resp["deleted"] = deleted;
       String s; serializeJson(resp, s);
       AsyncWebServerResponse* r = request->beginResponse(200, "application/json", s);
-      r->addHeader("Connection", "close");
       request->send(r);
     }
   });
@@ -1642,7 +2505,8 @@ void setupWebServer() {
 
   // API diagnostica: scansione I2C (mostra indirizzi trovati)
   server.on("/api/i2c-scan", HTTP_GET, [](AsyncWebServerRequest *request){
-    Serial.println("📡 Richiesta ricevuta: /api/i2c-scan");
+    PERF_SCOPE("GET /api/i2c-scan");
+    LOGD(LOG_WEB, "Richiesta ricevuta: /api/i2c-scan");
     DynamicJsonDocument doc(512);
     JsonArray arr = doc.createNestedArray("devices");
     uint8_t count = 0;
@@ -1659,39 +2523,27 @@ void setupWebServer() {
     doc["count"] = count;
     String resp; serializeJson(doc, resp);
     request->send(200, "application/json", resp);
-    Serial.printf("✓ I2C scan: %d dispositivi\n", count);
+    LOGI(LOG_WEB, "✓ I2C scan: %d dispositivi", count);
   });
   
   // API per test melodia
   server.on("/api/test-melody", HTTP_POST, [](AsyncWebServerRequest *request){}, NULL, 
   [](AsyncWebServerRequest *request, uint8_t *data, size_t len, size_t index, size_t total){
-    Serial.println("📡 Richiesta ricevuta: /api/test-melody");
-    if (index == 0) {
-      request->_tempObject = new String();
-      ((String*)request->_tempObject)->reserve(total);
+    PERF_SCOPE("POST /api/test-melody");
+    if (index == 0) LOGD(LOG_WEB, "Richiesta ricevuta: /api/test-melody");
+    UploadPtr<MelodyUpload> up(receiveBodyChunk<MelodyUpload>(request, data, len, index, total));
+    if (!up) return;
+    if (!up->finish()) { sendUploadError(request, up->errorMessage()); return; }
+    // Protezione termica: prima di toccare lo slot di test
+    if (!bellController.allowsSource(HIST_SRC_API)) {
+      request->send(503, "application/json", "{\"success\":false,\"message\":\"Temperatura elevata: melodia rifiutata\"}");
+      return;
     }
-    String* body = (String*)request->_tempObject;
-    body->concat((const char*)data, len);
-    if (index + len < total) { yield(); return; }
-    DynamicJsonDocument doc(12288);
-    DeserializationError derr = deserializeJson(doc, *body);
-    delete body; request->_tempObject = nullptr;
-    if (derr) { request->send(400, "application/json", "{\"success\":false,\"message\":\"JSON non valido\"}"); return; }
     
     // Test per ID oppure per sequenza di note ad-hoc
-  if (doc.containsKey("notes") && doc["notes"].is<JsonArray>()) {
-      JsonArray ns = doc["notes"].as<JsonArray>();
-      const size_t maxSteps = min((size_t)MAX_MELODY_STEPS, ns.size());
-      BellNote tempNotes[MAX_MELODY_STEPS];
-      uint8_t count = 0;
-      for (size_t i = 0; i < maxSteps; i++) {
-        JsonObject n = ns[i];
-        int b = n["bellNumber"] | 1;
-        int d = n["duration"] | 300;
-        int dl = n["delay"] | 800;
-        if (b < 1 || b > 2) continue;
-        tempNotes[count++] = { (uint8_t)b, (uint16_t)d, (uint16_t)dl };
-      }
+    if (up->melody.hasNotes) {
+      const BellNote* tempNotes = up->melody.notes;
+      uint8_t count = up->melody.noteCount;
       if (count == 0) {
         request->send(400, "application/json", "{\"success\":false,\"message\":\"Nessuna nota valida\"}");
         return;
@@ -1711,16 +2563,16 @@ void setupWebServer() {
       }
       bellController.playMelody(playIdx);
       request->send(200, "application/json", String("{\"success\":true,\"message\":\"Test melodia ad-hoc avviato\",\"index\":") + playIdx + "}");
-      Serial.printf("✓ Test melodia ad-hoc con %d note (slot %d)\n", count, playIdx);
+      LOGI(LOG_WEB, "✓ Test melodia ad-hoc con %d note (slot %d)", count, playIdx);
     } else {
-      int melodyId = doc["melodyId"] | -1;
+      int melodyId = (int)up->melodyId;
       if (melodyId >= 0 && melodyId < 10 && bellController.getMelodyNoteCount(melodyId) > 0) {
         bellController.playMelody(melodyId);
         request->send(200, "application/json", "{\"success\":true,\"message\":\"Melodia in riproduzione\"}");
-        Serial.printf("✓ Riproduzione melodia ID: %d\n", melodyId);
+        LOGI(LOG_WEB, "✓ Riproduzione melodia ID: %d", melodyId);
       } else {
         request->send(400, "application/json", "{\"success\":false,\"message\":\"ID melodia non valido\"}");
-        Serial.println("❌ ID melodia non valido");
+        LOGW(LOG_WEB, "❌ ID melodia non valido");
       }
     }
   });
@@ -1728,96 +2580,64 @@ void setupWebServer() {
   // API salva melodia
   server.on("/api/save-melody", HTTP_POST, [](AsyncWebServerRequest *request){}, NULL,
   [](AsyncWebServerRequest *request, uint8_t *data, size_t len, size_t index, size_t total){
-    Serial.println("📡 Richiesta ricevuta: /api/save-melody");
-    if (index == 0) {
-      request->_tempObject = new String();
-      ((String*)request->_tempObject)->reserve(total);
-    }
-    String* body = (String*)request->_tempObject;
-    body->concat((const char*)data, len);
-    if (index + len < total) { yield(); return; }
-    DynamicJsonDocument doc(12288);
-    DeserializationError err = deserializeJson(doc, *body);
-    delete body; request->_tempObject = nullptr;
-    if (err) {
-      request->send(400, "application/json", "{\"success\":false,\"message\":\"JSON non valido\"}");
+    PERF_SCOPE("POST /api/save-melody");
+    if (index == 0) LOGD(LOG_WEB, "Richiesta ricevuta: /api/save-melody");
+    UploadPtr<MelodyUpload> up(receiveBodyChunk<MelodyUpload>(request, data, len, index, total));
+    if (!up) return;
+    if (!up->finish()) {
+      sendUploadError(request, up->errorMessage());
       return;
     }
-    String name = doc["name"] | "Senza nome";
-    JsonArray ns = doc["notes"].as<JsonArray>();
-    if (!ns || ns.size() == 0) {
+    if (up->melody.notesSeen == 0) {
       request->send(400, "application/json", "{\"success\":false,\"message\":\"Note mancanti\"}");
       return;
     }
-    BellNote temp[MAX_MELODY_STEPS];
-    uint8_t count = 0;
-    for (JsonObject n : ns) {
-      int b = n["bellNumber"] | 1;
-      int d = n["duration"] | 300;
-      int dl = n["delay"] | 800;
-      if (b < 1 || b > 2) continue;
-      temp[count++] = { (uint8_t)b, (uint16_t)d, (uint16_t)dl };
-      if (count >= MAX_MELODY_STEPS) break;
-    }
-    if (count == 0) {
+    if (up->melody.noteCount == 0) {
       request->send(400, "application/json", "{\"success\":false,\"message\":\"Nessuna nota valida\"}");
       return;
     }
-    bool ok = bellController.addMelody(name.c_str(), temp, count);
-    if (!ok) {
+    // Come le altre modifiche alla configurazione: bozza, .new e marker di commit,
+    // poi pubblicazione (il file attivo non viene mai troncato sul posto)
+    ConfigTables* draft = beginConfigDraft(request);
+    if (!draft) return;
+    int assigned = -1;
+    for (int i=0; i<MAX_MELODIES && assigned < 0; i++) if (!draft->melodies[i].isActive) assigned = i;
+    if (assigned < 0) {
+      configStore.abortTransaction();
       request->send(500, "application/json", "{\"success\":false,\"message\":\"Nessuno slot libero\"}");
       return;
     }
-    // Trova indice assegnato
-    int assigned = -1;
-    for (int i=0;i<10;i++){
-      if (bellController.getMelodyNoteCount(i) == count && String(bellController.getMelodyName(i)) == name) { assigned = i; break; }
-    }
-    saveAllMelodiesToFS();
-    String resp = String("{\"success\":true,\"index\":") + (assigned>=0? String(assigned): String(-1)) + "}";
+    copyStagedMelody(draft->melodies[assigned], up->melody);
+    if (!commitConfigDraft(request, draft, true, false)) return;
+    LOGI(LOG_WEB, "Melodia aggiunta (slot %d)", assigned);
+    String resp = String("{\"success\":true,\"index\":") + assigned + "}";
     request->send(200, "application/json", resp);
   });
 
   // API aggiorna melodia esistente
   server.on("/api/update-melody", HTTP_POST, [](AsyncWebServerRequest *request){}, NULL,
   [](AsyncWebServerRequest *request, uint8_t *data, size_t len, size_t index, size_t total){
-    Serial.println("📡 Richiesta ricevuta: /api/update-melody");
-    if (index == 0) {
-      request->_tempObject = new String();
-      ((String*)request->_tempObject)->reserve(total);
-    }
-    String* body = (String*)request->_tempObject;
-    body->concat((const char*)data, len);
-    if (index + len < total) { yield(); return; }
-    DynamicJsonDocument doc(12288);
-    DeserializationError err = deserializeJson(doc, *body);
-    delete body; request->_tempObject = nullptr;
-    if (err) { request->send(400, "application/json", "{\"success\":false,\"message\":\"JSON non valido\"}"); return; }
-    int idx = doc["index"] | -1;
+    PERF_SCOPE("POST /api/update-melody");
+    if (index == 0) LOGD(LOG_WEB, "Richiesta ricevuta: /api/update-melody");
+    UploadPtr<MelodyUpload> up(receiveBodyChunk<MelodyUpload>(request, data, len, index, total));
+    if (!up) return;
+    if (!up->finish()) { sendUploadError(request, up->errorMessage()); return; }
+    int idx = (int)up->index;
     if (idx < 0 || idx >= 10) { request->send(400, "application/json", "{\"success\":false,\"message\":\"index non valido\"}"); return; }
-    String name = doc["name"] | "Senza nome";
-    JsonArray ns = doc["notes"].as<JsonArray>();
-    if (!ns || ns.size()==0){ request->send(400, "application/json", "{\"success\":false,\"message\":\"Note mancanti\"}"); return; }
-    BellNote temp[MAX_MELODY_STEPS];
-    uint8_t count = 0;
-    for (JsonObject n : ns){
-      int b = n["bellNumber"] | 1;
-      int d = n["duration"] | 300;
-      int dl = n["delay"] | 800;
-      if (b<1 || b>2) continue;
-      temp[count++] = { (uint8_t)b, (uint16_t)d, (uint16_t)dl };
-      if (count>=MAX_MELODY_STEPS) break;
-    }
-    if (count==0){ request->send(400, "application/json", "{\"success\":false,\"message\":\"Nessuna nota valida\"}"); return; }
-    bool ok = bellController.updateMelody((uint8_t)idx, name.c_str(), temp, count);
-    if (!ok){ request->send(500, "application/json", "{\"success\":false,\"message\":\"Aggiornamento fallito\"}"); return; }
-    saveAllMelodiesToFS();
+    if (up->melody.notesSeen == 0){ request->send(400, "application/json", "{\"success\":false,\"message\":\"Note mancanti\"}"); return; }
+    if (up->melody.noteCount==0){ request->send(400, "application/json", "{\"success\":false,\"message\":\"Nessuna nota valida\"}"); return; }
+    ConfigTables* draft = beginConfigDraft(request);
+    if (!draft) return;
+    copyStagedMelody(draft->melodies[idx], up->melody);
+    if (!commitConfigDraft(request, draft, true, false)) return;
+    bellController.melodyChanged((uint8_t)idx);
     request->send(200, "application/json", "{\"success\":true}");
   });
 
   // API elimina melodia
   server.on("/api/delete-melody", HTTP_POST, [](AsyncWebServerRequest *request){}, NULL,
   [](AsyncWebServerRequest *request, uint8_t *data, size_t len, size_t index, size_t total){
+    PERF_SCOPE("POST /api/delete-melody");
     if (index == 0) {
       request->_tempObject = new String();
       ((String*)request->_tempObject)->reserve(total);
@@ -1831,19 +2651,29 @@ void setupWebServer() {
   if (parseErr) { request->send(400, "application/json", "{\"success\":false}"); return; }
     int idx = doc["index"] | -1;
     if (idx < 0 || idx >= 10) { request->send(400, "application/json", "{\"success\":false}"); return; }
-    bool ok = bellController.deleteMelody(idx);
-    if (ok) saveAllMelodiesToFS();
-    request->send(200, "application/json", String("{\"success\":") + (ok?"true":"false") + "}");
+    ConfigTables* draft = beginConfigDraft(request);
+    if (!draft) return;
+    if (!draft->melodies[idx].isActive) {
+      configStore.abortTransaction();
+      request->send(200, "application/json", "{\"success\":false}");
+      return;
+    }
+    draft->melodies[idx].isActive = false;
+    draft->melodies[idx].noteCount = 0;
+    if (!commitConfigDraft(request, draft, true, false)) return;
+    request->send(200, "application/json", "{\"success\":true}");
   });
 
   // API per fermare la melodia in riproduzione (POST e GET)
   server.on("/api/stop-melody", HTTP_POST, [](AsyncWebServerRequest *request){
-    Serial.println("📡 Richiesta ricevuta: /api/stop-melody (POST)");
+    PERF_SCOPE("POST /api/stop-melody");
+    LOGD(LOG_WEB, "Richiesta ricevuta: /api/stop-melody (POST)");
     bellController.stopMelody();
     request->send(200, "application/json", "{\"success\":true,\"message\":\"Melodia fermata\"}");
   });
   server.on("/api/stop-melody", HTTP_GET, [](AsyncWebServerRequest *request){
-    Serial.println("📡 Richiesta ricevuta: /api/stop-melody (GET)");
+    PERF_SCOPE("GET /api/stop-melody");
+    LOGD(LOG_WEB, "Richiesta ricevuta: /api/stop-melody (GET)");
     bellController.stopMelody();
     request->send(200, "application/json", "{\"success\":true,\"message\":\"Melodia fermata\"}");
   });
@@ -1851,7 +2681,8 @@ void setupWebServer() {
   // API per aggiornamento orario manuale
   server.on("/api/set-time", HTTP_POST, [](AsyncWebServerRequest *request){}, NULL,
   [](AsyncWebServerRequest *request, uint8_t *data, size_t len, size_t index, size_t total){
-    Serial.println("📡 Richiesta ricevuta: /api/set-time");
+    PERF_SCOPE("POST /api/set-time");
+    LOGD(LOG_WEB, "Richiesta ricevuta: /api/set-time");
     if (index == 0) {
       request->_tempObject = new String();
       ((String*)request->_tempObject)->reserve(total);
@@ -1864,40 +2695,24 @@ void setupWebServer() {
     delete body; request->_tempObject = nullptr;
     String dateTime = doc["dateTime"];
     if (dateTime.length() > 0) {
-      // Parsing formato ISO 8601: "2025-09-12T15:30:00"
-      int year, month, day, hour, minute, second;
-      if (sscanf(dateTime.c_str(), "%d-%d-%dT%d:%d:%d", &year, &month, &day, &hour, &minute, &second) == 6) {
-        Serial.printf("[DEBUG] Imposto orario: %04d-%02d-%02d %02d:%02d:%02d\n", year, month, day, hour, minute, second);
-        // Aggiorna RTC se presente, altrimenti imposta orario manuale
-        if (systemStatus.rtcConnected) {
-          rtc.adjust(DateTime(year, month, day, hour, minute, second));
-          Serial.println("[DEBUG] RTC aggiornato");
-        } else {
-          manualTime = DateTime(year, month, day, hour, minute, second);
-          manualTimeValid = true;
-          Serial.println("[DEBUG] Orario manuale impostato (RTC assente)");
-        }
-        // Aggiorna variabili di sistema (simula sync NTP)
-        systemStatus.ntpSynced = true;
-        // Forza refresh display
-        updateDisplay();
+      if (applyManualDateTime(dateTime.c_str())) {
         request->send(200, "application/json", "{\"success\":true,\"message\":\"Orario aggiornato\"}");
-        Serial.print("✓ Richiesta aggiornamento orario: ");
-        Serial.println(dateTime);
+        LOGI(LOG_WEB, "✓ Richiesta aggiornamento orario: %s", dateTime.c_str());
       } else {
         request->send(400, "application/json", "{\"success\":false,\"message\":\"Formato data/ora non valido\"}");
-        Serial.println("❌ Formato data/ora non valido (parsing fallito)");
+        LOGW(LOG_WEB, "❌ Formato data/ora non valido (parsing fallito)");
       }
     } else {
       request->send(400, "application/json", "{\"success\":false,\"message\":\"Formato data/ora non valido\"}");
-      Serial.println("❌ Formato data/ora non valido (campo mancante)");
+      LOGW(LOG_WEB, "❌ Formato data/ora non valido (campo mancante)");
     }
   });
   
   // API per configurazione WiFi
   server.on("/api/configure-wifi", HTTP_POST, [](AsyncWebServerRequest *request){
-    Serial.println("📡 Richiesta ricevuta: /api/configure-wifi");
+    LOGD(LOG_WEB, "Richiesta ricevuta: /api/configure-wifi");
   }, NULL, [](AsyncWebServerRequest *request, uint8_t *data, size_t len, size_t index, size_t total){
+    PERF_SCOPE("POST /api/configure-wifi");
     // Accumula body
     if (index == 0) {
       request->_tempObject = new String();
@@ -1908,8 +2723,6 @@ void setupWebServer() {
     if (index + len < total) { return; }
     String jsonString = *body;
     delete body; request->_tempObject = nullptr;
-    Serial.print("JSON ricevuto: ");
-    Serial.println(jsonString);
     
     // Parse semplice senza ArduinoJson per evitare problemi
     int ssidStart = jsonString.indexOf("\"ssid\":\"") + 8;
@@ -1920,11 +2733,8 @@ void setupWebServer() {
     int passwordEnd = jsonString.indexOf("\"", passwordStart);
     String newPassword = jsonString.substring(passwordStart, passwordEnd);
     
-    Serial.print("Nuovo SSID: ");
-    Serial.println(newSSID);
-    Serial.print("Nuova Password: [NASCOSTA] (");
-    Serial.print(newPassword.length());
-    Serial.println(" caratteri)");
+    // Il corpo contiene la password: nel log (leggibile da /api/logs) solo SSID e lunghezza
+    LOGI(LOG_WEB, "Nuovo SSID: %s, password [NASCOSTA] (%u caratteri)", newSSID.c_str(), (unsigned)newPassword.length());
     
     if (newSSID.length() > 0 && newPassword.length() > 0) {
       // Salva le credenziali su SPIFFS
@@ -1936,40 +2746,45 @@ void setupWebServer() {
       if (file) {
         serializeJson(doc, file);
         file.close();
-        Serial.println("✓ Credenziali WiFi salvate");
+        LOGI(LOG_WEB, "✓ Credenziali WiFi salvate");
       }
       
       request->send(200, "application/json", "{\"success\":true,\"message\":\"WiFi configurato, riavvio...\"}");
-      Serial.println("✓ Configurazione WiFi accettata, riavvio tra 2 secondi...");
+      LOGI(LOG_WEB, "✓ Configurazione WiFi accettata, riavvio tra 2 secondi...");
       
-      // Programma riavvio
+      // Programma riavvio (salva prima le statistiche non ancora su flash)
+      bellStats.checkpoint();
       delay(2000);
       ESP.restart();
     } else {
       request->send(400, "application/json", "{\"success\":false,\"message\":\"SSID e password richiesti\"}");
-      Serial.println("❌ SSID o password mancanti");
+      LOGW(LOG_WEB, "❌ SSID o password mancanti");
     }
   });
 
   // API per STOP di emergenza
   server.on("/api/emergency-stop", HTTP_POST, [](AsyncWebServerRequest *request){
-    Serial.println("📡 Richiesta ricevuta: /api/emergency-stop");
-    bellController.emergencyStop();
+    PERF_SCOPE("POST /api/emergency-stop");
+    LOGD(LOG_WEB, "Richiesta ricevuta: /api/emergency-stop");
+    bellController.emergencyStop(HIST_SRC_API);
     request->send(200, "application/json", "{\"success\":true,\"message\":\"STOP di emergenza attivato\"}");
   });
 
   // API per toggle modalità test
   server.on("/api/toggle-test-mode", HTTP_POST, [](AsyncWebServerRequest *request){
+    PERF_SCOPE("POST /api/toggle-test-mode");
     testMode = !testMode;
     bellController.enableTestMode(testMode);
+    statusSnapshot.invalidate();
     String resp = String("{\"success\":true,\"testMode\":") + (testMode?"true":"false") + "}";
     request->send(200, "application/json", resp);
-    Serial.printf("Modalità test -> %s\n", testMode?"ON":"OFF");
+    LOGI(LOG_WEB, "Modalità test -> %s", testMode?"ON":"OFF");
   });
 
   // API per test singolo relè: /api/test-relay?relay=1&duration=500
   server.on("/api/test-relay", HTTP_GET, [](AsyncWebServerRequest *request){
-    Serial.println("📡 Richiesta ricevuta: /api/test-relay");
+    PERF_SCOPE("GET /api/test-relay");
+    LOGD(LOG_WEB, "Richiesta ricevuta: /api/test-relay");
     int relay = 1;
     int duration = 500;
     if (request->hasParam("relay")) {
@@ -1981,7 +2796,7 @@ void setupWebServer() {
 
     if (relay < 1 || relay > 2) {
       request->send(400, "application/json", "{\"success\":false,\"message\":\"relay must be 1 or 2\"}");
-      Serial.println("❌ test-relay: parametro relay non valido");
+      LOGW(LOG_WEB, "❌ test-relay: parametro relay non valido");
       return;
     }
 
@@ -1992,11 +2807,12 @@ void setupWebServer() {
 
     String resp = "{\"success\":true,\"relay\":" + String(relay) + ",\"duration\":" + String(duration) + "}";
     request->send(200, "application/json", resp);
-    Serial.printf("✓ test-relay eseguito: relay=%d duration=%d\n", relay, duration);
+    LOGI(LOG_WEB, "✓ test-relay eseguito: relay=%d duration=%d", relay, duration);
   });
   
   // API per abilitare/disabilitare campane
   server.on("/api/toggle-bells", HTTP_GET, [](AsyncWebServerRequest *request){
+    PERF_SCOPE("GET /api/toggle-bells");
     bool enabled = false;
     if (request->hasParam("enabled")) {
       String v = request->getParam("enabled")->value();
@@ -2004,15 +2820,17 @@ void setupWebServer() {
     } else {
       enabled = !systemStatus.bellsEnabled; // toggle if no param
     }
-    Serial.printf("[GET] toggle-bells -> %d\n", enabled);
+    LOGI(LOG_WEB, "[GET] toggle-bells -> %d", enabled);
     bellController.setEnabled(enabled);
     systemStatus.bellsEnabled = enabled;
     bellsEnabled = enabled;
-    updateDisplay();
+    statusSnapshot.invalidate();
+    statusScreen.requestRedraw();
     request->send(200, "application/json", String("{\"success\":true,\"enabled\":" ) + (enabled?"true":"false") + "}");
   });
   server.on("/api/toggle-bells", HTTP_POST, [](AsyncWebServerRequest *request){}, NULL, [](AsyncWebServerRequest *request, uint8_t *data, size_t len, size_t index, size_t total){
-    Serial.println("📡 Richiesta ricevuta: /api/toggle-bells (POST)");
+    PERF_SCOPE("POST /api/toggle-bells");
+    LOGD(LOG_WEB, "Richiesta ricevuta: /api/toggle-bells (POST)");
     if (index == 0) {
       request->_tempObject = new String();
       ((String*)request->_tempObject)->reserve(total);
@@ -2027,31 +2845,26 @@ void setupWebServer() {
       if (!err && doc.containsKey("enabled")) {
         enabled = doc["enabled"];
       } else {
-        Serial.println("⚠️ toggle-bells POST: body mancante/invalid, uso toggle");
+        LOGW(LOG_WEB, "⚠️ toggle-bells POST: body mancante/invalid, uso toggle");
         enabled = !systemStatus.bellsEnabled;
       }
     } else {
       enabled = !systemStatus.bellsEnabled;
     }
     delete body; request->_tempObject = nullptr;
-    Serial.printf("Toggle bells -> %d\n", enabled ? 1 : 0);
+    LOGI(LOG_WEB, "Toggle bells -> %d", enabled ? 1 : 0);
     bellController.setEnabled(enabled);
     systemStatus.bellsEnabled = enabled;
     bellsEnabled = enabled;
-    updateDisplay();
+    statusSnapshot.invalidate();
+    statusScreen.requestRedraw();
     request->send(200, "application/json", String("{\"success\":true,\"enabled\":") + (enabled?"true":"false") + "}");
   });
 
   // API diagnostica: lettura stato pin relè e LED
   server.on("/api/relay-status", HTTP_GET, [](AsyncWebServerRequest *request){
-    static uint32_t lastMs = 0;
-    uint32_t now = millis();
-    if (now - lastMs < 150) { // troppo frequente: alleggeriamo
-      request->send(429, "text/plain", "Too Many Requests");
-      return;
-    }
-    lastMs = now;
-    Serial.println("📡 Richiesta ricevuta: /api/relay-status");
+    PERF_SCOPE("GET /api/relay-status");
+    LOGD(LOG_WEB, "Richiesta ricevuta: /api/relay-status");
     DynamicJsonDocument doc(256);
     doc["relay_active_level"] = "LOW (active when LOW)";
     doc["enabled"] = systemStatus.bellsEnabled;
@@ -2069,7 +2882,8 @@ void setupWebServer() {
 
   // API diagnostica: impostare direttamente il pin del relè (/api/set-relay?relay=1&value=0)
   server.on("/api/set-relay", HTTP_GET, [](AsyncWebServerRequest *request){
-    Serial.println("📡 Richiesta ricevuta: /api/set-relay");
+    PERF_SCOPE("GET /api/set-relay");
+    LOGD(LOG_WEB, "Richiesta ricevuta: /api/set-relay");
     int relay = 1;
     int value = -1;
     if (request->hasParam("relay")) relay = request->getParam("relay")->value().toInt();
@@ -2089,23 +2903,16 @@ void setupWebServer() {
     digitalWrite(pin, value ? HIGH : LOW);
     String resp = "{\"success\":true,\"relay\":" + String(relay) + ",\"value\":" + String(value) + "}";
     request->send(200, "application/json", resp);
-    Serial.printf("Set relay %d -> %d\n", relay, value);
+    LOGI(LOG_WEB, "Set relay %d -> %d", relay, value);
   });
   // Serve i file statici da SPIFFS (no-cache per evitare UI vecchie)
   // Registrato alla fine per non ombreggiare le API.
   // Protezione Basic Auth per UI statica
-  server.on("/", HTTP_GET, [](AsyncWebServerRequest *request){
-    if (!request->authenticate(ADMIN_USER, ADMIN_PASSWORD)) {
-      return request->requestAuthentication();
-    }
-    request->send(SPIFFS, "/index.html", String(), false);
-  });
-  server.on("/index.html", HTTP_GET, [](AsyncWebServerRequest *request){
-    if (!request->authenticate(ADMIN_USER, ADMIN_PASSWORD)) {
-      return request->requestAuthentication();
-    }
-    request->send(SPIFFS, "/index.html", String(), false);
-  });
+  server.on("/", HTTP_GET, serveStatic);
+  server.on("/index.html", HTTP_GET, serveStatic);
+  // Canale push per la UI (SSE): sostituisce il polling di stato, ora e relè
+  liveEvents.begin(server);
+
   // Per le altre risorse statiche sotto / (css/js/png/etc.) proteggile con un handler generico
   server.onNotFound([](AsyncWebServerRequest *request){
     // Consenti sempre API pubbliche
@@ -2113,186 +2920,18 @@ void setupWebServer() {
       request->send(404, "application/json", "{\"success\":false,\"message\":\"API non trovata\"}");
       return;
     }
-    // Richiede autenticazione per le risorse statiche
-    if (!request->authenticate(ADMIN_USER, ADMIN_PASSWORD)) {
-      return request->requestAuthentication();
-    }
-    // Prova a servire dal FS, altrimenti 404
-    if (SPIFFS.exists(request->url())) {
-      request->send(SPIFFS, request->url(), String(), false);
-    } else if (request->url() == "/") {
-      request->send(SPIFFS, "/index.html", String(), false);
-    } else {
-      request->send(404, "text/plain", "Not Found");
-    }
+    serveStatic(request);
   });
   // Nota: l'handler onNotFound ora gestisce sia 404 API che le risorse statiche con auth
 
-  Serial.println("✓ Web Server configurato");
+  LOGI(LOG_WEB, "✓ Web Server configurato");
 }
 
 void updateDisplay() {
-  Serial.println("[DEBUG] Chiamata: updateDisplay()");
-  
-  // Aggiorna temperatura prima di mostrare il display
-  systemStatus.esp32Temperature = getESP32Temperature();
-  
-  tft.fillScreen(TFT_BLACK);
-  yield();
-
-  // Prepara dimensioni display
-  const int16_t W = tft.width();
-  const int16_t H = tft.height();
-  
-  // === HEADER CENTRATO ===
-  tft.setTextColor(TFT_CYAN);
-  tft.setTextSize(1);
-  tft.setTextDatum(TC_DATUM); // Top-Center
-  tft.drawString("CAMPANE CHIESA", W/2, 0);
-  yield();
-
-  // === OROLOGIO GRANDE AL CENTRO ===
-  char timeStr[20];
-  char dateStr[20];
-  bool timeValid = false;
-  
-  if (systemStatus.rtcConnected) {
-     DateTime now = rtc.now();
-     snprintf(timeStr, sizeof(timeStr), "%02d:%02d:%02d", now.hour(), now.minute(), now.second());
-     snprintf(dateStr, sizeof(dateStr), "%02d/%02d/%04d", now.day(), now.month(), now.year());
-     timeValid = true;
-     Serial.printf("[DEBUG] updateDisplay() - Ora da RTC: %s, Data: %s\n", timeStr, dateStr);
-   } else if (manualTimeValid) {
-     snprintf(timeStr, sizeof(timeStr), "%02d:%02d:%02d", manualTime.hour(), manualTime.minute(), manualTime.second());
-     snprintf(dateStr, sizeof(dateStr), "%02d/%02d/%04d", manualTime.day(), manualTime.month(), manualTime.year());
-     timeValid = true;
-     Serial.printf("[DEBUG] updateDisplay() - Ora manuale: %s, Data: %s\n", timeStr, dateStr);
-   } else if (systemStatus.ntpSynced) {
-     time_t now = time(nullptr);
-     struct tm * timeinfo = localtime(&now);
-     snprintf(timeStr, sizeof(timeStr), "%02d:%02d:%02d", timeinfo->tm_hour, timeinfo->tm_min, timeinfo->tm_sec);
-     snprintf(dateStr, sizeof(dateStr), "%02d/%02d/%04d", timeinfo->tm_mday, timeinfo->tm_mon+1, timeinfo->tm_year+1900);
-     timeValid = true;
-     Serial.printf("[DEBUG] updateDisplay() - Ora da NTP: %s, Data: %s\n", timeStr, dateStr);
-  }
-  
-  // Mostra orologio grande
-  if (timeValid) {
-    // Ora grande centrata
-    tft.setTextDatum(TC_DATUM); // Top-Center
-    tft.setTextSize(3);
-    tft.setTextColor(TFT_WHITE);
-    tft.drawString(timeStr, W/2, 22);
-    yield();
-
-    // Data più piccola centrata
-    tft.setTextSize(1);
-    tft.setTextColor(TFT_CYAN);
-    tft.drawString(dateStr, W/2, 54);
-    yield();
-  } else {
-    tft.setTextDatum(TC_DATUM);
-    tft.setTextSize(2);
-    tft.setTextColor(TFT_RED);
-    tft.drawString("NO TIME", W/2, 30);
-    yield();
-  }
-  
-  // === INDICATORI DI STATO CON ICONE COLORATE ===
-  // Ripristina allineamento a sinistra per le righe successive
-  tft.setTextDatum(TL_DATUM); // Top-Left
-  tft.setTextSize(1);
-  int yPos = 75;
-  
-  // WiFi Status con icona
-  tft.setCursor(0, yPos);
-  if (systemStatus.wifiConnected) {
-    tft.setTextColor(TFT_GREEN);
-    tft.print("● WiFi ");
-    tft.setTextColor(TFT_WHITE);
-    tft.print(WiFi.localIP());
-  } else {
-    tft.setTextColor(TFT_YELLOW);
-    tft.print("◐ WiFi AP ");
-    tft.setTextColor(TFT_WHITE);
-    tft.print(WiFi.softAPIP());
-  }
-  yPos += 12;
-  yield();
-  
-  // RTC Status con icona
-  tft.setCursor(0, yPos);
-  if (systemStatus.rtcConnected) {
-    tft.setTextColor(TFT_GREEN);
-    tft.print("● RTC ");
-    tft.setTextColor(TFT_WHITE);
-    tft.print("Connesso");
-  } else {
-    tft.setTextColor(TFT_RED);
-    tft.print("✗ RTC ");
-    tft.setTextColor(TFT_WHITE);
-    tft.print("Non trovato");
-  }
-  yPos += 12;
-  yield();
-  
-  // Stato Campane con icona
-  tft.setCursor(0, yPos);
-  if (systemStatus.bellsEnabled) {
-    tft.setTextColor(TFT_GREEN);
-    tft.print("♪ Campane ");
-    tft.setTextColor(TFT_GREEN);
-    tft.print("ABILITATE");
-  } else {
-    tft.setTextColor(TFT_RED);
-    tft.print("♪ Campane ");
-    tft.setTextColor(TFT_RED);
-    tft.print("DISABILITATE");
-  }
-  yPos += 12;
-  yield();
-  
-  // Temperatura ESP32 con icona e colori
-  tft.setCursor(0, yPos);
-  if (systemStatus.thermalProtection) {
-    tft.setTextColor(TFT_RED);
-    tft.print("▲ ESP32 ");
-    tft.print(systemStatus.esp32Temperature, 1);
-    tft.print("°C [CRITICA!]");
-  } else if (systemStatus.temperatureWarning) {
-    tft.setTextColor(TFT_YELLOW);
-    tft.print("△ ESP32 ");
-    tft.print(systemStatus.esp32Temperature, 1);
-    tft.print("°C [ALTA]");
-  } else {
-    tft.setTextColor(TFT_GREEN);
-    tft.print("● ESP32 ");
-    tft.print(systemStatus.esp32Temperature, 1);
-    tft.print("°C [OK]");
-  }
-  yPos += 12;
-  yield();
-  
-  // Fuso orario compatto
-  tft.setCursor(0, yPos);
-  tft.setTextColor(TFT_CYAN);
-  tft.print("⏰ UTC+");
-  tft.print(utcOffsetHours);
-  tft.print(" ");
-  tft.print(isDST ? "DST" : "STD");
-  yPos += 12;
-  yield();
-
-  // Info temperatura aggiuntive se necessario
-  if (systemStatus.thermalProtection || systemStatus.temperatureWarning) {
-    tft.setCursor(0, yPos);
-    tft.setTextColor(TFT_RED);
-    if (systemStatus.thermalProtection) {
-      tft.print("⚠ PROTEZIONE TERMICA ON");
-    } else {
-      tft.print("⚠ Monitoraggio attivo");
-    }
-  }
+  // Il task del display confronta con quanto già disegnato e invia solo le zone cambiate
+  ScreenState state;
+  readScreenState(state);
+  statusScreen.post(state);
 }
 
 
@@ -0,0 +1,52 @@
+#include "include/msgpack_writer.h"
+
+void MsgPackWriter::be(uint32_t v, uint8_t bytes) {
+    while (bytes-- > 0) out.write((uint8_t)(v >> (bytes * 8)));
+}
+
+// fixmap/fixarray/fixstr se possibile, altrimenti variante a 16 o 32 bit
+void MsgPackWriter::header(uint8_t fix, uint8_t fixMax, uint8_t code16, uint32_t n) {
+    if (n <= fixMax) { out.write((uint8_t)(fix | n)); return; }
+    if (n <= 0xFFFF) { out.write(code16); be(n, 2); return; }
+    out.write((uint8_t)(code16 + 1)); be(n, 4);
+}
+
+void MsgPackWriter::map(uint32_t count) {
+    header(0x80, 15, 0xde, count);
+}
+
+void MsgPackWriter::array(uint32_t count) {
+    header(0x90, 15, 0xdc, count);
+}
+
+void MsgPackWriter::string(const char* s) {
+    size_t len = strlen(s);
+    if (len <= 31) out.write((uint8_t)(0xa0 | len));
+    else if (len <= 0xFF) { out.write((uint8_t)0xd9); be(len, 1); }
+    else if (len <= 0xFFFF) { out.write((uint8_t)0xda); be(len, 2); }
+    else { out.write((uint8_t)0xdb); be(len, 4); }
+    out.write((const uint8_t*)s, len);
+}
+
+void MsgPackWriter::number(uint32_t v) {
+    if (v <= 0x7F) out.write((uint8_t)v);
+    else if (v <= 0xFF) { out.write((uint8_t)0xcc); be(v, 1); }
+    else if (v <= 0xFFFF) { out.write((uint8_t)0xcd); be(v, 2); }
+    else { out.write((uint8_t)0xce); be(v, 4); }
+}
+
+void MsgPackWriter::number(int32_t v) {
+    if (v >= 0) { number((uint32_t)v); return; }
+    if (v >= -32) out.write((uint8_t)(0xe0 | (v + 32)));
+    else if (v >= -128) { out.write((uint8_t)0xd0); be((uint32_t)v, 1); }
+    else if (v >= -32768) { out.write((uint8_t)0xd1); be((uint32_t)v, 2); }
+    else { out.write((uint8_t)0xd2); be((uint32_t)v, 4); }
+}
+
+void MsgPackWriter::boolean(bool v) {
+    out.write((uint8_t)(v ? 0xc3 : 0xc2));
+}
+
+void MsgPackWriter::nil() {
+    out.write((uint8_t)0xc0);
+}
@@ -0,0 +1,112 @@
+#include "include/perf_monitor.h"
+
+PerfMonitor perf;
+
+PerfMonitor::PerfMonitor() : count(0), epoch(1), resetMs(0) {
+    memset(probes, 0, sizeof(probes));
+    mux = portMUX_INITIALIZER_UNLOCKED;
+}
+
+void PerfMonitor::begin() {
+    resetMs = millis();
+}
+
+PerfProbe* PerfMonitor::probe(const char* name) {
+    PerfProbe* p = nullptr;
+    portENTER_CRITICAL(&mux);
+    for (uint8_t i = 0; i < count; i++) {
+        if (strcmp(probes[i].name, name) == 0) { p = &probes[i]; break; }
+    }
+    if (!p && count < PERF_MAX_PROBES) {
+        p = &probes[count++];
+        p->name = name;
+        p->epoch = 0;                   // Si azzera alla prima misura
+    }
+    portEXIT_CRITICAL(&mux);
+    return p;
+}
+
+void PerfMonitor::reset() {
+    epoch++;
+    resetMs = millis();
+}
+
+// Intervalli: 0..3 µs uno per valore, poi due per ottava (4-5, 6-7, 8-11, 12-15, ...)
+uint8_t PerfMonitor::bucketOf(uint32_t us) {
+    if (us < 4) return us;
+    uint8_t e = 31 - __builtin_clz(us);
+    uint8_t index = 2 * e + ((us >> (e - 1)) & 1);
+    return index < PERF_BUCKETS ? index : PERF_BUCKETS - 1;
+}
+
+uint32_t PerfMonitor::bucketUpper(uint8_t index) {
+    if (index < 4) return index;
+    uint8_t e = index / 2;
+    uint32_t half = 1UL << (e - 1);
+    return (1UL << e) + (index & 1) * half + half - 1;
+}
+
+void PerfProbe::record(uint32_t us) {
+    if (epoch != perf.epoch) {
+        epoch = perf.epoch;
+        count = 0;
+        totalUs = 0;
+        minUs = UINT32_MAX;
+        maxUs = 0;
+        memset(buckets, 0, sizeof(buckets));
+    }
+    count++;
+    totalUs += us;
+    if (us < minUs) minUs = us;
+    if (us > maxUs) maxUs = us;
+    uint8_t b = PerfMonitor::bucketOf(us);
+    if (++buckets[b] == UINT16_MAX) {
+        for (uint8_t i = 0; i < PERF_BUCKETS; i++) buckets[i] >>= 1;
+    }
+}
+
+// Limite superiore dell'intervallo che contiene il percentile (mai oltre il massimo)
+uint32_t PerfMonitor::percentile(const PerfProbe& p, uint8_t pct) {
+    uint32_t total = 0;
+    for (uint8_t i = 0; i < PERF_BUCKETS; i++) total += p.buckets[i];
+    if (total == 0) return 0;
+    uint32_t above = total - (total * pct + 99) / 100;     // Campioni che possono stare sopra
+    uint32_t seen = 0;
+    for (int8_t i = PERF_BUCKETS - 1; i >= 0; i--) {
+        seen += p.buckets[i];
+        if (seen > above) {
+            uint32_t upper = bucketUpper(i);
+            return upper < p.maxUs ? upper : p.maxUs;
+        }
+    }
+    return p.minUs;
+}
+
+void PerfMonitor::print(Print& out) {
+    out.printf("{\"cpuMHz\":%u,\"sinceResetMs\":%u,\"probes\":[", (unsigned)ESP.getCpuFreqMHz(), (unsigned)(millis() - resetMs));
+    bool first = true;
+    for (uint8_t i = 0; i < count; i++) {
+        const PerfProbe& p = probes[i];
+        if (p.epoch != epoch || p.count == 0) continue;
+        out.printf("%s{\"name\":\"%s\",\"count\":%u,\"minUs\":%u,\"avgUs\":%u,\"p50Us\":%u,\"p99Us\":%u,\"maxUs\":%u}",
+                   first ? "" : ",", p.name, (unsigned)p.count, (unsigned)p.minUs,
+                   (unsigned)(p.totalUs / p.count), (unsigned)percentile(p, 50),
+                   (unsigned)percentile(p, 99), (unsigned)p.maxUs);
+        first = false;
+    }
+    out.print("]}");
+}
+
+void PerfMonitor::printTable(Print& out) {
+    out.printf("=== PROFILO (%u ms dall'azzeramento, CPU %u MHz) ===\n",
+               (unsigned)(millis() - resetMs), (unsigned)ESP.getCpuFreqMHz());
+    out.printf("%-28s %8s %8s %8s %8s %8s %8s\n", "sonda", "conteggi", "min", "media", "p50", "p99", "max");
+    for (uint8_t i = 0; i < count; i++) {
+        const PerfProbe& p = probes[i];
+        if (p.epoch != epoch || p.count == 0) continue;
+        out.printf("%-28s %8u %8u %8u %8u %8u %8u\n", p.name, (unsigned)p.count, (unsigned)p.minUs,
+                   (unsigned)(p.totalUs / p.count), (unsigned)percentile(p, 50),
+                   (unsigned)percentile(p, 99), (unsigned)p.maxUs);
+    }
+    out.println("(tempi in µs)");
+}
@@ -0,0 +1,169 @@
+#include "include/power_manager.h"
+#include "include/button_service.h"
+#include "include/logger.h"
+#include <esp_timer.h>
+#include <esp_sleep.h>
+#include <driver/gpio.h>
+
+PowerManager powerManager;
+
+static const char* const BOOST_NAMES[POWER_BOOST_COUNT] = { "bells", "http" };
+
+PowerManager::PowerManager()
+    : pmActive(false), lightSleep(false), noSleepLock(nullptr), loopTask(nullptr), lastHttpMs(0),
+      lastActiveMs(0), manualMhz(POWER_MAX_MHZ), maxMhz(POWER_MAX_MHZ), sqwPin(-1), windowStartUs(0), lastUpdateUs(0),
+      idleUs(0), maxFreqUs(0), wakeups(0), boosts(0) {
+    for (uint8_t i = 0; i < POWER_BOOST_COUNT; i++) {
+        maxLocks[i] = nullptr;
+        boosted[i] = false;
+    }
+    mux = portMUX_INITIALIZER_UNLOCKED;
+}
+
+bool PowerManager::begin() {
+    loopTask = xTaskGetCurrentTaskHandle();
+    windowStartUs = lastUpdateUs = esp_timer_get_time();
+    lastActiveMs = millis();
+
+    esp_pm_config_esp32_t cfg;
+    cfg.max_freq_mhz = maxMhz;
+    cfg.min_freq_mhz = POWER_MIN_MHZ;
+    cfg.light_sleep_enable = POWER_LIGHT_SLEEP;
+    esp_err_t err = esp_pm_configure(&cfg);
+    if (err != ESP_OK) {
+        manualMhz = getCpuFrequencyMhz();
+        LOGW(LOG_SYS, "esp_pm non disponibile (%s): frequenza gestita dal loop, niente light sleep",
+             esp_err_to_name(err));
+        return false;
+    }
+    for (uint8_t i = 0; i < POWER_BOOST_COUNT; i++) {
+        esp_pm_lock_create(ESP_PM_CPU_FREQ_MAX, 0, BOOST_NAMES[i], &maxLocks[i]);
+    }
+    esp_pm_lock_create(ESP_PM_NO_LIGHT_SLEEP, 0, "bells_timing", &noSleepLock);
+    pmActive = true;
+    lightSleep = POWER_LIGHT_SLEEP;
+    if (lightSleep) esp_sleep_enable_gpio_wakeup();
+    LOGI(LOG_SYS, "esp_pm attivo: %u-%u MHz, light sleep %s", POWER_MIN_MHZ, POWER_MAX_MHZ,
+         lightSleep ? "sì" : "no");
+    return true;
+}
+
+void PowerManager::setMaxMhz(uint32_t mhz) {
+    if (mhz < POWER_MIN_MHZ) mhz = POWER_MIN_MHZ;
+    if (mhz > POWER_MAX_MHZ) mhz = POWER_MAX_MHZ;
+    if (mhz == maxMhz) return;
+    maxMhz = mhz;
+    LOGI(LOG_SYS, "Tetto frequenza CPU %u MHz", (unsigned)mhz);
+    if (pmActive) {
+        // Riconfigurazione a caldo: i lock di frequenza massima valgono il nuovo tetto
+        esp_pm_config_esp32_t cfg;
+        cfg.max_freq_mhz = maxMhz;
+        cfg.min_freq_mhz = POWER_MIN_MHZ;
+        cfg.light_sleep_enable = lightSleep;
+        esp_pm_configure(&cfg);
+    }
+    // Senza esp_pm ci pensa update() al giro successivo
+}
+
+void PowerManager::setSqwPin(int8_t pin) {
+    sqwPin = pin;
+    if (pin >= 0) pinMode(pin, INPUT_PULLUP);       // Uscita open drain del DS3231
+}
+
+void PowerManager::setBoost(uint8_t source, bool on) {
+    portENTER_CRITICAL(&mux);
+    bool changed = boosted[source] != on;
+    boosted[source] = on;
+    portEXIT_CRITICAL(&mux);
+    if (!changed) return;
+    if (on) boosts++;
+    if (!pmActive) return;
+    if (on) esp_pm_lock_acquire(maxLocks[source]);
+    else esp_pm_lock_release(maxLocks[source]);
+    // I tempi dei relè non devono subire i risvegli dal light sleep
+    if (source == POWER_BOOST_BELLS) {
+        if (on) esp_pm_lock_acquire(noSleepLock);
+        else esp_pm_lock_release(noSleepLock);
+    }
+}
+
+void PowerManager::update(bool bellsBusy) {
+    // Tempo a frequenza massima: con esp_pm solo con un boost attivo
+    int64_t nowUs = esp_timer_get_time();
+    bool atMax = pmActive ? (boosted[POWER_BOOST_BELLS] || boosted[POWER_BOOST_HTTP]) : manualMhz == POWER_MAX_MHZ;
+    if (atMax) maxFreqUs += nowUs - lastUpdateUs;
+    lastUpdateUs = nowUs;
+
+    setBoost(POWER_BOOST_BELLS, bellsBusy);
+    if (boosted[POWER_BOOST_HTTP] && millis() - lastHttpMs >= POWER_HTTP_BOOST_MS) {
+        setBoost(POWER_BOOST_HTTP, false);
+    }
+
+    if (pmActive) return;
+    // Ripiego senza esp_pm: frequenza minima solo dopo un po' senza attività
+    if (boosted[POWER_BOOST_BELLS] || boosted[POWER_BOOST_HTTP]) lastActiveMs = millis();
+    uint32_t want = millis() - lastActiveMs < POWER_IDLE_DOWN_MS ? maxMhz : POWER_MIN_MHZ;
+    if (want != manualMhz && setCpuFrequencyMhz(want)) {
+        manualMhz = want;
+        LOGD(LOG_SYS, "CPU a %u MHz", (unsigned)want);
+    }
+}
+
+void PowerManager::noteHttp() {
+    lastHttpMs = millis();
+    setBoost(POWER_BOOST_HTTP, true);
+    wake();
+}
+
+void PowerManager::wake() {
+    if (loopTask) xTaskNotifyGive(loopTask);
+}
+
+void PowerManager::idleWait(uint32_t maxMs) {
+    if (maxMs == 0) {
+        // Come prima: coopera con lo stack async senza sospendere il loop
+        delay(0);
+        yield();
+        return;
+    }
+    if (lightSleep) {
+        buttonService.armWake();
+        // SQW: risveglio sul livello opposto a quello attuale, cioè al prossimo fronte
+        if (sqwPin >= 0) {
+            gpio_wakeup_enable((gpio_num_t)sqwPin, digitalRead(sqwPin) ? GPIO_INTR_LOW_LEVEL : GPIO_INTR_HIGH_LEVEL);
+        }
+    }
+    int64_t start = esp_timer_get_time();
+    if (ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(maxMs)) > 0) wakeups++;
+    idleUs += esp_timer_get_time() - start;
+    if (lightSleep) {
+        if (sqwPin >= 0) gpio_wakeup_disable((gpio_num_t)sqwPin);
+        buttonService.disarmWake();
+    }
+}
+
+uint32_t PowerManager::getCpuMhz() {
+    return getCpuFrequencyMhz();
+}
+
+void PowerManager::print(Print& out, float temperatureC) {
+    int64_t window = esp_timer_get_time() - windowStartUs;
+    if (window <= 0) window = 1;
+    float maxShare = (float)maxFreqUs / window;
+    float idleShare = (float)idleUs / window;
+    if (maxShare > 1.0f) maxShare = 1.0f;
+    if (idleShare > 1.0f - maxShare) idleShare = 1.0f - maxShare;
+    // Stima: frequenza massima, loop sospeso (light sleep o CPU ferma al minimo), resto al minimo
+    float idleMa = lightSleep ? POWER_MA_SLEEP : POWER_MA_MIN;
+    float estimate = maxShare * POWER_MA_MAX + idleShare * idleMa +
+                     (1.0f - maxShare - idleShare) * POWER_MA_MIN;
+
+    out.printf("{\"pm\":%s,\"lightSleep\":%s,\"cpuMHz\":%u,\"minMHz\":%u,\"maxMHz\":%u,",
+               pmActive ? "true" : "false", lightSleep ? "true" : "false", (unsigned)getCpuMhz(),
+               POWER_MIN_MHZ, (unsigned)maxMhz);
+    out.printf("\"boost\":{\"bells\":%s,\"http\":%s},\"boosts\":%u,\"wakeups\":%u,",
+               boosted[POWER_BOOST_BELLS] ? "true" : "false", boosted[POWER_BOOST_HTTP] ? "true" : "false",
+               (unsigned)boosts, (unsigned)wakeups);
+    out.printf("\"windowMs\":%u,\"idlePct\":%.1f,\"maxFreqPct\":%.1f,\"estimatedMa\":%.1f,\"temperatureC\":%.1f}",
+               (unsigned)(window / 1000), idleShare * 100.0f, maxShare * 100.0f, estimate, temperatureC);
+}
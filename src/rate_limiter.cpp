@@ -0,0 +1,143 @@
+#include "include/rate_limiter.h"
+#include "include/web_stats.h"
+#include "include/power_manager.h"
+
+RateLimiter rateLimiter;
+
+struct RouteCost {
+    const char* prefix;
+    uint8_t cost;
+};
+
+// Primo prefisso corrispondente; le altre API costano 1, le risorse statiche 1
+static const RouteCost ROUTE_COSTS[] = {
+    { "/api/emergency-stop", 0 },
+    { "/api/stop-melody", 0 },
+    { "/api/events", 2 },               // Connessione SSE: lunga, fuori dal limite in corso
+    { "/api/backup", 10 },
+    { "/api/restore", 10 },
+    { "/api/batch", 5 },
+    { "/api/history", 4 },
+    { "/api/i2c-scan", 5 },
+    { "/api/test-melody", 3 },
+    { "/api/test-relay", 3 },
+    { "/api/set-relay", 3 },
+    { "/api/configure-wifi", 5 },
+    { "/api/ntp-resync", 5 },
+};
+
+RateLimiter::RateLimiter() : inFlight(0), throttled(false), rejectedRate(0), rejectedBusy(0), rejectedPerClient(0) {
+    memset(buckets, 0, sizeof(buckets));
+}
+
+uint8_t RateLimiter::routeCost(const String& url) {
+    for (size_t i = 0; i < sizeof(ROUTE_COSTS) / sizeof(ROUTE_COSTS[0]); i++) {
+        if (url.startsWith(ROUTE_COSTS[i].prefix)) return ROUTE_COSTS[i].cost;
+    }
+    return 1;
+}
+
+RateBucket& RateLimiter::bucketFor(uint32_t ip, uint32_t now) {
+    RateBucket* oldest = &buckets[0];
+    for (uint8_t i = 0; i < RATE_LIMIT_CLIENTS; i++) {
+        if (buckets[i].ip == ip && buckets[i].lastSeen != 0) return buckets[i];
+        if (buckets[i].lastSeen == 0 || (int32_t)(buckets[i].lastSeen - oldest->lastSeen) < 0) oldest = &buckets[i];
+    }
+    // Nuovo client: bucket pieno (un IP sostituito con richieste ancora aperte
+    // perde il proprio conteggio: release() non lo trova più e non fa nulla)
+    oldest->ip = ip;
+    oldest->open = 0;
+    oldest->milliTokens = RATE_LIMIT_BURST * 1000UL;
+    oldest->lastMs = now;
+    oldest->lastSeen = now;
+    return *oldest;
+}
+
+// Chiamata dal task AsyncTCP a fine intestazioni, una volta per richiesta
+bool RateLimiter::canHandle(AsyncWebServerRequest* request) {
+    uint8_t cost = routeCost(request->url());
+    if (cost == 0) return false;
+
+    // Le connessioni SSE restano aperte: contano per il bucket ma non per il limite in corso
+    bool longLived = request->url().startsWith("/api/events");
+    if (!longLived && inFlight >= maxInFlight()) {
+        rejectedBusy++;
+        return true;
+    }
+
+    uint32_t now = millis();
+    uint32_t ip = (uint32_t)request->client()->remoteIP();
+    RateBucket& b = bucketFor(ip, now);
+    if (!longLived && b.open >= RATE_LIMIT_PER_CLIENT) {
+        rejectedPerClient++;
+        return true;
+    }
+    uint32_t elapsed = min((uint32_t)(now - b.lastMs), (uint32_t)60000);
+    uint32_t refill = elapsed * (throttled ? RATE_LIMIT_THROTTLED_REFILL : RATE_LIMIT_REFILL); // ms * token/s = millitoken
+    b.milliTokens = min((uint32_t)(RATE_LIMIT_BURST * 1000UL), b.milliTokens + refill);
+    b.lastMs = now;
+    b.lastSeen = now;
+    if (b.milliTokens < cost * 1000UL) {
+        rejectedRate++;
+        return true;
+    }
+    b.milliTokens -= cost * 1000UL;
+
+    if (!longLived) {
+        inFlight++;
+        b.open++;
+        // Un corpo che smette di arrivare non deve tenere occupato uno slot
+        request->client()->setRxTimeout(RATE_LIMIT_IDLE_TIMEOUT);
+        WebStats::Token token = webStats.track(request);
+        request->onDisconnect([this, ip, token]() {
+            if (inFlight > 0) inFlight--;
+            release(ip);
+            webStats.finish(token);
+        });
+    }
+    // Frequenza massima per la risposta e loop risvegliato
+    powerManager.noteHttp();
+    return false;
+}
+
+void RateLimiter::release(uint32_t ip) {
+    for (uint8_t i = 0; i < RATE_LIMIT_CLIENTS; i++) {
+        if (buckets[i].ip == ip && buckets[i].lastSeen != 0) {
+            if (buckets[i].open > 0) buckets[i].open--;
+            return;
+        }
+    }
+}
+
+void RateLimiter::handleRequest(AsyncWebServerRequest* request) {
+    // Occupato: limite globale o per IP; altrimenti bucket del client esaurito
+    bool busy = inFlight >= maxInFlight();
+    if (!busy) {
+        uint32_t ip = (uint32_t)request->client()->remoteIP();
+        for (uint8_t i = 0; i < RATE_LIMIT_CLIENTS; i++) {
+            if (buckets[i].ip == ip && buckets[i].lastSeen != 0) { busy = buckets[i].open >= RATE_LIMIT_PER_CLIENT; break; }
+        }
+    }
+    AsyncWebServerResponse* r = busy
+        ? request->beginResponse(503, "application/json", "{\"success\":false,\"message\":\"Server occupato\"}")
+        : request->beginResponse(429, "application/json", "{\"success\":false,\"message\":\"Troppe richieste\"}");
+    r->addHeader("Retry-After", busy ? "1" : "2");
+    r->addHeader("Connection", "close");
+    request->send(r);
+}
+
+uint8_t RateLimiter::getInFlight() {
+    return inFlight;
+}
+
+uint32_t RateLimiter::getRejectedRate() {
+    return rejectedRate;
+}
+
+uint32_t RateLimiter::getRejectedBusy() {
+    return rejectedBusy;
+}
+
+uint32_t RateLimiter::getRejectedPerClient() {
+    return rejectedPerClient;
+}
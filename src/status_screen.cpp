@@ -0,0 +1,369 @@
+#include "include/status_screen.h"
+#include "include/logger.h"
+#include "include/perf_monitor.h"
+
+#define SCREEN_GLYPH_W (6 * SCREEN_CLOCK_SIZE)
+#define SCREEN_GLYPH_H (8 * SCREEN_CLOCK_SIZE)
+#define SCREEN_STRIP_H 8                // Altezza del font 6x8 a dimensione 1
+
+StatusScreen::StatusScreen(TFT_eSPI& display)
+    : tft(display), glyphA(&display), glyphB(&display), stripA(&display), stripB(&display),
+      useSprites(false), useDma(false), glyphFlip(0), stripFlip(0), fullPending(true),
+      shownTimeValid(false), task(nullptr), pendingState(false), pendingAp(false), apIp(0),
+      redrawRequested(false), lastBytes(0), totalBytes(0), fullRedraws(0), partialRedraws(0),
+      renderBytes(0), backlight(100) {
+    memset(shownTime, 0, sizeof(shownTime));
+    memset(shownDate, 0, sizeof(shownDate));
+    memset(shown, 0, sizeof(shown));
+    memset(&pending, 0, sizeof(pending));
+    memset(apSsid, 0, sizeof(apSsid));
+    memset(apPassword, 0, sizeof(apPassword));
+    mux = portMUX_INITIALIZER_UNLOCKED;
+}
+
+void StatusScreen::begin() {
+    // ~4,7 KB in tutto con display 240 px: se non ci sono, si disegna direttamente
+    bool ok = glyphA.createSprite(SCREEN_GLYPH_W, SCREEN_GLYPH_H) != nullptr;
+    ok = ok && stripA.createSprite(tft.width(), SCREEN_STRIP_H) != nullptr;
+    if (!ok) {
+        glyphA.deleteSprite();
+        stripA.deleteSprite();
+        LOGW(LOG_DISP, "sprite non allocati, disegno diretto");
+    }
+    useSprites = ok;
+
+    // Seconda copia degli sprite per il DMA. I buffer degli sprite a 16 bit sono
+    // già nell'ordine di byte del pannello: pushImageDMA senza swap
+    if (useSprites) {
+        bool dmaOk = glyphB.createSprite(SCREEN_GLYPH_W, SCREEN_GLYPH_H) != nullptr;
+        dmaOk = dmaOk && stripB.createSprite(tft.width(), SCREEN_STRIP_H) != nullptr;
+        dmaOk = dmaOk && tft.initDMA();
+        if (!dmaOk) {
+            glyphB.deleteSprite();
+            stripB.deleteSprite();
+            LOGW(LOG_DISP, "DMA non disponibile, trasferimenti bloccanti");
+        }
+        useDma = dmaOk;
+        tft.setSwapBytes(false);
+    }
+    fullPending = true;
+
+#ifdef TFT_BL
+    // Retroilluminazione in PWM al posto del livello fisso impostato da tft.init()
+    ledcSetup(SCREEN_BL_CHANNEL, 5000, 8);
+    ledcAttachPin(TFT_BL, SCREEN_BL_CHANNEL);
+    ledcWrite(SCREEN_BL_CHANNEL, (uint32_t)backlight * 255 / 100);
+#endif
+
+    if (xTaskCreatePinnedToCore(taskEntry, "display", DISPLAY_TASK_STACK, this,
+                                DISPLAY_TASK_PRIORITY, &task, DISPLAY_TASK_CORE) != pdPASS) {
+        task = nullptr;
+        LOGE(LOG_DISP, "impossibile avviare il task");
+    }
+}
+
+void StatusScreen::setBacklight(uint8_t percent) {
+    if (percent > 100) percent = 100;
+    if (percent == backlight) return;
+    backlight = percent;
+#ifdef TFT_BL
+    ledcWrite(SCREEN_BL_CHANNEL, (uint32_t)percent * 255 / 100);
+#endif
+}
+
+void StatusScreen::post(const ScreenState& s) {
+    portENTER_CRITICAL(&mux);
+    pending = s;
+    pendingState = true;
+    portEXIT_CRITICAL(&mux);
+    if (task) xTaskNotifyGive(task);
+}
+
+void StatusScreen::requestRedraw() {
+    redrawRequested = true;
+}
+
+bool StatusScreen::takeRedrawRequest() {
+    if (!redrawRequested) return false;
+    redrawRequested = false;
+    return true;
+}
+
+void StatusScreen::showApScreen(const char* ssid, const char* password, uint32_t ip) {
+    portENTER_CRITICAL(&mux);
+    strlcpy(apSsid, ssid, sizeof(apSsid));
+    strlcpy(apPassword, password, sizeof(apPassword));
+    apIp = ip;
+    pendingAp = true;
+    portEXIT_CRITICAL(&mux);
+    if (task) xTaskNotifyGive(task);
+}
+
+void StatusScreen::taskEntry(void* arg) {
+    ((StatusScreen*)arg)->taskLoop();
+}
+
+void StatusScreen::taskLoop() {
+    for (;;) {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        // Si disegna solo l'ultimo stato pubblicato: le notifiche intermedie si fondono
+        ScreenState s;
+        bool haveState, haveAp;
+        portENTER_CRITICAL(&mux);
+        haveState = pendingState;
+        haveAp = pendingAp;
+        if (haveState) s = pending;
+        pendingState = false;
+        pendingAp = false;
+        portEXIT_CRITICAL(&mux);
+
+        if (haveAp) {
+            drawAp();
+            fullPending = true;
+        } else if (haveState) {
+            PERF_SCOPE("display.render");
+            render(s);
+        }
+    }
+}
+
+TFT_eSprite& StatusScreen::nextGlyph() {
+    if (!useDma) return glyphA;
+    glyphFlip ^= 1;
+    return glyphFlip ? glyphB : glyphA;
+}
+
+TFT_eSprite& StatusScreen::nextStrip() {
+    if (!useDma) return stripA;
+    stripFlip ^= 1;
+    return stripFlip ? stripB : stripA;
+}
+
+// Con DMA il trasferimento parte e il task prosegue: pushImageDMA attende da sé
+// la fine del trasferimento precedente, che usa l'altro buffer
+void StatusScreen::push(TFT_eSprite& sprite, int16_t x, int16_t y, int16_t w, int16_t h) {
+    if (useDma) tft.pushImageDMA(x, y, w, h, (uint16_t*)sprite.getPointer());
+    else sprite.pushSprite(x, y);
+    renderBytes += (uint32_t)w * h * 2;
+}
+
+// Prima di disegnare direttamente sul TFT il bus deve essere libero
+void StatusScreen::waitDma() {
+    if (useDma) tft.dmaWait();
+}
+
+void StatusScreen::drawAp() {
+    char ip[16];
+    snprintf(ip, sizeof(ip), "%u.%u.%u.%u", (unsigned)(apIp & 0xFF), (unsigned)((apIp >> 8) & 0xFF),
+             (unsigned)((apIp >> 16) & 0xFF), (unsigned)(apIp >> 24));
+    tft.fillScreen(TFT_BLACK);
+    tft.setTextDatum(TL_DATUM);
+    tft.setTextColor(TFT_YELLOW);
+    tft.setTextSize(2);
+    tft.setCursor(4, 4);
+    tft.println("CONFIG AP ON");
+    tft.setTextSize(1);
+    tft.setCursor(4, 28);
+    tft.print("SSID: "); tft.println(apSsid);
+    tft.print("PWD : "); tft.println(apPassword);
+    tft.print("IP  : "); tft.println(ip);
+}
+
+// Le stringhe vengono azzerate prima di scriverle: le righe si confrontano con memcmp
+void StatusScreen::buildLines(const ScreenState& s, ScreenLine* out) {
+    memset(out, 0, sizeof(ScreenLine) * SCREEN_LINES);
+    ScreenLine& wifi = out[0];
+    snprintf(wifi.label, sizeof(wifi.label), "%s", s.wifiConnected ? "● WiFi " : "◐ WiFi AP ");
+    snprintf(wifi.value, sizeof(wifi.value), "%u.%u.%u.%u",
+             (unsigned)(s.ip & 0xFF), (unsigned)((s.ip >> 8) & 0xFF),
+             (unsigned)((s.ip >> 16) & 0xFF), (unsigned)(s.ip >> 24));
+    wifi.labelColor = s.wifiConnected ? TFT_GREEN : TFT_YELLOW;
+    wifi.valueColor = TFT_WHITE;
+
+    ScreenLine& rtc = out[1];
+    snprintf(rtc.label, sizeof(rtc.label), "%s", s.rtcConnected ? "● RTC " : "✗ RTC ");
+    snprintf(rtc.value, sizeof(rtc.value), "%s", s.rtcConnected ? "Connesso" : "Non trovato");
+    rtc.labelColor = s.rtcConnected ? TFT_GREEN : TFT_RED;
+    rtc.valueColor = TFT_WHITE;
+
+    ScreenLine& bells = out[2];
+    snprintf(bells.label, sizeof(bells.label), "♪ Campane ");
+    snprintf(bells.value, sizeof(bells.value), "%s", s.bellsEnabled ? "ABILITATE" : "DISABILITATE");
+    bells.labelColor = bells.valueColor = s.bellsEnabled ? TFT_GREEN : TFT_RED;
+
+    ScreenLine& temp = out[3];
+    const char* icon = s.thermalProtection ? "▲" : (s.temperatureWarning ? "△" : "●");
+    const char* band = s.thermalProtection ? "CRITICA!" : (s.temperatureWarning ? "ALTA" : "OK");
+    snprintf(temp.label, sizeof(temp.label), "%s ESP32 ", icon);
+    snprintf(temp.value, sizeof(temp.value), "%.1f°C [%s]", s.temperatureDeci / 10.0f, band);
+    temp.labelColor = temp.valueColor =
+        s.thermalProtection ? TFT_RED : (s.temperatureWarning ? TFT_YELLOW : TFT_GREEN);
+
+    ScreenLine& tz = out[4];
+    snprintf(tz.label, sizeof(tz.label), "⏰ UTC+%d %s", s.utcOffsetHours, s.isDST ? "DST" : "STD");
+    tz.labelColor = tz.valueColor = TFT_CYAN;
+
+    // Riga vuota quando non c'è nulla da segnalare (cancella l'avviso precedente)
+    ScreenLine& alert = out[5];
+    if (s.thermalProtection) {
+        snprintf(alert.label, sizeof(alert.label), "⚠ PROTEZIONE TERMICA ON");
+    } else if (s.temperatureWarning) {
+        snprintf(alert.label, sizeof(alert.label), "⚠ Monitoraggio attivo");
+    } else if (s.memoryAlarm) {
+        snprintf(alert.label, sizeof(alert.label), "⚠ Memoria bassa ");
+        snprintf(alert.value, sizeof(alert.value), "%u KB", s.freeHeapKb);
+    }
+    alert.labelColor = alert.valueColor = TFT_RED;
+}
+
+void StatusScreen::drawClockChar(uint8_t i, char c) {
+    const int16_t x = tft.width() / 2 - (SCREEN_CLOCK_CHARS * SCREEN_GLYPH_W) / 2 + i * SCREEN_GLYPH_W;
+    char text[2] = { c, '\0' };
+    if (useSprites) {
+        TFT_eSprite& glyph = nextGlyph();
+        glyph.fillSprite(TFT_BLACK);
+        glyph.setTextDatum(TL_DATUM);
+        glyph.setTextSize(SCREEN_CLOCK_SIZE);
+        glyph.setTextColor(TFT_WHITE);
+        glyph.drawString(text, 0, 0);
+        push(glyph, x, SCREEN_CLOCK_Y, SCREEN_GLYPH_W, SCREEN_GLYPH_H);
+    } else {
+        tft.fillRect(x, SCREEN_CLOCK_Y, SCREEN_GLYPH_W, SCREEN_GLYPH_H, TFT_BLACK);
+        tft.setTextDatum(TL_DATUM);
+        tft.setTextSize(SCREEN_CLOCK_SIZE);
+        tft.setTextColor(TFT_WHITE);
+        tft.drawString(text, x, SCREEN_CLOCK_Y);
+        renderBytes += SCREEN_GLYPH_W * SCREEN_GLYPH_H * 2;
+    }
+}
+
+// Ora non disponibile: scritta al posto di orologio e data
+void StatusScreen::drawNoTime() {
+    const int16_t h = SCREEN_DATE_Y + SCREEN_STRIP_H - SCREEN_CLOCK_Y;
+    waitDma();
+    tft.fillRect(0, SCREEN_CLOCK_Y, tft.width(), h, TFT_BLACK);
+    tft.setTextDatum(TC_DATUM);
+    tft.setTextSize(2);
+    tft.setTextColor(TFT_RED);
+    tft.drawString("NO TIME", tft.width() / 2, 30);
+    renderBytes += (uint32_t)tft.width() * h * 2;
+}
+
+void StatusScreen::drawDate(const char* date) {
+    const int16_t W = tft.width();
+    if (useSprites) {
+        TFT_eSprite& strip = nextStrip();
+        strip.fillSprite(TFT_BLACK);
+        strip.setTextDatum(TC_DATUM);
+        strip.setTextSize(1);
+        strip.setTextColor(TFT_CYAN);
+        strip.drawString(date, W / 2, 0);
+        push(strip, 0, SCREEN_DATE_Y, W, SCREEN_STRIP_H);
+    } else {
+        tft.fillRect(0, SCREEN_DATE_Y, W, SCREEN_STRIP_H, TFT_BLACK);
+        tft.setTextDatum(TC_DATUM);
+        tft.setTextSize(1);
+        tft.setTextColor(TFT_CYAN);
+        tft.drawString(date, W / 2, SCREEN_DATE_Y);
+        renderBytes += (uint32_t)W * SCREEN_STRIP_H * 2;
+    }
+}
+
+void StatusScreen::drawLine(uint8_t i, const ScreenLine& line) {
+    const int16_t W = tft.width();
+    const int16_t y = SCREEN_LINES_Y + i * SCREEN_LINE_PITCH;
+    TFT_eSPI* g = &tft;
+    int16_t top = y;
+    if (useSprites) {
+        TFT_eSprite& strip = nextStrip();
+        strip.fillSprite(TFT_BLACK);
+        g = &strip;
+        top = 0;
+    } else {
+        tft.fillRect(0, y, W, SCREEN_STRIP_H, TFT_BLACK);
+        renderBytes += (uint32_t)W * SCREEN_STRIP_H * 2;
+    }
+    g->setTextDatum(TL_DATUM);
+    g->setTextSize(1);
+    g->setCursor(0, top);
+    g->setTextColor(line.labelColor);
+    g->print(line.label);
+    g->setTextColor(line.valueColor);
+    g->print(line.value);
+    if (useSprites) push(*(TFT_eSprite*)g, 0, y, W, SCREEN_STRIP_H);
+}
+
+void StatusScreen::drawFull(const ScreenState& s, const ScreenLine* lines) {
+    waitDma();
+    tft.fillScreen(TFT_BLACK);
+    renderBytes += (uint32_t)tft.width() * tft.height() * 2;
+
+    tft.setTextColor(TFT_CYAN);
+    tft.setTextSize(1);
+    tft.setTextDatum(TC_DATUM);
+    tft.drawString("CAMPANE CHIESA", tft.width() / 2, 0);
+
+    if (s.timeValid) {
+        for (uint8_t i = 0; i < SCREEN_CLOCK_CHARS; i++) drawClockChar(i, s.time[i]);
+        drawDate(s.date);
+    } else {
+        drawNoTime();
+    }
+    for (uint8_t i = 0; i < SCREEN_LINES; i++) {
+        if (lines[i].label[0] || lines[i].value[0]) drawLine(i, lines[i]);
+    }
+}
+
+void StatusScreen::render(const ScreenState& s) {
+    ScreenLine lines[SCREEN_LINES];
+    buildLines(s, lines);
+    renderBytes = 0;
+    // Con DMA la transazione SPI resta aperta per tutto il render
+    if (useDma) tft.startWrite();
+
+    if (fullPending) {
+        fullPending = false;
+        drawFull(s, lines);
+        fullRedraws++;
+    } else {
+        if (s.timeValid != shownTimeValid) {
+            if (!s.timeValid) {
+                drawNoTime();
+            } else {
+                // Torna l'ora: si cancella la scritta e si ridisegnano tutte le cifre
+                waitDma();
+                tft.fillRect(0, SCREEN_CLOCK_Y, tft.width(), SCREEN_DATE_Y + SCREEN_STRIP_H - SCREEN_CLOCK_Y, TFT_BLACK);
+                renderBytes += (uint32_t)tft.width() * (SCREEN_DATE_Y + SCREEN_STRIP_H - SCREEN_CLOCK_Y) * 2;
+                memset(shownTime, 0, sizeof(shownTime));
+                memset(shownDate, 0, sizeof(shownDate));
+            }
+        }
+        if (s.timeValid) {
+            for (uint8_t i = 0; i < SCREEN_CLOCK_CHARS; i++) {
+                if (s.time[i] != shownTime[i]) drawClockChar(i, s.time[i]);
+            }
+            if (strcmp(s.date, shownDate) != 0) drawDate(s.date);
+        }
+        for (uint8_t i = 0; i < SCREEN_LINES; i++) {
+            if (memcmp(&lines[i], &shown[i], sizeof(ScreenLine)) != 0) drawLine(i, lines[i]);
+        }
+        if (renderBytes > 0) partialRedraws++;
+    }
+
+    shownTimeValid = s.timeValid;
+    memcpy(shownTime, s.time, sizeof(shownTime));
+    memcpy(shownDate, s.date, sizeof(shownDate));
+    memcpy(shown, lines, sizeof(shown));
+    if (useDma) {
+        tft.dmaWait();
+        tft.endWrite();
+    }
+    lastBytes = renderBytes;
+    totalBytes += renderBytes;
+}
+
+bool StatusScreen::isDmaEnabled() { return useDma; }
+uint32_t StatusScreen::getLastBytes() { return lastBytes; }
+uint32_t StatusScreen::getTotalBytes() { return totalBytes; }
+uint32_t StatusScreen::getFullRedraws() { return fullRedraws; }
+uint32_t StatusScreen::getPartialRedraws() { return partialRedraws; }
@@ -0,0 +1,119 @@
+#include "include/status_snapshot.h"
+#include "include/logger.h"
+#include <ArduinoJson.h>
+
+StatusSnapshot statusSnapshot;
+
+static const char* temperatureStatusName(const StatusFields& f) {
+    if (f.thermalProtection) return "CRITICA";
+    if (f.temperatureWarning) return "ELEVATA";
+    return "OK";
+}
+
+StatusSnapshot::StatusSnapshot()
+    : published(nullptr), generation(0), instance(0), builtMs(0), lastCheckMs(0),
+      dirty(false), firmwareVersion(""), readEpoch(nullptr) {
+    memset(slots, 0, sizeof(slots));
+    memset(&fields, 0, sizeof(fields));
+}
+
+void StatusSnapshot::begin(const char* firmware, uint32_t (*epochSource)()) {
+    firmwareVersion = firmware;
+    readEpoch = epochSource;
+    instance = esp_random();
+    build(fields);
+}
+
+bool StatusSnapshot::checkDue() {
+    uint32_t now = millis();
+    if (now - lastCheckMs < STATUS_SNAPSHOT_CHECK) return false;
+    lastCheckMs = now;
+    return true;
+}
+
+void StatusSnapshot::invalidate() {
+    dirty = true;
+}
+
+void StatusSnapshot::update(const StatusFields& f) {
+    uint32_t age = millis() - builtMs;
+    if (dirty) {
+        build(f);
+        return;
+    }
+    if (age < STATUS_SNAPSHOT_MIN_INTERVAL) return;
+    // Confronto campo per campo (memcmp vedrebbe anche i byte di padding)
+    bool changed =
+        f.wifiConnected != fields.wifiConnected || f.ntpSynced != fields.ntpSynced ||
+        f.rtcConnected != fields.rtcConnected || f.bellsEnabled != fields.bellsEnabled ||
+        f.testMode != fields.testMode || f.schedulerActive != fields.schedulerActive ||
+        f.apMode != fields.apMode || f.isDST != fields.isDST ||
+        f.temperatureWarning != fields.temperatureWarning || f.thermalProtection != fields.thermalProtection ||
+        f.timezoneOffset != fields.timezoneOffset || f.utcOffsetHours != fields.utcOffsetHours ||
+        f.totalBellRings != fields.totalBellRings || f.lastBellTime != fields.lastBellTime ||
+        f.temperatureDeci != fields.temperatureDeci || f.ip != fields.ip;
+    if (changed || age >= STATUS_SNAPSHOT_MAX_AGE) build(f);
+}
+
+void StatusSnapshot::build(const StatusFields& f) {
+    dirty = false;
+    StatusSlot* slot = (published == &slots[0]) ? &slots[1] : &slots[0];
+    uint32_t nowMs = millis();
+
+    DynamicJsonDocument doc(1024);
+    doc["wifiConnected"] = f.wifiConnected;
+    doc["ntpSynced"] = f.ntpSynced;
+    doc["rtcConnected"] = f.rtcConnected;
+    doc["bellsEnabled"] = f.bellsEnabled;
+    doc["testMode"] = f.testMode;
+    doc["schedulerActive"] = f.schedulerActive;
+    doc["apMode"] = f.apMode;
+    doc["timezoneOffset"] = f.timezoneOffset;
+    doc["isDST"] = f.isDST;
+    doc["firmwareVersion"] = firmwareVersion;
+    // Uptime al momento della generazione; la UI lo aggiorna con gli eventi "clock"
+    doc["uptimeMs"] = nowMs;
+    uint32_t epoch = readEpoch ? readEpoch() : 0;
+    if (epoch > nowMs / 1000) doc["bootEpoch"] = epoch - nowMs / 1000;
+    doc["totalBellRings"] = f.totalBellRings;
+    doc["lastBellTime"] = f.lastBellTime;
+    doc["esp32Temperature"] = f.temperatureDeci / 10.0f;
+    doc["temperatureWarning"] = f.temperatureWarning;
+    doc["thermalProtection"] = f.thermalProtection;
+    doc["temperatureStatus"] = temperatureStatusName(f);
+    char tz[40];
+    snprintf(tz, sizeof(tz), "Italia UTC+%d%s", f.utcOffsetHours, f.isDST ? " (Ora Legale)" : " (Ora Solare)");
+    doc["timezoneDescription"] = (const char*)tz;
+    char ip[16];
+    snprintf(ip, sizeof(ip), "%u.%u.%u.%u", (unsigned)(f.ip & 0xFF), (unsigned)((f.ip >> 8) & 0xFF),
+             (unsigned)((f.ip >> 16) & 0xFF), (unsigned)(f.ip >> 24));
+    doc["ipAddress"] = (const char*)ip;
+    doc[f.wifiConnected ? "wifiIP" : "apIP"] = (const char*)ip;
+
+    size_t len = serializeJson(doc, slot->json, sizeof(slot->json));
+    if (len == 0 || len >= sizeof(slot->json) - 1) {
+        LOGE(LOG_WEB, "StatusSnapshot: buffer insufficiente");
+        return;
+    }
+    size_t packLen = serializeMsgPack(doc, slot->pack, sizeof(slot->pack));
+    if (packLen == 0 || packLen >= sizeof(slot->pack)) {
+        LOGE(LOG_WEB, "StatusSnapshot: buffer MessagePack insufficiente");
+        return;
+    }
+    fields = f;
+    generation++;
+    builtMs = nowMs;
+    slot->length = len;
+    slot->packLength = packLen;
+    snprintf(slot->etag, sizeof(slot->etag), "\"%08x-%u\"", (unsigned)instance, (unsigned)generation);
+    snprintf(slot->packEtag, sizeof(slot->packEtag), "\"%08x-%u-m\"", (unsigned)instance, (unsigned)generation);
+    __atomic_store_n(&published, slot, __ATOMIC_RELEASE);
+}
+
+const StatusSlot* StatusSnapshot::current() {
+    return __atomic_load_n(&published, __ATOMIC_ACQUIRE);
+}
+
+uint32_t StatusSnapshot::getGeneration() {
+    return generation;
+}
@@ -0,0 +1,212 @@
+#include "include/thermal_governor.h"
+#include "include/bell_controller.h"
+#include "include/status_screen.h"
+#include "include/wifi_manager.h"
+#include "include/power_manager.h"
+#include "include/rate_limiter.h"
+#include "include/history_log.h"
+#include "include/logger.h"
+
+ThermalGovernor thermalGovernor;
+
+ThermalGovernor::ThermalGovernor()
+    : sampleSum(0), sampleIndex(0), primed(false), lastRawDeci(0), averageDeci(0), peakDeci(0),
+      readErrors(0), level(THERMAL_NORMAL), levelSinceMs(0), stopCandidateMs(0), lastSampleMs(0),
+      changes(0), stops(0), recentHead(0), recentCount(0), traceHead(0), traceCount(0),
+      traceSum(0), traceSamples(0), lastTraceMs(0) {
+    memset(samples, 0, sizeof(samples));
+    memset(levelMs, 0, sizeof(levelMs));
+    memset(recent, 0, sizeof(recent));
+    memset(trace, 0, sizeof(trace));
+}
+
+void ThermalGovernor::begin() {
+    levelSinceMs = lastTraceMs = millis();
+    update();
+}
+
+float ThermalGovernor::threshold(uint8_t level) {
+    switch (level) {
+        case THERMAL_DIM: return THERMAL_DIM_C;
+        case THERMAL_WIFI: return THERMAL_WIFI_C;
+        case THERMAL_CPU: return THERMAL_CPU_C;
+        case THERMAL_HTTP: return THERMAL_HTTP_C;
+        case THERMAL_MELODIES: return THERMAL_MELODIES_C;
+        case THERMAL_STOP: return THERMAL_STOP_C;
+        default: return -273.0f;
+    }
+}
+
+void ThermalGovernor::update() {
+    uint32_t now = millis();
+    if (lastSampleMs != 0 && now - lastSampleMs < THERMAL_SAMPLE_MS) return;
+    lastSampleMs = now;
+
+    // Su alcune revisioni il sensore non risponde: si tiene la media precedente
+    float raw = temperatureRead();
+    if (isnan(raw)) {
+        readErrors++;
+        return;
+    }
+    int16_t deci = (int16_t)lroundf(raw * 10.0f);
+    lastRawDeci = deci;
+    if (!primed) {
+        // Prima lettura su tutta la finestra: media subito valida
+        for (uint8_t i = 0; i < THERMAL_AVG_SAMPLES; i++) samples[i] = deci;
+        sampleSum = (int32_t)deci * THERMAL_AVG_SAMPLES;
+        primed = true;
+    } else {
+        sampleSum += deci - samples[sampleIndex];
+        samples[sampleIndex] = deci;
+        sampleIndex = (sampleIndex + 1) % THERMAL_AVG_SAMPLES;
+    }
+    averageDeci = (int16_t)(sampleSum / THERMAL_AVG_SAMPLES);
+    if (averageDeci > peakDeci) peakDeci = averageDeci;
+    systemStatus.esp32Temperature = averageDeci / 10.0f;
+
+    traceSum += averageDeci;
+    traceSamples++;
+    if (now - lastTraceMs >= THERMAL_TRACE_MS) {
+        lastTraceMs = now;
+        trace[traceHead] = (int16_t)(traceSum / traceSamples);
+        traceHead = (traceHead + 1) % THERMAL_TRACE_SIZE;
+        if (traceCount < THERMAL_TRACE_SIZE) traceCount++;
+        traceSum = 0;
+        traceSamples = 0;
+    }
+
+    uint8_t next = targetLevel(now);
+    if (next != level) setLevel(next, now);
+}
+
+// Si sale subito fino alla soglia superata più alta (STOP solo se persiste),
+// si scende di un livello alla volta con isteresi e tempo minimo
+uint8_t ThermalGovernor::targetLevel(uint32_t now) {
+    float avg = averageDeci / 10.0f;
+    uint8_t up = THERMAL_NORMAL;
+    for (uint8_t l = THERMAL_DIM; l < THERMAL_LEVEL_COUNT; l++) {
+        if (avg >= threshold(l)) up = l;
+    }
+    if (up == THERMAL_STOP) {
+        if (stopCandidateMs == 0) stopCandidateMs = now ? now : 1;
+        if (level < THERMAL_STOP && now - stopCandidateMs < THERMAL_STOP_HOLD_MS) up = THERMAL_MELODIES;
+    } else {
+        stopCandidateMs = 0;
+    }
+
+    if (up > level) return up;
+    if (level > THERMAL_NORMAL && avg < threshold(level) - THERMAL_HYSTERESIS &&
+        now - levelSinceMs >= THERMAL_DOWN_HOLD_MS) {
+        return level - 1;
+    }
+    return level;
+}
+
+void ThermalGovernor::setLevel(uint8_t next, uint32_t now) {
+    uint8_t from = level;
+    levelMs[from] += now - levelSinceMs;
+    levelSinceMs = now;
+    level = next;
+    changes++;
+
+    ThermalChange& c = recent[recentHead];
+    c.uptimeS = now / 1000;
+    c.from = from;
+    c.to = next;
+    c.temperatureDeci = averageDeci;
+    recentHead = (recentHead + 1) % THERMAL_RECENT_SIZE;
+    if (recentCount < THERMAL_RECENT_SIZE) recentCount++;
+
+    historyLog.append(HIST_THERMAL, HIST_SRC_SYSTEM, HISTORY_NONE, next, (uint16_t)(averageDeci > 0 ? averageDeci : 0));
+    if (next > from) {
+        LOGW(LOG_SYS, "Temperatura %.1f°C: protezione termica %s -> %s", averageDeci / 10.0f,
+             levelName(from), levelName(next));
+    } else {
+        LOGI(LOG_SYS, "Temperatura %.1f°C: protezione termica %s -> %s", averageDeci / 10.0f,
+             levelName(from), levelName(next));
+    }
+
+    apply();
+    if (next == THERMAL_STOP) {
+        stops++;
+        bellController.emergencyStop(HIST_SRC_SYSTEM);
+    }
+}
+
+// Le mitigazioni sono cumulative: ognuna attiva dal proprio livello in su
+void ThermalGovernor::apply() {
+    statusScreen.setBacklight(level >= THERMAL_DIM ? THERMAL_DIM_PERCENT : 100);
+    wifiManager.setTxCap(level >= THERMAL_WIFI ? WIFI_TX_MIN : WIFI_TX_MAX);
+    powerManager.setMaxMhz(level >= THERMAL_CPU ? POWER_MIN_MHZ : POWER_MAX_MHZ);
+    rateLimiter.setThrottle(level >= THERMAL_HTTP);
+    bellController.setPlayLimit(level >= THERMAL_STOP ? BELL_PLAY_NONE
+                                : level >= THERMAL_MELODIES ? BELL_PLAY_CRITICAL : BELL_PLAY_ALL);
+    systemStatus.temperatureWarning = level >= THERMAL_DIM;
+    systemStatus.thermalProtection = level >= THERMAL_HTTP;
+    statusScreen.requestRedraw();
+}
+
+void ThermalGovernor::print(Print& out) {
+    uint32_t now = millis();
+    out.printf("{\"temperatureC\":%.1f,\"rawC\":%.1f,\"peakC\":%.1f,\"readErrors\":%u,",
+               averageDeci / 10.0f, lastRawDeci / 10.0f, peakDeci / 10.0f, (unsigned)readErrors);
+    out.printf("\"level\":%u,\"levelName\":\"%s\",\"inLevelS\":%u,\"changes\":%u,\"stops\":%u,",
+               level, levelName(level), (unsigned)((now - levelSinceMs) / 1000), (unsigned)changes, (unsigned)stops);
+    out.printf("\"mitigations\":{\"backlightPct\":%u,\"wifiTxDbm\":%.1f,\"cpuMaxMHz\":%u,\"httpThrottled\":%s,\"melodies\":\"%s\"},",
+               statusScreen.getBacklight(), wifiManager.getTxDbm(), (unsigned)powerManager.getMaxMhz(),
+               rateLimiter.isThrottled() ? "true" : "false",
+               level >= THERMAL_STOP ? "none" : level >= THERMAL_MELODIES ? "critical" : "all");
+
+    out.print("\"levels\":[");
+    for (uint8_t l = 0; l < THERMAL_LEVEL_COUNT; l++) {
+        uint32_t ms = levelMs[l] + (l == level ? now - levelSinceMs : 0);
+        if (l == THERMAL_NORMAL) {
+            out.printf("{\"name\":\"%s\",\"timeS\":%u}", levelName(l), (unsigned)(ms / 1000));
+        } else {
+            out.printf(",{\"name\":\"%s\",\"fromC\":%.1f,\"timeS\":%u}", levelName(l), threshold(l), (unsigned)(ms / 1000));
+        }
+    }
+    out.print("],\"recent\":[");
+    for (uint8_t i = 0; i < recentCount; i++) {
+        const ThermalChange& c = recent[(recentHead + THERMAL_RECENT_SIZE - recentCount + i) % THERMAL_RECENT_SIZE];
+        out.printf("%s{\"uptime\":%u,\"from\":\"%s\",\"to\":\"%s\",\"temperatureC\":%.1f}", i ? "," : "",
+                   (unsigned)c.uptimeS, levelName(c.from), levelName(c.to), c.temperatureDeci / 10.0f);
+    }
+    // Dal minuto più vecchio al più recente
+    out.print("],\"minutes\":[");
+    for (uint8_t i = 0; i < traceCount; i++) {
+        int16_t t = trace[(traceHead + THERMAL_TRACE_SIZE - traceCount + i) % THERMAL_TRACE_SIZE];
+        out.printf("%s%.1f", i ? "," : "", t / 10.0f);
+    }
+    out.print("]}");
+}
+
+void ThermalGovernor::printSummary(Print& out) {
+    out.printf("🌡️ Temperatura ESP32: %.1f°C (media), ultima lettura %.1f°C, picco %.1f°C\n",
+               averageDeci / 10.0f, lastRawDeci / 10.0f, peakDeci / 10.0f);
+    out.printf("Livello: %s da %u s, %u cambi, %u arresti\n", levelName(level),
+               (unsigned)((millis() - levelSinceMs) / 1000), (unsigned)changes, (unsigned)stops);
+    out.print("Soglie:");
+    for (uint8_t l = THERMAL_DIM; l < THERMAL_LEVEL_COUNT; l++) {
+        out.printf(" %s=%.1f°C", levelName(l), threshold(l));
+    }
+    out.println();
+    for (uint8_t i = 0; i < recentCount; i++) {
+        const ThermalChange& c = recent[(recentHead + THERMAL_RECENT_SIZE - recentCount + i) % THERMAL_RECENT_SIZE];
+        out.printf("  %6u s  %s -> %s  %.1f°C\n", (unsigned)c.uptimeS, levelName(c.from), levelName(c.to),
+                   c.temperatureDeci / 10.0f);
+    }
+}
+
+const char* ThermalGovernor::levelName(uint8_t level) {
+    switch (level) {
+        case THERMAL_NORMAL: return "normal";
+        case THERMAL_DIM: return "dim";
+        case THERMAL_WIFI: return "wifi";
+        case THERMAL_CPU: return "cpu";
+        case THERMAL_HTTP: return "http";
+        case THERMAL_MELODIES: return "melodies";
+        case THERMAL_STOP: return "stop";
+        default: return "?";
+    }
+}
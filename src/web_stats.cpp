@@ -0,0 +1,108 @@
+#include "include/web_stats.h"
+#include "include/rate_limiter.h"
+
+WebStats webStats;
+
+// Percorsi con latenza separata; l'ultimo raccoglie tutto il resto
+static RouteLatency ROUTES[] = {
+    { "/api/status", 0, 0, 0 },
+    { "/api/melodies", 0, 0, 0 },
+    { "/api/melody", 0, 0, 0 },
+    { "/api/weekly-schedules", 0, 0, 0 },
+    { "/api/special-events", 0, 0, 0 },
+    { "/api/time", 0, 0, 0 },
+    { "/api/relay-status", 0, 0, 0 },
+    { "/api/history", 0, 0, 0 },
+    { "/api/backup", 0, 0, 0 },
+    { "/api/restore", 0, 0, 0 },
+    { "/api/batch", 0, 0, 0 },
+    { "/api/", 0, 0, 0 },
+    { "/", 0, 0, 0 },
+};
+static const uint8_t ROUTE_COUNT = sizeof(ROUTES) / sizeof(ROUTES[0]);
+
+WebStats::WebStats() : openCount(0), openPeak(0), connections(0), requests(0), reused(0) {
+    memset(openClients, 0, sizeof(openClients));
+    memset(openRequests, 0, sizeof(openRequests));
+}
+
+uint8_t WebStats::routeIndex(const String& url) {
+    for (uint8_t i = 0; i < ROUTE_COUNT - 1; i++) {
+        if (url.startsWith(ROUTES[i].prefix)) return i;
+    }
+    return ROUTE_COUNT - 1;
+}
+
+// Chiamate dal task AsyncTCP (richieste e disconnessioni): nessun lock necessario
+WebStats::Token WebStats::track(AsyncWebServerRequest* request) {
+    Token t;
+    t.client = request->client();
+    t.startMs = millis();
+    t.startFree = ESP.getFreeHeap();
+    t.startMinFree = ESP.getMinFreeHeap();
+    t.route = routeIndex(request->url());
+    t.slot = -1;
+    requests++;
+    int8_t free = -1;
+    for (uint8_t i = 0; i < WEB_STATS_OPEN_SLOTS; i++) {
+        if (openClients[i] == t.client) { t.slot = i; break; }
+        if (!openClients[i] && free < 0) free = i;
+    }
+    if (t.slot >= 0) {
+        // Stessa connessione di una richiesta precedente ancora aperta (keep-alive)
+        reused++;
+        openRequests[t.slot]++;
+        return t;
+    }
+    connections++;
+    if (free >= 0) {
+        openClients[free] = t.client;
+        openRequests[free] = 1;
+        t.slot = free;
+        if (++openCount > openPeak) openPeak = openCount;
+    }
+    return t;
+}
+
+void WebStats::finish(const Token& t) {
+    uint32_t elapsed = millis() - t.startMs;
+    RouteLatency& r = ROUTES[t.route];
+    r.count++;
+    r.totalMs += elapsed;
+    if (elapsed > r.maxMs) r.maxMs = elapsed;
+    uint32_t minFree = ESP.getMinFreeHeap();
+    if (minFree < t.startMinFree) {
+        r.heapLows++;
+        uint32_t used = t.startFree > minFree ? t.startFree - minFree : 0;
+        if (used > r.heapPeak) r.heapPeak = used;
+    }
+    if (t.slot >= 0 && openClients[t.slot] == t.client && --openRequests[t.slot] == 0) {
+        openClients[t.slot] = nullptr;
+        if (openCount > 0) openCount--;
+    }
+}
+
+void WebStats::print(Print& out) {
+    out.printf("{\"connections\":{\"open\":%u,\"peak\":%u,\"total\":%u,\"inFlight\":%u},",
+               openCount, openPeak, (unsigned)connections, rateLimiter.getInFlight());
+    // Richieste per connessione: 1.00 finché il server chiude dopo ogni risposta
+    out.printf("\"requests\":%u,\"reused\":%u,\"reuseRatio\":%.2f,",
+               (unsigned)requests, (unsigned)reused, requests ? (double)reused / requests : 0.0);
+    out.printf("\"rejected\":{\"rate\":%u,\"busy\":%u,\"perClient\":%u},",
+               (unsigned)rateLimiter.getRejectedRate(), (unsigned)rateLimiter.getRejectedBusy(),
+               (unsigned)rateLimiter.getRejectedPerClient());
+    out.printf("\"limits\":{\"maxInFlight\":%u,\"perClient\":%u,\"idleTimeoutS\":%u},",
+               RATE_LIMIT_MAX_INFLIGHT, RATE_LIMIT_PER_CLIENT, RATE_LIMIT_IDLE_TIMEOUT);
+    out.print("\"routes\":[");
+    bool first = true;
+    for (uint8_t i = 0; i < ROUTE_COUNT; i++) {
+        const RouteLatency& r = ROUTES[i];
+        if (r.count == 0) continue;
+        out.printf("%s{\"route\":\"%s%s\",\"count\":%u,\"avgMs\":%u,\"maxMs\":%u,\"heapPeak\":%u,\"heapLows\":%u}",
+                   first ? "" : ",", r.prefix, i >= ROUTE_COUNT - 2 ? "*" : "",
+                   (unsigned)r.count, (unsigned)(r.totalMs / r.count), (unsigned)r.maxMs,
+                   (unsigned)r.heapPeak, (unsigned)r.heapLows);
+        first = false;
+    }
+    out.print("]}");
+}
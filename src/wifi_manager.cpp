@@ -0,0 +1,266 @@
+#include "include/wifi_manager.h"
+#include "include/logger.h"
+#include <ArduinoJson.h>
+#include <SPIFFS.h>
+
+WifiManager wifiManager;
+
+// Livelli di potenza selezionabili dall'adattamento (quarti di dBm)
+static const wifi_power_t TX_LEVELS[] = {
+    WIFI_POWER_5dBm, WIFI_POWER_7dBm, WIFI_POWER_8_5dBm,
+    WIFI_POWER_11dBm, WIFI_POWER_13dBm, WIFI_POWER_15dBm
+};
+
+WifiManager::WifiManager()
+    : state(WIFI_LINK_OFF), apActive(false), modemSleep(false), callback(nullptr), apSsid(nullptr), apPassword(nullptr),
+      gotIp(false), lost(false), lastReason(0), apStations(0),
+      stateMs(0), downSinceMs(0), backoffMs(0), attempts(0), failures(0), connects(0),
+      disconnects(0), downtimeMs(0), everConnected(false),
+      rssiAvg(0), rssiLast(0), txLevel(WIFI_TX_START), txCap(WIFI_TX_MAX), txChanges(0), lastRssiMs(0), lastTxChangeMs(0) {
+    ssid[0] = '\0';
+    password[0] = '\0';
+}
+
+bool WifiManager::begin(const char* apName, const char* apPass) {
+    apSsid = apName;
+    apPassword = apPass;
+    WiFi.persistent(false);
+    WiFi.setAutoReconnect(false);       // I tentativi li decide update()
+    WiFi.onEvent([this](arduino_event_id_t event, arduino_event_info_t info) { onEvent(event, info); });
+
+    if (SPIFFS.exists("/wifi_config.json")) {
+        fs::File file = SPIFFS.open("/wifi_config.json", "r");
+        if (file) {
+            DynamicJsonDocument doc(512);
+            deserializeJson(doc, file);
+            file.close();
+            strlcpy(ssid, doc["ssid"] | "", sizeof(ssid));
+            strlcpy(password, doc["password"] | "", sizeof(password));
+        }
+    }
+    downSinceMs = millis();
+    if (!ssid[0] || !password[0]) {
+        LOGW(LOG_NET, "Nessuna rete WiFi configurata");
+        state = WIFI_LINK_OFF;
+        WiFi.mode(WIFI_AP);
+        WiFi.setSleep(false);
+        setAp(true);
+        return false;
+    }
+
+    // Senza modem sleep niente latenze al DTIM, ma la radio resta sempre accesa
+    WiFi.mode(WIFI_STA);
+    WiFi.setSleep(modemSleep);
+    LOGI(LOG_NET, "SSID: %s", ssid);
+    connect();
+    return true;
+}
+
+// Task degli eventi di rete: solo flag, le azioni le fa update()
+void WifiManager::onEvent(arduino_event_id_t event, arduino_event_info_t info) {
+    switch (event) {
+        case ARDUINO_EVENT_WIFI_STA_GOT_IP:
+            gotIp = true;
+            break;
+        case ARDUINO_EVENT_WIFI_STA_DISCONNECTED:
+            lastReason = info.wifi_sta_disconnected.reason;
+            lost = true;
+            break;
+        case ARDUINO_EVENT_WIFI_STA_LOST_IP:
+            lost = true;
+            break;
+        case ARDUINO_EVENT_WIFI_AP_STACONNECTED:
+            apStations++;
+            break;
+        case ARDUINO_EVENT_WIFI_AP_STADISCONNECTED:
+            if (apStations > 0) apStations--;
+            break;
+        default:
+            break;
+    }
+}
+
+void WifiManager::connect() {
+    attempts++;
+    gotIp = false;
+    lost = false;
+    state = WIFI_LINK_CONNECTING;
+    stateMs = millis();
+    // Potenza fissa durante i tentativi: ridotta rispetto ai 20 dBm per il calore
+    WiFi.setTxPower(connectPower());
+    WiFi.begin(ssid, password);
+    LOGD(LOG_NET, "Tentativo di connessione %u", (unsigned)attempts);
+}
+
+void WifiManager::scheduleRetry() {
+    failures++;
+    uint8_t shift = failures - 1 < 10 ? failures - 1 : 10;
+    uint32_t wait = (uint32_t)WIFI_BACKOFF_MIN_MS << shift;
+    if (wait > WIFI_BACKOFF_MAX_MS) wait = WIFI_BACKOFF_MAX_MS;
+    // ±25%: tra 3/4 e 5/4 dell'attesa nominale
+    backoffMs = wait - wait / 4 + esp_random() % (wait / 2 + 1);
+    state = WIFI_LINK_BACKOFF;
+    stateMs = millis();
+    LOGI(LOG_NET, "Nuovo tentativo WiFi tra %lu ms (%u falliti)", (unsigned long)backoffMs, (unsigned)failures);
+}
+
+void WifiManager::update() {
+    uint32_t now = millis();
+    switch (state) {
+        case WIFI_LINK_CONNECTING:
+            if (gotIp) {
+                gotIp = false;
+                lost = false;
+                state = WIFI_LINK_CONNECTED;
+                stateMs = now;
+                if (everConnected) downtimeMs += now - downSinceMs;
+                everConnected = true;
+                failures = 0;
+                backoffMs = 0;
+                connects++;
+                rssiLast = WiFi.RSSI();
+                rssiAvg = rssiLast * 4;
+                lastRssiMs = now;
+                setTxLevel(WIFI_TX_START);
+                LOGI(LOG_NET, "✓ WiFi connesso: IP %s, RSSI %d dBm", WiFi.localIP().toString().c_str(), rssiLast);
+                if (callback) callback(true);
+            } else if (lost || now - stateMs >= WIFI_CONNECT_TIMEOUT_MS) {
+                LOGW(LOG_NET, "Tentativo WiFi %u fallito (%s, motivo %u)", (unsigned)attempts,
+                     lost ? "rifiutato" : "timeout", lastReason);
+                lost = false;
+                WiFi.disconnect();
+                scheduleRetry();
+            }
+            break;
+
+        case WIFI_LINK_CONNECTED:
+            if (lost) {
+                lost = false;
+                disconnects++;
+                downSinceMs = now;
+                LOGW(LOG_NET, "WiFi perso (motivo %u)", lastReason);
+                if (callback) callback(false);
+                WiFi.disconnect();
+                scheduleRetry();
+                break;
+            }
+            if (apActive && apStations == 0) setAp(false);
+            if (now - lastRssiMs >= WIFI_RSSI_SAMPLE_MS) {
+                lastRssiMs = now;
+                adaptTxPower();
+            }
+            break;
+
+        case WIFI_LINK_BACKOFF:
+            if (now - stateMs >= backoffMs) connect();
+            break;
+
+        default:
+            break;
+    }
+
+    // Rete assente da troppo: AP di recupero mentre si continua a ritentare
+    if ((state == WIFI_LINK_CONNECTING || state == WIFI_LINK_BACKOFF) && !apActive &&
+        now - downSinceMs >= WIFI_AP_AFTER_MS) {
+        WiFi.mode(WIFI_AP_STA);
+        setAp(true);
+    }
+}
+
+void WifiManager::setAp(bool on) {
+    if (on == apActive) return;
+    apActive = on;
+    if (on) {
+        WiFi.softAP(apSsid, apPassword);
+        LOGW(LOG_NET, "Access Point attivo: %s, IP %s", apSsid, WiFi.softAPIP().toString().c_str());
+    } else {
+        WiFi.softAPdisconnect(false);
+        WiFi.mode(WIFI_STA);
+        apStations = 0;
+        LOGI(LOG_NET, "Access Point spento: rete WiFi di nuovo disponibile");
+    }
+}
+
+void WifiManager::forceAp() {
+    if (state == WIFI_LINK_AP_ONLY) return;
+    bool wasConnected = state == WIFI_LINK_CONNECTED;
+    state = WIFI_LINK_AP_ONLY;
+    WiFi.disconnect(true);
+    WiFi.mode(WIFI_AP);
+    apActive = false;
+    setAp(true);
+    if (wasConnected && callback) callback(false);
+}
+
+// Potenza dei tentativi, entro il tetto
+wifi_power_t WifiManager::connectPower() {
+    return TX_LEVELS[txCap] < WIFI_TX_CONNECT ? TX_LEVELS[txCap] : WIFI_TX_CONNECT;
+}
+
+void WifiManager::setTxCap(uint8_t level) {
+    if (level > WIFI_TX_MAX) level = WIFI_TX_MAX;
+    if (level == txCap) return;
+    txCap = level;
+    LOGI(LOG_NET, "Tetto potenza WiFi %.1f dBm", TX_LEVELS[level] / 4.0f);
+    if (state == WIFI_LINK_CONNECTED) {
+        if (txLevel > txCap) setTxLevel(txCap);
+    } else if (state == WIFI_LINK_CONNECTING) {
+        WiFi.setTxPower(connectPower());
+    }
+}
+
+void WifiManager::setTxLevel(uint8_t level) {
+    if (level > txCap) level = txCap;
+    if (level < WIFI_TX_MIN) level = WIFI_TX_MIN;
+    WiFi.setTxPower(TX_LEVELS[level]);
+    if (level != txLevel) {
+        txChanges++;
+        LOGD(LOG_NET, "Potenza WiFi %.1f -> %.1f dBm (RSSI medio %d)",
+             TX_LEVELS[txLevel] / 4.0f, TX_LEVELS[level] / 4.0f, rssiAvg / 4);
+    }
+    txLevel = level;
+    lastTxChangeMs = millis();
+}
+
+// Media mobile esponenziale (peso 1/4) dell'RSSI, poi un passo di potenza se
+// il segnale è stabilmente fuori dalla fascia
+void WifiManager::adaptTxPower() {
+    int8_t rssi = WiFi.RSSI();
+    if (rssi == 0) return;                      // Lettura non disponibile
+    rssiLast = rssi;
+    rssiAvg += rssi - rssiAvg / 4;
+    if (millis() - lastTxChangeMs < WIFI_TX_SETTLE_MS) return;
+    int16_t avg = rssiAvg / 4;
+    if (avg > WIFI_RSSI_STRONG && txLevel > WIFI_TX_MIN) setTxLevel(txLevel - 1);
+    else if (avg < WIFI_RSSI_WEAK && txLevel < txCap) setTxLevel(txLevel + 1);
+}
+
+float WifiManager::getTxDbm() {
+    if (state == WIFI_LINK_CONNECTED) return TX_LEVELS[txLevel] / 4.0f;
+    return connectPower() / 4.0f;
+}
+
+void WifiManager::print(Print& out) {
+    uint32_t now = millis();
+    out.printf("{\"state\":\"%s\",\"apActive\":%s,\"apStations\":%u,", stateName(state),
+               apActive ? "true" : "false", (unsigned)apStations);
+    out.printf("\"rssi\":%d,\"rssiAvg\":%d,\"txDbm\":%.1f,\"txCapDbm\":%.1f,\"txChanges\":%u,", rssiLast,
+               rssiAvg / 4, getTxDbm(), TX_LEVELS[txCap] / 4.0f, (unsigned)txChanges);
+    out.printf("\"attempts\":%u,\"failures\":%u,\"connects\":%u,\"disconnects\":%u,\"lastReason\":%u,",
+               (unsigned)attempts, (unsigned)failures, (unsigned)connects, (unsigned)disconnects, lastReason);
+    uint32_t down = downtimeMs;
+    if (state != WIFI_LINK_CONNECTED && everConnected) down += now - downSinceMs;
+    out.printf("\"backoffMs\":%u,\"downtimeMs\":%u,\"inStateMs\":%u}",
+               (unsigned)(state == WIFI_LINK_BACKOFF ? backoffMs : 0), (unsigned)down, (unsigned)(now - stateMs));
+}
+
+const char* WifiManager::stateName(uint8_t state) {
+    switch (state) {
+        case WIFI_LINK_OFF: return "off";
+        case WIFI_LINK_CONNECTING: return "connecting";
+        case WIFI_LINK_CONNECTED: return "connected";
+        case WIFI_LINK_BACKOFF: return "backoff";
+        case WIFI_LINK_AP_ONLY: return "ap";
+        default: return "?";
+    }
+}
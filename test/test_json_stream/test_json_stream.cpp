@@ -0,0 +1,172 @@
+#include <unity.h>
+#include <stdio.h>
+#include <string.h>
+#include "include/json_stream.h"
+
+// Raccoglie gli eventi del parser in una traccia testuale compatta:
+// "{k" / "}k" oggetti, "[k" / "]k" array, "k=v" valori
+class TraceHandler : public JsonStreamHandler {
+public:
+    char trace[512];
+    char lastValue[JSON_STREAM_VALUE_LEN];
+
+    TraceHandler() { clear(); }
+    void clear() { trace[0] = '\0'; lastValue[0] = '\0'; }
+
+    void add(const char* s) { strncat(trace, s, sizeof(trace) - strlen(trace) - 1); }
+    void onStartObject(uint8_t depth, const char* key) override { add("{"); add(key); }
+    void onEndObject(uint8_t depth, const char* key) override { add("}"); add(key); }
+    void onStartArray(uint8_t depth, const char* key) override { add("["); add(key); }
+    void onEndArray(uint8_t depth, const char* key) override { add("]"); add(key); }
+    void onValue(uint8_t depth, const char* key, JsonValueType type, const char* text) override {
+        add(key); add("="); add(text); add(";");
+        strncpy(lastValue, text, sizeof(lastValue) - 1);
+        lastValue[sizeof(lastValue) - 1] = '\0';
+    }
+};
+
+static TraceHandler handler;
+
+// Documento intero in un solo chunk
+static bool parse(const char* json) {
+    handler.clear();
+    JsonStreamParser p(&handler);
+    p.feed((const uint8_t*)json, strlen(json));
+    return p.finish();
+}
+
+// Un byte alla volta, come con chunk HTTP spezzati in punti arbitrari
+static bool parseBytewise(const char* json) {
+    handler.clear();
+    JsonStreamParser p(&handler);
+    for (size_t i = 0; json[i]; i++) p.feed((const uint8_t*)json + i, 1);
+    return p.finish();
+}
+
+void setUp() {}
+void tearDown() {}
+
+void test_valid_document() {
+    TEST_ASSERT_TRUE(parse("{\"a\":1,\"b\":[true,null,\"x\"],\"c\":{}}"));
+    TEST_ASSERT_EQUAL_STRING("{a=1;[b=true;=null;=x;]b{c}c}", handler.trace);
+}
+
+void test_bytewise_matches_single_chunk() {
+    const char* json = "{\"name\":\"Funerale\",\"notes\":[{\"bellNumber\":1,\"duration\":300}]}";
+    TEST_ASSERT_TRUE(parse(json));
+    char expected[512];
+    strcpy(expected, handler.trace);
+    TEST_ASSERT_TRUE(parseBytewise(json));
+    TEST_ASSERT_EQUAL_STRING(expected, handler.trace);
+}
+
+void test_empty_containers() {
+    TEST_ASSERT_TRUE(parse("[]"));
+    TEST_ASSERT_TRUE(parse("{\"a\":[],\"b\":[[]]}"));
+}
+
+void test_trailing_comma_rejected() {
+    TEST_ASSERT_FALSE(parse("[1,]"));
+    TEST_ASSERT_FALSE(parse("{\"a\":[1,2,]}"));
+    TEST_ASSERT_FALSE(parse("{\"a\":1,}"));
+    TEST_ASSERT_FALSE(parse("[,]"));
+}
+
+void test_incomplete_and_trailing_data_rejected() {
+    TEST_ASSERT_FALSE(parse("{\"a\":1"));
+    TEST_ASSERT_FALSE(parse("{\"a\":1}x"));
+    TEST_ASSERT_FALSE(parse("{\"a\" 1}"));
+}
+
+void test_bmp_escape() {
+    TEST_ASSERT_TRUE(parse("[\"\\u00e8\"]"));                   // è
+    TEST_ASSERT_EQUAL_STRING("\xc3\xa8", handler.lastValue);
+    TEST_ASSERT_TRUE(parse("[\"\\u20ac\"]"));                   // €
+    TEST_ASSERT_EQUAL_STRING("\xe2\x82\xac", handler.lastValue);
+}
+
+void test_surrogate_pair_is_utf8() {
+    // U+1F514 (campana): un solo carattere UTF-8 a 4 byte, non CESU-8
+    TEST_ASSERT_TRUE(parse("[\"\\ud83d\\udd14\"]"));
+    TEST_ASSERT_EQUAL_STRING("\xf0\x9f\x94\x94", handler.lastValue);
+    TEST_ASSERT_TRUE(parseBytewise("[\"a\\uD83D\\uDD14b\"]"));
+    TEST_ASSERT_EQUAL_STRING("a\xf0\x9f\x94\x94" "b", handler.lastValue);
+}
+
+void test_lone_surrogates_rejected() {
+    TEST_ASSERT_FALSE(parse("[\"\\ud83d\"]"));                  // Alto senza basso
+    TEST_ASSERT_FALSE(parse("[\"\\ud83dx\"]"));
+    TEST_ASSERT_FALSE(parse("[\"\\ud83d\\n\"]"));
+    TEST_ASSERT_FALSE(parse("[\"\\ud83d\\u0041\"]"));
+    TEST_ASSERT_FALSE(parse("[\"\\udd14\"]"));                  // Basso da solo
+    TEST_ASSERT_FALSE(parse("[\"\\u0000\"]"));
+}
+
+void test_long_value_rejected() {
+    char json[128];
+    char text[JSON_STREAM_VALUE_LEN + 1];
+    // 63 byte: il massimo accettato
+    memset(text, 'x', JSON_STREAM_VALUE_LEN - 1);
+    text[JSON_STREAM_VALUE_LEN - 1] = '\0';
+    snprintf(json, sizeof(json), "{\"name\":\"%s\"}", text);
+    TEST_ASSERT_TRUE(parse(json));
+    TEST_ASSERT_EQUAL_STRING(text, handler.lastValue);
+    // 64 byte: errore, non troncamento
+    memset(text, 'x', JSON_STREAM_VALUE_LEN);
+    text[JSON_STREAM_VALUE_LEN] = '\0';
+    snprintf(json, sizeof(json), "{\"name\":\"%s\"}", text);
+    TEST_ASSERT_FALSE(parse(json));
+    TEST_ASSERT_FALSE(parseBytewise(json));
+}
+
+void test_long_key_rejected() {
+    TEST_ASSERT_TRUE(parse("{\"abcdefghijklmnopqrs\":1}"));     // 19 byte
+    TEST_ASSERT_FALSE(parse("{\"abcdefghijklmnopqrst\":1}"));   // 20 byte
+}
+
+void test_long_number_rejected() {
+    char json[128];
+    char digits[JSON_STREAM_VALUE_LEN + 1];
+    memset(digits, '1', JSON_STREAM_VALUE_LEN);
+    digits[JSON_STREAM_VALUE_LEN] = '\0';
+    snprintf(json, sizeof(json), "[%s]", digits);
+    TEST_ASSERT_FALSE(parse(json));
+}
+
+// Il gestore scarta un valore valido: il parsing si ferma e riporta il suo errore
+class AbortHandler : public TraceHandler {
+public:
+    JsonStreamParser* parser = nullptr;
+    void onValue(uint8_t depth, const char* key, JsonValueType type, const char* text) override {
+        if (strcmp(key, "name") == 0) { parser->abort("nome troppo lungo"); return; }
+        TraceHandler::onValue(depth, key, type, text);
+    }
+};
+
+void test_handler_abort() {
+    AbortHandler h;
+    JsonStreamParser p(&h);
+    h.parser = &p;
+    const char* json = "{\"name\":\"x\",\"notes\":[1]}";
+    p.feed((const uint8_t*)json, strlen(json));
+    TEST_ASSERT_FALSE(p.finish());
+    TEST_ASSERT_EQUAL_STRING("nome troppo lungo", p.errorMessage());
+    TEST_ASSERT_EQUAL_STRING("{", h.trace);
+}
+
+int main(int argc, char** argv) {
+    UNITY_BEGIN();
+    RUN_TEST(test_valid_document);
+    RUN_TEST(test_bytewise_matches_single_chunk);
+    RUN_TEST(test_empty_containers);
+    RUN_TEST(test_trailing_comma_rejected);
+    RUN_TEST(test_incomplete_and_trailing_data_rejected);
+    RUN_TEST(test_bmp_escape);
+    RUN_TEST(test_surrogate_pair_is_utf8);
+    RUN_TEST(test_lone_surrogates_rejected);
+    RUN_TEST(test_long_value_rejected);
+    RUN_TEST(test_long_key_rejected);
+    RUN_TEST(test_long_number_rejected);
+    RUN_TEST(test_handler_abort);
+    return UNITY_END();
+}